@@ -0,0 +1,114 @@
+#include "AllocationTracker.h"
+
+#ifdef FP_TRACK_ALLOCATIONS
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    /// \desc how deeply the calling thread is nested in tracked scopes
+    thread_local int scopeDepth = 0;
+    /// \desc frames past this many allocating ones are counted but not printed
+    constexpr uint32_t MAX_REPORTED_FRAMES = 10;
+}
+
+AllocationTracker& AllocationTracker::instance() {
+    // never destroyed, operator new may still be called during static destruction
+    static AllocationTracker* tracker = new (std::malloc(sizeof(AllocationTracker))) AllocationTracker();
+    return *tracker;
+}
+
+void AllocationTracker::recordAllocation(size_t bytes) {
+    if (scopeDepth > 0) {
+        _frameAllocations.fetch_add(1, std::memory_order_relaxed);
+        _frameBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+AllocationTracker::Counts AllocationTracker::takeCounts() {
+    return Counts{ _frameAllocations.exchange(0, std::memory_order_relaxed),
+                   _frameBytes.exchange(0, std::memory_order_relaxed) };
+}
+
+void AllocationTracker::endFrame(uint32_t frame) {
+    const Counts counts = takeCounts();
+    const uint64_t allocations = counts.allocations;
+    const uint64_t bytes = counts.bytes;
+    if (frame <= WARM_UP_FRAMES) {
+        _warmUpAllocations += allocations;
+        return;
+    }
+    ++_steadyFrames;
+    if (allocations == 0) {
+        return;
+    }
+    if (++_allocatingFrames <= MAX_REPORTED_FRAMES) {
+        fprintf(stderr, "[ERROR]: frame %u made %llu heap allocations (%llu bytes)\n",
+                frame, static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(bytes));
+    }
+    _steadyAllocations += allocations;
+    _steadyBytes += bytes;
+}
+
+void AllocationTracker::report() const {
+    fprintf(stdout, "[INFO]: %llu heap allocations in the %u warm up frames\n",
+            static_cast<unsigned long long>(_warmUpAllocations), WARM_UP_FRAMES);
+    if (passed()) {
+        fprintf(stdout, "[INFO]: no heap allocations in %u steady state frames\n", _steadyFrames);
+    } else {
+        fprintf(stderr, "[ERROR]: %u of %u steady state frames allocated, %llu allocations and %llu bytes in total\n",
+                _allocatingFrames, _steadyFrames,
+                static_cast<unsigned long long>(_steadyAllocations), static_cast<unsigned long long>(_steadyBytes));
+    }
+}
+
+AllocationTracker::Scope::Scope() {
+    ++scopeDepth;
+}
+
+AllocationTracker::Scope::~Scope() {
+    --scopeDepth;
+}
+
+// the replaced global allocation functions. The over-aligned forms are left to the
+// library and go uncounted; nothing in the frame loop is over-aligned.
+
+void* operator new(size_t bytes) {
+    AllocationTracker::instance().recordAllocation(bytes);
+    if (void* memory = std::malloc(bytes ? bytes : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t bytes) {
+    return ::operator new(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept {
+    AllocationTracker::instance().recordAllocation(bytes);
+    return std::malloc(bytes ? bytes : 1);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t& tag) noexcept {
+    return ::operator new(bytes, tag);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+#endif // FP_TRACK_ALLOCATIONS
@@ -0,0 +1,82 @@
+#ifndef ALLOCATION_TRACKER_H
+#define ALLOCATION_TRACKER_H
+
+/// \desc Counts the heap allocations made inside the frame loop.
+///
+/// Everything here is compiled out unless FP_TRACK_ALLOCATIONS is defined
+/// (cmake -DFP_TRACK_ALLOCATIONS=ON); that build replaces the global operator
+/// new and delete, and the macros below expand to nothing otherwise.
+///
+///   FP_TRACK_ALLOCATIONS_SCOPE()          counts every operator new on the calling thread
+///                                         while the enclosing scope lives
+///   FP_TRACK_ALLOCATIONS_FRAME_END(frame) closes a render frame; once the warm up frames are
+///                                         over, a frame that allocated is reported as an error
+///   FP_TRACK_ALLOCATIONS_REPORT()         prints the totals
+///   FP_TRACK_ALLOCATIONS_PASSED()         false when a steady state frame allocated, true
+///                                         when tracking is compiled out
+
+#ifdef FP_TRACK_ALLOCATIONS
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class AllocationTracker {
+public:
+    /// \desc frames that may still allocate while caches, pools and the frame arena grow to size
+    static constexpr uint32_t WARM_UP_FRAMES = 120;
+
+    struct Counts {
+        uint64_t allocations;
+        uint64_t bytes;
+    };
+
+    static AllocationTracker& instance();
+
+    /// \desc called by the replaced operator new
+    void recordAllocation(size_t bytes);
+    /// \desc what the scopes of every thread allocated since the last call, or the last endFrame
+    Counts takeCounts();
+
+    void endFrame(uint32_t frame);
+    void report() const;
+    bool passed() const { return _allocatingFrames == 0; }
+
+    /// \desc marks the calling thread as inside the frame loop for its lifetime
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+    };
+
+private:
+    AllocationTracker() = default;
+
+    /// \desc allocations since the last endFrame, from every thread
+    std::atomic<uint64_t> _frameAllocations{0};
+    std::atomic<uint64_t> _frameBytes{0};
+
+    uint32_t _steadyFrames = 0;
+    uint32_t _allocatingFrames = 0;
+    uint64_t _steadyAllocations = 0;
+    uint64_t _steadyBytes = 0;
+    uint64_t _warmUpAllocations = 0;
+};
+
+#define FP_TRACK_ALLOCATIONS_CONCAT_INNER(a, b) a##b
+#define FP_TRACK_ALLOCATIONS_CONCAT(a, b) FP_TRACK_ALLOCATIONS_CONCAT_INNER(a, b)
+#define FP_TRACK_ALLOCATIONS_SCOPE() AllocationTracker::Scope FP_TRACK_ALLOCATIONS_CONCAT(_fpAllocationScope, __LINE__)
+#define FP_TRACK_ALLOCATIONS_FRAME_END(frame) AllocationTracker::instance().endFrame(frame)
+#define FP_TRACK_ALLOCATIONS_REPORT() AllocationTracker::instance().report()
+#define FP_TRACK_ALLOCATIONS_PASSED() AllocationTracker::instance().passed()
+
+#else
+
+#define FP_TRACK_ALLOCATIONS_SCOPE() ((void)0)
+#define FP_TRACK_ALLOCATIONS_FRAME_END(frame) ((void)0)
+#define FP_TRACK_ALLOCATIONS_REPORT() ((void)0)
+#define FP_TRACK_ALLOCATIONS_PASSED() true
+
+#endif // FP_TRACK_ALLOCATIONS
+
+#endif // ALLOCATION_TRACKER_H
@@ -1,5 +1,8 @@
 #include "FPEngine.h"
 #include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 
 #ifndef M_PI
 #define M_PI 3.14159265f
@@ -9,9 +12,61 @@ float getRand() {
     return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
 }
 
-FPEngine::FPEngine()
-    : CSCI441::OpenGLEngine(4, 1,
-                                 1280, 720, // Increased window size for better view
+// Scene lighting and tree materials, shared by the scene and the impostor bake
+const glm::vec3 DIR_LIGHT_DIRECTION(-1.0f, -1.0f, -1.0f);
+const glm::vec3 DIR_LIGHT_COLOR(1.0f, 1.0f, 1.0f);
+const glm::vec3 TREE_AMBIENT(0.2f, 0.2f, 0.2f);
+const glm::vec3 TRUNK_DIFFUSE(99 / 255.f, 39 / 255.f, 9 / 255.f);
+const glm::vec3 LEAVES_DIFFUSE(46 / 255.f, 143 / 255.f, 41 / 255.f);
+const glm::vec3 TREE_SPECULAR(0.3f, 0.3f, 0.3f);
+const float TREE_SHININESS = 32.0f;
+
+// Every lamp's light, shared by the bake and the point lights of the dynamic objects
+const glm::vec3 LAMP_LIGHT_OFFSET(0.0f, 7.0f, 0.0f);
+const glm::vec3 LAMP_LIGHT_COLOR(0.0f, 0.0f, 1.0f); // Blue color
+const float LAMP_LIGHT_CONSTANT = 1.0f;
+const float LAMP_LIGHT_LINEAR = 0.09f;
+const float LAMP_LIGHT_QUADRATIC = 0.032f;
+// beyond it a lamp adds less than 1% of its color, so the bake leaves it out
+const float LAMP_LIGHT_RANGE = 60.0f;
+
+// Baked materials: the platform textures keep their brightness under the directional light alone
+const glm::vec3 PLATFORM_AMBIENT(0.45f, 0.45f, 0.45f);
+const glm::vec3 PLATFORM_DIFFUSE(0.95f, 0.95f, 0.95f);
+const glm::vec3 LAMP_POST_AMBIENT(0.2f, 0.2f, 0.2f);
+const glm::vec3 LAMP_POST_DIFFUSE(0.5f, 0.5f, 0.5f);
+const glm::vec3 LAMP_BULB_AMBIENT(0.2f, 0.2f, 0.5f);
+const glm::vec3 LAMP_BULB_DIFFUSE(0.0f, 0.0f, 1.0f);
+// world units between lightmap texels, as far as LightBaker::MAX_TILE_SIZE allows
+const float LIGHTMAP_TEXEL_SIZE = 0.5f;
+
+// Beak triangles, the bottom one is the top one lowered
+const GLfloat BEAK_VERTICES[] = {
+    0.0f, 0.2f, 0.0f,  // Tip of the triangle
+    -0.1f, 0.0f, 0.15f, // Left corner
+    0.1f, 0.0f, 0.15f,  // Right corner
+    0.0f, 0.05f, 0.0f,
+    -0.1f, -0.15f, 0.15f,
+    0.1f, -0.15f, 0.15f
+};
+// Marble body material
+const glm::vec3 MARBLE_COLOR(1.0f, 0.0f, 0.0f);
+
+// Bounding spheres used to measure screen coverage, relative to the prop's base
+const glm::vec3 TREE_BOUNDS_OFFSET(0.0f, 6.5f, 0.0f);
+const float TREE_BOUNDS_RADIUS = 7.0f;
+const glm::vec3 LAMP_BOUNDS_OFFSET(0.0f, 3.5f, 0.0f);
+const float LAMP_BOUNDS_RADIUS = 3.6f;
+
+// Bounding boxes used for occlusion culling, relative to the prop's base
+const glm::vec3 TREE_BOX_MIN(-3.0f, 0.0f, -3.0f);
+const glm::vec3 TREE_BOX_MAX(3.0f, 13.0f, 3.0f);
+const glm::vec3 LAMP_BOX_MIN(-0.5f, 0.0f, -0.5f);
+const glm::vec3 LAMP_BOX_MAX(0.5f, 7.5f, 0.5f);
+
+FPEngine::FPEngine(const LaunchOptions& options)
+    : CSCI441::OpenGLEngine(4, options.gpuDriven ? 5 : 1,
+                                 options.width, options.height,
                                  "FP - The Grey Havens"),
         _pFreeCam(nullptr),
         _pArcballCam(nullptr),
@@ -21,38 +76,33 @@ FPEngine::FPEngine()
         _animationTime(0.0f),
         _groundVAO(0),
         _numGroundPoints(0),
-        _marbleVBO(0),
-        _marbleVAO(0),
-        NUM_SPRITES(4),
-        MAX_BOX_SIZE(0.8f)
+        _beakVAO(0),
+        _beakVBO(0),
+        _launchOptions(options)
 {
     for(auto& key : _keys) key = GL_FALSE;
 
     _mousePosition = glm::vec2(MOUSE_UNINITIALIZED, MOUSE_UNINITIALIZED );
     _leftMouseButtonState = GLFW_RELEASE;
-    _enemies = new std::vector<Marble>();
     _rectPlatforms.clear();
     _diskPlatforms.clear();
 }
 
 FPEngine::~FPEngine() {
-    delete _lightingShaderProgram;
-    delete _textureShaderProgram;
     delete _pFreeCam;
     delete _pArcballCam;
     delete _pFPCam;
     delete _pTPCam;
     delete _pVehicle;
-    delete _enemies;
-    if (_marbleVBO) {
-        glDeleteBuffers(1, &_marbleVBO);
-        _marbleVBO = 0; // Reset to prevent dangling references
-    }
-
-    if (_marbleVAO) {
-        glDeleteVertexArrays(1, &_marbleVAO);
-        _marbleVAO = 0;
+    if (_pSession) {
+        _pSession->disconnect();
+        delete _pSession;
     }
+    delete _pParticleSystem;
+    delete _pTreeImpostors;
+    delete _pGpuRenderer;
+    delete _pOcclusionCuller;
+    delete _pJobs;
 }
 
 void FPEngine::mSetupTextures() {
@@ -102,52 +152,24 @@ GLuint FPEngine::_loadAndRegisterTexture(const char* FILENAME) {
 
 
 bool FPEngine::checkCollision(const glm::vec3& pos1, float radius1, const glm::vec3& pos2, float radius2) {
-    float distanceSquared = glm::dot(pos1 - pos2, pos1 - pos2); // Squared distance
-    float combinedRadii = radius1 + radius2;
-    return distanceSquared <= (combinedRadii * combinedRadii);
+    return SimKernels::spheresOverlap(pos1, radius1, pos2, radius2);
 }
 
 bool FPEngine::isMovementValid(const glm::vec3& newPosition) const {
-    float vehicleRadius = _pVehicle->getBoundingRadius();
-    const float TREE_RADIUS = 0.5f; // Adjust based on the actual size of the tree model
-    const float LAMP_RADIUS = 0.5f; // Adjust based on the actual size of the lamp model
-
-    glm::vec3 currentPosition = _pVehicle->getPosition();
-
-    // Check collision with trees
-    for (const TreeData& tree : _trees) {
-        glm::vec3 treePosition(tree.modelMatrixTrunk[3]); // Extract tree trunk position
-        if (checkCollision(newPosition, vehicleRadius, treePosition, TREE_RADIUS)) {
-            glm::vec3 bounceDirection = glm::normalize(currentPosition - treePosition);
-            _pVehicle->setPosition(currentPosition + bounceDirection * 0.2f); // Small bounce backward
-            return false;
-        }
-    }
-
-    // Check collision with lamps
-    for (const LampData& lamp : _lamps) {
-        if (checkCollision(newPosition, vehicleRadius, lamp.position, LAMP_RADIUS)) {
-            glm::vec3 bounceDirection = glm::normalize(currentPosition - lamp.position);
-            _pVehicle->setPosition(currentPosition + bounceDirection * 0.2f); // Small bounce backward
-            return false;
-        }
+    FP_PROFILE_SCOPE("FPEngine::isMovementValid");
+    // Check collision with the trees and lamps in the level's grid cells around the vehicle
+    glm::vec3 propPosition;
+    if (!SimKernels::findPropCollision(_level, newPosition, _pVehicle->getBoundingRadius(), propPosition)) {
+        return true; // No collision detected
     }
-
-    return true; // No collision detected
+    glm::vec3 currentPosition = _pVehicle->getPosition();
+    glm::vec3 bounceDirection = glm::normalize(currentPosition - propPosition);
+    _pVehicle->setPosition(currentPosition + bounceDirection * 0.2f); // Small bounce backward
+    return false;
 }
 
 glm::vec3 FPEngine::_evalBezierCurve(const glm::vec3 P0, const glm::vec3 P1, const glm::vec3 P2, const glm::vec3 P3, const GLfloat T) const{
-    // TODO #01: solve the curve equation
-    GLfloat oneMinusT = 1.0f - T;
-    GLfloat b0 = oneMinusT * oneMinusT * oneMinusT;
-    GLfloat b1 = 3 * oneMinusT * oneMinusT * T;
-    GLfloat b2 = 3 * oneMinusT * T * T;
-    GLfloat b3 = T * T * T;
-
-    // Compute the point on the curve
-    glm::vec3 bezierPoint = b0 * P0 + b1 * P1 + b2 * P2 + b3 * P3;
-
-    return bezierPoint;
+    return SimKernels::evalBezierCurve(P0, P1, P2, P3, T);
 }
 
 void FPEngine::_createCurve(GLuint vao, GLuint vbo, GLsizei &numVAOPoints) const {
@@ -189,12 +211,6 @@ void FPEngine::handleKeyEvent(GLint key, GLint action, GLint mods) {
 
     if (action == GLFW_PRESS || action == GLFW_REPEAT) { // Handle key press
         switch (key) {
-            // Quit!
-            case GLFW_KEY_Q:
-            case GLFW_KEY_ESCAPE:
-                setWindowShouldClose();
-                break;
-
                 // Zoom In/Out with arcball
             case GLFW_KEY_EQUAL: // Zoom in with '=' key
                 if (action == GLFW_PRESS || action == GLFW_REPEAT) {
@@ -212,7 +228,8 @@ void FPEngine::handleKeyEvent(GLint key, GLint action, GLint mods) {
                 }
             break;
             case GLFW_KEY_SPACE:
-                if (!_isJumping) {
+                // the server does not know about jumps
+                if (!_isJumping && !_pSession) {
                     _isJumping = true;
                     _jumpProgress = 0.0f;
 
@@ -259,6 +276,114 @@ void FPEngine::handleKeyEvent(GLint key, GLint action, GLint mods) {
     }
 }
 
+void FPEngine::queueKeyEvent(GLint key, GLint action, GLint mods) {
+    // keys that act on the window or the renderer are handled right here on the main thread
+    if (action == GLFW_PRESS || action == GLFW_REPEAT) {
+        switch (key) {
+            // Quit!
+            case GLFW_KEY_Q:
+            case GLFW_KEY_ESCAPE:
+                setWindowShouldClose();
+                return;
+
+            case GLFW_KEY_G:
+                if (action == GLFW_PRESS) {
+                    _qualityGovernor.setEnabled(!_qualityGovernor.isEnabled());
+                    _applyQualitySettings();
+                    fprintf(stdout, "[INFO]: adaptive quality %s\n", _qualityGovernor.isEnabled() ? "enabled" : "disabled");
+                }
+                return;
+
+            case GLFW_KEY_I:
+                if (action == GLFW_PRESS) {
+                    _logFrameStats = !_logFrameStats;
+                    fprintf(stdout, "[INFO]: frame statistics %s\n", _logFrameStats ? "enabled" : "disabled");
+                }
+                return;
+
+            case GLFW_KEY_O:
+                if (action == GLFW_PRESS) {
+                    _occlusionCullingEnabled = !_occlusionCullingEnabled;
+                    fprintf(stdout, "[INFO]: occlusion culling %s, %zu of %zu props culled last frame\n",
+                            _occlusionCullingEnabled ? "enabled" : "disabled",
+                            _pOcclusionCuller->getNumCulled(), _pOcclusionCuller->getNumTested());
+                }
+                return;
+
+            default:
+                break;
+        }
+    }
+    _queueInputEvent(InputEvent{InputEvent::KEY, key, action, mods, glm::vec2(0.0f), 0});
+}
+
+void FPEngine::queueMouseButtonEvent(GLint button, GLint action, GLint mods) {
+    _queueInputEvent(InputEvent{InputEvent::MOUSE_BUTTON, button, action, mods, glm::vec2(0.0f), 0});
+}
+
+void FPEngine::queueCursorPositionEvent(glm::vec2 currMousePosition) {
+    _queueInputEvent(InputEvent{InputEvent::CURSOR, 0, 0, 0, currMousePosition, 0});
+}
+
+void FPEngine::_queueInputEvent(InputEvent event) {
+    event.sequence = _latencyProbe.recordInput();
+    if (!_inputQueue.push(event)) {
+        fprintf(stderr, "[ERROR]: input queue is full, dropping event\n");
+        return;
+    }
+    _queuedInputSequence = event.sequence;
+}
+
+bool FPEngine::_drainInputQueue() {
+    bool applied = false;
+    InputEvent event;
+    while (_inputQueue.pop(event)) {
+        _handleInputEvent(event);
+        _appliedInputSequence = event.sequence;
+        applied = true;
+    }
+    return applied;
+}
+
+void FPEngine::_wakeSimulationForInput() {
+    if (!_launchOptions.lateLatch || _queuedInputSequence == _wokenInputSequence) {
+        return;
+    }
+    _wokenInputSequence = _queuedInputSequence;
+    {
+        std::lock_guard<std::mutex> lock(_simulationWakeMutex);
+        _inputPending = true;
+    }
+    _simulationWake.notify_one();
+}
+
+void FPEngine::_awaitLatchedInput() const {
+    if (!_launchOptions.lateLatch || _publishedInputSequence.load(std::memory_order_acquire) >= _wokenInputSequence) {
+        return;
+    }
+    // the simulation only has to apply the events and republish, far less than a frame
+    FP_PROFILE_SCOPE("FPEngine::_awaitLatchedInput");
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + LATE_LATCH_TIMEOUT;
+    while (_publishedInputSequence.load(std::memory_order_acquire) < _wokenInputSequence
+           && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+void FPEngine::_handleInputEvent(const InputEvent& event) {
+    switch (event.type) {
+        case InputEvent::KEY:
+            handleKeyEvent(event.code, event.action, event.mods);
+            break;
+        case InputEvent::MOUSE_BUTTON:
+            handleMouseButtonEvent(event.code, event.action, event.mods);
+            break;
+        case InputEvent::CURSOR:
+            handleCursorPositionEvent(event.position);
+            break;
+    }
+}
+
 void FPEngine::handleMouseButtonEvent(GLint button, GLint action, GLint mods) {
     // if the event is for the left mouse button
     if( button == GLFW_MOUSE_BUTTON_LEFT ) {
@@ -320,6 +445,10 @@ void FPEngine::handleCursorPositionEvent(glm::vec2 currMousePosition) {
 //engine Setup
 
 void FPEngine::mSetupGLFW() {
+    if (_launchOptions.headless) {
+        _setupHeadlessContext();
+        return;
+    }
     CSCI441::OpenGLEngine::mSetupGLFW();
 
     // set our callbacks
@@ -331,6 +460,48 @@ void FPEngine::mSetupGLFW() {
     glfwSetWindowUserPointer(mpWindow, this);
 }
 
+void FPEngine::_setupHeadlessContext() {
+    glfwSetErrorCallback([](int error, const char* description) {
+        fprintf(stderr, "[ERROR]: GLFW %d: %s\n", error, description);
+    });
+
+#ifdef GLFW_PLATFORM_NULL
+    // GLFW 3.4+: no display connection at all, the context is surfaceless EGL or OSMesa
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (!glfwInit()) {
+        fprintf(stderr, "[ERROR]: Could not initialize GLFW for headless rendering\n");
+        mErrorCode = OPENGL_ENGINE_ERROR_GLFW_INIT;
+        return;
+    }
+
+    const bool osmesa = _launchOptions.contextAPI == LaunchOptions::ContextAPI::OSMESA;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, mOpenGLMajorVersion);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, mOpenGLMinorVersion);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, osmesa ? GLFW_OSMESA_CONTEXT_API : GLFW_EGL_CONTEXT_API);
+
+    mpWindow = glfwCreateWindow(mWindowWidth, mWindowHeight, mWindowTitle, nullptr, nullptr);
+    if (!mpWindow) {
+        fprintf(stderr, "[ERROR]: Could not create a headless %s context\n", osmesa ? "OSMesa" : "EGL");
+        glfwTerminate();
+        mErrorCode = OPENGL_ENGINE_ERROR_GLFW_WINDOW;
+        return;
+    }
+    glfwMakeContextCurrent(mpWindow);
+    glfwSetWindowUserPointer(mpWindow, this);
+
+    if (!gladLoadGL(glfwGetProcAddress)) {
+        fprintf(stderr, "[ERROR]: Could not load the OpenGL functions\n");
+        mErrorCode = OPENGL_ENGINE_ERROR_GLAD_INIT;
+        return;
+    }
+    fprintf(stdout, "[INFO]: headless %s context: %s\n", osmesa ? "OSMesa" : "EGL",
+            reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+}
+
 void FPEngine::mSetupOpenGL() {
     glEnable( GL_DEPTH_TEST );                        // enable depth testing
     glDepthFunc( GL_LESS );                           // use less than depth test
@@ -342,42 +513,21 @@ void FPEngine::mSetupOpenGL() {
 }
 
 void FPEngine::mSetupShaders() {
-    _lightingShaderProgram = new CSCI441::ShaderProgram("shaders/lighting.vs.glsl", "shaders/lighting.fs.glsl");
-    // Retrieve uniform locations
-    _lightingShaderUniformLocations.mvpMatrix = _lightingShaderProgram->getUniformLocation("mvpMatrix");
-    _lightingShaderUniformLocations.normalMatrix = _lightingShaderProgram->getUniformLocation("normalMatrix");
-    _lightingShaderUniformLocations.modelMatrix = _lightingShaderProgram->getUniformLocation("modelMatrix");
-    _lightingShaderUniformLocations.viewPos = _lightingShaderProgram->getUniformLocation("viewPos");
+    _pShaderCache = new ShaderCache();
 
-    // Material properties
-    _lightingShaderUniformLocations.materialAmbient = _lightingShaderProgram->getUniformLocation("material.ambient");
-    _lightingShaderUniformLocations.materialDiffuse = _lightingShaderProgram->getUniformLocation("material.diffuse");
-    _lightingShaderUniformLocations.materialSpecular = _lightingShaderProgram->getUniformLocation("material.specular");
-    _lightingShaderUniformLocations.materialShininess = _lightingShaderProgram->getUniformLocation("material.shininess");
-
-    // Directional Light
-    _lightingShaderUniformLocations.dirLightDirection = _lightingShaderProgram->getUniformLocation("dirLight.direction");
-    _lightingShaderUniformLocations.dirLightColor = _lightingShaderProgram->getUniformLocation("dirLight.color");
-
-    // Point Lights
-    _lightingShaderUniformLocations.numPointLights = _lightingShaderProgram->getUniformLocation("numPointLights");
-    _lightingShaderUniformLocations.pointLightPositions = _lightingShaderProgram->getUniformLocation("pointLightPositions");
-    _lightingShaderUniformLocations.pointLightColors = _lightingShaderProgram->getUniformLocation("pointLightColors");
-    _lightingShaderUniformLocations.pointLightConstants = _lightingShaderProgram->getUniformLocation("pointLightConstants");
-    _lightingShaderUniformLocations.pointLightLinears = _lightingShaderProgram->getUniformLocation("pointLightLinears");
-    _lightingShaderUniformLocations.pointLightQuadratics = _lightingShaderProgram->getUniformLocation("pointLightQuadratics");
+    // variants are compiled on demand, the lighting ones once the number of lamps is known
+    _pLightingPermutations = new ShaderPermutations(*_pShaderCache, "shaders/lighting.vs.glsl", "shaders/lighting.fs.glsl");
+    _pTexturePermutations = new ShaderPermutations(*_pShaderCache, "shaders/texture.vs.glsl", "shaders/texture.fs.glsl");
 
-    // Spot Light
-    _lightingShaderUniformLocations.spotLightDirection = _lightingShaderProgram->getUniformLocation("spotLightDirection");
-    _lightingShaderUniformLocations.spotLightPosition = _lightingShaderProgram->getUniformLocation("spotLightPosition");
-    _lightingShaderUniformLocations.spotLightWidth = _lightingShaderProgram->getUniformLocation("spotLightWidth");
-    _lightingShaderUniformLocations.spotLightColor = _lightingShaderProgram->getUniformLocation("spotLightColor");
+    // all programs are requested before any is queried, so the driver can build them in parallel
+    _textureShaderProgram = _pTexturePermutations->get({ "SPOT_LIGHT", "LIGHTMAP" });
+    _unlitTextureShaderProgram = _pTexturePermutations->get({});
+    _screenQuadShaderProgram = _pShaderCache->load("shaders/screenQuad.vs.glsl", "shaders/screenQuad.fs.glsl");
 
-    // Attribute locations
-    _lightingShaderAttributeLocations.vPos = _lightingShaderProgram->getAttributeLocation("vPos");
-    _lightingShaderAttributeLocations.vNormal = _lightingShaderProgram->getAttributeLocation("vNormal");
+    // Attribute locations, fixed by layout(location) so every permutation shares them
+    _lightingShaderAttributeLocations.vPos = 0;
+    _lightingShaderAttributeLocations.vNormal = 1;
 
-    _textureShaderProgram = new CSCI441::ShaderProgram("shaders/texture.vs.glsl", "shaders/texture.fs.glsl");
     _textureShaderUniformLocations.mvpMatrix = _textureShaderProgram->getUniformLocation("mvpMatrix");
     _textureShaderUniformLocations.aTextMap = _textureShaderProgram->getUniformLocation("textureMap");
 
@@ -389,74 +539,205 @@ void FPEngine::mSetupShaders() {
     _textureShaderUniformLocations.spotLightWidth = _textureShaderProgram->getUniformLocation("spotLightWidth");
     _textureShaderUniformLocations.spotLightColor = _textureShaderProgram->getUniformLocation("spotLightColor");
 
-    _billboardShaderProgram = new CSCI441::ShaderProgram( "shaders/billboardQuadShader.v.glsl",
-                                                          "shaders/billboardQuadShader.g.glsl",
-                                                          "shaders/billboardQuadShader.f.glsl" );
+    _textureShaderUniformLocations.positionScale = _textureShaderProgram->getUniformLocation("positionScale");
+    _textureShaderUniformLocations.positionOffset = _textureShaderProgram->getUniformLocation("positionOffset");
+    _textureShaderUniformLocations.lightmap = _textureShaderProgram->getUniformLocation("lightmap");
+    _textureShaderUniformLocations.lightmapRect = _textureShaderProgram->getUniformLocation("lightmapRect");
 
-    _billboardShaderProgramUniforms.mvMatrix            = _billboardShaderProgram->getUniformLocation( "mvMatrix");
-    _billboardShaderProgramUniforms.projMatrix          = _billboardShaderProgram->getUniformLocation( "projMatrix");
-    _billboardShaderProgramUniforms.image               = _billboardShaderProgram->getUniformLocation( "image");
+    _unlitTextureMvpLocation = _unlitTextureShaderProgram->getUniformLocation("mvpMatrix");
+    _unlitTexturePositionScaleLocation = _unlitTextureShaderProgram->getUniformLocation("positionScale");
+    _unlitTexturePositionOffsetLocation = _unlitTextureShaderProgram->getUniformLocation("positionOffset");
 
-    _billboardShaderProgramAttributes.vPos              = _billboardShaderProgram->getAttributeLocation( "vPos");
+    _screenQuadImageLocation = _screenQuadShaderProgram->getUniformLocation("image");
 
-    // set static uniforms
-    _billboardShaderProgram->setProgramUniform( _billboardShaderProgramUniforms.image, 0 );
+    // every texture is read from unit 0 and the lightmap from unit 1, so the samplers are set once instead of per draw
+    _textureShaderProgram->useProgram();
+    glUniform1i(_textureShaderUniformLocations.aTextMap, 0);
+    glUniform1i(_textureShaderUniformLocations.lightmap, 1);
+    _screenQuadShaderProgram->useProgram();
+    glUniform1i(_screenQuadImageLocation, 0);
 }
 
-void FPEngine::mSetupBuffers() {
-    fprintf(stdout, "[DEBUG]: Setting up buffers...\n");
+const FPEngine::LightingVariant& FPEngine::_getLightingVariant(int numPointLights, int features) const {
+    const int key = numPointLights * 64 + features;
+    auto variant = _lightingVariants.find(key);
+    if (variant != _lightingVariants.end()) {
+        return variant->second;
+    }
 
-    glGenVertexArrays( NUM_VAOS, _vaos );
-    glGenBuffers( NUM_VAOS, _vbos );
-    glGenBuffers( NUM_VAOS, _ibos );
+    std::vector<std::string> defines = { "NUM_POINT_LIGHTS " + std::to_string(numPointLights) };
+    if (features & LIGHTING_SPOT_LIGHT) defines.push_back("SPOT_LIGHT");
+    if (features & LIGHTING_UNLIT_FLAT) defines.push_back("UNLIT_FLAT");
+    if (features & LIGHTING_VEHICLE_MESH) defines.push_back("VEHICLE_MESH");
+    if (features & LIGHTING_PACKED_MESH) defines.push_back("PACKED_MESH");
+    if (features & LIGHTING_BAKED) defines.push_back("BAKED_LIGHT");
+
+    LightingVariant& created = _lightingVariants[key];
+    // the GPU-driven program is not a permutation, but takes the camera and lights under the same names
+    created.program = (features & LIGHTING_GPU_DRIVEN) ? _pGpuRenderer->getDrawProgram() : _pLightingPermutations->get(defines);
+
+    // each variant strips the uniforms it does not need, so missing ones are expected and stay -1
+    const GLuint handle = created.program->getShaderProgramHandle();
+    LightingShaderUniformLocations& locations = created.locations;
+    locations.mvpMatrix = glGetUniformLocation(handle, "mvpMatrix");
+    locations.normalMatrix = glGetUniformLocation(handle, "normalMatrix");
+    locations.modelMatrix = glGetUniformLocation(handle, "modelMatrix");
+    locations.viewPos = glGetUniformLocation(handle, "viewPos");
 
-    // Load textures first
-    mSetupTextures();
+    // Material properties
+    locations.materialAmbient = glGetUniformLocation(handle, "material.ambient");
+    locations.materialDiffuse = glGetUniformLocation(handle, "material.diffuse");
+    locations.materialSpecular = glGetUniformLocation(handle, "material.specular");
+    locations.materialShininess = glGetUniformLocation(handle, "material.shininess");
 
-    //***************************************************************************
-    // Particle System generation
+    // Directional Light
+    locations.dirLightDirection = glGetUniformLocation(handle, "dirLight.direction");
+    locations.dirLightColor = glGetUniformLocation(handle, "dirLight.color");
+
+    // Point Lights
+    locations.pointLightPositions = glGetUniformLocation(handle, "pointLightPositions");
+    locations.pointLightColors = glGetUniformLocation(handle, "pointLightColors");
+    locations.pointLightConstants = glGetUniformLocation(handle, "pointLightConstants");
+    locations.pointLightLinears = glGetUniformLocation(handle, "pointLightLinears");
+    locations.pointLightQuadratics = glGetUniformLocation(handle, "pointLightQuadratics");
+
+    // Spot Light
+    locations.spotLightDirection = glGetUniformLocation(handle, "spotLightDirection");
+    locations.spotLightPosition = glGetUniformLocation(handle, "spotLightPosition");
+    locations.spotLightWidth = glGetUniformLocation(handle, "spotLightWidth");
+    locations.spotLightColor = glGetUniformLocation(handle, "spotLightColor");
+
+    // Packed mesh decode
+    locations.packedPositionScale = glGetUniformLocation(handle, "packedPositionScale");
+    locations.packedPositionOffset = glGetUniformLocation(handle, "packedPositionOffset");
+
+    // Baked directional light and lamps
+    locations.bakedLight = glGetUniformLocation(handle, "bakedLight");
+
+    return created;
+}
+
+void FPEngine::_useLightingVariant(int numPointLights, int features) const {
+    const LightingVariant& variant = _getLightingVariant(numPointLights, features);
+    _lightingShaderProgram = variant.program;
+    _lightingShaderUniformLocations = variant.locations;
+    _lightingShaderProgram->useProgram();
+}
+
+void FPEngine::_sendFrameLightingUniforms(const SceneSnapshot& snapshot) const {
+    // Arrays to hold point light data
+    glm::vec3 pointLightPositions[MAX_POINT_LIGHTS];
+    glm::vec3 pointLightColors[MAX_POINT_LIGHTS];
+    float pointLightConstants[MAX_POINT_LIGHTS];
+    float pointLightLinears[MAX_POINT_LIGHTS];
+    float pointLightQuadratics[MAX_POINT_LIGHTS];
+
+    // Populate the point light arrays
+    for(int i = 0; i < _numPointLights; ++i) {
+        pointLightPositions[i] = _lamps[i].position + LAMP_LIGHT_OFFSET;
+        pointLightColors[i] = LAMP_LIGHT_COLOR;
+        pointLightConstants[i] = LAMP_LIGHT_CONSTANT;
+        pointLightLinears[i] = LAMP_LIGHT_LINEAR;
+        pointLightQuadratics[i] = LAMP_LIGHT_QUADRATIC;
+    }
+
+    // the dynamic objects switch between the variants with and without the spot light, for
+    // packed meshes and for the rest, plus the vehicle's; the static props use the baked ones,
+    // or the GPU-driven program when it draws them
+    const int PACKED_BAKED = LIGHTING_PACKED_MESH | LIGHTING_BAKED;
+    const std::pair<int, int> variants[] = {
+        { _numPointLights, LIGHTING_SPOT_LIGHT }, { _numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_PACKED_MESH },
+        { _numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_VEHICLE_MESH },
+        { 0, PACKED_BAKED }, { 0, LIGHTING_SPOT_LIGHT | PACKED_BAKED },
+        { _numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_GPU_DRIVEN } };
+    const size_t numVariants = sizeof(variants) / sizeof(variants[0]) - (_pGpuRenderer ? 0 : 1);
+    for (size_t i = 0; i < numVariants; ++i) {
+        const std::pair<int, int>& variant = variants[i];
+        const int features = variant.second;
+        _useLightingVariant(variant.first, features);
+
+        // Send the camera position to the shader
+        _glState.uniform(_lightingShaderUniformLocations.viewPos, snapshot.cameraPosition);
+
+        // Set directional light uniforms using the correct uniform names and locations
+        _glState.uniform(_lightingShaderUniformLocations.dirLightDirection, DIR_LIGHT_DIRECTION);
+        _glState.uniform(_lightingShaderUniformLocations.dirLightColor, DIR_LIGHT_COLOR);
+
+        if (variant.first > 0) {
+            _glState.uniform(_lightingShaderUniformLocations.pointLightPositions, _numPointLights, pointLightPositions);
+            _glState.uniform(_lightingShaderUniformLocations.pointLightColors, _numPointLights, pointLightColors);
+            _glState.uniform(_lightingShaderUniformLocations.pointLightConstants, _numPointLights, pointLightConstants);
+            _glState.uniform(_lightingShaderUniformLocations.pointLightLinears, _numPointLights, pointLightLinears);
+            _glState.uniform(_lightingShaderUniformLocations.pointLightQuadratics, _numPointLights, pointLightQuadratics);
+        }
 
-    _spriteLocations = (glm::vec3*)malloc(sizeof(glm::vec3) * NUM_SPRITES);
-    _spriteIndices = (GLushort*)malloc(sizeof(GLushort) * NUM_SPRITES);
-    _distances = (GLfloat*)malloc(sizeof(GLfloat) * NUM_SPRITES);
-    _numVAOPoints[VAO_ID::PARTICLE_SYSTEM] = NUM_SPRITES;
-    for( int i = 0; i < NUM_SPRITES; i++ ) {
-        glm::vec3 pos( _randNumber(MAX_BOX_SIZE), _randNumber(MAX_BOX_SIZE), _randNumber(MAX_BOX_SIZE) );
-        _spriteLocations[i] = pos;
-        _spriteIndices[i] = i;
+        if (features & LIGHTING_SPOT_LIGHT) {
+            _glState.uniform(_lightingShaderUniformLocations.spotLightPosition, snapshot.spotLight.pos);
+            _glState.uniform(_lightingShaderUniformLocations.spotLightDirection, snapshot.spotLight.dir);
+            _glState.uniform(_lightingShaderUniformLocations.spotLightColor, snapshot.spotLight.color);
+            _glState.uniform(_lightingShaderUniformLocations.spotLightWidth, snapshot.spotLight.width);
+        }
+    }
+}
+
+bool FPEngine::_spotLightReaches(const SpotLight& spotLight, const glm::vec3& center, float radius) {
+    // distance from the center to the cone's surface, measured perpendicular to it
+    const glm::vec3 axis = glm::normalize(spotLight.dir);
+    const glm::vec3 toCenter = center - spotLight.pos;
+    const float along = glm::dot(toCenter, axis);
+    const float across = glm::length(toCenter - along * axis);
+    const float cosWidth = spotLight.width;
+    const float sinWidth = std::sqrt(std::max(0.0f, 1.0f - cosWidth * cosWidth));
+    if (along < -radius) {
+        return false;
     }
+    return across * cosWidth - along * sinWidth <= radius;
+}
+
+void FPEngine::mSetupBuffers() {
+    fprintf(stdout, "[DEBUG]: Setting up buffers...\n");
 
-    glBindVertexArray( _vaos[VAO_ID::PARTICLE_SYSTEM] );
+    // the light bake is the first to need the workers
+    _pJobs = new JobSystem(_launchOptions.jobThreads);
 
-    glBindBuffer( GL_ARRAY_BUFFER, _vbos[VAO_ID::PARTICLE_SYSTEM] );
-    glBufferData( GL_ARRAY_BUFFER, _numVAOPoints[VAO_ID::PARTICLE_SYSTEM] * sizeof(glm::vec3), _spriteLocations, GL_STATIC_DRAW );
+    // Load textures first
+    mSetupTextures();
 
-    glEnableVertexAttribArray( _billboardShaderProgramAttributes.vPos );
-    glVertexAttribPointer( _billboardShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0 );
+    _streamBuffer.setup();
 
-    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _ibos[VAO_ID::PARTICLE_SYSTEM] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, _numVAOPoints[VAO_ID::PARTICLE_SYSTEM] * sizeof(GLushort), _spriteIndices, GL_STATIC_DRAW );
+    //***************************************************************************
+    // Particle System generation
 
-    fprintf( stdout, "[INFO]: point sprites read in with VAO/VBO/IBO %d/%d/%d\n", _vaos[VAO_ID::PARTICLE_SYSTEM], _vbos[VAO_ID::PARTICLE_SYSTEM], _ibos[VAO_ID::PARTICLE_SYSTEM] );
+    _pParticleSystem = new ParticleSystem(NUM_PARTICLES);
+    _pParticleSystem->setup(_texHandles[TEXTURE_ID::PARTICLE_SYSTEM_TEX], *_pShaderCache);
 
     // Connect our 3D Object Library to our shader
     CSCI441::setVertexAttributeLocations(_lightingShaderAttributeLocations.vPos, _lightingShaderAttributeLocations.vNormal);
 
     // Setup buffers after textures
-    _initializePlatforms();
+    _loadLevel();
+    _bakeStaticLighting();
     _createArchBuffers();
-    _generateEnvironment();
 
-    // Marble buffers
-    glGenVertexArrays(1, &_marbleVAO);
-    glBindVertexArray(_marbleVAO);
+    // the scene variant is needed from here on: by the impostor bake and by the vehicle
+    _numPointLights = std::min(static_cast<int>(_lamps.size()), MAX_POINT_LIGHTS);
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT);
+    _setupLODMeshes();
+    _bakeTreeImpostors();
+    _setupOcclusionCulling();
+    _setupGpuDrivenRendering();
+    _vehicleMesh.setup(_getLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_VEHICLE_MESH).program);
 
-    glGenBuffers(1, &_marbleVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, _marbleVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(_marbleLocations), _marbleLocations, GL_STATIC_DRAW);
+    // Beak buffers
+    glGenVertexArrays(1, &_beakVAO);
+    glBindVertexArray(_beakVAO);
+
+    glGenBuffers(1, &_beakVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, _beakVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BEAK_VERTICES), BEAK_VERTICES, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(_lightingShaderAttributeLocations.vPos);
-    glVertexAttribPointer(_lightingShaderAttributeLocations.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glVertexAttribPointer(_lightingShaderAttributeLocations.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     glBindVertexArray(0);
 
@@ -464,296 +745,226 @@ void FPEngine::mSetupBuffers() {
     glGenBuffers(1, &_curveVBO);
 
     _createCurve(_curveVAO, _curveVBO, _numCurvePoints);
+
+    // the screen quad is generated from gl_VertexID, core profile still needs a VAO bound to draw
+    glGenVertexArrays(1, &_screenQuadVAO);
 }
 
 
-void FPEngine::_initializePlatforms() {
-    const float INNER_RADIUS = 10.0f;  // Inner radius of the disks
-    const float OUTER_RADIUS = 40.0f;  // Outer radius of the disks
-    const float GAP = 30.0f;           // Gap between the edges of the disks
-    const int numSegments = 100;
-
-    // Calculate the distance between centers of the disks
-    float diskSeparation = OUTER_RADIUS + GAP + OUTER_RADIUS;
-
-    // --- Disk 1 (Center at origin) ---
-    DiskPlatform disk1;
-    disk1.position = glm::vec3(0.0f, 0.0f, 0.0f);
-    disk1.inner_radius = INNER_RADIUS;
-    disk1.outer_radius = OUTER_RADIUS;
-    disk1.textureID = _texHandles[TEXTURE_ID::RUG];
-    disk1.buffer = 2;
-    disk1.fallBuffer = 1.0;
-    _generateDisk(disk1, numSegments);
-    _diskPlatforms.push_back(disk1);
-
-    RectPlatform invisiblePlatform;
-    invisiblePlatform.position = glm::vec3(0.0f, 0.0f, 0.0f); // Centered on disk1
-    invisiblePlatform.lengthX = 5.0f;  // Arbitrary size
-    invisiblePlatform.lengthZ = 5.0f;
-    invisiblePlatform.buffer = 2;
-    invisiblePlatform.fallBuffer = 1.0; // Adjust as needed for interaction
-    invisiblePlatform.textureID = 0;    // No texture or set to an invisible texture
-    _generateRectangle(invisiblePlatform);
-    _rectPlatforms.push_back(invisiblePlatform);
-
-    // --- Disk 2 (20 units apart + radii) ---
-    DiskPlatform disk2;
-    disk2.position = glm::vec3(diskSeparation, 0.0f, 0.0f); // Proper separation
-    disk2.inner_radius = INNER_RADIUS;
-    disk2.outer_radius = OUTER_RADIUS;
-    disk2.textureID = _texHandles[TEXTURE_ID::RAINBOW];
-    disk2.buffer = 2;
-    disk2.fallBuffer = 1.0;
-    _generateDisk(disk2, numSegments);
-    _diskPlatforms.push_back(disk2);
-
-    // --- Rectangle Platform (Connecting the two disks) ---
-    RectPlatform rect;
-    rect.position = glm::vec3(diskSeparation / 2.0f, 0.0f, 0.0f); // Midpoint between disks
-    rect.lengthX = 10.0f;
-    rect.lengthZ = 5.0f;
-    rect.buffer = 2;
-    rect.fallBuffer = 0.8;
-    rect.textureID = _texHandles[TEXTURE_ID::IRISES];
-    _generateRectangle(rect);
-    _rectPlatforms.push_back(rect);
-
-    // Rectangle 1 (Above Disk 1)
-    RectPlatform rect1;
-    rect1.position = glm::vec3(disk1.position.x, 0.0f, disk1.position.z + 50.0f);
-    rect1.lengthX = 5.0f;  // Same size as existing rectangle
-    rect1.lengthZ = 10.0f;
-    rect1.buffer = 2;
-    rect1.fallBuffer = 0.8;
-    rect1.textureID = _texHandles[TEXTURE_ID::IRISES];
-    _generateRectangle(rect1);
-    _rectPlatforms.push_back(rect1);
-
-    // Rectangle 2 (Above Disk 2)
-    RectPlatform rect2;
-    rect2.position = glm::vec3(disk2.position.x, 0.0f, disk2.position.z + 50.0f);
-    rect2.lengthX = 5.0f;  // Same size as existing rectangle
-    rect2.lengthZ = 10.0f;
-    rect2.buffer = 2;
-    rect2.fallBuffer = 0.8;
-    rect2.textureID = _texHandles[TEXTURE_ID::IRISES];
-    _generateRectangle(rect2);
-    _rectPlatforms.push_back(rect2);
-
-    // Larger Rectangle (Higher Above the Smaller Rectangles)
-    RectPlatform largerRect;
-    largerRect.position = glm::vec3((disk1.position.x + disk2.position.x) / 2.0f, 0.0f, (disk1.position.z + disk2.position.z) / 2.0f + 87.0f);
-    largerRect.lengthX = 200.0f;  // Larger size
-    largerRect.lengthZ = 50.0f;
-    largerRect.buffer = 2;
-    largerRect.fallBuffer = 0.8;
-    largerRect.textureID = _texHandles[TEXTURE_ID::QUARTZ];
-    _generateRectangle(largerRect);
-    _rectPlatforms.push_back(largerRect);
-}
-
-
-void FPEngine::_generateDisk(DiskPlatform& disk, int numSegments) {
-    std::vector<GLfloat> vertices;
-    std::vector<GLuint> indices;
-
-    for (int i = 0; i <= numSegments; ++i) {
-        float angle = (float)i / numSegments * 2.0f * M_PI;
-        float cosAngle = cos(angle);
-        float sinAngle = sin(angle);
-
-        // Inner vertex
-        vertices.insert(vertices.end(), {
-            disk.inner_radius * cosAngle, 0.0f, disk.inner_radius * sinAngle,
-            0.5f + (cosAngle * 0.5f * (disk.inner_radius / disk.outer_radius)), // Adjusted texture scaling
-            0.5f + (sinAngle * 0.5f * (disk.inner_radius / disk.outer_radius))
-        });
-
-        // Outer vertex
-        vertices.insert(vertices.end(), {
-            disk.outer_radius * cosAngle, 0.0f, disk.outer_radius * sinAngle,
-            0.5f + cosAngle * 0.5f,
-            0.5f + sinAngle * 0.5f
-        });
-
-        if (i < numSegments) {
-            indices.push_back(i * 2);
-            indices.push_back(i * 2 + 1);
-            indices.push_back((i + 1) * 2);
-
-            indices.push_back(i * 2 + 1);
-            indices.push_back((i + 1) * 2 + 1);
-            indices.push_back((i + 1) * 2);
-        }
+void FPEngine::_loadLevel() {
+    if (!_level.open(_launchOptions.levelPath.c_str())) {
+        // there is nothing to play on, stop as soon as the engine is set up
+        setWindowShouldClose();
+        return;
     }
 
-    glGenVertexArrays(1, &disk.vao);
-    glBindVertexArray(disk.vao);
+    // every platform shares one buffer, each decodes its packed vertices with its own scale and offset
+    glGenVertexArrays(1, &_levelVAO);
+    glBindVertexArray(_levelVAO);
 
-    GLuint vbo, ebo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &_levelVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, _levelVBO);
+    glBufferData(GL_ARRAY_BUFFER, _level.getNumVertices() * sizeof(LevelFormat::Vertex), _level.getVertices(), GL_STATIC_DRAW);
 
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &_levelEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _levelEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _level.getNumIndices() * sizeof(GLushort), _level.getIndices(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0); // Position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(0); // Position, plain shorts the shader scales
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(LevelFormat::Vertex), (void*)offsetof(LevelFormat::Vertex, position));
     glEnableVertexAttribArray(1); // Texture coordinates
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(LevelFormat::Vertex), (void*)offsetof(LevelFormat::Vertex, texCoord));
 
     glBindVertexArray(0);
-}
-
-void FPEngine::_generateRectangle(RectPlatform& rect) {
-    GLfloat vertices[] = {
-        -rect.lengthX / 2, 0.0f, -rect.lengthZ / 2,  0.0f, 0.0f, // Bottom-left
-         rect.lengthX / 2, 0.0f, -rect.lengthZ / 2,  1.0f, 0.0f, // Bottom-right
-         rect.lengthX / 2, 0.0f,  rect.lengthZ / 2,  1.0f, 1.0f, // Top-right
-        -rect.lengthX / 2, 0.0f,  rect.lengthZ / 2,  0.0f, 1.0f  // Top-left
-    };
-
-    GLuint indices[] = { 0, 1, 2, 2, 3, 0 };
-
-    glGenVertexArrays(1, &rect.vao);
-    glBindVertexArray(rect.vao);
 
-    GLuint vbo, ebo;
-    glGenBuffers(1, &vbo);
-    glGenBuffers(1, &ebo);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    // in LevelFormat::Texture order, the hidden platform has none
+    const GLuint textures[] = { 0, _texHandles[TEXTURE_ID::RUG], _texHandles[TEXTURE_ID::MARBLE], _texHandles[TEXTURE_ID::RAINBOW],
+                                _texHandles[TEXTURE_ID::IRISES], _texHandles[TEXTURE_ID::QUARTZ] };
+    const size_t NUM_LEVEL_TEXTURES = sizeof(textures) / sizeof(textures[0]);
+
+    for (size_t i = 0; i < _level.getNumPlatforms(); ++i) {
+        const LevelFormat::Platform& platform = _level.getPlatforms()[i];
+        const GLuint textureID = platform.texture < NUM_LEVEL_TEXTURES ? textures[platform.texture] : 0;
+        if (platform.type == LevelFormat::PLATFORM_DISK) {
+            _diskPlatforms.push_back(DiskPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                   platform.firstIndex, static_cast<GLsizei>(platform.numIndices),
+                                                   static_cast<GLint>(platform.firstVertex),
+                                                   glm::make_vec3(platform.positionScale), glm::make_vec3(platform.positionOffset),
+                                                   textureID, platform.fallBuffer });
+        } else {
+            _rectPlatforms.push_back(RectPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                   platform.firstIndex, static_cast<GLsizei>(platform.numIndices),
+                                                   static_cast<GLint>(platform.firstVertex),
+                                                   glm::make_vec3(platform.positionScale), glm::make_vec3(platform.positionOffset),
+                                                   textureID, platform.fallBuffer });
+        }
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    for (size_t i = 0; i < _level.getNumProps(); ++i) {
+        const LevelFormat::Prop& prop = _level.getProps()[i];
+        if (prop.type == LevelFormat::PROP_TREE) {
+            _addTree(glm::make_vec3(prop.position));
+        } else {
+            _addLamp(glm::make_vec3(prop.position));
+        }
+    }
+    // nothing here moves again, so this is the only time their matrices are computed
+    _sceneTransforms.update();
+
+    // the first vehicle spawn wins, every marble spawn gets its own marble
+    size_t numMarbles = 0;
+    bool vehicleSpawned = false;
+    for (size_t i = 0; i < _level.getNumSpawns(); ++i) {
+        const LevelFormat::Spawn& spawn = _level.getSpawns()[i];
+        if (spawn.type == LevelFormat::SPAWN_MARBLE) {
+            ++numMarbles;
+        } else if (spawn.type == LevelFormat::SPAWN_VEHICLE && !vehicleSpawned) {
+            _vehicleSpawnPosition = glm::make_vec3(spawn.position);
+            _vehicleSpawnHeading = spawn.heading;
+            vehicleSpawned = true;
+        }
+    }
+    // sized once here so the marble buffer and LOD slots can be made before the scene is set up
+    _marbleLocations.resize(numMarbles);
+    _marbleDirections.resize(numMarbles);
+}
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+void FPEngine::_bakeStaticLighting() {
+    const auto start = std::chrono::steady_clock::now();
+    const LightBaker::Lights lights{ DIR_LIGHT_DIRECTION, DIR_LIGHT_COLOR, LAMP_LIGHT_OFFSET, LAMP_LIGHT_COLOR,
+                                     LAMP_LIGHT_CONSTANT, LAMP_LIGHT_LINEAR, LAMP_LIGHT_QUADRATIC, LAMP_LIGHT_RANGE };
+    const LightBaker baker(_level, lights, *_pJobs);
 
-    glBindVertexArray(0);
+    // the platforms are flat, each is baked over its bounding square or rectangle
+    std::vector<LightBaker::Surface> surfaces;
+    surfaces.reserve(_diskPlatforms.size() + _rectPlatforms.size());
+    for (const DiskPlatform& disk : _diskPlatforms) {
+        const glm::vec2 center(disk.position.x, disk.position.z);
+        surfaces.push_back(LightBaker::Surface{ center - disk.outer_radius, center + disk.outer_radius, disk.position.y });
+    }
+    for (const RectPlatform& rect : _rectPlatforms) {
+        const glm::vec2 center(rect.position.x, rect.position.z);
+        const glm::vec2 halfSize(rect.lengthX / 2.0f, rect.lengthZ / 2.0f);
+        surfaces.push_back(LightBaker::Surface{ center - halfSize, center + halfSize, rect.position.y });
+    }
+    LightBaker::Lightmap lightmap;
+    if (!baker.bakeLightmap(surfaces.data(), surfaces.size(), LightBaker::Material{ PLATFORM_AMBIENT, PLATFORM_DIFFUSE },
+                            LIGHTMAP_TEXEL_SIZE, lightmap)) {
+        // unlit is still playable: one white texel under every platform
+        lightmap.width = lightmap.height = 1;
+        lightmap.texels.assign(1, glm::vec3(1.0f));
+        lightmap.surfaceRects.assign(surfaces.size(), glm::vec4(0.0f, 0.0f, 0.5f, 0.5f));
+    }
+    _diskLightmapRects.assign(lightmap.surfaceRects.begin(), lightmap.surfaceRects.begin() + _diskPlatforms.size());
+    _rectLightmapRects.assign(lightmap.surfaceRects.begin() + _diskPlatforms.size(), lightmap.surfaceRects.end());
+
+    // texels are floats, the lamps push the lit side of a surface past 1
+    glGenTextures(1, &_lightmapTexture);
+    glBindTexture(GL_TEXTURE_2D, _lightmapTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, lightmap.width, lightmap.height, 0, GL_RGB, GL_FLOAT, lightmap.texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // one probe per prop part, at the middle of its mesh: the trunk and post stand on their
+    // node, the leaves' cone starts at theirs and the bulb is centered on the light
+    _bakedLight.resize(_sceneTransforms.getNumNodes());
+    std::vector<glm::vec3> centers;
+    std::vector<LightBaker::AmbientCube> cubes;
+    auto bakeParts = [&](const std::vector<TransformHierarchy::Node>& nodes, const glm::vec3& centerOffset,
+                         const glm::vec3& ambient, const glm::vec3& diffuse) {
+        centers.clear();
+        for (TransformHierarchy::Node node : nodes) {
+            centers.push_back(glm::vec3(_sceneTransforms.getWorldMatrix(node)[3]) + centerOffset);
+        }
+        cubes.resize(nodes.size());
+        baker.bakeProbes(centers.data(), centers.size(), LightBaker::Material{ ambient, diffuse }, cubes.data());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            _bakedLight[nodes[i]] = cubes[i];
+        }
+    };
+    std::vector<TransformHierarchy::Node> trunks, leaves, posts, bulbs;
+    for (const TreeData& tree : _trees) {
+        trunks.push_back(tree.trunk);
+        leaves.push_back(tree.leaves);
+    }
+    for (const LampData& lamp : _lamps) {
+        posts.push_back(lamp.post);
+        bulbs.push_back(lamp.light);
+    }
+    bakeParts(trunks, glm::vec3(0.0f, 2.5f, 0.0f), TREE_AMBIENT, TRUNK_DIFFUSE);
+    bakeParts(leaves, glm::vec3(0.0f, 4.0f, 0.0f), TREE_AMBIENT, LEAVES_DIFFUSE);
+    bakeParts(posts, glm::vec3(0.0f, 3.5f, 0.0f), LAMP_POST_AMBIENT, LAMP_POST_DIFFUSE);
+    bakeParts(bulbs, glm::vec3(0.0f), LAMP_BULB_AMBIENT, LAMP_BULB_DIFFUSE);
+
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stdout, "[INFO]: baked %zu lamps into a %dx%d lightmap and %zu probes in %.1f ms\n",
+            baker.getNumLamps(), lightmap.width, lightmap.height, trunks.size() + leaves.size() + posts.size() + bulbs.size(),
+            milliseconds);
 }
 
 void FPEngine::_drawPlatforms(glm::mat4 viewMtx, glm::mat4 projMtx) const {
     _textureShaderProgram->useProgram();
 
-    // Draw Disk Platforms
-    for (const DiskPlatform& platform : _diskPlatforms) {
-        glm::mat4 modelMtx = glm::translate(glm::mat4(1.0f), platform.position);
-        glm::mat4 mvpMtx = projMtx * viewMtx * modelMtx;
-
-        glUniformMatrix4fv(_textureShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMtx));
-        glBindVertexArray(platform.vao);
+    // the level geometry decodes to world space, so one matrix serves every platform
+    _glState.uniform(_textureShaderUniformLocations.mvpMatrix, projMtx * viewMtx);
+    _glState.bindTexture(1, GL_TEXTURE_2D, _lightmapTexture);
+    _drawLevelPlatforms(_textureShaderUniformLocations.positionScale, _textureShaderUniformLocations.positionOffset,
+                        _textureShaderUniformLocations.lightmapRect);
+}
 
-        glActiveTexture(GL_TEXTURE0); // Activate Texture Unit 0
-        glBindTexture(GL_TEXTURE_2D, platform.textureID); // Bind the texture
-        glDrawElements(GL_TRIANGLES, 6 * 100, GL_UNSIGNED_INT, nullptr);
-        glBindVertexArray(0);
-        glUniform1i(_textureShaderUniformLocations.aTextMap, 0); // Ensure shader uses Texture Unit 0
+void FPEngine::_drawLevelPlatforms(GLint positionScaleLocation, GLint positionOffsetLocation, GLint lightmapRectLocation) const {
+    _glState.bindVertexArray(_levelVAO);
 
+    // Draw Disk Platforms
+    for (size_t i = 0; i < _diskPlatforms.size(); ++i) {
+        const DiskPlatform& platform = _diskPlatforms[i];
+        _glState.bindTexture(0, GL_TEXTURE_2D, platform.textureID);
+        _glState.uniform(positionScaleLocation, platform.positionScale);
+        _glState.uniform(positionOffsetLocation, platform.positionOffset);
+        _glState.uniform(lightmapRectLocation, 1, &_diskLightmapRects[i]);
+        _glState.drawElementsBaseVertex(GL_TRIANGLES, platform.numIndices, GL_UNSIGNED_SHORT,
+                                        (void*)(platform.firstIndex * sizeof(GLushort)), platform.baseVertex);
     }
 
     // Draw Rectangle Platforms
-    for (const RectPlatform& platform : _rectPlatforms) {
-        glm::mat4 modelMtx = glm::translate(glm::mat4(1.0f), platform.position);
-        glm::mat4 mvpMtx = projMtx * viewMtx * modelMtx;
-
-        glUniformMatrix4fv(_textureShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMtx));
-        glBindTexture(GL_TEXTURE_2D, platform.textureID);
-
-        glBindVertexArray(platform.vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-        glBindVertexArray(0);
+    for (size_t i = 0; i < _rectPlatforms.size(); ++i) {
+        const RectPlatform& platform = _rectPlatforms[i];
+        _glState.bindTexture(0, GL_TEXTURE_2D, platform.textureID);
+        _glState.uniform(positionScaleLocation, platform.positionScale);
+        _glState.uniform(positionOffsetLocation, platform.positionOffset);
+        _glState.uniform(lightmapRectLocation, 1, &_rectLightmapRects[i]);
+        _glState.drawElementsBaseVertex(GL_TRIANGLES, platform.numIndices, GL_UNSIGNED_SHORT,
+                                        (void*)(platform.firstIndex * sizeof(GLushort)), platform.baseVertex);
     }
 }
 
-void FPEngine::_generateEnvironment() {
-    fprintf(stdout, "[DEBUG]: Generating racetrack environment...\n");
-    srand(static_cast<unsigned int>(time(0)));
-
-    const int numSegments = 17;
-
-    // Generate trees and lamps for Disk Platforms (along inner and outer radii)
-    for (const DiskPlatform& disk : _diskPlatforms) {
-        for (int i = 0; i < numSegments; ++i) {
-            float angle = static_cast<float>(i) / numSegments * 2.0f * M_PI;
-            float cosAngle = cos(angle);
-            float sinAngle = sin(angle);
-
-            glm::vec3 innerPosition = disk.position + glm::vec3(disk.inner_radius * cosAngle, 0.0f, disk.inner_radius * sinAngle);
-            glm::vec3 outerPosition = disk.position + glm::vec3(disk.outer_radius * cosAngle, 0.0f, disk.outer_radius * sinAngle);
-
-
-            if (i % 2 == 0) {
-                // Trees
-                glm::mat4 innerTreeMatrix = glm::translate(glm::mat4(1.0f), innerPosition);
-                glm::mat4 innerLeavesMatrix = glm::translate(innerTreeMatrix, glm::vec3(0, 5, 0));
-                _trees.emplace_back(TreeData{innerTreeMatrix, innerLeavesMatrix});
-
-                glm::mat4 outerTreeMatrix = glm::translate(glm::mat4(1.0f), outerPosition);
-                glm::mat4 outerLeavesMatrix = glm::translate(outerTreeMatrix, glm::vec3(0, 5, 0));
-                _trees.emplace_back(TreeData{outerTreeMatrix, outerLeavesMatrix});
-            } else {
-                // Lamps
-                glm::mat4 innerLampMatrix = glm::translate(glm::mat4(1.0f), innerPosition);
-                _lamps.emplace_back(LampData{innerLampMatrix, glm::translate(innerLampMatrix, glm::vec3(0, 7, 0)), innerPosition});
-
-                glm::mat4 outerLampMatrix = glm::translate(glm::mat4(1.0f), outerPosition);
-                _lamps.emplace_back(LampData{outerLampMatrix, glm::translate(outerLampMatrix, glm::vec3(0, 7, 0)), outerPosition});
-            }
-        }
-    }
-
-    // Generate trees and lamps for Rectangular Platforms only if dimensions are valid
-    for (const RectPlatform& rect : _rectPlatforms) {
-        if (rect.lengthX < 20.0f || rect.lengthZ < 20.0f) {
-            continue; // Skip if either dimension is smaller than 20
-        }
+void FPEngine::_addTree(const glm::vec3& position) {
+    const TransformHierarchy::Node trunk = _sceneTransforms.addNode(TransformHierarchy::NO_PARENT, position);
+    const TransformHierarchy::Node leaves = _sceneTransforms.addNode(trunk, glm::vec3(0, 5, 0));
+    _trees.emplace_back(TreeData{trunk, leaves});
+}
 
-        const int numObjects = 20; // Number of trees/lamps
-
-        for (int i = 0; i < numObjects; ++i) {
-            float x = getRand() * rect.lengthX - rect.lengthX / 2.0f;
-            float z = getRand() * rect.lengthZ - rect.lengthZ / 2.0f;
-            glm::vec3 position = rect.position + glm::vec3(x, 0.0f, z);
-
-            if (i % 2 == 0) {
-                // Trees
-                glm::mat4 treeMatrix = glm::translate(glm::mat4(1.0f), position);
-                glm::mat4 leavesMatrix = glm::translate(treeMatrix, glm::vec3(0, 5, 0));
-                _trees.emplace_back(TreeData{treeMatrix, leavesMatrix});
-            } else {
-                // Lamps
-                glm::mat4 lampMatrix = glm::translate(glm::mat4(1.0f), position);
-                _lamps.emplace_back(LampData{lampMatrix, glm::translate(lampMatrix, glm::vec3(0, 7, 0)), position});
-            }
-        }
-    }
+void FPEngine::_addLamp(const glm::vec3& position) {
+    const TransformHierarchy::Node post = _sceneTransforms.addNode(TransformHierarchy::NO_PARENT, position);
+    const TransformHierarchy::Node light = _sceneTransforms.addNode(post, LAMP_LIGHT_OFFSET);
+    _lamps.emplace_back(LampData{post, light, position});
 }
 
 
 void FPEngine::mSetupScene() {
+    _buildTickGraph();
+
     // Create the Vehicle
-    _pVehicle = new Vehicle(_lightingShaderProgram->getShaderProgramHandle(),
-                            _lightingShaderUniformLocations.mvpMatrix,
-                            _lightingShaderUniformLocations.normalMatrix,
-                            _lightingShaderUniformLocations.materialAmbient,
-                            _lightingShaderUniformLocations.materialDiffuse,
-                            _lightingShaderUniformLocations.materialSpecular,
-                            _lightingShaderUniformLocations.materialShininess);
-
-    float initialAngle = 0.0f; // Start at the 0-degree mark of the track
-    float initialHeading = glm::radians(180.0f);
-    float startingRadius = (STARTING_RADIUS_I + STARTING_RADIUS_O) / 2.0f; // Midpoint of the track
-    float startX = startingRadius * cos(initialAngle);
-    float startZ = startingRadius * sin(initialAngle);
-    _pVehicle->setPosition(glm::vec3(startX, 0.0f, startZ));
-    _pVehicle->setHeading(initialHeading);
+    _pVehicle = new Vehicle();
+
+    _pVehicle->setPosition(_vehicleSpawnPosition);
+    _pVehicle->setHeading(_vehicleSpawnHeading);
+
+    // the level places everything, the marbles still wander randomly
+    srand(static_cast<unsigned int>(time(0)));
 
     //initialize coins and marbles and spheres
     _initializeMarbleLocations();
@@ -778,7 +989,7 @@ void FPEngine::mSetupScene() {
     _pTPCam = new TPCamera(); // Distance and height
 
     //spotlight
-    _spotLight.pos = glm::vec3(startX, 10.0f, startZ);  // Position 10 units above the starting position
+    _spotLight.pos = _vehicleSpawnPosition + glm::vec3(0.0f, 10.0f, 0.0f);  // Position 10 units above the starting position
     _spotLight.dir = glm::vec3(0.0f, -1.0f, 0.0f);      // Pointing downwards
     _spotLight.width = glm::cos(glm::radians(15.0f));   // Spotlight cone width
     _spotLight.color = glm::vec3(1.0f, 0.0f, 0.0f);
@@ -787,17 +998,38 @@ void FPEngine::mSetupScene() {
     _isJumping = false;
     _jumpProgress = 0.0f;
 
-    _particleSystemAngle = 0.0f;
+    if (!_launchOptions.connectAddress.empty()) {
+        _connectToSession();
+    }
+}
+
+void FPEngine::_connectToSession() {
+    NetAddress server;
+    if (!NetAddress::parse(_launchOptions.connectAddress, NetProtocol::DEFAULT_PORT, server)) {
+        fprintf(stderr, "[ERROR]: could not resolve %s, playing alone\n", _launchOptions.connectAddress.c_str());
+        return;
+    }
+    _pSession = new SessionClient();
+    if (!_pSession->connect(server, _launchOptions.levelPath.c_str())) {
+        fprintf(stderr, "[ERROR]: could not join %s, playing alone\n", _launchOptions.connectAddress.c_str());
+        delete _pSession;
+        _pSession = nullptr;
+        return;
+    }
 }
 
 
-void FPEngine::_renderScene(glm::mat4 viewMtx, glm::mat4 projMtx) const {
-    if(!_billboardShaderProgram) {
+void FPEngine::_renderScene(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx) {
+    FP_PROFILE_SCOPE("FPEngine::_renderScene");
+    if(!_lightingShaderProgram) {
         return;
     }
 
+    // this frame's depth pyramid, before anything below asks _isVisible
+    _rasterizeOccluders(viewMtx, projMtx);
+
     _drawPlatforms(viewMtx, projMtx);
-    _drawBlueSpheres(viewMtx, projMtx);
+    _drawBlueSpheres(snapshot, viewMtx, projMtx);
     //for bezier
     int time = _bezierCurve.currentPos;
     float curveIndex= _bezierCurve.currentPos - time;
@@ -810,256 +1042,154 @@ void FPEngine::_renderScene(glm::mat4 viewMtx, glm::mat4 projMtx) const {
     glm::mat4 mvpMtx = projMtx * viewMtx * groundModelMtx;
 
     // Set MVP matrix
-    glUniformMatrix4fv(_textureShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMtx));
+    _glState.uniform(_textureShaderUniformLocations.mvpMatrix, mvpMtx);
 
     // Bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _texHandles[TEXTURE_ID::RUG]);
-    glUniform1i(_textureShaderUniformLocations.aTextMap, 0);
+    _glState.bindTexture(0, GL_TEXTURE_2D, _texHandles[TEXTURE_ID::RUG]);
 
     // Bind and draw ground VAO
-    glBindVertexArray(_groundVAO);
-    glDrawElements(GL_TRIANGLES, _numGroundPoints, GL_UNSIGNED_INT, nullptr);
-    glBindVertexArray(0);
+    _glState.bindVertexArray(_groundVAO);
+    _glState.drawElements(GL_TRIANGLES, _numGroundPoints, GL_UNSIGNED_INT, nullptr);
 
 
     // Send spotlight information
-    glUniform3fv(_textureShaderUniformLocations.spotLightPosition, 1, glm::value_ptr(_spotLight.pos));
-    glUniform3fv(_textureShaderUniformLocations.spotLightDirection, 1, glm::value_ptr(_spotLight.dir));
-    glUniform1f(_textureShaderUniformLocations.spotLightWidth, _spotLight.width);
-    glUniform3fv(_textureShaderUniformLocations.spotLightColor, 1, glm::value_ptr(_spotLight.color));
-
-    const int MAX_POINT_LIGHTS = 10;
-
-    // Arrays to hold point light data
-    glm::vec3 pointLightPositions[MAX_POINT_LIGHTS];
-    glm::vec3 pointLightColors[MAX_POINT_LIGHTS];
-    float pointLightConstants[MAX_POINT_LIGHTS];
-    float pointLightLinears[MAX_POINT_LIGHTS];
-    float pointLightQuadratics[MAX_POINT_LIGHTS];
-
-    // Determine the number of point lights
-    int numPointLights = std::min(static_cast<int>(_lamps.size()), MAX_POINT_LIGHTS);
-
-    // Populate the point light arrays
-    for(int i = 0; i < numPointLights; ++i) {
-        pointLightPositions[i] = _lamps[i].position;
-        pointLightColors[i] = glm::vec3(0.0f, 0.0f, 1.0f); // Blue color
-        pointLightConstants[i] = 1.0f;
-        pointLightLinears[i] = 0.09f;
-        pointLightQuadratics[i] = 0.032f;
-    }
-
-    _lightingShaderProgram->useProgram();
-    glm::vec3 cameraPosition;
-    if (currCamera == CameraType::ARCBALL) {
-        cameraPosition = _pArcballCam->getPosition();
-    } else if (currCamera == CameraType::FREECAM) {
-        cameraPosition = _pFreeCam->getPosition();
-    } else if (currCamera == CameraType::FIRSTPERSON) {
-        cameraPosition = _pFPCam->getPosition();
-    } else if (currCamera == CameraType::THIRDPERSON) {
-        cameraPosition = _pTPCam->getPosition();
-    }
-
-    // Send the camera position to the shader
-    glUniform3fv(_lightingShaderUniformLocations.viewPos, 1, glm::value_ptr(cameraPosition));
-
-    // Set directional light uniforms using the correct uniform names and locations
-    glm::vec3 lightDirection(-1.0f, -1.0f, -1.0f);
-    glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
-    glUniform3fv(_lightingShaderUniformLocations.dirLightDirection, 1, glm::value_ptr(lightDirection));
-    glUniform3fv(_lightingShaderUniformLocations.dirLightColor, 1, glm::value_ptr(lightColor));
-
-    glUniform1i(_lightingShaderUniformLocations.numPointLights, numPointLights);
-    glUniform3fv(_lightingShaderUniformLocations.pointLightPositions, numPointLights, glm::value_ptr(pointLightPositions[0]));
-    glUniform3fv(_lightingShaderUniformLocations.pointLightColors, numPointLights, glm::value_ptr(pointLightColors[0]));
-    glUniform1fv(_lightingShaderUniformLocations.pointLightConstants, numPointLights, pointLightConstants);
-    glUniform1fv(_lightingShaderUniformLocations.pointLightLinears, numPointLights, pointLightLinears);
-    glUniform1fv(_lightingShaderUniformLocations.pointLightQuadratics, numPointLights, pointLightQuadratics);
-
-    // Set spot light uniforms
-    glUniform3fv(_lightingShaderUniformLocations.spotLightPosition, 1, glm::value_ptr(_spotLight.pos));
-    glUniform3fv(_lightingShaderUniformLocations.spotLightDirection, 1, glm::value_ptr(_spotLight.dir));
-    glUniform3fv(_lightingShaderUniformLocations.spotLightColor, 1, glm::value_ptr(_spotLight.color));
-    glUniform1f(_lightingShaderUniformLocations.spotLightWidth, _spotLight.width);
-
-    //// BEGIN DRAWING THE TREES ////
-    // Draw trunks
-    for(const TreeData& tree : _trees){
-        _computeAndSendMatrixUniforms(tree.modelMatrixTrunk, viewMtx, projMtx);
-
-        // Set material properties for tree trunks
-        glm::vec3 trunkAmbient(0.2f, 0.2f, 0.2f);
-        glm::vec3 trunkDiffuse(99 / 255.f, 39 / 255.f, 9 / 255.f);
-        glm::vec3 trunkSpecular(0.3f, 0.3f, 0.3f);
-        float trunkShininess = 32.0f;
-
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(trunkAmbient));
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(trunkDiffuse));
-        glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(trunkSpecular));
-        glUniform1f(_lightingShaderUniformLocations.materialShininess, trunkShininess);
-        _computeAndSendMatrixUniforms(tree.modelMatrixTrunk, viewMtx, projMtx);
-        CSCI441::drawSolidCylinder(1, 1, 5, 16, 16);
-    }
-
-    // Draw leaves
-    for(const TreeData& tree : _trees){
-        _computeAndSendMatrixUniforms(tree.modelMatrixLeaves, viewMtx, projMtx);
-
-        // Set material properties for tree leaves
-        glm::vec3 leavesAmbient(0.2f, 0.2f, 0.2f);
-        glm::vec3 leavesDiffuse(46 / 255.f, 143 / 255.f, 41 / 255.f);
-        glm::vec3 leavesSpecular(0.3f, 0.3f, 0.3f);
-        float leavesShininess = 32.0f;
-
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(leavesAmbient));
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(leavesDiffuse));
-        glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(leavesSpecular));
-        glUniform1f(_lightingShaderUniformLocations.materialShininess, leavesShininess);
-        _computeAndSendMatrixUniforms(tree.modelMatrixLeaves, viewMtx, projMtx);
-        CSCI441::drawSolidCone(3, 8, 16, 16);
-    }
-    //// END DRAWING THE TREES ////
-
-    //// BEGIN DRAWING THE LAMPS ////
-    // Draw posts
-    for (const LampData &lamp: _lamps) {
-        _computeAndSendMatrixUniforms(lamp.modelMatrixPost, viewMtx, projMtx);
-
-        // Set material properties for lamp posts
-        glm::vec3 postAmbient(0.2f, 0.2f, 0.2f);
-        glm::vec3 postDiffuse(0.5f, 0.5f, 0.5f);
-        glm::vec3 postSpecular(0.3f, 0.3f, 0.3f);
-        float postShininess = 32.0f;
-
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(postAmbient));
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(postDiffuse));
-        glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(postSpecular));
-        glUniform1f(_lightingShaderUniformLocations.materialShininess, postShininess);
-
-        CSCI441::drawSolidCylinder(0.2, 0.2, 7, 16, 16);
-    }
-
-    // Draw lights
-    for (const LampData &lamp: _lamps) {
-        _computeAndSendMatrixUniforms(lamp.modelMatrixLight, viewMtx, projMtx);
-
-        // Set material properties for lamp lights
-        glm::vec3 lightAmbient(0.2f, 0.2f, 0.5f);
-        glm::vec3 lightDiffuse(0.0f, 0.0f, 1.0f); // Blue color
-        glm::vec3 lightSpecular(0.5f, 0.5f, 0.5f);
-        float lightShininess = 64.0f;
-
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(lightAmbient));
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(lightDiffuse));
-        glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(lightSpecular));
-        glUniform1f(_lightingShaderUniformLocations.materialShininess, lightShininess);
-
-        CSCI441::drawSolidSphere(0.5, 16, 16);
+    _glState.uniform(_textureShaderUniformLocations.spotLightPosition, snapshot.spotLight.pos);
+    _glState.uniform(_textureShaderUniformLocations.spotLightDirection, snapshot.spotLight.dir);
+    _glState.uniform(_textureShaderUniformLocations.spotLightWidth, snapshot.spotLight.width);
+    _glState.uniform(_textureShaderUniformLocations.spotLightColor, snapshot.spotLight.color);
+
+    _sendFrameLightingUniforms(snapshot);
+    const glm::vec3& cameraPosition = snapshot.cameraPosition;
+
+    // trees, lamps and marbles: culled and drawn on the GPU in one indirect draw, or one by one here
+    FrameList<glm::vec3> impostorPositions(_frameArena, _trees.size());
+    if(_pGpuRenderer) {
+        _pGpuRenderer->draw(snapshot.marbleLocations.data(), snapshot.marbleLocations.size(), viewMtx, projMtx, _lodBias,
+                            _pTreeImpostors ? TREE_IMPOSTOR_COVERAGE : 0.0f, snapshot.animationTime, _streamBuffer);
+    } else {
+        _drawProps(snapshot, viewMtx, projMtx, impostorPositions);
     }
-    //// END DRAWING THE LAMPS ////
 
-    _pVehicle->drawVehicle(viewMtx, projMtx);
+    // the vehicle sits right under the spot light; the whole model is one draw
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_VEHICLE_MESH);
+    _vehicleMesh.draw(snapshot.vehicles, snapshot.numVehicles, viewMtx, projMtx, _streamBuffer);
 
     //draw marbles
-    _drawMarbles(viewMtx, projMtx);
+    if(!_pGpuRenderer) {
+        _drawMarbles(snapshot, viewMtx, projMtx);
+    }
 
     //draw coins
-    _drawCoins(viewMtx, projMtx);
+    _drawCoins(snapshot, viewMtx, projMtx);
 
     //draw arch
     _drawArch(viewMtx, projMtx);
 
     //bezier curve
     // Render Bézier Curve
-    _lightingShaderProgram->useProgram();
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT);
 
     glm::mat4 curveModelMtx = glm::mat4(1.0f);
     glm::mat4 curveMVP = projMtx * viewMtx * curveModelMtx;
-    glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(curveMVP));
+    _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, curveMVP);
+
+    //distant trees, batched into one instanced draw with their own shader
+    if(_pTreeImpostors && _pGpuRenderer) {
+        _pGpuRenderer->drawImpostors(*_pTreeImpostors, viewMtx, projMtx, cameraPosition);
+    } else if(_pTreeImpostors) {
+        _pTreeImpostors->draw(impostorPositions.data(), impostorPositions.size(), viewMtx, projMtx, cameraPosition,
+                                 _streamBuffer);
+    }
 
+    //draw particles last so they blend over the opaque scene
+    _pParticleSystem->draw(viewMtx, projMtx);
 }
 
 void FPEngine::_updateScene() {
-    _particleSystemAngle += 0.01f;
-    if(_particleSystemAngle >= 6.28f) {
-        _particleSystemAngle -= 6.28f;
+    FP_PROFILE_SCOPE("FPEngine::_updateScene");
+    if (_pSession) {
+        _updateSession();
+        return;
     }
+    _tickGraph.run(*_pJobs);
+}
 
-    const glm::vec3 START_POSITION((STARTING_RADIUS_I + STARTING_RADIUS_O) / 2.0f, 0.0f, 0.0f);
-    const float BLINKING_DURATION = 3.0f; // Total blinking duration in seconds
-    _animationTime += 0.016f;
+void FPEngine::_buildTickGraph() {
+    // the pickups, the marbles and the vehicle share nothing but what _tickBegin captured,
+    // so they run side by side; everything that needs two of them waits for "resolve"
+    const TaskGraph::TaskID input = _tickGraph.addTask("tick input", [this] { _tickBegin(); });
+    const TaskGraph::TaskID pickups = _tickGraph.addTask("tick pickups", [this] { _tickPickups(); });
+    const TaskGraph::TaskID marbles = _tickGraph.addTask("tick marbles", [this] { _tickMarbles(); });
+    const TaskGraph::TaskID vehicle = _tickGraph.addTask("tick vehicle", [this] { _tickVehicle(); });
+    const TaskGraph::TaskID resolve = _tickGraph.addTask("tick resolve", [this] { _tickResolve(); });
+    for (TaskGraph::TaskID task : { pickups, marbles, vehicle }) {
+        _tickGraph.addDependency(input, task);
+        _tickGraph.addDependency(task, resolve);
+    }
+}
 
-    glm::vec3 currentPosition = _pVehicle->getPosition();
-    glm::vec3 newPosition = currentPosition; // Start with the current position
-    float vehicleRadius = _pVehicle->getBoundingRadius();
+void FPEngine::_tickBegin() {
+    _animationTime += SIM_TIMESTEP;
+
+    _tickState = TickState{};
+    _tickState.vehiclePosition = _pVehicle->getPosition();
+    _tickState.vehicleRadius = _pVehicle->getBoundingRadius();
+    _tickState.coinsLeft = !_coins.empty();
 
     // Spotlight hover over the vehicle
-    _spotLight.pos = currentPosition + glm::vec3(0.0f, 10.0f, 0.0f);
+    _spotLight.pos = _tickState.vehiclePosition + glm::vec3(0.0f, 10.0f, 0.0f);
     _spotLight.dir = glm::vec3(0.0f, -1.0f, 0.0f);
 
     _updateActiveCamera();
+}
+
+void FPEngine::_tickPickups() {
+    const glm::vec3& currentPosition = _tickState.vehiclePosition;
+    const float vehicleRadius = _tickState.vehicleRadius;
 
     //handle blue spheres
-    for (auto it = _blueSpheres.begin(); it != _blueSpheres.end();) {
-        if (checkCollision(_pVehicle->getPosition(), _pVehicle->getBoundingRadius(), *it, BLUE_SPHERE_RADIUS)) {
-            _initializeMarbleLocations(); // Reset marbles
-            it = _blueSpheres.erase(it); // Remove the collected sphere
+    for (size_t i = 0; i < _blueSpheres.size();) {
+        if (checkCollision(currentPosition, vehicleRadius, _blueSpheres[i], BLUE_SPHERE_RADIUS)) {
+            _tickState.resetMarbles = true; // Reset marbles
+            // the spheres have no order, the last one fills the gap
+            _blueSpheres[i] = _blueSpheres.back();
+            _blueSpheres.pop_back();
         } else {
-            ++it;
-        }
-    }
-    //handle jump
-    if (_isJumping) {
-        _jumpProgress = glm::clamp(_jumpProgress + 0.02f, 0.0f, 1.0f); // Keep progress within bounds
-
-        glm::vec3 jumpPosition = _evalBezierCurve(
-            _jumpControlPoints[0],
-            _jumpControlPoints[1],
-            _jumpControlPoints[2],
-            _jumpControlPoints[3],
-            _jumpProgress
-        );
-
-        _pVehicle->setPosition(jumpPosition);
-
-        if (_jumpProgress >= 1.0f) {
-            _isJumping = false;
-            _jumpProgress = 0.0f; // Reset progress for next jump
+            ++i;
         }
     }
 
     // Handle coin collisions
     if (!_coins.empty()) {
-        Coin coin = _coins[0];
-        const glm::vec3 &coinPosition = coin.getPosition();
+        const Coin& coin = _coins.back();
+        const glm::vec3 coinPosition = coin.getPosition();
         float coinRadius = coin.getSize(); // Coin size
-        float distance = glm::length(currentPosition - coinPosition);
 
         if (checkCollision(currentPosition, vehicleRadius, coinPosition, coinRadius)) {
             fprintf(stdout, "[INFO]: Coin collected! Removing coin at position (%.2f, %.2f, %.2f)\n",
                     coinPosition.x, coinPosition.y, coinPosition.z);
             _pVehicle->setCoinCount(_pVehicle->getCoinCount() + 1);
-            _coins.erase(_coins.begin());
+            _tickState.pickupBurst = true;
+            _tickState.pickupPosition = coinPosition;
+            _coins.pop_back();
         }
     }
+}
 
-    if (_coins.empty()) {
-        // Clear the enemies vector
-        _enemies->clear();
-        for (int i = 0; i < NUM_MARBLES; ++i) {
-            _marbleLocations[i] = glm::vec3(0, 0, 0); // Set to default position
+void FPEngine::_tickMarbles() {
+    if (!_tickState.coinsLeft) {
+        for (glm::vec3& location : _marbleLocations) {
+            location = glm::vec3(0, 0, 0); // Set to default position
         }
 
         // If you want to ensure marble directions are reset as well
-        for (int i = 0; i < NUM_MARBLES; ++i) {
-            _marbleDirections[i] = glm::vec3(0, 0, 0); // Reset directions to prevent movement
+        for (glm::vec3& direction : _marbleDirections) {
+            direction = glm::vec3(0, 0, 0); // Reset directions to prevent movement
         }
     }
 
     // Handle marble movement
-    for (int i = 0; i < 4; ++i) { // Only update the first 4 marbles
+    for (size_t i = 0; i < _marbleLocations.size(); ++i) {
         _marbleLocations[i] += glm::vec3(
             (getRand() - 0.5f) * 0.1f, // Random x direction
             0.0f,                     // No y movement
@@ -1067,29 +1197,65 @@ void FPEngine::_updateScene() {
         );
     }
 
-    // Update VBO
-    glBindBuffer(GL_ARRAY_BUFFER, _marbleVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(_marbleLocations), _marbleLocations);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
     _moveMarbles();
     _collideMarblesWithWall();
     _collideMarblesWithMarbles();
+}
 
-    if (!_isFalling && !_isBlinking && !_isJumping) {
-        // Handle player movement
-        glm::vec3 movementVector(0.0f);
-        if (_keys[GLFW_KEY_W]) movementVector += glm::vec3(sin(_pVehicle->getHeading()), 0.0f, cos(_pVehicle->getHeading())) * 0.2f;
-        if (_keys[GLFW_KEY_S]) movementVector += glm::vec3(-sin(_pVehicle->getHeading()), 0.0f, -cos(_pVehicle->getHeading())) * 0.2f;
-        if (_keys[GLFW_KEY_A]) _pVehicle->turnLeft();
-        if (_keys[GLFW_KEY_D]) _pVehicle->turnRight();
+void FPEngine::_tickVehicle() {
+    //handle jump
+    if (_isJumping) {
+        _jumpProgress = glm::clamp(_jumpProgress + 0.02f, 0.0f, 1.0f); // Keep progress within bounds
 
-        newPosition += movementVector;
+        glm::vec3 jumpPosition = _evalBezierCurve(
+            _jumpControlPoints[0],
+            _jumpControlPoints[1],
+            _jumpControlPoints[2],
+            _jumpControlPoints[3],
+            _jumpProgress
+        );
 
-        if (!isMovementValid(newPosition)) newPosition -= movementVector * 1.5f;
+        _pVehicle->setPosition(jumpPosition);
 
+        if (_jumpProgress >= 1.0f) {
+            _isJumping = false;
+            _jumpProgress = 0.0f; // Reset progress for next jump
+            _tickState.landingBurst = true;
+            _tickState.landingPosition = jumpPosition;
+        }
+    }
+
+    _tickState.vehicleMoving = !_isFalling && !_isBlinking && !_isJumping;
+    if (!_tickState.vehicleMoving) {
+        return;
+    }
+
+    // Handle player movement
+    glm::vec3 newPosition = _tickState.vehiclePosition; // Start with the current position
+    glm::vec3 movementVector(0.0f);
+    if (_keys[GLFW_KEY_W]) movementVector += glm::vec3(sin(_pVehicle->getHeading()), 0.0f, cos(_pVehicle->getHeading())) * 0.2f;
+    if (_keys[GLFW_KEY_S]) movementVector += glm::vec3(-sin(_pVehicle->getHeading()), 0.0f, -cos(_pVehicle->getHeading())) * 0.2f;
+    if (_keys[GLFW_KEY_A]) _pVehicle->turnLeft();
+    if (_keys[GLFW_KEY_D]) _pVehicle->turnRight();
+
+    newPosition += movementVector;
+
+    if (!isMovementValid(newPosition)) newPosition -= movementVector * 1.5f;
+
+    // Check the disk and rect platforms, each with a small margin
+    _tickState.newPosition = newPosition;
+    _tickState.offPlatform = !SimKernels::isOnPlatform(newPosition, _diskPlatforms.data(), _diskPlatforms.size(),
+                                                       _rectPlatforms.data(), _rectPlatforms.size());
+}
+
+void FPEngine::_tickResolve() {
+    const glm::vec3 START_POSITION = _vehicleSpawnPosition;
+    const float BLINKING_DURATION = 3.0f; // Total blinking duration in seconds
+
+    if (_tickState.vehicleMoving) {
         // Check for collisions with marbles
-        for (int i = 0; i < 4; ++i) {
-            if (checkCollision(currentPosition, vehicleRadius, _marbleLocations[i], MARBLE_RADIUS)) {
+        for (size_t i = 0; i < _marbleLocations.size(); ++i) {
+            if (checkCollision(_tickState.vehiclePosition, _tickState.vehicleRadius, _marbleLocations[i], MARBLE_RADIUS)) {
                 _isBlinking = true;
                 _blinkTimer = 0.0f;
                 _blinkingTime = 0.0f; // Track blinking duration
@@ -1097,42 +1263,18 @@ void FPEngine::_updateScene() {
             }
         }
 
-        bool isOffPlatform = true;
-
-        // Check Disk Platforms
-        for (const DiskPlatform& disk : _diskPlatforms) {
-            glm::vec3 relativePos = newPosition - disk.position;
-            float distToCenter = glm::length(glm::vec2(relativePos.x, relativePos.z));
-            if (distToCenter >= (disk.inner_radius - disk.fallBuffer) && distToCenter <= (disk.outer_radius+disk.fallBuffer)) {
-                isOffPlatform = false;
-                break; // Still on a disk platform
-            }
-        }
-
-        // Check Rect Platforms
-        for (const RectPlatform& rect : _rectPlatforms) {
-            glm::vec3 relativePos = newPosition - rect.position;
-
-            // Correct boundary check with a small margin
-            if (glm::abs(relativePos.x) <= (rect.lengthX / 2.0f + rect.fallBuffer) &&
-                glm::abs(relativePos.z) <= (rect.lengthZ / 2.0f + rect.fallBuffer)) {
-                isOffPlatform = false;
-                break; // Still on a rectangular platform
-                }
-        }
-
-        if (isOffPlatform) {
+        if (_tickState.offPlatform) {
             _isFalling = true;
             _fallTime = 0.0f;
         }
 
-        if (!_isBlinking && !isOffPlatform) {
-            _pVehicle->setPosition(newPosition);
+        if (!_isBlinking && !_tickState.offPlatform) {
+            _pVehicle->setPosition(_tickState.newPosition);
         }
     } else if (_isBlinking) {
         // Handle blinking
-        _blinkingTime += 0.016f;
-        _blinkTimer += 0.016f;
+        _blinkingTime += SIM_TIMESTEP;
+        _blinkTimer += SIM_TIMESTEP;
 
         if (_blinkTimer >= 0.2f) { // Toggle visibility every 0.2 seconds
             _blinkTimer = 0.0f;
@@ -1145,12 +1287,11 @@ void FPEngine::_updateScene() {
 
             // Reset vehicle and marbles
             _pVehicle->setPosition(START_POSITION);
-            _initializeMarbleLocations(); // Reset marbles
-
+            _tickState.resetMarbles = true;
         }
     } else if (_isFalling) {
         // Handle falling
-        _fallTime += 0.016f;
+        _fallTime += SIM_TIMESTEP;
         _pVehicle->animateFall(_fallTime);
         if (_fallTime > 3.0f) {
             _pVehicle->setPosition(START_POSITION);
@@ -1161,54 +1302,326 @@ void FPEngine::_updateScene() {
 
         }
     }
+
+    if (_tickState.resetMarbles) {
+        _initializeMarbleLocations();
+    }
+    if (_tickState.pickupBurst) {
+        _particleBursts.push(ParticleBurst{ParticleSystem::PICKUP, _tickState.pickupPosition});
+    }
+    if (_tickState.landingBurst) {
+        _particleBursts.push(ParticleBurst{ParticleSystem::LANDING, _tickState.landingPosition});
+    }
 }
 
+void FPEngine::_updateSession() {
+    _animationTime += SIM_TIMESTEP;
+
+    uint8_t buttons = 0;
+    if (_keys[GLFW_KEY_W]) buttons |= NetProtocol::BUTTON_FORWARD;
+    if (_keys[GLFW_KEY_S]) buttons |= NetProtocol::BUTTON_BACK;
+    if (_keys[GLFW_KEY_A]) buttons |= NetProtocol::BUTTON_LEFT;
+    if (_keys[GLFW_KEY_D]) buttons |= NetProtocol::BUTTON_RIGHT;
+    _pSession->tick(buttons);
+
+    if (_pSession->hasFailed()) {
+        // the world as it was last seen stays, and the marbles carry on from there locally
+        fprintf(stderr, "[ERROR]: left the session, playing alone\n");
+        _pSession->disconnect();
+        delete _pSession;
+        _pSession = nullptr;
+        _numRemoteVehicles = 0;
+        _marbleLocations.resize(_marbleDirections.size());
+        _initializeMarbleLocations();
+        return;
+    }
+    if (!_pSession->isConnected()) {
+        return;
+    }
+
+    const Vehicle& predicted = _pSession->getPredictedVehicle();
+    _pVehicle->setPosition(predicted.getPosition());
+    _pVehicle->setHeading(predicted.getHeading());
+    _spotLight.pos = predicted.getPosition() + glm::vec3(0.0f, 10.0f, 0.0f);
+    _updateActiveCamera();
+
+    // only what the server found relevant is shown, the marble list shrinks to it
+    _numRemoteVehicles = 0;
+    _marbleLocations.clear();
+    for (const SessionClient::RemoteEntity& entity : _pSession->getRemoteEntities()) {
+        if (entity.id < NetProtocol::MAX_VEHICLES) {
+            _remoteVehicles[_numRemoteVehicles++] = Vehicle::Pose{ entity.position, entity.heading, 0.0f, true };
+            continue;
+        }
+        const size_t marbleIndex = static_cast<size_t>(entity.id) - NetProtocol::MAX_VEHICLES;
+        if (marbleIndex < _marbleDirections.size()) {
+            _marbleLocations.push_back(entity.position);
+        }
+    }
+}
 
 void FPEngine::run() {
+    // the simulation runs on its own thread; this thread keeps the GL context and the window
+    FP_PROFILE_THREAD_NAME("render");
+    _publishSnapshot();
+    _simulationRunning.store(true, std::memory_order_release);
+    std::thread simulationThread(&FPEngine::_simulationLoop, this);
+
+    if (!_launchOptions.dumpDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(_launchOptions.dumpDirectory, error);
+        if (error) {
+            fprintf(stderr, "[ERROR]: could not create %s: %s\n", _launchOptions.dumpDirectory.c_str(), error.message().c_str());
+        }
+    }
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastFrameTime = startTime;
+    std::chrono::steady_clock::time_point lastStatsTime = startTime;
     while (!glfwWindowShouldClose(mpWindow)) {
-        glDrawBuffer(GL_BACK);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        FP_PROFILE_SCOPE("frame");
+        FP_TRACK_ALLOCATIONS_SCOPE();
+        _glState.beginFrame();
+        _frameArena.reset();
+        _streamBuffer.beginFrame();
+
+        // input first, the simulation applies it while the frame is being set up
+        glfwPollEvents();
+        _wakeSimulationForInput();
+
+        // the whole frame, swap included, is what has to fit the budget
+        std::chrono::steady_clock::time_point frameTime = std::chrono::steady_clock::now();
+        if (_qualityGovernor.update(std::chrono::duration<float>(frameTime - lastFrameTime).count())) {
+            _applyQualitySettings();
+        }
+        lastFrameTime = frameTime;
+        const QualityGovernor::Settings& quality = _qualityGovernor.getSettings();
 
         // Get framebuffer dimensions
         GLint framebufferWidth, framebufferHeight;
         glfwGetFramebufferSize(mpWindow, &framebufferWidth, &framebufferHeight);
 
+        if (_launchOptions.headless) {
+            // there may be no default framebuffer at all, so the frame goes to an offscreen one
+            _resizeRenderTarget(_outputFBO, _outputColorTexture, _outputDepthRenderbuffer,
+                                _outputWidth, _outputHeight, framebufferWidth, framebufferHeight);
+            glBindFramebuffer(GL_FRAMEBUFFER, _outputFBO);
+        } else {
+            glDrawBuffer(GL_BACK);
+        }
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Below full quality the scene is drawn into a smaller target and upscaled afterwards
+        const bool scaledScene = quality.resolutionScale < 1.0f;
+        GLsizei sceneWidth = framebufferWidth;
+        GLsizei sceneHeight = framebufferHeight;
+        if (scaledScene) {
+            sceneWidth = std::max(1, static_cast<GLsizei>(framebufferWidth * quality.resolutionScale));
+            sceneHeight = std::max(1, static_cast<GLsizei>(framebufferHeight * quality.resolutionScale));
+            _resizeRenderTarget(_sceneFBO, _sceneColorTexture, _sceneDepthRenderbuffer,
+                                _sceneWidth, _sceneHeight, sceneWidth, sceneHeight);
+            glBindFramebuffer(GL_FRAMEBUFFER, _sceneFBO);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
         // Set the main viewport
-        glViewport(0, 0, framebufferWidth, framebufferHeight);
+        glViewport(0, 0, sceneWidth, sceneHeight);
+
+        // latch the newest snapshot as late as possible, once it holds the input polled above
+        _awaitLatchedInput();
+        _snapshots.fetch();
+        const SceneSnapshot& snapshot = _snapshots.readBuffer();
 
         // Render the main scene
         glm::mat4 projMtx;
-        glm::mat4 viewMtx;
-
-        if (currCamera == CameraType::ARCBALL) {
-            projMtx = glm::perspective(glm::radians(45.0f), static_cast<float>(framebufferWidth) / framebufferHeight, 0.1f, 100.0f);
-            viewMtx = _pArcballCam->getViewMatrix();
-        } else if (currCamera == CameraType::FREECAM) {
-            projMtx = _pFreeCam->getProjectionMatrix();
-            viewMtx = _pFreeCam->getViewMatrix();
-        } else if (currCamera == CameraType::FIRSTPERSON) {
-            projMtx = glm::perspective(glm::radians(45.0f), static_cast<float>(framebufferWidth) / framebufferHeight, 0.1f, 100.0f);
-            viewMtx = _pFPCam->getViewMatrix();
-        } else if (currCamera == CameraType::THIRDPERSON) {
+        if (snapshot.camera == CameraType::FREECAM) {
+            projMtx = snapshot.freeCamProjMtx;
+        } else {
             projMtx = glm::perspective(glm::radians(45.0f), static_cast<float>(framebufferWidth) / framebufferHeight, 0.1f, 100.0f);
-            _pTPCam->update(_pVehicle->getPosition(), _pVehicle->getHeading());
-            viewMtx = _pTPCam->getViewMatrix();
         }
 
-        _renderScene(viewMtx, projMtx);
+        {
+            FP_PROFILE_GPU_SCOPE("particles");
+            _updateParticles(snapshot);
+        }
+
+        {
+            FP_PROFILE_GPU_SCOPE("scene");
+            _renderScene(snapshot, snapshot.viewMtx, projMtx);
+        }
+
+        if (scaledScene) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, _sceneFBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _outputFBO);
+            glBlitFramebuffer(0, 0, sceneWidth, sceneHeight, 0, 0, framebufferWidth, framebufferHeight,
+                              GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            glBindFramebuffer(GL_FRAMEBUFFER, _outputFBO);
+            glViewport(0, 0, framebufferWidth, framebufferHeight);
+        }
 
         // Render the minimap
-        _renderMinimap();
+        {
+            FP_PROFILE_GPU_SCOPE("minimap");
+            _renderMinimap(snapshot);
+        }
 
-        // Update the scene
-        _updateScene();
+        if (!_launchOptions.dumpDirectory.empty()) {
+            _dumpFrame(framebufferWidth, framebufferHeight);
+        }
 
-        glfwSwapBuffers(mpWindow);
-        glfwPollEvents();
+        if (_launchOptions.headless) {
+            // nothing is presented, wait for the GPU instead so frame times stay honest
+            FP_PROFILE_SCOPE("glFinish");
+            glFinish();
+        } else {
+            FP_PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(mpWindow);
+        }
+        _latencyProbe.recordPresent(snapshot.inputSequence);
+        ++_frameCount;
+        _glState.endFrame();
+        _streamBuffer.endFrame();
+        FP_PROFILE_FRAME_END();
+        FP_TRACK_ALLOCATIONS_FRAME_END(_frameCount);
+
+        if (_logFrameStats && frameTime - lastStatsTime >= std::chrono::seconds(1)) {
+            _logFrameStatistics();
+            lastStatsTime = frameTime;
+        }
+
+        if (_launchOptions.frameLimit != 0 && _frameCount >= _launchOptions.frameLimit) {
+            setWindowShouldClose();
+        }
+    }
+
+    if (_frameCount > 0) {
+        const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+        fprintf(stdout, "[INFO]: rendered %u frames in %.2f s (%.2f ms/frame, %.1f fps)\n",
+                _frameCount, seconds, seconds * 1000.0f / _frameCount, _frameCount / seconds);
+        _logFrameStatistics();
+    }
+    FP_TRACK_ALLOCATIONS_REPORT();
+
+    _simulationRunning.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(_simulationWakeMutex);
+    }
+    _simulationWake.notify_one();
+    simulationThread.join();
+
+    FP_PROFILE_WRITE_TRACE("fp_trace.json");
+}
+
+void FPEngine::_simulationLoop() {
+    using Clock = std::chrono::steady_clock;
+    const auto tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(SIM_TIMESTEP));
+    auto nextTick = Clock::now();
+    FP_PROFILE_THREAD_NAME("simulation");
+
+    while (_simulationRunning.load(std::memory_order_acquire)) {
+        {
+            FP_PROFILE_SCOPE("simulation tick");
+            FP_TRACK_ALLOCATIONS_SCOPE();
+            _drainInputQueue();
+
+            _updateScene();
+            ++_simulationTick;
+            _publishSnapshot();
+        }
+
+        // fixed rate; if a tick overruns, the next one starts right away instead of catching up
+        nextTick += tickDuration;
+        auto now = Clock::now();
+        if (nextTick < now) {
+            nextTick = now;
+        }
+
+        // input that arrives before the next tick is applied at once and republished without
+        // advancing the world, so the cameras answer in the frame that polled it
+        while (_simulationRunning.load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> lock(_simulationWakeMutex);
+            if (!_simulationWake.wait_until(lock, nextTick, [this] {
+                    return _inputPending || !_simulationRunning.load(std::memory_order_acquire); })) {
+                break;
+            }
+            _inputPending = false;
+            lock.unlock();
+
+            FP_PROFILE_SCOPE("simulation input");
+            FP_TRACK_ALLOCATIONS_SCOPE();
+            if (_drainInputQueue()) {
+                _publishSnapshot();
+            }
+        }
     }
 }
 
-void FPEngine::_renderMinimap() const {
+void FPEngine::_publishSnapshot() {
+    FP_PROFILE_SCOPE("FPEngine::_publishSnapshot");
+    SceneSnapshot& snapshot = _snapshots.writeBuffer();
+    snapshot.tick = _simulationTick;
+    snapshot.camera = currCamera;
+
+    if (currCamera == CameraType::ARCBALL) {
+        snapshot.viewMtx = _pArcballCam->getViewMatrix();
+        snapshot.cameraPosition = _pArcballCam->getPosition();
+    } else if (currCamera == CameraType::FREECAM) {
+        snapshot.viewMtx = _pFreeCam->getViewMatrix();
+        snapshot.freeCamProjMtx = _pFreeCam->getProjectionMatrix();
+        snapshot.cameraPosition = _pFreeCam->getPosition();
+    } else if (currCamera == CameraType::FIRSTPERSON) {
+        snapshot.viewMtx = _pFPCam->getViewMatrix();
+        snapshot.cameraPosition = _pFPCam->getPosition();
+    } else if (currCamera == CameraType::THIRDPERSON) {
+        _pTPCam->update(_pVehicle->getPosition(), _pVehicle->getHeading());
+        snapshot.viewMtx = _pTPCam->getViewMatrix();
+        snapshot.cameraPosition = _pTPCam->getPosition();
+    }
+
+    snapshot.vehicles[0] = _pVehicle->getPose();
+    std::copy(_remoteVehicles, _remoteVehicles + _numRemoteVehicles, snapshot.vehicles + 1);
+    snapshot.numVehicles = 1 + _numRemoteVehicles;
+    snapshot.marbleLocations = _marbleLocations;
+    // a session has no coins or blue spheres, they stay local to playing alone
+    if (_pSession) {
+        snapshot.blueSpheres.clear();
+    } else {
+        snapshot.blueSpheres = _blueSpheres;
+    }
+    snapshot.hasCoin = !_coins.empty() && !_pSession;
+    if (snapshot.hasCoin) {
+        snapshot.coinPosition = _coins.back().getPosition();
+        snapshot.coinSize = _coins.back().getSize();
+    }
+    snapshot.spotLight = _spotLight;
+    snapshot.animationTime = _animationTime;
+    snapshot.inputSequence = _appliedInputSequence;
+
+    _snapshots.publish();
+    _publishedInputSequence.store(_appliedInputSequence, std::memory_order_release);
+}
+
+void FPEngine::_updateParticles(const SceneSnapshot& snapshot) {
+    FP_PROFILE_SCOPE("FPEngine::_updateParticles");
+    ParticleBurst burst;
+    while (_particleBursts.pop(burst)) {
+        _pParticleSystem->emitBurst(burst.type, burst.position);
+    }
+
+    // Sparkles follow the next coin to collect
+    _pParticleSystem->setCoinEmitter(snapshot.coinPosition, snapshot.hasCoin);
+
+    // advance by the simulated time since the last frame, at most a few ticks after a stall
+    if (snapshot.tick != _lastRenderedTick) {
+        const uint64_t MAX_TICKS = 4;
+        uint64_t ticks = std::min(snapshot.tick - _lastRenderedTick, MAX_TICKS);
+        _pParticleSystem->update(ticks * SIM_TIMESTEP);
+        _lastRenderedTick = snapshot.tick;
+    }
+}
+
+void FPEngine::_renderMinimap(const SceneSnapshot& snapshot) {
+    FP_PROFILE_SCOPE("FPEngine::_renderMinimap");
     // Get framebuffer dimensions
     GLint framebufferWidth, framebufferHeight;
     glfwGetFramebufferSize(mpWindow, &framebufferWidth, &framebufferHeight);
@@ -1217,13 +1630,43 @@ void FPEngine::_renderMinimap() const {
     GLint minimapWidth = framebufferWidth / 5;
     GLint minimapHeight = framebufferHeight / 5;
 
-    // Set the minimap viewport to the top-right corner
-    glViewport(framebufferWidth - minimapWidth, framebufferHeight - minimapHeight, minimapWidth, minimapHeight);
-
     // Disable depth testing for the minimap
-    glDisable(GL_DEPTH_TEST);
-    glClear(GL_DEPTH_BUFFER_BIT); // Clear depth buffer
+    _glState.setEnabled(GL_DEPTH_TEST, false);
+
+    const GLint interval = _qualityGovernor.getSettings().minimapInterval;
+    if (interval <= 1) {
+        // Set the minimap viewport to the top-right corner
+        glViewport(framebufferWidth - minimapWidth, framebufferHeight - minimapHeight, minimapWidth, minimapHeight);
+        glClear(GL_DEPTH_BUFFER_BIT); // Clear depth buffer
+        _drawMinimap(snapshot);
+    } else {
+        // redraw into the cached image every few frames, a resize forces a redraw
+        const bool resized = minimapWidth != _minimapWidth || minimapHeight != _minimapHeight;
+        if (resized || _frameCount % static_cast<GLuint>(interval) == 0) {
+            _resizeRenderTarget(_minimapFBO, _minimapColorTexture, _minimapDepthRenderbuffer,
+                                _minimapWidth, _minimapHeight, minimapWidth, minimapHeight);
+            glBindFramebuffer(GL_FRAMEBUFFER, _minimapFBO);
+            glViewport(0, 0, minimapWidth, minimapHeight);
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            _drawMinimap(snapshot);
+            glBindFramebuffer(GL_FRAMEBUFFER, _outputFBO);
+        }
+
+        // blend the cached image over the scene like the direct draw would have been
+        glViewport(framebufferWidth - minimapWidth, framebufferHeight - minimapHeight, minimapWidth, minimapHeight);
+        _screenQuadShaderProgram->useProgram();
+        _glState.bindTexture(0, GL_TEXTURE_2D, _minimapColorTexture);
+        _glState.bindVertexArray(_screenQuadVAO);
+        _glState.drawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+
+    // Re-enable depth testing and reset viewport
+    _glState.setEnabled(GL_DEPTH_TEST, true);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+}
 
+void FPEngine::_drawMinimap(const SceneSnapshot& snapshot) const {
     // Set up orthographic projection for the minimap
     glm::mat4 projMtx = glm::ortho(
         -WORLD_SIZE / 2.0f, WORLD_SIZE / 2.0f,
@@ -1238,226 +1681,230 @@ void FPEngine::_renderMinimap() const {
     );
     viewMtx = glm::rotate(viewMtx, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-    _textureShaderProgram->useProgram();
-
-    // --- Render Disk Platforms ---
-    for (const DiskPlatform& disk : _diskPlatforms) {
-        glm::mat4 modelMtx = glm::translate(glm::mat4(1.0f), disk.position);
-        glm::mat4 mvpMtx = projMtx * viewMtx * modelMtx;
-        glUniformMatrix4fv(_textureShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMtx));
-
-        glBindTexture(GL_TEXTURE_2D, disk.textureID);
-        glBindVertexArray(disk.vao);
-        glDrawElements(GL_TRIANGLES, 6 * 100, GL_UNSIGNED_INT, nullptr); // Adjust for disk
-        glBindVertexArray(0);
-    }
+    // the minimap shows no lighting, so it uses the variants without any
+    _unlitTextureShaderProgram->useProgram();
 
-    // --- Render Rect Platforms ---
-    for (const RectPlatform& rect : _rectPlatforms) {
-        glm::mat4 modelMtx = glm::translate(glm::mat4(1.0f), rect.position);
-        glm::mat4 mvpMtx = projMtx * viewMtx * modelMtx;
-        glUniformMatrix4fv(_textureShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMtx));
-
-        glBindTexture(GL_TEXTURE_2D, rect.textureID);
-        glBindVertexArray(rect.vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr); // 6 indices for a rectangle
-        glBindVertexArray(0);
-    }
+    _glState.uniform(_unlitTextureMvpLocation, projMtx * viewMtx);
+    _drawLevelPlatforms(_unlitTexturePositionScaleLocation, _unlitTexturePositionOffsetLocation, -1);
 
     // Render the player as a green square in the minimap
-    _lightingShaderProgram->useProgram();
-    glm::mat4 playerModelMtx = glm::translate(glm::mat4(1.0f), _pVehicle->getPosition());
+    _useLightingVariant(0, LIGHTING_UNLIT_FLAT);
+    glm::mat4 playerModelMtx = glm::translate(glm::mat4(1.0f), snapshot.vehicles[0].position);
     playerModelMtx = glm::scale(playerModelMtx, glm::vec3(5.0f));
     glm::mat4 playerMVP = projMtx * viewMtx * playerModelMtx;
-    glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(playerMVP));
-    glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
-    glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
+    _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, playerMVP);
+    _glState.uniform(_lightingShaderUniformLocations.materialAmbient, glm::vec3(0.0f, 1.0f, 0.0f));
+    _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, glm::vec3(0.0f, 1.0f, 0.0f));
     CSCI441::drawSolidCube(1.0f);
+    _glState.externalDraw();
 
     // Render enemies as red squares
-    for (const glm::vec3& enemyPosition : _marbleLocations) {
+    for (const glm::vec3& enemyPosition : snapshot.marbleLocations) {
         if (enemyPosition != glm::vec3(0.0f)) {
             glm::mat4 enemyModelMtx = glm::translate(glm::mat4(1.0f), enemyPosition);
             enemyModelMtx = glm::scale(enemyModelMtx, glm::vec3(5.0f));
             glm::mat4 enemyMVP = projMtx * viewMtx * enemyModelMtx;
-            glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(enemyMVP));
-            glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(glm::vec3(1.0f, 0.0f, 0.0f)));
-            glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(glm::vec3(1.0f, 0.0f, 0.0f)));
+            _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, enemyMVP);
+            _glState.uniform(_lightingShaderUniformLocations.materialAmbient, glm::vec3(1.0f, 0.0f, 0.0f));
+            _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, glm::vec3(1.0f, 0.0f, 0.0f));
             CSCI441::drawSolidCube(1.0f);
+            _glState.externalDraw();
         }
     }
 
     // Render coins as yellow squares
-    if (!_coins.empty()) {
-        Coin coin = _coins[0];
-        glm::mat4 coinModelMtx = glm::translate(glm::mat4(1.0f), coin.getPosition());
+    if (snapshot.hasCoin) {
+        glm::mat4 coinModelMtx = glm::translate(glm::mat4(1.0f), snapshot.coinPosition);
         coinModelMtx = glm::scale(coinModelMtx, glm::vec3(5.0f)); // Size for minimap
         glm::mat4 coinMVP = projMtx * viewMtx * coinModelMtx;
-        glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(coinMVP));
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1,
-                     glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.0f))); // Yellow color
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.0f)));
+        _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, coinMVP);
+        _glState.uniform(_lightingShaderUniformLocations.materialAmbient, glm::vec3(1.0f, 1.0f, 0.0f)); // Yellow color
+        _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, glm::vec3(1.0f, 1.0f, 0.0f));
         CSCI441::drawSolidCube(1.0f);
+        _glState.externalDraw();
     }
-
-    // Re-enable depth testing and reset viewport
-    glEnable(GL_DEPTH_TEST);
-    glViewport(0, 0, framebufferWidth, framebufferHeight);
 }
 
 
-void FPEngine::_drawCoins(glm::mat4 viewMtx, glm::mat4 projMtx) const {
-    _lightingShaderProgram->useProgram();
+void FPEngine::_drawCoins(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx) const {
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT);
 
-    if (!_coins.empty()) {
-        Coin coin = _coins[0];
-        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), coin.getPosition());
+    if (snapshot.hasCoin) {
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), snapshot.coinPosition);
         modelMatrix = glm::rotate(modelMatrix, glm::radians(90.0f),
                                   glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate to align with z-axis
 
         modelMatrix = glm::scale(modelMatrix,
-                                 glm::vec3(coin.getSize(), coin.getSize(), coin.getSize() * 0.4f)); // Thicker coins
+                                 glm::vec3(snapshot.coinSize, snapshot.coinSize, snapshot.coinSize * 0.4f)); // Thicker coins
         glm::mat4 mvpMatrix = projMtx * viewMtx * modelMatrix;
 
         // Send uniforms for MVP and material properties
-        glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-        glUniformMatrix4fv(_lightingShaderUniformLocations.modelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-        glUniformMatrix3fv(_lightingShaderUniformLocations.normalMatrix, 1, GL_FALSE,
-                           glm::value_ptr(glm::transpose(glm::inverse(glm::mat3(modelMatrix)))));
+        _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, mvpMatrix);
+        _glState.uniform(_lightingShaderUniformLocations.modelMatrix, modelMatrix);
+        _glState.uniform(_lightingShaderUniformLocations.normalMatrix, glm::transpose(glm::inverse(glm::mat3(modelMatrix))));
 
         // Set consistent gold material properties
         glm::vec3 goldColor(1.0f, 0.84f, 0.0f); // Gold color
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(goldColor * 0.3f));
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(goldColor));
-        glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(glm::vec3(0.8f)));
-        glUniform1f(_lightingShaderUniformLocations.materialShininess, 64.0f);
+        _glState.uniform(_lightingShaderUniformLocations.materialAmbient, goldColor * 0.3f);
+        _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, goldColor);
+        _glState.uniform(_lightingShaderUniformLocations.materialSpecular, glm::vec3(0.8f));
+        _glState.uniform(_lightingShaderUniformLocations.materialShininess, 64.0f);
 
-        glUniformMatrix4fv(_lightingShaderUniformLocations.modelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+        _glState.uniform(_lightingShaderUniformLocations.modelMatrix, modelMatrix);
         CSCI441::drawSolidDisk(0.0f, 0.5f, 32, 1);
+        _glState.externalDraw();
+    }
+}
 
-        //***************************************************************************
-        // Draw Particle System
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDisable(GL_DEPTH_TEST);
-
-        _billboardShaderProgram->useProgram();
-        glm::mat4 partModelMatrix = glm::rotate(modelMatrix, _particleSystemAngle, CSCI441::Y_AXIS);
-        glm::mat4 mvMatrix = viewMtx * partModelMatrix;
-        _billboardShaderProgram->setProgramUniform(_billboardShaderProgramUniforms.mvMatrix, mvMatrix);
-        _billboardShaderProgram->setProgramUniform(_billboardShaderProgramUniforms.projMatrix, projMtx);
-
-        glBindVertexArray(_vaos[VAO_ID::PARTICLE_SYSTEM]);
-        glBindTexture(GL_TEXTURE_2D, _texHandles[TEXTURE_ID::PARTICLE_SYSTEM_TEX]);
-
-        // compute distances
-        glm::mat4 viewMatrix = _pArcballCam->getViewMatrix();
-        glm::vec3 forward(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
-        glm::vec3 camPosition = _pArcballCam->getPosition();
-        glm::vec3 lookAtPoint = camPosition + forward;
-
-        glm::vec3 v = lookAtPoint - _pArcballCam->getPosition();
-        for (int i = 0; i < NUM_SPRITES; i++) {
-            glm::vec3 currentSprite = _spriteLocations[_spriteIndices[i]];
-            glm::vec3 p = glm::vec4(currentSprite, 1) * partModelMatrix;
-            glm::vec3 ep = p - _pArcballCam->getPosition();
-            float vp = dot(v, ep);
-
-            _distances[i] = vp;
+void FPEngine::_drawProps(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx,
+                          FrameList<glm::vec3>& impostorPositions) {
+    //// BEGIN DRAWING THE TREES ////
+    const glm::mat4 projViewMtx = projMtx * viewMtx;
+    // Pick each tree's level once; distant trees are batched as impostors.
+    // Every tree is tested on its own, so the tests are spread over the job system
+    bool* treeVisible = _frameArena.allocate<bool>(_trees.size());
+    _pJobs->parallelFor(_trees.size(), PROPS_PER_JOB, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            const glm::vec3& treePosition = _sceneTransforms.getPosition(_trees[i].trunk);
+            treeVisible[i] = _isVisible(treePosition + TREE_BOX_MIN, treePosition + TREE_BOX_MAX);
+            if(!treeVisible[i]) continue;
+            _treeLODs[i] = _selectLOD(treePosition + TREE_BOUNDS_OFFSET, TREE_BOUNDS_RADIUS, _treeLODs[i],
+                                      viewMtx, projMtx, _pTreeImpostors ? TREE_IMPOSTOR_COVERAGE : 0.0f);
         }
+    });
+    for(size_t i = 0; i < _trees.size(); ++i) {
+        if(treeVisible[i] && _treeLODs[i] == LODMesh::NUM_LEVELS) {
+            impostorPositions.push_back(_sceneTransforms.getPosition(_trees[i].trunk));
+        }
+    }
 
-        // sort indices by distance
-        for (int i = 0; i < NUM_SPRITES; i++) {
-            for (int j = 0; j < NUM_SPRITES; j++) {
-                if (_distances[i] < _distances[j]) {
-                    GLushort swapInd = _spriteIndices[i];
-                    _spriteIndices[i] = _spriteIndices[j];
-                    _spriteIndices[j] = swapInd;
-
-                    GLfloat swapDist = _distances[i];
-                    _distances[i] = _distances[j];
-                    _distances[j] = swapDist;
-                }
-            }
+    // the spot light only follows the vehicle, most frames it reaches none of the trees
+    bool spotLightOnTrees = false;
+    for(size_t i = 0; i < _trees.size() && !spotLightOnTrees; ++i) {
+        if(!treeVisible[i] || _treeLODs[i] == LODMesh::NUM_LEVELS) continue;
+        spotLightOnTrees = _spotLightReaches(snapshot.spotLight, _sceneTransforms.getPosition(_trees[i].trunk) + TREE_BOUNDS_OFFSET, TREE_BOUNDS_RADIUS);
+    }
+    // the directional light and the lamps are baked, the material only matters to the spot light
+    _useLightingVariant(0, (spotLightOnTrees ? LIGHTING_SPOT_LIGHT : 0) | LIGHTING_PACKED_MESH | LIGHTING_BAKED);
+
+    // Draw trunks
+    _sendMaterialUniforms(TREE_AMBIENT, TRUNK_DIFFUSE, TREE_SPECULAR, TREE_SHININESS);
+    _sendPackedMeshUniforms(_treeTrunkMesh);
+    for(size_t i = 0; i < _trees.size(); ++i) {
+        if(!treeVisible[i] || _treeLODs[i] == LODMesh::NUM_LEVELS) continue;
+        _sendNodeMatrixUniforms(_trees[i].trunk, projViewMtx);
+        _sendBakedLightUniforms(_trees[i].trunk);
+        _treeTrunkMesh.draw(_treeLODs[i]);
+    }
+
+    // Draw leaves
+    _sendMaterialUniforms(TREE_AMBIENT, LEAVES_DIFFUSE, TREE_SPECULAR, TREE_SHININESS);
+    _sendPackedMeshUniforms(_treeLeavesMesh);
+    for(size_t i = 0; i < _trees.size(); ++i) {
+        if(!treeVisible[i] || _treeLODs[i] == LODMesh::NUM_LEVELS) continue;
+        _sendNodeMatrixUniforms(_trees[i].leaves, projViewMtx);
+        _sendBakedLightUniforms(_trees[i].leaves);
+        _treeLeavesMesh.draw(_treeLODs[i]);
+    }
+    //// END DRAWING THE TREES ////
+
+    //// BEGIN DRAWING THE LAMPS ////
+    bool* lampVisible = _frameArena.allocate<bool>(_lamps.size());
+    _pJobs->parallelFor(_lamps.size(), PROPS_PER_JOB, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            lampVisible[i] = _isVisible(_lamps[i].position + LAMP_BOX_MIN, _lamps[i].position + LAMP_BOX_MAX);
+            if(!lampVisible[i]) continue;
+            _lampLODs[i] = _selectLOD(_lamps[i].position + LAMP_BOUNDS_OFFSET, LAMP_BOUNDS_RADIUS, _lampLODs[i], viewMtx, projMtx);
         }
+    });
 
-        // update IBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibos[VAO_ID::PARTICLE_SYSTEM]);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLushort) * NUM_SPRITES, _spriteIndices);
+    bool spotLightOnLamps = false;
+    for(size_t i = 0; i < _lamps.size() && !spotLightOnLamps; ++i) {
+        if(!lampVisible[i]) continue;
+        spotLightOnLamps = _spotLightReaches(snapshot.spotLight, _lamps[i].position + LAMP_BOUNDS_OFFSET, LAMP_BOUNDS_RADIUS);
+    }
+    _useLightingVariant(0, (spotLightOnLamps ? LIGHTING_SPOT_LIGHT : 0) | LIGHTING_PACKED_MESH | LIGHTING_BAKED);
 
-        glDrawElements(GL_POINTS, _numVAOPoints[VAO_ID::PARTICLE_SYSTEM], GL_UNSIGNED_SHORT, (void *) 0);
+    // Draw posts
+    _sendMaterialUniforms(LAMP_POST_AMBIENT, LAMP_POST_DIFFUSE, glm::vec3(0.3f, 0.3f, 0.3f), 32.0f);
+    _sendPackedMeshUniforms(_lampPostMesh);
+    for(size_t i = 0; i < _lamps.size(); ++i) {
+        if(!lampVisible[i]) continue;
+        _sendNodeMatrixUniforms(_lamps[i].post, projViewMtx);
+        _sendBakedLightUniforms(_lamps[i].post);
+        _lampPostMesh.draw(_lampLODs[i]);
+    }
 
-        glEnable(GL_DEPTH_TEST);
+    // Draw lights
+    _sendMaterialUniforms(LAMP_BULB_AMBIENT, LAMP_BULB_DIFFUSE, glm::vec3(0.5f, 0.5f, 0.5f), 64.0f); // Blue color
+    _sendPackedMeshUniforms(_sphereMesh);
+    for(size_t i = 0; i < _lamps.size(); ++i) {
+        if(!lampVisible[i]) continue;
+        _sendNodeMatrixUniforms(_lamps[i].light, projViewMtx);
+        _sendBakedLightUniforms(_lamps[i].light);
+        _sphereMesh.draw(_lampLODs[i]);
     }
+    //// END DRAWING THE LAMPS ////
 }
 
-void FPEngine::_drawMarbles(glm::mat4 viewMtx, glm::mat4 projMtx) const {
-    _lightingShaderProgram->useProgram();
-    for (int i = 0; i < 4; ++i) {
-        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), _marbleLocations[i]);
+void FPEngine::_drawMarbles(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx) {
+    // the bodies are packed and the beaks are not, so each gets its own pass and variant
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_PACKED_MESH);
+    _sendPackedMeshUniforms(_sphereMesh);
+    const glm::vec3 marbleExtent(Marble::RADIUS);
+    bool* marbleVisible = _frameArena.allocate<bool>(snapshot.marbleLocations.size());
+    _pJobs->parallelFor(snapshot.marbleLocations.size(), PROPS_PER_JOB, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            marbleVisible[i] = _isVisible(snapshot.marbleLocations[i] - marbleExtent, snapshot.marbleLocations[i] + marbleExtent);
+            if (!marbleVisible[i]) continue;
+            _marbleLODs[i] = _selectLOD(snapshot.marbleLocations[i], Marble::RADIUS, _marbleLODs[i], viewMtx, projMtx);
+        }
+    });
+    for (size_t i = 0; i < snapshot.marbleLocations.size(); ++i) {
+        if (!marbleVisible[i]) continue;
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), snapshot.marbleLocations[i]);
         modelMatrix = glm::scale(modelMatrix, glm::vec3(Marble::RADIUS)); // Scale marble
         glm::mat4 mvpMatrix = projMtx * viewMtx * modelMatrix;
 
         // Set material properties for marble
-        glm::vec3 marbleColor(1.0f, 0.0f, 0.0f);
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(marbleColor * 0.3f));
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(marbleColor));
-        glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(glm::vec3(0.5f)));
-        glUniform1f(_lightingShaderUniformLocations.materialShininess, 32.0f);
+        _glState.uniform(_lightingShaderUniformLocations.materialAmbient, MARBLE_COLOR * 0.3f);
+        _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, MARBLE_COLOR);
+        _glState.uniform(_lightingShaderUniformLocations.materialSpecular, glm::vec3(0.5f));
+        _glState.uniform(_lightingShaderUniformLocations.materialShininess, 32.0f);
 
-        glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-        CSCI441::drawSolidSphere(Marble::RADIUS, 16, 16);
+        _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, mvpMatrix);
+        _sphereMesh.draw(_marbleLODs[i]);
+    }
 
-        // Render the animated beak
-        _animateBeak(i, viewMtx, projMtx);
+    // Render the animated beaks
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT);
+    for (size_t i = 0; i < snapshot.marbleLocations.size(); ++i) {
+        if (!marbleVisible[i]) continue;
+        _animateBeak(snapshot.marbleLocations[i], snapshot.animationTime, viewMtx, projMtx);
     }
 }
 
 void FPEngine::_drawBeakTriangle(bool isTop) const {
-    GLfloat beakVertices[] = {
-        0.0f, 0.2f, 0.0f,  // Tip of the triangle
-        -0.1f, 0.0f, 0.15f, // Left corner
-        0.1f, 0.0f, 0.15f   // Right corner
-    };
-
-    if (!isTop) {
-        for (int i = 1; i < 9; i += 3) {
-            beakVertices[i] -= 0.15f; // Lower the triangle for the bottom beak
-        }
-    }
-
-    GLuint beakVBO;
-    glGenBuffers(1, &beakVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, beakVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(beakVertices), beakVertices, GL_STATIC_DRAW);
-
-    // Bind and enable vertex attributes
-    glEnableVertexAttribArray(_lightingShaderAttributeLocations.vPos);
-    glVertexAttribPointer(_lightingShaderAttributeLocations.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-
-    // Cleanup
-    glDisableVertexAttribArray(_lightingShaderAttributeLocations.vPos);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glDeleteBuffers(1, &beakVBO);
+    // both triangles live in one buffer, the top one first
+    _glState.bindVertexArray(_beakVAO);
+    _glState.drawArrays(GL_TRIANGLES, isTop ? 0 : 3, 3);
 }
 
 
-void FPEngine::_animateBeak(int marbleIndex, glm::mat4 viewMtx, glm::mat4 projMtx) const {
+void FPEngine::_animateBeak(const glm::vec3& marbleLocation, float animationTime, glm::mat4 viewMtx, glm::mat4 projMtx) const {
     // Oscillation
-    float beakOffset = glm::sin(_animationTime * 2.0f) * 0.05f; // Faster oscillation
+    float beakOffset = glm::sin(animationTime * 2.0f) * 0.05f; // Faster oscillation
 
     // Rotation
-    float rotationAngle = _animationTime * glm::radians(45.0f); // Rotate 45 degrees per second
+    float rotationAngle = animationTime * glm::radians(45.0f); // Rotate 45 degrees per second
     glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), rotationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
 
     // Scaling (pulsating)
-    float scaleFactor = 1.0f + glm::sin(_animationTime * 3.0f) * 0.1f; // Pulsate between 1.0 and 1.1
+    float scaleFactor = 1.0f + glm::sin(animationTime * 3.0f) * 0.1f; // Pulsate between 1.0 and 1.1
     glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(scaleFactor));
 
     // Base transformation (marble position)
-    glm::mat4 baseMatrix = glm::translate(glm::mat4(1.0f), _marbleLocations[marbleIndex]);
+    glm::mat4 baseMatrix = glm::translate(glm::mat4(1.0f), marbleLocation);
 
     // Apply transformations for the top beak
     glm::mat4 topBeakMatrix = baseMatrix * rotationMatrix * scaleMatrix;
@@ -1465,7 +1912,7 @@ void FPEngine::_animateBeak(int marbleIndex, glm::mat4 viewMtx, glm::mat4 projMt
     glm::mat4 topMVP = projMtx * viewMtx * topBeakMatrix;
 
     // Send matrix to the shader and draw the top triangle
-    glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(topMVP));
+    _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, topMVP);
     _drawBeakTriangle(true);
 
     // Apply transformations for the bottom beak
@@ -1474,7 +1921,7 @@ void FPEngine::_animateBeak(int marbleIndex, glm::mat4 viewMtx, glm::mat4 projMt
     glm::mat4 bottomMVP = projMtx * viewMtx * bottomBeakMatrix;
 
     // Send matrix to the shader and draw the bottom triangle
-    glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(bottomMVP));
+    _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, bottomMVP);
     _drawBeakTriangle(false);
 }
 
@@ -1484,13 +1931,29 @@ void FPEngine::_animateBeak(int marbleIndex, glm::mat4 viewMtx, glm::mat4 projMt
 
 void FPEngine::mCleanupShaders() {
     fprintf( stdout, "[INFO]: ...deleting Shaders.\n" );
-    delete _lightingShaderProgram;
-    delete _textureShaderProgram;
+    // the lighting and texture programs belong to their permutations
+    delete _pLightingPermutations;
+    delete _pTexturePermutations;
+    delete _screenQuadShaderProgram;
+    _lightingVariants.clear();
+    _lightingShaderProgram = nullptr;
+    _textureShaderProgram = nullptr;
+    _screenQuadShaderProgram = nullptr;
+    _pLightingPermutations = nullptr;
+    _pTexturePermutations = nullptr;
+    _unlitTextureShaderProgram = nullptr;
+    if (_pShaderCache) {
+        fprintf( stdout, "[INFO]: ...shader cache: %zu programs loaded from binaries, %zu compiled\n",
+                 _pShaderCache->getNumHits(), _pShaderCache->getNumMisses() );
+    }
+    delete _pShaderCache;
+    _pShaderCache = nullptr;
 }
 
 void FPEngine::mCleanupBuffers() {
     fprintf( stdout, "[INFO]: ...deleting VAOs....\n" );
     CSCI441::deleteObjectVAOs();
+    FP_PROFILE_GPU_CLEANUP();
     glDeleteVertexArrays( 1, &_groundVAO );
 
     fprintf( stdout, "[INFO]: ...deleting VBOs....\n" );
@@ -1498,14 +1961,44 @@ void FPEngine::mCleanupBuffers() {
 
     fprintf( stdout, "[INFO]: ...deleting models..\n" );
     delete _pVehicle;
+    _vehicleMesh.cleanup();
+    _streamBuffer.cleanup();
+
+    glDeleteVertexArrays(1, &_levelVAO);
+    glDeleteBuffers(1, &_levelVBO);
+    glDeleteBuffers(1, &_levelEBO);
+    _level.close();
 
     glDeleteVertexArrays(1, &_archVAO);
+    glDeleteVertexArrays(1, &_beakVAO);
+    glDeleteBuffers(1, &_beakVBO);
+
+    _pParticleSystem->cleanup();
+
+    _treeTrunkMesh.cleanup();
+    _treeLeavesMesh.cleanup();
+    _lampPostMesh.cleanup();
+    _sphereMesh.cleanup();
+    if (_pTreeImpostors) _pTreeImpostors->cleanup();
+    if (_pGpuRenderer) _pGpuRenderer->cleanup();
+
+    glDeleteVertexArrays(1, &_screenQuadVAO);
+    glDeleteFramebuffers(1, &_sceneFBO);
+    glDeleteTextures(1, &_sceneColorTexture);
+    glDeleteRenderbuffers(1, &_sceneDepthRenderbuffer);
+    glDeleteFramebuffers(1, &_minimapFBO);
+    glDeleteTextures(1, &_minimapColorTexture);
+    glDeleteRenderbuffers(1, &_minimapDepthRenderbuffer);
+    glDeleteFramebuffers(1, &_outputFBO);
+    glDeleteTextures(1, &_outputColorTexture);
+    glDeleteRenderbuffers(1, &_outputDepthRenderbuffer);
 }
 
 void FPEngine::mCleanupTextures() {
     fprintf( stdout, "[INFO]: ...deleting textures\n" );
     // TODO #23 - delete textures
     glDeleteTextures(1, &_texHandles[RUG]);
+    glDeleteTextures(1, &_lightmapTexture);
 
 }
 
@@ -1513,8 +2006,9 @@ void FPEngine::mCleanupTextures() {
 //
 // Private Helper Functions
 
-void FPEngine::_drawBlueSpheres(glm::mat4 viewMtx, glm::mat4 projMtx) const {
-    _lightingShaderProgram->useProgram();
+void FPEngine::_drawBlueSpheres(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx) const {
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_PACKED_MESH);
+    _sendPackedMeshUniforms(_sphereMesh);
 
     // Define material properties for blue spheres
     glm::vec3 blueColor(0.0f, 0.0f, 1.0f);   // Blue diffuse color
@@ -1522,103 +2016,59 @@ void FPEngine::_drawBlueSpheres(glm::mat4 viewMtx, glm::mat4 projMtx) const {
     glm::vec3 specularColor(0.3f, 0.3f, 0.5f); // Light specular reflection
     float shininess = 32.0f;
 
-    for (const glm::vec3& spherePos : _blueSpheres) {
+    _blueSphereLODs.resize(snapshot.blueSpheres.size(), 0);
+    for (size_t i = 0; i < snapshot.blueSpheres.size(); ++i) {
+        const glm::vec3& spherePos = snapshot.blueSpheres[i];
+        if (!_isVisible(spherePos - glm::vec3(BLUE_SPHERE_RADIUS), spherePos + glm::vec3(BLUE_SPHERE_RADIUS))) continue;
         glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), spherePos);
         glm::mat4 mvpMatrix = projMtx * viewMtx * modelMatrix;
 
         // Set uniforms for transformations
-        glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-        glUniformMatrix4fv(_lightingShaderUniformLocations.modelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+        _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, mvpMatrix);
+        _glState.uniform(_lightingShaderUniformLocations.modelMatrix, modelMatrix);
 
         // Set material properties for the blue sphere
-        glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(ambientColor));
-        glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(blueColor));
-        glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(specularColor));
-        glUniform1f(_lightingShaderUniformLocations.materialShininess, shininess);
+        _glState.uniform(_lightingShaderUniformLocations.materialAmbient, ambientColor);
+        _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, blueColor);
+        _glState.uniform(_lightingShaderUniformLocations.materialSpecular, specularColor);
+        _glState.uniform(_lightingShaderUniformLocations.materialShininess, shininess);
 
         // Draw the sphere
-        CSCI441::drawSolidSphere(BLUE_SPHERE_RADIUS, 16, 16);
+        _blueSphereLODs[i] = _selectLOD(spherePos, BLUE_SPHERE_RADIUS, _blueSphereLODs[i], viewMtx, projMtx);
+        _sphereMesh.draw(_blueSphereLODs[i]);
     }
 }
 
 void FPEngine::_initializeBlueSpheres() {
     _blueSpheres.clear(); // Clear any previous spheres
-    const float HEIGHT_OFFSET = 1.0f; // Height above the platform
-    const int MAX_TRIES = 50;         // Max attempts to find a valid position
-
-    // Function to check if position is within a disk platform
-    auto isOnDiskPlatform = [](const glm::vec3& pos, const DiskPlatform& disk) {
-        float dist = glm::length(glm::vec2(pos.x - disk.position.x, pos.z - disk.position.z));
-        return dist >= disk.inner_radius && dist <= disk.outer_radius;
-    };
-
-    // Place blue spheres on disk platforms
-    for (const DiskPlatform& disk : _diskPlatforms) {
-        glm::vec3 position;
-        int tries = 0;
-
-        do {
-            float angle = getRand() * 2.0f * M_PI; // Random angle
-            float radius = disk.inner_radius + getRand() * (disk.outer_radius - disk.inner_radius);
-            float x = disk.position.x + radius * cos(angle);
-            float z = disk.position.z + radius * sin(angle);
-            position = glm::vec3(x, HEIGHT_OFFSET, z);
-            tries++;
-        } while (!isOnDiskPlatform(position, disk) && tries < MAX_TRIES);
-
-        if (tries < MAX_TRIES) {
-            _blueSpheres.push_back(position);
-        } else {
-            fprintf(stderr, "Failed to place blue sphere on a disk platform\n");
-        }
-    }
-
-    // Function to check if position is within a rectangle platform
-    auto isOnRectPlatform = [](const glm::vec3& pos, const RectPlatform& rect) {
-        glm::vec3 relativePos = pos - rect.position;
-        return glm::abs(relativePos.x) <= rect.lengthX / 2.0f && glm::abs(relativePos.z) <= rect.lengthZ / 2.0f;
-    };
-
-    // Place blue spheres on rectangle platforms
-    for (const RectPlatform& rect : _rectPlatforms) {
-        glm::vec3 position;
-        int tries = 0;
-
-        do {
-            float x = rect.position.x + (getRand() - 0.5f) * rect.lengthX;
-            float z = rect.position.z + (getRand() - 0.5f) * rect.lengthZ;
-            position = glm::vec3(x, HEIGHT_OFFSET, z);
-            tries++;
-        } while (!isOnRectPlatform(position, rect) && tries < MAX_TRIES);
-
-        if (tries < MAX_TRIES) {
-            _blueSpheres.push_back(position);
-        } else {
-            fprintf(stderr, "Failed to place blue sphere on a rectangle platform\n");
+    for (size_t i = 0; i < _level.getNumPickups(); ++i) {
+        const LevelFormat::Pickup& pickup = _level.getPickups()[i];
+        if (pickup.type == LevelFormat::PICKUP_BLUE_SPHERE) {
+            _blueSpheres.push_back(glm::make_vec3(pickup.position));
         }
     }
 }
 
 void FPEngine::_drawArch(glm::mat4 viewMtx, glm::mat4 projMtx) const {
-    _lightingShaderProgram->useProgram();
+    _useLightingVariant(_numPointLights, LIGHTING_SPOT_LIGHT | LIGHTING_PACKED_MESH);
+    _sendPackedMeshUniforms(_archPositionScale, _archPositionOffset);
 
 glm::mat4 modelMatrix = glm::mat4(1.0f);
     modelMatrix = glm::translate(modelMatrix, glm::vec3(25.0f, 0.0f, 0.0f)); // Position on one side
 
     glm::mat4 mvpMatrix = projMtx * viewMtx * modelMatrix;
 
-    glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+    _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, mvpMatrix);
 
     // Material properties for the arch
     glm::vec3 archColor(0.0f, 0.0f, 1.0f);
-    glUniform3fv(_lightingShaderUniformLocations.materialAmbient, 1, glm::value_ptr(archColor * 0.3f));
-    glUniform3fv(_lightingShaderUniformLocations.materialDiffuse, 1, glm::value_ptr(archColor));
-    glUniform3fv(_lightingShaderUniformLocations.materialSpecular, 1, glm::value_ptr(glm::vec3(0.2f)));
-    glUniform1f(_lightingShaderUniformLocations.materialShininess, 32.0f);
+    _glState.uniform(_lightingShaderUniformLocations.materialAmbient, archColor * 0.3f);
+    _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, archColor);
+    _glState.uniform(_lightingShaderUniformLocations.materialSpecular, glm::vec3(0.2f));
+    _glState.uniform(_lightingShaderUniformLocations.materialShininess, 32.0f);
 
-    glBindVertexArray(_archVAO);
-    glDrawElements(GL_TRIANGLES, _numArchPoints, GL_UNSIGNED_INT, nullptr);
-    glBindVertexArray(0);
+    _glState.bindVertexArray(_archVAO);
+    _glState.drawElements(GL_TRIANGLES, _numArchPoints, GL_UNSIGNED_SHORT, nullptr);
 }
 
 
@@ -1630,7 +2080,7 @@ void FPEngine::_createArchBuffers() {
     const float INNER_RADIUS = 13.0f;          // Starting radius
     const float OUTER_RADIUS = 15.0f;
     std::vector<GLfloat> vertices;
-    std::vector<GLuint> indices;
+    std::vector<GLushort> indices;
 
     // Generate vertices for the arch
     for (int i = 0; i <= NUM_SEGMENTS; ++i) {
@@ -1667,6 +2117,22 @@ void FPEngine::_createArchBuffers() {
         }
     }
 
+    std::vector<uint32_t> remap;
+    MeshOptimizer::logReport("arch", MeshOptimizer::optimize(indices.data(), indices.size(), vertices.size() / 3,
+                                                             vertices.data(), 3, remap));
+    MeshOptimizer::remapVertices(remap, vertices, 3);
+
+    // Pack the positions inside the arch's bounds, it has no normals
+    const float archMin[3] = { -OUTER_RADIUS, 0.0f, -OUTER_RADIUS };
+    const float archMax[3] = { OUTER_RADIUS, MAX_HEIGHT, 0.0f };
+    const PackedVertex::PositionDecode decode = PackedVertex::decodeForBounds(archMin, archMax);
+    _archPositionScale = glm::make_vec3(decode.scale);
+    _archPositionOffset = glm::make_vec3(decode.offset);
+    std::vector<PackedVertex::PositionNormal> packed(vertices.size() / 3, PackedVertex::PositionNormal{});
+    for (size_t i = 0; i < packed.size(); ++i) {
+        PackedVertex::packPosition(decode, &vertices[i * 3], packed[i].position);
+    }
+
     // Create VAO and VBO for the arch
     GLuint archVBO, archEBO;
     glGenVertexArrays(1, &_archVAO);
@@ -1674,14 +2140,15 @@ void FPEngine::_createArchBuffers() {
 
     glGenBuffers(1, &archVBO);
     glBindBuffer(GL_ARRAY_BUFFER, archVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex::PositionNormal), packed.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &archEBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, archEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0); // Vertex positions
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(0); // Vertex positions, plain shorts the shader scales
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex::PositionNormal),
+                          (void*)offsetof(PackedVertex::PositionNormal, position));
 
     glBindVertexArray(0);
 
@@ -1691,118 +2158,49 @@ void FPEngine::_createArchBuffers() {
 
 
 void FPEngine::_initializeCoins() {
-    const int NUM_COINS_PER_PLATFORM = 10; // Number of coins per platform
-    const float COIN_HEIGHT = 1.0f;
-    const float FLOATING_HEIGHT = 3.0f; // Coins 4 units in the air
-
     _coins.clear(); // Clear any existing coins before regeneration
-
-    // Generate coins for Disk Platforms
-    for (const DiskPlatform& disk : _diskPlatforms) {
-        float minRadius = disk.inner_radius + 1.0f; // Buffer of 1 unit
-        float maxRadius = disk.outer_radius - 1.0f;
-
-        for (int i = 0; i < NUM_COINS_PER_PLATFORM; ++i) {
-            float angle = getRand() * 2.0f * M_PI;
-            float radius = minRadius + getRand() * (maxRadius - minRadius);
-            float x = radius * cos(angle);
-            float z = radius * sin(angle);
-
-            // Randomly decide if the coin will float
-            float y = (getRand() > 0.7f) ? COIN_HEIGHT + FLOATING_HEIGHT : COIN_HEIGHT;
-
-            glm::vec3 position = disk.position + glm::vec3(x, y, z);
-            _coins.emplace_back(position, 1.0f); // Add the coin
-        }
-    }
-
-    // Generate coins for Rectangular Platforms
-    for (const RectPlatform& rect : _rectPlatforms) {
-        float minX = -rect.lengthX / 2.0f + 1.0f; // Buffer of 1 unit
-        float maxX = rect.lengthX / 2.0f - 1.0f;
-        float minZ = -rect.lengthZ / 2.0f + 1.0f;
-        float maxZ = rect.lengthZ / 2.0f - 1.0f;
-
-        for (int i = 0; i < NUM_COINS_PER_PLATFORM; ++i) {
-            float x = getRand() * (maxX - minX) + minX;
-            float z = getRand() * (maxZ - minZ) + minZ;
-
-            glm::vec3 position = rect.position + glm::vec3(x, 1, z);
-            _coins.emplace_back(position, 1.0f); // Add the coin
+    // last pickup first, so the coin to collect next is at the back and taking it is a pop_back
+    for (size_t i = _level.getNumPickups(); i-- > 0;) {
+        const LevelFormat::Pickup& pickup = _level.getPickups()[i];
+        if (pickup.type == LevelFormat::PICKUP_COIN) {
+            _coins.emplace_back(glm::make_vec3(pickup.position), 1.0f); // Add the coin
         }
     }
 }
 
 void FPEngine::_initializeMarbleLocations() {
-    // Initialize marbles at the four corners of the platform
-    _marbleLocations[0] = glm::vec3(-WORLD_SIZE / 2.0f, Marble::RADIUS, -WORLD_SIZE / 2.0f); // Bottom-left
-    _marbleLocations[1] = glm::vec3(-WORLD_SIZE / 2.0f, Marble::RADIUS, WORLD_SIZE / 2.0f);  // Top-left
-    _marbleLocations[2] = glm::vec3(WORLD_SIZE / 2.0f, Marble::RADIUS, -WORLD_SIZE / 2.0f);  // Bottom-right
-    _marbleLocations[3] = glm::vec3(WORLD_SIZE / 2.0f, Marble::RADIUS, WORLD_SIZE / 2.0f);   // Top-right
-
-    // Initialize directions to point toward the center (initial vehicle location)
-    for (int i = 0; i < 4; ++i) {
-        _marbleDirections[i] = glm::normalize(glm::vec3(0.0f, 0.0f, 0.0f) - _marbleLocations[i]); // Center is (0,0,0)
+    // Initialize marbles at the level's marble spawn points
+    size_t marble = 0;
+    for (size_t i = 0; i < _level.getNumSpawns(); ++i) {
+        const LevelFormat::Spawn& spawn = _level.getSpawns()[i];
+        if (spawn.type != LevelFormat::SPAWN_MARBLE) continue;
+        _marbleLocations[marble] = glm::make_vec3(spawn.position);
+
+        // Initialize directions to point toward the center (initial vehicle location)
+        _marbleDirections[marble] = glm::normalize(glm::vec3(0.0f, 0.0f, 0.0f) - _marbleLocations[marble]); // Center is (0,0,0)
+        ++marble;
     }
 }
 
 void FPEngine::_collideMarblesWithWall() {
-    for (int i = 0; i < NUM_MARBLES; ++i) {
-        if (_marbleLocations[i].x > WORLD_SIZE / 2.0f - Marble::RADIUS || _marbleLocations[i].x < -WORLD_SIZE / 2.0f + MARBLE_RADIUS) {
-            _marbleDirections[i].x *= -1.0f;
-        }
-        if (_marbleLocations[i].z > WORLD_SIZE / 2.0f - Marble::RADIUS || _marbleLocations[i].z < -WORLD_SIZE / 2.0f + MARBLE_RADIUS) {
-            _marbleDirections[i].z *= -1.0f;
-        }
-    }
+    FP_PROFILE_SCOPE("FPEngine::_collideMarblesWithWall");
+    SimKernels::bounceMarblesOffWalls(_marbleLocations.data(), _marbleDirections.data(), _marbleLocations.size(),
+                                      WORLD_SIZE / 2.0f, Marble::RADIUS);
 }
 
 void FPEngine::_moveMarbles() {
-    glm::vec3 heroPosition = _pVehicle->getPosition();
-
-    for (int i = 0; i < NUM_MARBLES; ++i) {
-        glm::vec3 toHero = glm::normalize(heroPosition - _marbleLocations[i]); // Vector pointing to Hero
-        glm::vec3 currentDirection = _marbleDirections[i];                    // Current heading of the marble
-
-        // Calculate the angular step toward the Hero
-        const float angleStep = 0.07f; // Adjust this value to control turning speed
-        float dotProduct = glm::dot(currentDirection, toHero); // Cosine of the angle between current heading and target direction
-        dotProduct = glm::clamp(dotProduct, -1.0f, 1.0f); // Clamp to avoid numerical issues
-        float angleToHero = acos(dotProduct);             // Calculate the angle to the Hero
-
-        // Check if adjustment is needed
-        if (angleToHero > 0.001f) { // Threshold to avoid jitter when nearly aligned
-            glm::vec3 rotationAxis = glm::normalize(glm::cross(currentDirection, toHero)); // Axis of rotation
-            if (glm::length(rotationAxis) > 0.0f) { // Ensure the vectors are not parallel
-                glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::min(angleStep, angleToHero), rotationAxis);
-                glm::vec4 newDirection = rotationMatrix * glm::vec4(currentDirection, 0.0f); // Apply the rotation
-                _marbleDirections[i] = glm::normalize(glm::vec3(newDirection)); // Update marble heading
-            }
-        }
-
-        // Move the marble forward along its new heading
-        _marbleLocations[i] += _marbleDirections[i] * MARBLE_SPEED * 0.35f;
-
-        // Keep the marbles at the correct height (on the ground)
-        _marbleLocations[i].y = Marble::RADIUS;
-    }
+    FP_PROFILE_SCOPE("FPEngine::_moveMarbles");
+    // each marble steers on its own, towards where the vehicle was when the tick began
+    _pJobs->parallelFor(_marbleLocations.size(), MARBLES_PER_JOB, [this](size_t begin, size_t end) {
+        SimKernels::steerMarbles(_marbleLocations.data() + begin, _marbleDirections.data() + begin, end - begin,
+                                 _tickState.vehiclePosition, MARBLE_SPEED * 0.35f, Marble::RADIUS);
+    });
 }
 
 
 void FPEngine::_collideMarblesWithMarbles() {
-    for (int i = 0; i < NUM_MARBLES; ++i) {
-        for (int j = i + 1; j < NUM_MARBLES; ++j) {
-            glm::vec3 diff = _marbleLocations[j] - _marbleLocations[i];
-            float dist = glm::length(diff);
-            if (dist < 2 * Marble::RADIUS) {
-                glm::vec3 normal = glm::normalize(diff);
-                glm::vec3 relativeVel = _marbleDirections[j] - _marbleDirections[i];
-                float dot = glm::dot(relativeVel, normal);
-                _marbleDirections[i] += dot * normal;
-                _marbleDirections[j] -= dot * normal;
-            }
-        }
-    }
+    FP_PROFILE_SCOPE("FPEngine::_collideMarblesWithMarbles");
+    SimKernels::collideMarbles(_marbleLocations.data(), _marbleDirections.data(), _marbleLocations.size(), Marble::RADIUS);
 }
 
 void FPEngine::_updateActiveCamera() {
@@ -1818,66 +2216,358 @@ void FPEngine::_updateActiveCamera() {
     }
 }
 
-void FPEngine::generateTorusMesh(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices,
-                       float innerRadius, float outerRadius, int numSides, int numRings) {
-    for (int ring = 0; ring <= numRings; ++ring) {
-        float theta = (float)ring / numRings * 2.0f * M_PI;
-        float cosTheta = cos(theta);
-        float sinTheta = sin(theta);
+void FPEngine::_setupLODMeshes() {
+    // same shapes the CSCI441 calls used to draw, at every level of detail
+    _treeTrunkMesh = LODMesh::createCylinder(1.0f, 1.0f, 5.0f);
+    _treeLeavesMesh = LODMesh::createCone(3.0f, 8.0f);
+    _lampPostMesh = LODMesh::createCylinder(0.2f, 0.2f, 7.0f);
+    _sphereMesh = LODMesh::createSphere(0.5f);
+
+    _treeLODs.assign(_trees.size(), 0);
+    _lampLODs.assign(_lamps.size(), 0);
+    _marbleLODs.assign(_marbleLocations.size(), 0);
+
+    fprintf(stdout, "[INFO]: LOD meshes created, tree triangles per level: %d/%d/%d/%d\n",
+            _treeTrunkMesh.getNumTriangles(0) + _treeLeavesMesh.getNumTriangles(0),
+            _treeTrunkMesh.getNumTriangles(1) + _treeLeavesMesh.getNumTriangles(1),
+            _treeTrunkMesh.getNumTriangles(2) + _treeLeavesMesh.getNumTriangles(2),
+            _treeTrunkMesh.getNumTriangles(3) + _treeLeavesMesh.getNumTriangles(3));
+    MeshOptimizer::Report cacheReport = _treeTrunkMesh.getCacheReport();
+    cacheReport += _treeLeavesMesh.getCacheReport();
+    cacheReport += _lampPostMesh.getCacheReport();
+    cacheReport += _sphereMesh.getCacheReport();
+    MeshOptimizer::logReport("LOD meshes", cacheReport);
+}
+
+void FPEngine::_bakeTreeImpostors() {
+    // the tree spans the cone's radius and reaches the top of the leaves at y = 13
+    _pTreeImpostors = new ImpostorAtlas(8, 128, 256);
+    if (!_pTreeImpostors->setup(3.0f, 13.0f, *_pShaderCache)) {
+        delete _pTreeImpostors;
+        _pTreeImpostors = nullptr;
+        return;
+    }
+
+    // bake with the directional light only; point lights barely reach distant trees
+    _useLightingVariant(0, LIGHTING_PACKED_MESH);
+    _glState.uniform(_lightingShaderUniformLocations.dirLightDirection, DIR_LIGHT_DIRECTION);
+    _glState.uniform(_lightingShaderUniformLocations.dirLightColor, DIR_LIGHT_COLOR);
+
+    glm::mat4 trunkMtx(1.0f);
+    glm::mat4 leavesMtx = glm::translate(trunkMtx, glm::vec3(0, 5, 0));
+    glm::mat4 projMtx = _pTreeImpostors->getBakeProjectionMatrix();
+
+    for (GLuint view = 0; view < _pTreeImpostors->getNumViews(); ++view) {
+        _pTreeImpostors->beginBake(view);
+        glm::mat4 viewMtx = _pTreeImpostors->getBakeViewMatrix(view);
+        _glState.uniform(_lightingShaderUniformLocations.viewPos, _pTreeImpostors->getBakeEyePosition(view));
+
+        _sendMaterialUniforms(TREE_AMBIENT, TRUNK_DIFFUSE, TREE_SPECULAR, TREE_SHININESS);
+        _computeAndSendMatrixUniforms(trunkMtx, viewMtx, projMtx);
+        _sendPackedMeshUniforms(_treeTrunkMesh);
+        _treeTrunkMesh.draw(0);
+
+        _sendMaterialUniforms(TREE_AMBIENT, LEAVES_DIFFUSE, TREE_SPECULAR, TREE_SHININESS);
+        _computeAndSendMatrixUniforms(leavesMtx, viewMtx, projMtx);
+        _sendPackedMeshUniforms(_treeLeavesMesh);
+        _treeLeavesMesh.draw(0);
+    }
+    _pTreeImpostors->endBake();
+}
+
+void FPEngine::_setupOcclusionCulling() {
+    _pOcclusionCuller = new OcclusionCuller(128, 64);
+
+    // Occluders have to stay inside what they stand for, so the coarse rings
+    // keep their outer corners on the rim and push the inner ones out to the hole
+    const int OCCLUDER_SEGMENTS = 16;
+    const float segmentAngle = 2.0f * M_PI / OCCLUDER_SEGMENTS;
+    for (const DiskPlatform& disk : _diskPlatforms) {
+        float innerRadius = disk.inner_radius / cos(segmentAngle / 2.0f);
+        for (int i = 0; i < OCCLUDER_SEGMENTS; ++i) {
+            glm::vec3 dirA(cos(i * segmentAngle), 0.0f, sin(i * segmentAngle));
+            glm::vec3 dirB(cos((i + 1) * segmentAngle), 0.0f, sin((i + 1) * segmentAngle));
+            glm::vec3 innerA = disk.position + dirA * innerRadius, innerB = disk.position + dirB * innerRadius;
+            glm::vec3 outerA = disk.position + dirA * disk.outer_radius, outerB = disk.position + dirB * disk.outer_radius;
+            _platformOccluder.insert(_platformOccluder.end(), { innerA, outerA, outerB, innerA, outerB, innerB });
+        }
+    }
+    for (const RectPlatform& rect : _rectPlatforms) {
+        if (rect.textureID == 0) continue; // the hidden platform does not block anything
+        glm::vec3 halfX(rect.lengthX / 2.0f, 0.0f, 0.0f), halfZ(0.0f, 0.0f, rect.lengthZ / 2.0f);
+        glm::vec3 corners[4] = { rect.position - halfX - halfZ, rect.position + halfX - halfZ,
+                                 rect.position + halfX + halfZ, rect.position - halfX + halfZ };
+        _platformOccluder.insert(_platformOccluder.end(), { corners[0], corners[1], corners[2], corners[2], corners[3], corners[0] });
+    }
+
+    // crown cone with a coarse polygon base inscribed in the real one
+    const float CROWN_RADIUS = 3.0f, CROWN_HEIGHT = 8.0f;
+    const glm::vec3 apex(0.0f, CROWN_HEIGHT, 0.0f);
+    for (int i = 0; i < OCCLUDER_SEGMENTS / 2; ++i) {
+        float angleA = i * 2.0f * segmentAngle, angleB = (i + 1) * 2.0f * segmentAngle;
+        glm::vec3 baseA(cos(angleA) * CROWN_RADIUS, 0.0f, sin(angleA) * CROWN_RADIUS);
+        glm::vec3 baseB(cos(angleB) * CROWN_RADIUS, 0.0f, sin(angleB) * CROWN_RADIUS);
+        _crownOccluder.insert(_crownOccluder.end(), { baseA, baseB, apex });
+    }
+
+    fprintf(stdout, "[INFO]: occlusion culler using a %dx%d depth buffer, %zu platform and %zu crown occluder triangles\n",
+            _pOcclusionCuller->getWidth(), _pOcclusionCuller->getHeight(),
+            _platformOccluder.size() / 3, _crownOccluder.size() / 3 * _trees.size());
+}
+
+void FPEngine::_setupGpuDrivenRendering() {
+    if (!_launchOptions.gpuDriven) return;
+    if (!GpuDrivenRenderer::isSupported()) {
+        fprintf(stderr, "[ERROR]: --gpu-driven needs OpenGL 4.5, drawing the props one by one instead\n");
+        return;
+    }
+    _pGpuRenderer = new GpuDrivenRenderer();
+    if (!_pGpuRenderer->setup(*_pShaderCache, _numPointLights)) {
+        delete _pGpuRenderer;
+        _pGpuRenderer = nullptr;
+        return;
+    }
+
+    const GLuint trunkMesh = _pGpuRenderer->addMesh(_treeTrunkMesh);
+    const GLuint leavesMesh = _pGpuRenderer->addMesh(_treeLeavesMesh);
+    const GLuint postMesh = _pGpuRenderer->addMesh(_lampPostMesh);
+    const GLuint sphereMesh = _pGpuRenderer->addMesh(_sphereMesh);
+    // the beaks get the face normals the float buffer never had
+    GLuint beakMeshes[2];
+    for (int beak = 0; beak < 2; ++beak) {
+        const GLfloat* corners = BEAK_VERTICES + beak * 9;
+        const glm::vec3 a(corners[0], corners[1], corners[2]), b(corners[3], corners[4], corners[5]), c(corners[6], corners[7], corners[8]);
+        const glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+        std::vector<GLfloat> vertices;
+        for (const glm::vec3& corner : { a, b, c }) {
+            vertices.insert(vertices.end(), { corner.x, corner.y, corner.z, normal.x, normal.y, normal.z });
+        }
+        beakMeshes[beak] = _pGpuRenderer->addMesh(vertices, { 0, 1, 2 });
+    }
+
+    // the props never move: their node's matrix, bounds and baked light are final
+    auto addProp = [this](TransformHierarchy::Node node, GLuint mesh, const glm::vec3& boundsCenter, float boundsRadius,
+                          GLuint flags, const GpuDrivenRenderer::Material& material) {
+        GpuDrivenRenderer::Part part{};
+        part.model = _sceneTransforms.getWorldMatrix(node);
+        part.boundsCenter = boundsCenter;
+        part.boundsRadius = boundsRadius;
+        part.mesh = mesh;
+        part.anchor = GpuDrivenRenderer::NO_ANCHOR;
+        part.flags = flags | GpuDrivenRenderer::PART_BAKED;
+        part.material = material;
+        std::copy(_bakedLight[node].faces, _bakedLight[node].faces + 6, part.bakedLight);
+        _pGpuRenderer->addPart(part);
+    };
+    // trunk and crown share the tree's bounds, so they always pick the same level
+    const GLuint treeImpostor = _pTreeImpostors ? GpuDrivenRenderer::PART_USES_IMPOSTOR : 0;
+    for (const TreeData& tree : _trees) {
+        const glm::vec3 center = _sceneTransforms.getPosition(tree.trunk) + TREE_BOUNDS_OFFSET;
+        addProp(tree.trunk, trunkMesh, center, TREE_BOUNDS_RADIUS,
+                treeImpostor | (_pTreeImpostors ? GpuDrivenRenderer::PART_DRAWS_IMPOSTOR : 0),
+                { TREE_AMBIENT, TRUNK_DIFFUSE, TREE_SPECULAR, TREE_SHININESS });
+        addProp(tree.leaves, leavesMesh, center, TREE_BOUNDS_RADIUS, treeImpostor,
+                { TREE_AMBIENT, LEAVES_DIFFUSE, TREE_SPECULAR, TREE_SHININESS });
+    }
+    for (const LampData& lamp : _lamps) {
+        const glm::vec3 center = lamp.position + LAMP_BOUNDS_OFFSET;
+        addProp(lamp.post, postMesh, center, LAMP_BOUNDS_RADIUS, 0,
+                { LAMP_POST_AMBIENT, LAMP_POST_DIFFUSE, glm::vec3(0.3f, 0.3f, 0.3f), 32.0f });
+        addProp(lamp.light, sphereMesh, center, LAMP_BOUNDS_RADIUS, 0,
+                { LAMP_BULB_AMBIENT, LAMP_BULB_DIFFUSE, glm::vec3(0.5f, 0.5f, 0.5f), 64.0f });
+    }
+
+    // a marble's body and beaks hang off its anchor, its location uploaded every frame
+    const GpuDrivenRenderer::Material marbleMaterial{ MARBLE_COLOR * 0.3f, MARBLE_COLOR, glm::vec3(0.5f), 32.0f };
+    for (size_t i = 0; i < _marbleLocations.size(); ++i) {
+        GpuDrivenRenderer::Part part{};
+        part.anchor = static_cast<GLint>(i);
+        part.material = marbleMaterial;
+
+        part.model = glm::scale(glm::mat4(1.0f), glm::vec3(Marble::RADIUS));
+        part.boundsRadius = Marble::RADIUS;
+        part.mesh = sphereMesh;
+        part.flags = 0;
+        _pGpuRenderer->addPart(part);
+
+        // the beaks turn around the marble, the bounds cover the whole circle
+        part.boundsRadius = Marble::RADIUS + 0.5f;
+        part.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.1f, Marble::RADIUS));
+        part.mesh = beakMeshes[0];
+        part.flags = GpuDrivenRenderer::PART_BEAK | GpuDrivenRenderer::PART_BEAK_BOBS;
+        _pGpuRenderer->addPart(part);
+        part.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.1f, Marble::RADIUS));
+        part.mesh = beakMeshes[1];
+        part.flags = GpuDrivenRenderer::PART_BEAK;
+        _pGpuRenderer->addPart(part);
+    }
+    _pGpuRenderer->upload(_marbleLocations.size());
+}
+
+void FPEngine::_rasterizeOccluders(glm::mat4 viewMtx, glm::mat4 projMtx) const {
+    if (!_occlusionCullingEnabled) return;
+    FP_PROFILE_SCOPE("FPEngine::_rasterizeOccluders");
 
-        for (int side = 0; side <= numSides; ++side) {
-            float phi = (float)side / numSides * 2.0f * M_PI;
-            float cosPhi = cos(phi);
-            float sinPhi = sin(phi);
+    _pOcclusionCuller->beginFrame(projMtx * viewMtx);
+    _pOcclusionCuller->rasterizeTriangles(_platformOccluder.data(), _platformOccluder.size(), glm::mat4(1.0f));
+    for (const TreeData& tree : _trees) {
+        _pOcclusionCuller->rasterizeTriangles(_crownOccluder.data(), _crownOccluder.size(), _sceneTransforms.getWorldMatrix(tree.leaves));
+    }
+    _pOcclusionCuller->buildPyramid();
+}
 
-            float x = (outerRadius + innerRadius * cosPhi) * cosTheta;
-            float y = innerRadius * sinPhi;
-            float z = (outerRadius + innerRadius * cosPhi) * sinTheta;
+bool FPEngine::_isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+    return !_occlusionCullingEnabled || _pOcclusionCuller->isVisible(boxMin, boxMax);
+}
 
-            float u = (float)ring / numRings;
-            float v = (float)side / numSides;
+GLubyte FPEngine::_selectLOD(const glm::vec3& center, float radius, GLubyte currentLevel,
+                             glm::mat4 viewMtx, glm::mat4 projMtx, float impostorThreshold) const {
+    float coverage = LODMesh::screenCoverage(center, radius, viewMtx, projMtx) * _lodBias;
+    return static_cast<GLubyte>(LODMesh::selectLevel(coverage, currentLevel, impostorThreshold));
+}
 
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-            vertices.push_back(u);
-            vertices.push_back(v);
+void FPEngine::_logFrameStatistics() {
+    const GLStateCache::FrameStats& stats = _glState.getLastFrameStats();
+    fprintf(stdout, "[INFO]: last frame: %u draws, %u triangles, %u program / %u VAO / %u texture binds, "
+                    "%u state changes, %u uniform uploads, %u redundant calls skipped\n",
+            stats.drawCalls, stats.triangles, stats.programBinds, stats.vertexArrayBinds, stats.textureBinds,
+            stats.stateChanges, stats.uniformUploads, stats.elidedCalls);
+    if (_pGpuRenderer) {
+        // the indirect draw's triangles are not in the stats above, only the GPU knows them
+        const GpuDrivenRenderer::DrawCounts counts = _pGpuRenderer->readLastDrawCounts();
+        fprintf(stdout, "[INFO]: GPU-driven draw: %u of %zu parts, %u triangles, %u impostors\n",
+                counts.instances, _pGpuRenderer->getNumParts(), counts.triangles, counts.impostors);
+    }
+    fprintf(stdout, "[INFO]: stream buffer: %ld KB written last frame, %u stalls, %u overflows so far\n",
+            static_cast<long>(_streamBuffer.getBytesUsed() / 1024), _streamBuffer.getNumStalls(), _streamBuffer.getNumOverflows());
+
+    const LatencyProbe::Percentiles latency = _latencyProbe.getPercentiles(_frameArena);
+    if (latency.samples > 0) {
+        fprintf(stdout, "[INFO]: input to swap over the last %zu events: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms (late latch %s)\n",
+                latency.samples, latency.p50, latency.p90, latency.p99, latency.max,
+                _launchOptions.lateLatch ? "on" : "off");
+    }
+}
+
+void FPEngine::_resizeRenderTarget(GLuint& fbo, GLuint& colorTexture, GLuint& depthRenderbuffer,
+                                   GLsizei& currentWidth, GLsizei& currentHeight, GLsizei width, GLsizei height) {
+    if (fbo != 0 && currentWidth == width && currentHeight == height) {
+        return;
+    }
+    if (fbo == 0) {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &colorTexture);
+        glGenRenderbuffers(1, &depthRenderbuffer);
+    }
 
-            // Indices for the triangle strip
-            if (ring < numRings && side < numSides) {
-                int current = ring * (numSides + 1) + side;
-                int next = (ring + 1) * (numSides + 1) + side;
+    GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "[ERROR]: render target of %dx%d is incomplete\n", width, height);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-                indices.push_back(current);
-                indices.push_back(next);
-                indices.push_back(current + 1);
+    currentWidth = width;
+    currentHeight = height;
+}
 
-                indices.push_back(current + 1);
-                indices.push_back(next);
-                indices.push_back(next + 1);
+void FPEngine::_dumpFrame(GLsizei width, GLsizei height) {
+    FP_PROFILE_SCOPE("FPEngine::_dumpFrame");
+    GLubyte* pixels = _frameArena.allocate<GLubyte>(static_cast<size_t>(width) * height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _outputFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    const bool raw = _launchOptions.dumpFormat == LaunchOptions::DumpFormat::RAW;
+    // formatted in place, building a std::filesystem::path would allocate every frame
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/frame_%05u.%s", _launchOptions.dumpDirectory.c_str(), _frameCount, raw ? "rgba" : "ppm");
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "[ERROR]: could not open %s to dump the frame\n", path);
+        return;
+    }
+    // GL rows start at the bottom, image files at the top
+    if (raw) {
+        for (GLsizei y = height - 1; y >= 0; --y) {
+            fwrite(pixels + static_cast<size_t>(y) * width * 4, 1, static_cast<size_t>(width) * 4, file);
+        }
+    } else {
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        const size_t rowBytes = static_cast<size_t>(width) * 3;
+        GLubyte* row = _frameArena.allocate<GLubyte>(rowBytes);
+        for (GLsizei y = height - 1; y >= 0; --y) {
+            const GLubyte* source = pixels + static_cast<size_t>(y) * width * 4;
+            for (GLsizei x = 0; x < width; ++x) {
+                row[x * 3 + 0] = source[x * 4 + 0];
+                row[x * 3 + 1] = source[x * 4 + 1];
+                row[x * 3 + 2] = source[x * 4 + 2];
             }
+            fwrite(row, 1, rowBytes, file);
         }
     }
+    fclose(file);
 }
 
+void FPEngine::_applyQualitySettings() {
+    const QualityGovernor::Settings& settings = _qualityGovernor.getSettings();
+    _lodBias = settings.lodBias;
+    _pParticleSystem->setActiveFraction(settings.particleFraction);
+    fprintf(stdout, "[INFO]: quality level %d (%.1f ms average): resolution %.0f%%, LOD bias %.2f, particles %.0f%%, minimap every %d frames\n",
+            _qualityGovernor.getLevel(), _qualityGovernor.getAverageFrameSeconds() * 1000.0f,
+            settings.resolutionScale * 100.0f, settings.lodBias, settings.particleFraction * 100.0f,
+            settings.minimapInterval);
+}
+
+void FPEngine::_sendMaterialUniforms(const glm::vec3& ambient, const glm::vec3& diffuse,
+                                     const glm::vec3& specular, float shininess) const {
+    _glState.uniform(_lightingShaderUniformLocations.materialAmbient, ambient);
+    _glState.uniform(_lightingShaderUniformLocations.materialDiffuse, diffuse);
+    _glState.uniform(_lightingShaderUniformLocations.materialSpecular, specular);
+    _glState.uniform(_lightingShaderUniformLocations.materialShininess, shininess);
+}
+
+void FPEngine::_sendPackedMeshUniforms(const glm::vec3& positionScale, const glm::vec3& positionOffset) const {
+    _glState.uniform(_lightingShaderUniformLocations.packedPositionScale, positionScale);
+    _glState.uniform(_lightingShaderUniformLocations.packedPositionOffset, positionOffset);
+}
+
+void FPEngine::_sendBakedLightUniforms(TransformHierarchy::Node node) const {
+    _glState.uniform(_lightingShaderUniformLocations.bakedLight, 6, _bakedLight[node].faces);
+}
 
 void FPEngine::_computeAndSendMatrixUniforms(glm::mat4 modelMtx, glm::mat4 viewMtx, glm::mat4 projMtx) const {
     // Compute the Model-View-Projection matrix
     glm::mat4 mvpMtx = projMtx * viewMtx * modelMtx;
 
     // Send MVP matrix to shader
-    glUniformMatrix4fv(_lightingShaderUniformLocations.mvpMatrix, 1, GL_FALSE, glm::value_ptr(mvpMtx));
+    _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, mvpMtx);
 
     // Compute and send the Normal matrix
     glm::mat3 normalMtx = glm::transpose(glm::inverse(glm::mat3(modelMtx)));
-    glUniformMatrix3fv(_lightingShaderUniformLocations.normalMatrix, 1, GL_FALSE, glm::value_ptr(normalMtx));
+    _glState.uniform(_lightingShaderUniformLocations.normalMatrix, normalMtx);
 
     // Send model matrix to shader
-    glUniformMatrix4fv(_lightingShaderUniformLocations.modelMatrix, 1, GL_FALSE, glm::value_ptr(modelMtx));
+    _glState.uniform(_lightingShaderUniformLocations.modelMatrix, modelMtx);
 }
 
-GLfloat FPEngine::_randNumber( const GLfloat MAX ) {
-    return rand() / (GLfloat)RAND_MAX * MAX * 2.0 - MAX;
+void FPEngine::_sendNodeMatrixUniforms(TransformHierarchy::Node node, const glm::mat4& projViewMtx) const {
+    const glm::mat4& modelMtx = _sceneTransforms.getWorldMatrix(node);
+    _glState.uniform(_lightingShaderUniformLocations.mvpMatrix, projViewMtx * modelMtx);
+    _glState.uniform(_lightingShaderUniformLocations.normalMatrix, _sceneTransforms.getNormalMatrix(node));
+    _glState.uniform(_lightingShaderUniformLocations.modelMatrix, modelMtx);
 }
 
 //*************************************************************************************
@@ -1886,15 +2576,15 @@ GLfloat FPEngine::_randNumber( const GLfloat MAX ) {
 
 void mp_engine_keyboard_callback(GLFWwindow *window, int key, int scancode, int action, int mods ) {
     auto engine = (FPEngine*) glfwGetWindowUserPointer(window);
-    engine->handleKeyEvent(key, action, mods);
+    engine->queueKeyEvent(key, action, mods);
 }
 
 void mp_engine_cursor_callback(GLFWwindow *window, double x, double y ) {
     auto engine = (FPEngine*) glfwGetWindowUserPointer(window);
-    engine->handleCursorPositionEvent(glm::vec2(x, y));
+    engine->queueCursorPositionEvent(glm::vec2(x, y));
 }
 
 void mp_engine_mouse_button_callback(GLFWwindow *window, int button, int action, int mods ) {
     auto engine = (FPEngine*) glfwGetWindowUserPointer(window);
-    engine->handleMouseButtonEvent(button, action, mods);
+    engine->queueMouseButtonEvent(button, action, mods);
 }
\ No newline at end of file
@@ -12,15 +12,47 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <string.h>
+#include <string>
 #include <vector>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 //#include "FPSCamera.hpp"
 #include "ArcballCamera.h"
 #include "Vehicle.h"
+#include "VehicleMesh.h"
 #include "FPCamera.h"
 #include "Marble.h"
 #include "Coin.h"
 #include "TPCamera.h"
+#include "ParticleSystem.h"
+#include "LODMesh.h"
+#include "ImpostorAtlas.h"
+#include "OcclusionCuller.h"
+#include "TripleBuffer.h"
+#include "SpscQueue.h"
+#include "Profiler.h"
+#include "QualityGovernor.h"
+#include "ShaderCache.h"
+#include "GLStateCache.h"
+#include "TransformHierarchy.h"
+#include "LevelFile.h"
+#include "PackedVertex.h"
+#include "LatencyProbe.h"
+#include "SimKernels.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
+#include "SessionClient.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
+#include "LightBaker.h"
+#include "GpuDrivenRenderer.h"
+#include "StreamBuffer.h"
+#include "MeshOptimizer.h"
 
 // Forward Declarations of Callback Functions
 void mp_engine_keyboard_callback(GLFWwindow *window, int key, int scancode, int action, int mods );
@@ -34,30 +66,6 @@ enum class CameraType {
     THIRDPERSON
 };
 
-struct RectPlatform {
-    glm::vec3 position;
-    float lengthX;
-    float lengthZ;
-    GLuint vao;
-    GLuint vbo;
-    GLuint ebo;
-    GLuint textureID;
-    float buffer;
-    float fallBuffer;
-};
-
-struct DiskPlatform {
-    glm::vec3 position;
-    float inner_radius;
-    float outer_radius;
-    GLuint vao;
-    GLuint vbo;
-    GLuint ebo;
-    GLuint textureID;
-    float buffer;
-    float fallBuffer;
-};
-
 struct BezierCurve {
     glm::vec3* controlPoints = nullptr;
     GLuint numControlPoints = 0;
@@ -67,19 +75,51 @@ struct BezierCurve {
 
 extern BezierCurve _bezierCurve;
 
+/// \desc how the engine is launched, filled from the command line in main()
+struct LaunchOptions {
+    enum class ContextAPI { EGL, OSMESA };
+    enum class DumpFormat { PPM, RAW };
+
+    /// \desc no visible window, the frames are rendered into an offscreen framebuffer
+    bool headless = false;
+    /// \desc context creation API used when headless
+    ContextAPI contextAPI = ContextAPI::EGL;
+    /// \desc exit after this many frames, 0 runs until the window is closed
+    GLuint frameLimit = 0;
+    /// \desc every rendered frame is written to this directory when not empty
+    std::string dumpDirectory;
+    DumpFormat dumpFormat = DumpFormat::PPM;
+    /// \desc level compiled by fp_levelc, relative to the working directory like the shaders and images
+    std::string levelPath = "grey_havens.fplevel";
+    /// \desc the render thread waits briefly for the simulation to apply the input it just polled
+    bool lateLatch = true;
+    /// \desc "host[:port]" of an fp_server to join, playing alone when empty
+    std::string connectAddress;
+    /// \desc threads the job system uses, the calling one included; 0 means one per hardware thread
+    unsigned jobThreads = 0;
+    /// \desc asks for a GL 4.5 context and culls and draws the props on the GPU, see GpuDrivenRenderer
+    bool gpuDriven = false;
+    GLint width = 1280;
+    GLint height = 720;
+};
+
 class FPEngine final : public CSCI441::OpenGLEngine {
 public:
     BezierCurve _bezierCurve;
     static constexpr GLfloat WORLD_SIZE = 300.0f;
-    FPEngine();
+    explicit FPEngine(const LaunchOptions& options = LaunchOptions());
     ~FPEngine() final;
     CameraType currCamera = CameraType::THIRDPERSON;
     void run() final;
 
-    // Event Handlers
+    // Event Handlers, called on the simulation thread
     void handleKeyEvent(GLint key, GLint action, GLint mods);
     void handleMouseButtonEvent(GLint button, GLint action, GLint mods); // Updated to include mods
     void handleCursorPositionEvent(glm::vec2 currMousePosition);
+    // Called from the GLFW callbacks on the main thread, forward the event to the simulation
+    void queueKeyEvent(GLint key, GLint action, GLint mods);
+    void queueMouseButtonEvent(GLint button, GLint action, GLint mods);
+    void queueCursorPositionEvent(glm::vec2 currMousePosition);
     static bool checkCollision(const glm::vec3& pos1, float radius1,
                                const glm::vec3& pos2, float radius2);
     bool isMovementValid(const glm::vec3& newPosition) const;
@@ -97,43 +137,51 @@ public:
     glm::vec3 _jumpControlPoints[4]; // Control points for the Bezier curve
 
 
-    std::vector<Marble> *_enemies; // List of all enemies
     float _enemySpawnInterval = 10.0f; // Time between enemy spawns
     float _enemySpawnTimer = 0.0f;
-    GLuint _marbleVBO;
-    GLuint _marbleVAO;
-    static constexpr int NUM_MARBLES = 100;
-    glm::vec3 _marbleLocations[NUM_MARBLES];
+    /// \desc top and bottom beak triangles, drawn for every visible marble
+    GLuint _beakVAO;
+    GLuint _beakVBO;
+    /// \desc one marble per marble spawn point of the level
+    std::vector<glm::vec3> _marbleLocations;
     void _initializeMarbleLocations();
     const float MARBLE_RADIUS = 0.5f;
     const float MARBLE_SPEED = 0.1f;
-    glm::vec3 _marbleDirections[NUM_MARBLES];
+    std::vector<glm::vec3> _marbleDirections;
     std::vector<glm::vec3> _blueSpheres; // Positions of blue spheres
     float BLUE_SPHERE_RADIUS = 0.5f;
     void _initializeBlueSpheres();
-    void _drawBlueSpheres(glm::mat4 viewMtx, glm::mat4 projMtx) const;
-    void _renderMinimap() const;
+    struct SceneSnapshot;
+    void _drawBlueSpheres(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx) const;
+    void _renderMinimap(const SceneSnapshot& snapshot);
+    void _drawMinimap(const SceneSnapshot& snapshot) const;
     void _createCurve(GLuint vao, GLuint vbo, GLsizei &numVAOPoints) const;
     glm::vec3 _evalBezierCurve(const glm::vec3 P0, const glm::vec3 P1, const glm::vec3 P2, const glm::vec3 P3, const GLfloat T) const;
 
     void _collideMarblesWithWall();
     void _collideMarblesWithMarbles();
+    /// \desc steers the marbles towards the vehicle, this many to a job
     void _moveMarbles();
-    void _drawMarbles(glm::mat4 viewMtx, glm::mat4 projMtx) const;
-    void _animateBeak(int marbleIndex, glm::mat4 viewMtx, glm::mat4 projMtx) const;
+    static constexpr size_t MARBLES_PER_JOB = 256;
+    /// \desc culls and draws the trees and lamps, collecting the trees left to impostors
+    void _drawProps(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx,
+                    FrameList<glm::vec3>& impostorPositions);
+    void _drawMarbles(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx);
+    void _animateBeak(const glm::vec3& marbleLocation, float animationTime, glm::mat4 viewMtx, glm::mat4 projMtx) const;
     void _drawBeakTriangle(bool isTop) const;
 
     std::vector<Coin> _coins;
     void _initializeCoins();
-    void _drawCoins(glm::mat4 viewMtx, glm::mat4 projMtx) const;
+    void _drawCoins(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx) const;
 
     bool _isBlinking = false;        // Track if the vehicle is in blinking state
     float _blinkTimer = 0.0f;        // Timer for controlling blink intervals
     int _blinkCount = 0;             // Count the number of blinks
     float _blinkingTime = 0.0f;
     const int MAX_BLINKS = 3;
-    float STARTING_RADIUS_I = 10.0f;
-    float STARTING_RADIUS_O = 40.0f;
+    /// \desc where the vehicle starts and restarts after a fall, from the level
+    glm::vec3 _vehicleSpawnPosition = glm::vec3(0.0f);
+    float _vehicleSpawnHeading = 0.0f;
 
 private:
     // Engine Setup and Cleanup
@@ -148,14 +196,35 @@ private:
     void mCleanupTextures() final;
 
     // Rendering
-    void _renderScene(glm::mat4 viewMtx, glm::mat4 projMtx) const;
+    void _renderScene(const SceneSnapshot& snapshot, glm::mat4 viewMtx, glm::mat4 projMtx);
     void _updateScene();
-    void _initializePlatforms();
     void _drawPlatforms(glm::mat4 viewMtx, glm::mat4 projMtx) const;
+    /// \desc draws every platform with the bound texture program, uploading each one's position decode
+    void _drawLevelPlatforms(GLint positionScaleLocation, GLint positionOffsetLocation, GLint lightmapRectLocation) const;
+
+    // Level
+    /// \desc the compiled level, mapped for the lifetime of the engine
+    LevelFile _level;
+    /// \desc every platform in one buffer, uploaded straight from the level file
+    GLuint _levelVAO = 0;
+    GLuint _levelVBO = 0;
+    GLuint _levelEBO = 0;
+    /// \desc maps the level and creates the platforms, props and spawn points it describes
+    void _loadLevel();
 
     std::vector<RectPlatform> _rectPlatforms;
     std::vector<DiskPlatform> _diskPlatforms;
 
+    // Shared session
+    /// \desc set when playing on a server, which then owns the vehicle and the marbles
+    SessionClient* _pSession = nullptr;
+    /// \desc the other players' vehicles, as interpolated on the last tick
+    Vehicle::Pose _remoteVehicles[NetProtocol::MAX_VEHICLES - 1];
+    size_t _numRemoteVehicles = 0;
+    void _connectToSession();
+    /// \desc _updateScene in a session: sends the input, predicts the vehicle and shows the rest as the server sent it
+    void _updateSession();
+
     // Input Tracking
     static constexpr GLuint NUM_KEYS = GLFW_KEY_LAST;
     GLboolean _keys[NUM_KEYS];
@@ -172,6 +241,8 @@ private:
     //FPSCamera* _pFPSCam;
 
     Vehicle* _pVehicle;
+    /// \desc the vehicle model, baked once and drawn for every pose
+    VehicleMesh _vehicleMesh;
 
     // Animation State
     float _animationTime;
@@ -183,35 +254,114 @@ private:
     //arch
     GLuint _archVAO;
     GLsizei _numArchPoints;
+    /// \desc decode of the arch's packed positions
+    glm::vec3 _archPositionScale;
+    glm::vec3 _archPositionOffset;
 
     // Coins
     GLuint _coinVAO;
     GLsizei _numCoinPoints;
 
     // Particles
-    static constexpr GLuint NUM_VAOS = 1;
-    enum VAO_ID {
-        /// \desc the particle system
-        PARTICLE_SYSTEM = 0
-    };
-    GLuint _vaos[NUM_VAOS];
-    GLuint _vbos[NUM_VAOS];
-    GLuint _ibos[NUM_VAOS];
-    GLsizei _numVAOPoints[NUM_VAOS];
-
-    /// \desc our sprites exist within a box of this size
-    const GLfloat MAX_BOX_SIZE;
-    /// \desc the number of sprites to draw and the size of the _spriteLocations,
-    /// \desc _spriteIndices, and _distances arrays
-    const GLuint NUM_SPRITES;
-    /// \desc the (x,y,z) location of each sprite
-    glm::vec3* _spriteLocations = nullptr;
-    /// \desc the order to draw the sprites in
-    GLushort* _spriteIndices = nullptr;
-    /// \desc will be used to store the distance to the camera
-    GLfloat* _distances = nullptr;
-    /// \desc angle to rotate the particle system by
-    GLfloat _particleSystemAngle;
+    /// \desc size of the pool shared by the coin, pickup and landing emitters
+    static constexpr GLuint NUM_PARTICLES = 65536;
+    /// \desc GPU particle system simulated with transform feedback
+    ParticleSystem* _pParticleSystem = nullptr;
+
+    // Level of detail
+    /// \desc tree, lamp and sphere primitives pre-built at every level of detail
+    LODMesh _treeTrunkMesh;
+    LODMesh _treeLeavesMesh;
+    LODMesh _lampPostMesh;
+    LODMesh _sphereMesh;
+    /// \desc current level of each object, kept between frames for hysteresis
+    mutable std::vector<GLubyte> _treeLODs;
+    mutable std::vector<GLubyte> _lampLODs;
+    mutable std::vector<GLubyte> _blueSphereLODs;
+    mutable std::vector<GLubyte> _marbleLODs;
+    /// \desc trees, lamps or marbles culled and given a level per job, written by the jobs
+    /// into their own slots of the vectors above
+    static constexpr size_t PROPS_PER_JOB = 128;
+    /// \desc atlas of baked tree views used for distant trees
+    ImpostorAtlas* _pTreeImpostors = nullptr;
+    /// \desc trees covering less of the screen than this become impostors
+    static constexpr float TREE_IMPOSTOR_COVERAGE = 0.03f;
+    /// \desc scales screen coverage before picking a level; below 1 favours coarser meshes
+    float _lodBias = 1.0f;
+    /// \desc with --gpu-driven on a GL 4.5 context: trees, lamps and marbles culled and drawn in
+    /// one indirect draw, in place of _drawProps and _drawMarbles
+    GpuDrivenRenderer* _pGpuRenderer = nullptr;
+
+    // Occlusion culling
+    /// \desc software depth buffer the props are tested against before drawing
+    OcclusionCuller* _pOcclusionCuller = nullptr;
+    bool _occlusionCullingEnabled = true;
+    /// \desc platform occluders as a world space triangle list
+    std::vector<glm::vec3> _platformOccluder;
+    /// \desc tree crown occluder as a triangle list relative to the leaves matrix
+    std::vector<glm::vec3> _crownOccluder;
+
+    void _setupOcclusionCulling();
+    /// \desc registers every tree, lamp and marble with _pGpuRenderer when --gpu-driven asked for it
+    void _setupGpuDrivenRendering();
+    void _rasterizeOccluders(glm::mat4 viewMtx, glm::mat4 projMtx) const;
+    bool _isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+    void _setupLODMeshes();
+    void _bakeTreeImpostors();
+    GLubyte _selectLOD(const glm::vec3& center, float radius, GLubyte currentLevel,
+                       glm::mat4 viewMtx, glm::mat4 projMtx, float impostorThreshold = 0.0f) const;
+
+    // Headless rendering
+    const LaunchOptions _launchOptions;
+    /// \desc stands in for the default framebuffer when headless, 0 otherwise
+    GLuint _outputFBO = 0;
+    GLuint _outputColorTexture = 0;
+    GLuint _outputDepthRenderbuffer = 0;
+    GLsizei _outputWidth = 0;
+    GLsizei _outputHeight = 0;
+
+    /// \desc creates an invisible window with an EGL or OSMesa context instead of the regular one
+    void _setupHeadlessContext();
+    /// \desc reads back the finished frame and writes it to the dump directory
+    void _dumpFrame(GLsizei width, GLsizei height);
+
+    // Adaptive quality
+    /// \desc picks the quality level from the measured frame times
+    QualityGovernor _qualityGovernor;
+    /// \desc reduced resolution target the scene is drawn into before being upscaled
+    GLuint _sceneFBO = 0;
+    GLuint _sceneColorTexture = 0;
+    GLuint _sceneDepthRenderbuffer = 0;
+    GLsizei _sceneWidth = 0;
+    GLsizei _sceneHeight = 0;
+    /// \desc minimap image reused between redraws at the lower quality levels
+    GLuint _minimapFBO = 0;
+    GLuint _minimapColorTexture = 0;
+    GLuint _minimapDepthRenderbuffer = 0;
+    GLsizei _minimapWidth = 0;
+    GLsizei _minimapHeight = 0;
+    /// \desc frames rendered so far, paces the minimap redraws
+    GLuint _frameCount = 0;
+
+    // GL state
+    /// \desc every bind and draw of the render thread goes through here
+    GLStateCache& _glState = GLStateCache::instance();
+    /// \desc prints the previous frame's draw and bind counts once a second, toggled with I
+    bool _logFrameStats = false;
+    /// \desc writes one line of GLStateCache statistics to stdout
+    void _logFrameStatistics();
+    /// \desc draws a texture over the current viewport
+    CachedShaderProgram* _screenQuadShaderProgram = nullptr;
+    GLint _screenQuadImageLocation = -1;
+    /// \desc empty VAO for the attributeless screen quad
+    GLuint _screenQuadVAO = 0;
+
+    /// \desc (re)creates a color + depth render target when the requested size changes
+    static void _resizeRenderTarget(GLuint& fbo, GLuint& colorTexture, GLuint& depthRenderbuffer,
+                                    GLsizei& currentWidth, GLsizei& currentHeight, GLsizei width, GLsizei height);
+    /// \desc hands the governor's current settings to the LOD selection and the particles
+    void _applyQualitySettings();
 
     //***************************************************************************
     // Shader Program Information
@@ -235,24 +385,8 @@ private:
     /// \desc texture handles for our textures
     GLuint _texHandles[NUM_TEXTURES];
 
-    CSCI441::ShaderProgram* _billboardShaderProgram = nullptr;
-    /// \desc stores the locations of all of our shader uniforms
-    struct BillboardShaderProgramUniforms {
-        /// \desc the ModelView Matrix to apply
-        GLint mvMatrix;
-        /// \desc the Projection Matrix to apply
-        GLint projMatrix;
-        /// \desc the texture to apply
-        GLint image;
-    } _billboardShaderProgramUniforms;
-    /// \desc stores the locations of all of our shader attributes
-    struct BillboardShaderProgramAttributes {
-        /// \desc the vertex position
-        GLint vPos;
-    } _billboardShaderProgramAttributes;
-
     /// \desc shader program that performs texturing
-    CSCI441::ShaderProgram* _textureShaderProgram;
+    CachedShaderProgram* _textureShaderProgram = nullptr;
     /// \desc stores the locations of all of our shader uniforms
     struct TextureShaderUniformLocations {
         /// \desc precomputed MVP matrix location
@@ -263,6 +397,10 @@ private:
         GLint spotLightDirection;
         GLint spotLightWidth;
         GLint spotLightColor;
+        GLint positionScale;
+        GLint positionOffset;
+        GLint lightmap;
+        GLint lightmapRect;
     } _textureShaderUniformLocations;
     /// \desc stores the locations of all of our shader attributes
     struct TextureShaderAttributeLocations {
@@ -276,18 +414,34 @@ private:
 
     // Lamps
     struct LampData {
-        glm::mat4 modelMatrixPost;
-        glm::mat4 modelMatrixLight;
+        TransformHierarchy::Node post;
+        TransformHierarchy::Node light;
         glm::vec3 position;
     };
     std::vector<LampData> _lamps;
+    void _addLamp(const glm::vec3& position);
 
     // Trees
     struct TreeData {
-        glm::mat4 modelMatrixTrunk;
-        glm::mat4 modelMatrixLeaves;
+        TransformHierarchy::Node trunk;
+        TransformHierarchy::Node leaves;
     };
     std::vector<TreeData> _trees;
+    void _addTree(const glm::vec3& position);
+
+    // Baked lighting
+    /// \desc LightBaker's atlas for the platforms, read from texture unit 1
+    GLuint _lightmapTexture = 0;
+    /// \desc each platform's place in the atlas, in _diskPlatforms and _rectPlatforms order
+    std::vector<glm::vec4> _diskLightmapRects;
+    std::vector<glm::vec4> _rectLightmapRects;
+    /// \desc ambient cube of every tree and lamp part, indexed by its _sceneTransforms node
+    std::vector<LightBaker::AmbientCube> _bakedLight;
+    /// \desc bakes the directional light and every lamp into the above, once the level is loaded
+    void _bakeStaticLighting();
+
+    /// \desc transforms of the static props, filled by _loadLevel and read-only afterwards
+    TransformHierarchy _sceneTransforms;
     const std::vector<TreeData>& getTrees() const { return _trees; }
 
     // Spot Light data
@@ -298,8 +452,131 @@ private:
         float width = glm::radians(5.f);
     } _spotLight;
 
+    // Simulation thread
+    /// \desc fixed simulation step, the game logic has always advanced this much per update
+    static constexpr float SIM_TIMESTEP = 0.016f;
+public:
+    /// \desc copy of everything the renderer reads from the simulation, published once per tick
+    struct SceneSnapshot {
+        uint64_t tick = 0;
+        CameraType camera = CameraType::THIRDPERSON;
+        glm::mat4 viewMtx = glm::mat4(1.0f);
+        /// \desc the free camera's own projection; the other cameras take the framebuffer's aspect on the render thread
+        glm::mat4 freeCamProjMtx = glm::mat4(1.0f);
+        glm::vec3 cameraPosition = glm::vec3(0.0f);
+        /// \desc the player's vehicle first, then the other players' in a session
+        Vehicle::Pose vehicles[NetProtocol::MAX_VEHICLES]{};
+        size_t numVehicles = 1;
+        std::vector<glm::vec3> marbleLocations;
+        std::vector<glm::vec3> blueSpheres;
+        bool hasCoin = false;
+        glm::vec3 coinPosition = glm::vec3(0.0f);
+        float coinSize = 0.0f;
+        SpotLight spotLight;
+        float animationTime = 0.0f;
+        /// \desc sequence number of the last input event applied, see LatencyProbe
+        uint64_t inputSequence = 0;
+    };
+
+private:
+    /// \desc snapshots handed from the simulation thread to the render thread
+    TripleBuffer<SceneSnapshot> _snapshots;
+
+    /// \desc window input captured on the main thread
+    struct InputEvent {
+        enum Type { KEY, MOUSE_BUTTON, CURSOR } type;
+        GLint code;
+        GLint action;
+        GLint mods;
+        glm::vec2 position;
+        uint64_t sequence;
+    };
+    SpscQueue<InputEvent, 256> _inputQueue;
+    /// \desc stamps the input events and measures when they reach the screen
+    LatencyProbe _latencyProbe;
+    /// \desc main thread: the last event queued and the last one the simulation was woken for
+    uint64_t _queuedInputSequence = 0;
+    uint64_t _wokenInputSequence = 0;
+    /// \desc simulation thread: the last event applied
+    uint64_t _appliedInputSequence = 0;
+    /// \desc the last event applied by a published snapshot
+    std::atomic<uint64_t> _publishedInputSequence{0};
+    /// \desc wakes the simulation between ticks when input arrives
+    std::mutex _simulationWakeMutex;
+    std::condition_variable _simulationWake;
+    bool _inputPending = false;
+    /// \desc longest the render thread waits for the simulation to apply fresh input
+    static constexpr std::chrono::microseconds LATE_LATCH_TIMEOUT{2000};
+
+    /// \desc particle bursts raised by the simulation, emitted on the render thread
+    struct ParticleBurst {
+        ParticleSystem::EmitterType type;
+        glm::vec3 position;
+    };
+    SpscQueue<ParticleBurst, 64> _particleBursts;
+
+    /// \desc workers for the simulation's tick graph and the render thread's culling
+    JobSystem* _pJobs = nullptr;
+    /// \desc one simulation tick when playing alone, see _buildTickGraph
+    TaskGraph _tickGraph;
+    /// \desc what the tasks of one tick hand each other. Tasks that may run at the
+    /// same time read the vehicle as it was when the tick began and leave their
+    /// results here, and "resolve" applies them
+    struct TickState {
+        glm::vec3 vehiclePosition;
+        float vehicleRadius;
+        /// \desc coins left when the tick began, the marbles stop once there are none
+        bool coinsLeft;
+        /// \desc the vehicle took input this tick, moving towards newPosition
+        bool vehicleMoving;
+        glm::vec3 newPosition;
+        bool offPlatform;
+        /// \desc a blue sphere was hit, the marbles start over
+        bool resetMarbles;
+        /// \desc _particleBursts has one producer, so the tasks' bursts are pushed by "resolve"
+        bool pickupBurst;
+        bool landingBurst;
+        glm::vec3 pickupPosition;
+        glm::vec3 landingPosition;
+    } _tickState{};
+    /// \desc input -> pickups || marbles || vehicle -> resolve
+    void _buildTickGraph();
+    void _tickBegin();
+    void _tickPickups();
+    void _tickMarbles();
+    void _tickVehicle();
+    void _tickResolve();
+
+    /// \desc render thread scratch memory for draw lists, sort buffers and culling results,
+    /// reset at the start of every frame
+    FrameArena _frameArena{1 << 20};
+    /// \desc what the GPU reads of a frame's dynamic data: vehicle instances, impostor
+    /// positions, the GPU-driven anchors and command resets. 100k impostors take 1.2 MB
+    static constexpr GLsizeiptr STREAM_REGION_SIZE = 4 << 20;
+    mutable StreamBuffer _streamBuffer{STREAM_REGION_SIZE};
+
+    std::atomic<bool> _simulationRunning{false};
+    uint64_t _simulationTick = 0;
+    /// \desc tick of the last snapshot the particles were advanced to
+    uint64_t _lastRenderedTick = 0;
+
+    void _simulationLoop();
+    void _publishSnapshot();
+    void _queueInputEvent(InputEvent event);
+    void _handleInputEvent(const InputEvent& event);
+    /// \desc applies every queued input event, returns whether there were any
+    bool _drainInputQueue();
+    /// \desc main thread, after polling: lets the simulation apply the new input before its next tick
+    void _wakeSimulationForInput();
+    /// \desc main thread, just before the snapshot is fetched: waits until it holds the polled input
+    void _awaitLatchedInput() const;
+    void _updateParticles(const SceneSnapshot& snapshot);
+
     // Shaders
-    CSCI441::ShaderProgram* _lightingShaderProgram = nullptr;
+    /// \desc lighting variant bound by the last _useLightingVariant call
+    mutable CachedShaderProgram* _lightingShaderProgram = nullptr;
+    /// \desc compiles every program in the game and keeps their binaries between runs
+    ShaderCache* _pShaderCache = nullptr;
     struct LightingShaderUniformLocations {
         GLint mvpMatrix;
         GLint normalMatrix;
@@ -317,7 +594,6 @@ private:
         GLint dirLightColor;
 
         // Point Light properties
-        GLint numPointLights;
         GLint pointLightPositions;
         GLint pointLightColors;
         GLint pointLightConstants;
@@ -329,7 +605,54 @@ private:
         GLint spotLightDirection;
         GLint spotLightWidth;
         GLint spotLightColor;
-    }_lightingShaderUniformLocations;
+
+        // Packed mesh decode
+        GLint packedPositionScale;
+        GLint packedPositionOffset;
+
+        // Baked directional light and lamps
+        GLint bakedLight;
+    };
+    /// \desc locations in the lighting variant bound by the last _useLightingVariant call
+    mutable LightingShaderUniformLocations _lightingShaderUniformLocations;
+
+    /// \desc lighting.vs.glsl features switched on with #defines
+    enum LightingFeature {
+        LIGHTING_SPOT_LIGHT = 1 << 0,
+        LIGHTING_UNLIT_FLAT = 1 << 1,
+        LIGHTING_VEHICLE_MESH = 1 << 2,
+        LIGHTING_PACKED_MESH = 1 << 3,
+        LIGHTING_BAKED = 1 << 4,
+        /// \desc not a permutation: GpuDrivenRenderer's draw program, given the same camera and lights
+        LIGHTING_GPU_DRIVEN = 1 << 5
+    };
+    struct LightingVariant {
+        CachedShaderProgram* program;
+        LightingShaderUniformLocations locations;
+    };
+    /// \desc #define variants of the lighting and texture programs
+    ShaderPermutations* _pLightingPermutations = nullptr;
+    ShaderPermutations* _pTexturePermutations = nullptr;
+    /// \desc every lighting variant used so far, keyed by point light count and features
+    mutable std::map<int, LightingVariant> _lightingVariants;
+    static constexpr int MAX_POINT_LIGHTS = 10;
+    /// \desc point lights the scene variants evaluate, the first lamps up to MAX_POINT_LIGHTS;
+    /// the trees, lamps and platforms take every lamp from the bake instead
+    int _numPointLights = 0;
+    /// \desc texture variant without the spot light, for the minimap
+    CachedShaderProgram* _unlitTextureShaderProgram = nullptr;
+    GLint _unlitTextureMvpLocation = -1;
+    GLint _unlitTexturePositionScaleLocation = -1;
+    GLint _unlitTexturePositionOffsetLocation = -1;
+
+    /// \desc the variant for this light count and features, compiled the first time it is asked for
+    const LightingVariant& _getLightingVariant(int numPointLights, int features) const;
+    /// \desc binds a variant and points _lightingShaderProgram and _lightingShaderUniformLocations at it
+    void _useLightingVariant(int numPointLights, int features) const;
+    /// \desc uploads the camera and lights to every scene variant
+    void _sendFrameLightingUniforms(const SceneSnapshot& snapshot) const;
+    /// \desc whether a bounding sphere touches the spot light's cone
+    static bool _spotLightReaches(const SpotLight& spotLight, const glm::vec3& center, float radius);
 
     struct LightingShaderAttributeLocations {
         GLint vPos;
@@ -339,16 +662,17 @@ private:
 
 
     // Helper Functions
-    void _generateRectangle(RectPlatform& rect);
-    void _generateDisk(DiskPlatform& disk, int numSegments);
-
-    static GLfloat _randNumber( GLfloat MAX );
-
     void _drawArch(glm::mat4 viewMtx, glm::mat4 projMtx) const;
     void _createArchBuffers();
-    void _generateEnvironment();
     void _computeAndSendMatrixUniforms(glm::mat4 modelMtx, glm::mat4 viewMtx, glm::mat4 projMtx) const;
-    void generateTorusMesh(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices, float innerRadius, float outerRadius, int numSides, int numRings);
+    /// \desc same as above with the matrices cached in _sceneTransforms
+    void _sendNodeMatrixUniforms(TransformHierarchy::Node node, const glm::mat4& projViewMtx) const;
+    void _sendMaterialUniforms(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular, float shininess) const;
+    /// \desc position decode for the next packed mesh drawn with a LIGHTING_PACKED_MESH variant
+    void _sendPackedMeshUniforms(const glm::vec3& positionScale, const glm::vec3& positionOffset) const;
+    void _sendPackedMeshUniforms(const LODMesh& mesh) const { _sendPackedMeshUniforms(mesh.getPositionScale(), mesh.getPositionOffset()); }
+    /// \desc the node's ambient cube, for a LIGHTING_BAKED variant
+    void _sendBakedLightUniforms(TransformHierarchy::Node node) const;
 
 
     // Zoom Handling
@@ -0,0 +1,57 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+    unsigned char* alignUp(unsigned char* pointer, size_t alignment) {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+        return pointer + (((address + alignment - 1) & ~(uintptr_t(alignment) - 1)) - address);
+    }
+}
+
+FrameArena::FrameArena(size_t capacity)
+    : _block(static_cast<unsigned char*>(::operator new(capacity))),
+      _capacity(capacity),
+      _used(0),
+      _overflowBytes(0),
+      _highWaterMark(0)
+{
+    _overflow.reserve(16);
+}
+
+FrameArena::~FrameArena() {
+    reset();
+    ::operator delete(_block);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    unsigned char* start = alignUp(_block + _used, alignment);
+    if (start + bytes <= _block + _capacity) {
+        _used = static_cast<size_t>(start - _block) + bytes;
+        _highWaterMark = std::max(_highWaterMark, _used + _overflowBytes);
+        return start;
+    }
+
+    // over budget this frame; the block catches up at the next reset
+    auto* memory = static_cast<unsigned char*>(::operator new(bytes + alignment));
+    _overflow.push_back(memory);
+    _overflowBytes += bytes + alignment;
+    _highWaterMark = std::max(_highWaterMark, _used + _overflowBytes);
+    return alignUp(memory, alignment);
+}
+
+void FrameArena::reset() {
+    for (void* memory : _overflow) {
+        ::operator delete(memory);
+    }
+    if (!_overflow.empty()) {
+        // a little headroom so a frame that needs slightly more next time does not spill again
+        ::operator delete(_block);
+        _capacity = _highWaterMark + _highWaterMark / 4;
+        _block = static_cast<unsigned char*>(::operator new(_capacity));
+    }
+    _overflow.clear();
+    _overflowBytes = 0;
+    _used = 0;
+}
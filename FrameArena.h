@@ -0,0 +1,88 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/// \desc bump allocator for memory that only lives for one frame: draw lists,
+/// sort buffers and query results. Allocating moves a pointer, reset() at the
+/// start of the next frame takes everything back at once and nothing is ever
+/// destroyed, so only trivially destructible types belong in it.
+///
+/// A frame that needs more than the block holds gets the rest from the heap;
+/// the next reset() then grows the block to that frame's high water mark, so
+/// after the first frames of a scene the arena does not touch the heap again.
+/// Used from one thread only.
+class FrameArena {
+public:
+    explicit FrameArena(size_t capacity);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /// \desc alignment must be a power of two; the memory is uninitialized
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    /// \desc room for count values of T, uninitialized
+    template<typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /// \desc invalidates everything allocated since the last reset
+    void reset();
+
+    size_t getCapacity() const { return _capacity; }
+    size_t getBytesUsed() const { return _used; }
+    /// \desc most bytes any frame has used so far, overflow included
+    size_t getHighWaterMark() const { return _highWaterMark; }
+
+private:
+    unsigned char* _block;
+    size_t _capacity;
+    size_t _used;
+    size_t _overflowBytes;
+    size_t _highWaterMark;
+    /// \desc heap allocations made this frame because the block was full
+    std::vector<void*> _overflow;
+};
+
+/// \desc list of at most capacity values living in a FrameArena until its next reset
+template<typename T>
+class FrameList {
+public:
+    FrameList(FrameArena& arena, size_t capacity)
+        : _data(arena.allocate<T>(capacity)),
+          _size(0),
+          _capacity(capacity)
+    {}
+
+    void push_back(const T& value) {
+        assert(_size < _capacity);
+        new (&_data[_size++]) T(value);
+    }
+    void clear() { _size = 0; }
+
+    T& operator[](size_t i) { return _data[i]; }
+    const T& operator[](size_t i) const { return _data[i]; }
+    T* data() { return _data; }
+    const T* data() const { return _data; }
+    T* begin() { return _data; }
+    T* end() { return _data + _size; }
+    const T* begin() const { return _data; }
+    const T* end() const { return _data + _size; }
+    size_t size() const { return _size; }
+    size_t capacity() const { return _capacity; }
+    bool empty() const { return _size == 0; }
+
+private:
+    T* _data;
+    size_t _size;
+    size_t _capacity;
+};
+
+#endif // FRAME_ARENA_H
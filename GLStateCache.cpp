@@ -0,0 +1,225 @@
+#include "GLStateCache.h"
+#include <glm/gtc/type_ptr.hpp>
+
+GLStateCache& GLStateCache::instance() {
+    static GLStateCache stateCache;
+    return stateCache;
+}
+
+GLStateCache::GLStateCache()
+    : _frame{},
+      _lastFrame{}
+{
+    invalidate();
+}
+
+void GLStateCache::beginFrame() {
+    invalidate();
+    _frame = FrameStats{};
+}
+
+void GLStateCache::endFrame() {
+    _lastFrame = _frame;
+}
+
+void GLStateCache::invalidate() {
+    _program = UNKNOWN;
+    _vertexArray = UNKNOWN;
+    _activeTextureUnit = UNKNOWN;
+    for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+        _textures[unit] = UNKNOWN;
+        _textureTargets[unit] = GL_NONE;
+    }
+    for (GLuint& capability : _capabilities) {
+        capability = UNKNOWN;
+    }
+    _blendSourceFactor = GL_NONE;
+    _blendDestinationFactor = GL_NONE;
+    _depthMask = UNKNOWN;
+}
+
+void GLStateCache::useProgram(GLuint program) {
+    if (program == _program) {
+        ++_frame.elidedCalls;
+        return;
+    }
+    glUseProgram(program);
+    _program = program;
+    ++_frame.programBinds;
+}
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+    if (vao == _vertexArray) {
+        ++_frame.elidedCalls;
+        return;
+    }
+    glBindVertexArray(vao);
+    _vertexArray = vao;
+    ++_frame.vertexArrayBinds;
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    const bool cached = unit < MAX_TEXTURE_UNITS;
+    if (cached && _textures[unit] == texture && _textureTargets[unit] == target) {
+        ++_frame.elidedCalls;
+        return;
+    }
+    if (unit != _activeTextureUnit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        _activeTextureUnit = unit;
+        ++_frame.stateChanges;
+    }
+    glBindTexture(target, texture);
+    if (cached) {
+        _textures[unit] = texture;
+        _textureTargets[unit] = target;
+    }
+    ++_frame.textureBinds;
+}
+
+int GLStateCache::_capabilityIndex(GLenum capability) {
+    switch (capability) {
+        case GL_BLEND: return 0;
+        case GL_DEPTH_TEST: return 1;
+        case GL_RASTERIZER_DISCARD: return 2;
+        default: return -1;
+    }
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled) {
+    const int index = _capabilityIndex(capability);
+    if (index != -1 && _capabilities[index] == static_cast<GLuint>(enabled)) {
+        ++_frame.elidedCalls;
+        return;
+    }
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+    if (index != -1) {
+        _capabilities[index] = enabled;
+    }
+    ++_frame.stateChanges;
+}
+
+void GLStateCache::setBlendFunc(GLenum sourceFactor, GLenum destinationFactor) {
+    if (sourceFactor == _blendSourceFactor && destinationFactor == _blendDestinationFactor) {
+        ++_frame.elidedCalls;
+        return;
+    }
+    glBlendFunc(sourceFactor, destinationFactor);
+    _blendSourceFactor = sourceFactor;
+    _blendDestinationFactor = destinationFactor;
+    ++_frame.stateChanges;
+}
+
+void GLStateCache::setDepthMask(GLboolean mask) {
+    if (static_cast<GLuint>(mask) == _depthMask) {
+        ++_frame.elidedCalls;
+        return;
+    }
+    glDepthMask(mask);
+    _depthMask = mask;
+    ++_frame.stateChanges;
+}
+
+unsigned int GLStateCache::_countTriangles(GLenum mode, GLsizei count) {
+    switch (mode) {
+        case GL_TRIANGLES: return static_cast<unsigned int>(count / 3);
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN: return count > 2 ? static_cast<unsigned int>(count - 2) : 0;
+        default: return 0;
+    }
+}
+
+void GLStateCache::drawArrays(GLenum mode, GLint first, GLsizei count) {
+    glDrawArrays(mode, first, count);
+    ++_frame.drawCalls;
+    _frame.triangles += _countTriangles(mode, count);
+}
+
+void GLStateCache::drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances) {
+    glDrawArraysInstanced(mode, first, count, instances);
+    ++_frame.drawCalls;
+    _frame.triangles += _countTriangles(mode, count) * static_cast<unsigned int>(instances);
+}
+
+void GLStateCache::drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+    glDrawElements(mode, count, type, indices);
+    ++_frame.drawCalls;
+    _frame.triangles += _countTriangles(mode, count);
+}
+
+void GLStateCache::drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances) {
+    glDrawElementsInstanced(mode, count, type, indices, instances);
+    ++_frame.drawCalls;
+    _frame.triangles += _countTriangles(mode, count) * static_cast<unsigned int>(instances);
+}
+
+void GLStateCache::drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex) {
+    glDrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+    ++_frame.drawCalls;
+    _frame.triangles += _countTriangles(mode, count);
+}
+
+void GLStateCache::multiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount) {
+    glMultiDrawElementsIndirect(mode, type, indirect, drawCount, 0);
+    ++_frame.drawCalls;
+}
+
+void GLStateCache::drawArraysIndirect(GLenum mode, const void* indirect) {
+    glDrawArraysIndirect(mode, indirect);
+    ++_frame.drawCalls;
+}
+
+void GLStateCache::externalDraw() {
+    // the helper bound a vertex array we did not see; its triangle count is unknown
+    _vertexArray = UNKNOWN;
+    ++_frame.drawCalls;
+}
+
+void GLStateCache::uniform(GLint location, GLint value) {
+    glUniform1i(location, value);
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, GLfloat value) {
+    glUniform1f(location, value);
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, const glm::vec3& value) {
+    glUniform3fv(location, 1, glm::value_ptr(value));
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, const glm::mat3& value) {
+    glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, const glm::mat4& value) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, GLsizei count, const GLint* values) {
+    glUniform1iv(location, count, values);
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, GLsizei count, const GLfloat* values) {
+    glUniform1fv(location, count, values);
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, GLsizei count, const glm::vec3* values) {
+    glUniform3fv(location, count, glm::value_ptr(values[0]));
+    ++_frame.uniformUploads;
+}
+
+void GLStateCache::uniform(GLint location, GLsizei count, const glm::vec4* values) {
+    glUniform4fv(location, count, glm::value_ptr(values[0]));
+    ++_frame.uniformUploads;
+}
@@ -0,0 +1,101 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+/// \desc shadow copy of the GL binding state of the render thread. Binds and
+/// state changes that would not change anything are dropped before they
+/// reach the driver, and every draw, bind and uniform upload is counted so a
+/// frame's cost can be read back after it ends.
+///
+/// Code that binds behind its back (the CSCI441 object helpers, setup code)
+/// leaves the shadow copy stale: call externalDraw() after such a draw, and
+/// invalidate() after anything else. beginFrame() invalidates as well, so a
+/// stale entry never outlives the frame it happened in.
+class GLStateCache {
+public:
+    /// \desc totals of one frame
+    struct FrameStats {
+        unsigned int drawCalls;
+        unsigned int triangles;
+        unsigned int programBinds;
+        unsigned int vertexArrayBinds;
+        unsigned int textureBinds;
+        /// \desc enable/disable, blend function, depth mask and active texture changes
+        unsigned int stateChanges;
+        unsigned int uniformUploads;
+        /// \desc calls dropped because the state was already set
+        unsigned int elidedCalls;
+    };
+
+    static constexpr GLuint MAX_TEXTURE_UNITS = 8;
+
+    static GLStateCache& instance();
+
+    /// \desc forgets the cached state and starts counting a new frame
+    void beginFrame();
+    /// \desc makes the counted frame available through getLastFrameStats()
+    void endFrame();
+    const FrameStats& getLastFrameStats() const { return _lastFrame; }
+
+    /// \desc forgets everything, the next call of each kind reaches GL
+    void invalidate();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    /// \desc GL_BLEND, GL_DEPTH_TEST and GL_RASTERIZER_DISCARD are cached, anything else is passed through
+    void setEnabled(GLenum capability, bool enabled);
+    void setBlendFunc(GLenum sourceFactor, GLenum destinationFactor);
+    void setDepthMask(GLboolean mask);
+
+    void drawArrays(GLenum mode, GLint first, GLsizei count);
+    void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+    void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+    void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances);
+    void drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex);
+    /// \desc GL 4.3+, the commands come from the bound GL_DRAW_INDIRECT_BUFFER; counted as one
+    /// draw call, the triangles are only known to the GPU
+    void multiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount);
+    void drawArraysIndirect(GLenum mode, const void* indirect);
+    /// \desc counts a draw made by code that binds its own vertex array
+    void externalDraw();
+
+    void uniform(GLint location, GLint value);
+    void uniform(GLint location, GLfloat value);
+    void uniform(GLint location, const glm::vec3& value);
+    void uniform(GLint location, const glm::mat3& value);
+    void uniform(GLint location, const glm::mat4& value);
+    void uniform(GLint location, GLsizei count, const GLint* values);
+    void uniform(GLint location, GLsizei count, const GLfloat* values);
+    void uniform(GLint location, GLsizei count, const glm::vec3* values);
+    void uniform(GLint location, GLsizei count, const glm::vec4* values);
+
+private:
+    GLStateCache();
+
+    /// \desc slot of a cached capability, -1 when it is not cached
+    static int _capabilityIndex(GLenum capability);
+    static unsigned int _countTriangles(GLenum mode, GLsizei count);
+
+    static constexpr int NUM_CAPABILITIES = 3;
+    /// \desc marks a cached value as not known
+    static constexpr GLuint UNKNOWN = 0xFFFFFFFF;
+
+    GLuint _program;
+    GLuint _vertexArray;
+    GLuint _activeTextureUnit;
+    GLuint _textures[MAX_TEXTURE_UNITS];
+    GLenum _textureTargets[MAX_TEXTURE_UNITS];
+    /// \desc 0 disabled, 1 enabled, UNKNOWN
+    GLuint _capabilities[NUM_CAPABILITIES];
+    GLenum _blendSourceFactor;
+    GLenum _blendDestinationFactor;
+    GLuint _depthMask;
+
+    FrameStats _frame;
+    FrameStats _lastFrame;
+};
+
+#endif // GL_STATE_CACHE_H
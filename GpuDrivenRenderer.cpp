@@ -0,0 +1,338 @@
+#include "GpuDrivenRenderer.h"
+#include "GLStateCache.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+    /// \desc invocations per work group, local_size_x in gpuCull.cs.glsl
+    constexpr GLuint CULL_GROUP_SIZE = 64;
+    /// \desc shader storage bindings shared by both programs
+    constexpr GLuint PART_BINDING = 0;
+    constexpr GLuint MESH_BINDING = 1;
+    constexpr GLuint ANCHOR_BINDING = 2;
+    constexpr GLuint COMMAND_BINDING = 3;
+    constexpr GLuint INSTANCE_BINDING = 4;
+    constexpr GLuint IMPOSTOR_BINDING = 5;
+    /// \desc vertex array bindings: the merged vertices, and the part index per instance
+    constexpr GLuint VERTEX_BINDING = 0;
+    constexpr GLuint INSTANCE_VERTEX_BINDING = 1;
+
+    bool linked(const CachedShaderProgram* program) {
+        GLint status = GL_FALSE;
+        glGetProgramiv(program->getShaderProgramHandle(), GL_LINK_STATUS, &status);
+        return status == GL_TRUE;
+    }
+}
+
+bool GpuDrivenRenderer::isSupported() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major > 4 || (major == 4 && minor >= 5);
+}
+
+GpuDrivenRenderer::GpuDrivenRenderer()
+    : _impostorCommand{4, 0, 0, 0},
+      _vao(0),
+      _vertexBuffer(0),
+      _indexBuffer(0),
+      _partBuffer(0),
+      _meshBuffer(0),
+      _commandBuffer(0),
+      _instanceBuffer(0),
+      _impostorBuffer(0),
+      _maxAnchors(0),
+      _cullProgram(nullptr),
+      _drawProgram(nullptr)
+{
+    static_assert(sizeof(GpuPart) == 240, "GpuPart has to match the std430 Part in the shaders");
+    static_assert(sizeof(GpuMesh) == 48, "GpuMesh has to match the std430 Mesh in the shaders");
+    static_assert(sizeof(DrawElementsCommand) == 5 * sizeof(GLuint), "the cull pass indexes the commands as uints");
+}
+
+GpuDrivenRenderer::~GpuDrivenRenderer() {
+    delete _cullProgram;
+    delete _drawProgram;
+}
+
+bool GpuDrivenRenderer::setup(ShaderCache& shaderCache, int numPointLights) {
+    _cullProgram = shaderCache.loadCompute("shaders/gpuCull.cs.glsl");
+    _drawProgram = shaderCache.load("shaders/gpuDraw.vs.glsl", "shaders/lighting.fs.glsl", {},
+                                    { "NUM_POINT_LIGHTS " + std::to_string(numPointLights) });
+    if (!linked(_cullProgram) || !linked(_drawProgram)) {
+        fprintf(stderr, "[ERROR]: GPU-driven programs did not link\n");
+        cleanup();
+        return false;
+    }
+
+    _cullLocations.numParts = _cullProgram->getUniformLocation("numParts");
+    _cullLocations.numAnchors = _cullProgram->getUniformLocation("numAnchors");
+    _cullLocations.frustumPlanes = _cullProgram->getUniformLocation("frustumPlanes");
+    _cullLocations.viewMatrix = _cullProgram->getUniformLocation("viewMatrix");
+    _cullLocations.projectionScale = _cullProgram->getUniformLocation("projectionScale");
+    _cullLocations.lodBias = _cullProgram->getUniformLocation("lodBias");
+    _cullLocations.impostorCoverage = _cullProgram->getUniformLocation("impostorCoverage");
+    _cullLocations.impostorCommand = _cullProgram->getUniformLocation("impostorCommand");
+
+    _drawLocations.projViewMatrix = _drawProgram->getUniformLocation("projViewMatrix");
+    _drawLocations.animationTime = _drawProgram->getUniformLocation("animationTime");
+    return true;
+}
+
+void GpuDrivenRenderer::cleanup() {
+    glDeleteVertexArrays(1, &_vao);
+    const GLuint buffers[] = { _vertexBuffer, _indexBuffer, _partBuffer, _meshBuffer, _commandBuffer,
+                               _instanceBuffer, _impostorBuffer };
+    glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    _vao = _vertexBuffer = _indexBuffer = _partBuffer = _meshBuffer = 0;
+    _commandBuffer = _instanceBuffer = _impostorBuffer = 0;
+    delete _cullProgram;
+    delete _drawProgram;
+    _cullProgram = _drawProgram = nullptr;
+}
+
+GpuDrivenRenderer::DrawElementsCommand GpuDrivenRenderer::_appendLevel(const PackedVertex::PositionNormal* vertices, GLsizei numVertices,
+                                                                       const GLuint* indices, GLsizei numIndices) {
+    const DrawElementsCommand command{ static_cast<GLuint>(numIndices), 0, static_cast<GLuint>(_indices.size()),
+                                       static_cast<GLint>(_vertices.size()), 0 };
+    _vertices.insert(_vertices.end(), vertices, vertices + numVertices);
+    _indices.insert(_indices.end(), indices, indices + numIndices);
+    return command;
+}
+
+GLuint GpuDrivenRenderer::addMesh(const LODMesh& mesh) {
+    GpuMesh entry{};
+    entry.positionScale = glm::vec4(mesh.getPositionScale(), 0.0f);
+    entry.positionOffset = glm::vec4(mesh.getPositionOffset(), 0.0f);
+    entry.firstCommand = static_cast<GLuint>(_commands.size());
+    entry.numLevels = LODMesh::NUM_LEVELS;
+
+    // the levels live in their own buffers; read back once here, so the mesh keeps drawing on its own too
+    std::vector<PackedVertex::PositionNormal> vertices;
+    std::vector<GLushort> shortIndices;
+    std::vector<GLuint> indices;
+    for (GLuint level = 0; level < LODMesh::NUM_LEVELS; ++level) {
+        const LODMesh::LevelBuffers buffers = mesh.getLevelBuffers(level);
+        vertices.resize(buffers.numVertices);
+        indices.resize(buffers.numIndices);
+        glGetNamedBufferSubData(buffers.vbo, 0, vertices.size() * sizeof(PackedVertex::PositionNormal), vertices.data());
+        if (buffers.indexType == GL_UNSIGNED_SHORT) {
+            shortIndices.resize(buffers.numIndices);
+            glGetNamedBufferSubData(buffers.ebo, 0, shortIndices.size() * sizeof(GLushort), shortIndices.data());
+            std::copy(shortIndices.begin(), shortIndices.end(), indices.begin());
+        } else {
+            glGetNamedBufferSubData(buffers.ebo, 0, indices.size() * sizeof(GLuint), indices.data());
+        }
+        _commands.push_back(_appendLevel(vertices.data(), buffers.numVertices, indices.data(), buffers.numIndices));
+    }
+
+    _meshes.push_back(entry);
+    return static_cast<GLuint>(_meshes.size() - 1);
+}
+
+GLuint GpuDrivenRenderer::addMesh(const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices) {
+    const size_t numVertices = vertices.size() / 6;
+    float min[3] = { 0.0f, 0.0f, 0.0f }, max[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < numVertices; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const float value = vertices[i * 6 + axis];
+            min[axis] = i == 0 ? value : std::min(min[axis], value);
+            max[axis] = i == 0 ? value : std::max(max[axis], value);
+        }
+    }
+    const PackedVertex::PositionDecode decode = PackedVertex::decodeForBounds(min, max);
+    std::vector<PackedVertex::PositionNormal> packed(numVertices);
+    for (size_t i = 0; i < numVertices; ++i) {
+        PackedVertex::packPosition(decode, &vertices[i * 6], packed[i].position);
+        PackedVertex::packNormal(&vertices[i * 6 + 3], packed[i].normal);
+    }
+
+    GpuMesh entry{};
+    entry.positionScale = glm::vec4(decode.scale[0], decode.scale[1], decode.scale[2], 0.0f);
+    entry.positionOffset = glm::vec4(decode.offset[0], decode.offset[1], decode.offset[2], 0.0f);
+    entry.firstCommand = static_cast<GLuint>(_commands.size());
+    entry.numLevels = 1;
+    _commands.push_back(_appendLevel(packed.data(), static_cast<GLsizei>(numVertices), indices.data(),
+                                     static_cast<GLsizei>(indices.size())));
+
+    _meshes.push_back(entry);
+    return static_cast<GLuint>(_meshes.size() - 1);
+}
+
+void GpuDrivenRenderer::addPart(const Part& part) {
+    GpuPart entry{};
+    entry.model = part.model;
+    entry.bounds = glm::vec4(part.boundsCenter, part.boundsRadius);
+    entry.ambient = glm::vec4(part.material.ambient, 0.0f);
+    entry.diffuse = glm::vec4(part.material.diffuse, 0.0f);
+    entry.specular = glm::vec4(part.material.specular, part.material.shininess);
+    for (int face = 0; face < 6; ++face) {
+        entry.bakedLight[face] = glm::vec4(part.bakedLight[face], 0.0f);
+    }
+    entry.mesh = part.mesh;
+    entry.anchor = part.anchor;
+    entry.flags = part.flags;
+    entry.level = 0;
+    _parts.push_back(entry);
+}
+
+void GpuDrivenRenderer::upload(size_t numAnchors) {
+    // every level of a mesh can hold all of its parts, so the lists never overflow whatever the cull picks
+    std::vector<GLuint> partsPerMesh(_meshes.size(), 0);
+    GLuint numImpostors = 0;
+    for (const GpuPart& part : _parts) {
+        ++partsPerMesh[part.mesh];
+        if (part.flags & PART_DRAWS_IMPOSTOR) ++numImpostors;
+    }
+    GLuint numInstances = 0;
+    for (size_t mesh = 0; mesh < _meshes.size(); ++mesh) {
+        for (GLuint level = 0; level < _meshes[mesh].numLevels; ++level) {
+            _commands[_meshes[mesh].firstCommand + level].baseInstance = numInstances;
+            numInstances += partsPerMesh[mesh];
+        }
+    }
+    _maxAnchors = numAnchors;
+
+    // immutable storage; the commands are reset by copying from the stream buffer, the anchors live there
+    auto createBuffer = [](GLuint& buffer, size_t size, const void* data, GLbitfield flags) {
+        glCreateBuffers(1, &buffer);
+        glNamedBufferStorage(buffer, std::max<size_t>(size, 16), size > 0 ? data : nullptr, flags);
+    };
+    createBuffer(_vertexBuffer, _vertices.size() * sizeof(PackedVertex::PositionNormal), _vertices.data(), 0);
+    createBuffer(_indexBuffer, _indices.size() * sizeof(GLuint), _indices.data(), 0);
+    createBuffer(_partBuffer, _parts.size() * sizeof(GpuPart), _parts.data(), 0);
+    createBuffer(_meshBuffer, _meshes.size() * sizeof(GpuMesh), _meshes.data(), 0);
+    createBuffer(_commandBuffer, _commands.size() * sizeof(DrawElementsCommand) + sizeof(DrawArraysCommand), nullptr, 0);
+    createBuffer(_instanceBuffer, numInstances * sizeof(GLuint), nullptr, 0);
+    createBuffer(_impostorBuffer, numImpostors * sizeof(glm::vec4), nullptr, 0);
+
+    glCreateVertexArrays(1, &_vao);
+    glVertexArrayVertexBuffer(_vao, VERTEX_BINDING, _vertexBuffer, 0, sizeof(PackedVertex::PositionNormal));
+    glEnableVertexArrayAttrib(_vao, 0);
+    glVertexArrayAttribFormat(_vao, 0, 3, GL_SHORT, GL_FALSE, offsetof(PackedVertex::PositionNormal, position));
+    glVertexArrayAttribBinding(_vao, 0, VERTEX_BINDING);
+    glEnableVertexArrayAttrib(_vao, 1);
+    glVertexArrayAttribFormat(_vao, 1, 2, GL_SHORT, GL_FALSE, offsetof(PackedVertex::PositionNormal, normal));
+    glVertexArrayAttribBinding(_vao, 1, VERTEX_BINDING);
+    // the part index, advanced per instance from the command's baseInstance
+    glVertexArrayVertexBuffer(_vao, INSTANCE_VERTEX_BINDING, _instanceBuffer, 0, sizeof(GLuint));
+    glVertexArrayBindingDivisor(_vao, INSTANCE_VERTEX_BINDING, 1);
+    glEnableVertexArrayAttrib(_vao, 2);
+    glVertexArrayAttribIFormat(_vao, 2, 1, GL_UNSIGNED_INT, 0);
+    glVertexArrayAttribBinding(_vao, 2, INSTANCE_VERTEX_BINDING);
+    glVertexArrayElementBuffer(_vao, _indexBuffer);
+
+    fprintf(stdout, "[INFO]: GPU-driven path: %zu parts over %zu meshes, %zu triangles, in %zu indirect draws\n",
+            _parts.size(), _meshes.size(), _indices.size() / 3, _commands.size());
+
+    // the GPU has its copy
+    std::vector<PackedVertex::PositionNormal>().swap(_vertices);
+    std::vector<GLuint>().swap(_indices);
+}
+
+void GpuDrivenRenderer::draw(const glm::vec3* anchors, size_t numAnchors, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+                             float lodBias, float impostorCoverage, float animationTime, StreamBuffer& stream) const {
+    if (!_cullProgram || !_vao || _parts.empty()) {
+        return;
+    }
+    GLStateCache& glState = GLStateCache::instance();
+
+    // the cull pass counts the instances up from zero again, from a copy of the commands made in the stream
+    const GLsizeiptr commandsSize = _commands.size() * sizeof(DrawElementsCommand);
+    GLintptr commandsOffset = 0;
+    auto* commands = static_cast<unsigned char*>(
+        stream.map(commandsSize + sizeof(DrawArraysCommand), alignof(DrawElementsCommand), commandsOffset));
+    // the anchors widened to vec4 for std430; the binding needs a range even when there are none
+    numAnchors = std::min(numAnchors, _maxAnchors);
+    const GLsizeiptr anchorsSize = std::max<size_t>(numAnchors, 1) * sizeof(glm::vec4);
+    GLintptr anchorsOffset = 0;
+    glm::vec4* anchorData = nullptr;
+    if (commands) {
+        memcpy(commands, _commands.data(), commandsSize);
+        memcpy(commands + commandsSize, &_impostorCommand, sizeof(DrawArraysCommand));
+        stream.unmap();
+        anchorData = static_cast<glm::vec4*>(stream.map(anchorsSize, stream.getStorageAlignment(), anchorsOffset));
+    }
+    if (!anchorData) {
+        return;
+    }
+    for (size_t i = 0; i < numAnchors; ++i) {
+        anchorData[i] = glm::vec4(anchors[i], 1.0f);
+    }
+    stream.unmap();
+    glCopyNamedBufferSubData(stream.getBuffer(), _commandBuffer, commandsOffset, 0, commandsSize + sizeof(DrawArraysCommand));
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PART_BINDING, _partBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_BINDING, _meshBuffer);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, ANCHOR_BINDING, stream.getBuffer(), anchorsOffset, anchorsSize);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, _commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, _instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IMPOSTOR_BINDING, _impostorBuffer);
+
+    // frustum planes from the rows of projection * view, pointing inwards
+    const glm::mat4 projViewMtx = projMtx * viewMtx;
+    glm::vec4 planes[6];
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int side = 0; side < 2; ++side) {
+            const float sign = side == 0 ? 1.0f : -1.0f;
+            glm::vec4 plane(projViewMtx[0][3] + sign * projViewMtx[0][axis], projViewMtx[1][3] + sign * projViewMtx[1][axis],
+                            projViewMtx[2][3] + sign * projViewMtx[2][axis], projViewMtx[3][3] + sign * projViewMtx[3][axis]);
+            const float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            planes[axis * 2 + side] = plane * (1.0f / length);
+        }
+    }
+
+    _cullProgram->useProgram();
+    glState.uniform(_cullLocations.numParts, static_cast<GLint>(_parts.size()));
+    glState.uniform(_cullLocations.numAnchors, static_cast<GLint>(numAnchors));
+    glState.uniform(_cullLocations.frustumPlanes, 6, planes);
+    glState.uniform(_cullLocations.viewMatrix, viewMtx);
+    glState.uniform(_cullLocations.projectionScale, projMtx[1][1]);
+    glState.uniform(_cullLocations.lodBias, lodBias);
+    glState.uniform(_cullLocations.impostorCoverage, impostorCoverage);
+    glState.uniform(_cullLocations.impostorCommand, static_cast<GLint>(_commands.size() * 5));
+    glDispatchCompute((static_cast<GLuint>(_parts.size()) + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    // the draws read the commands, the instance lists as attributes and the impostor positions
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    _drawProgram->useProgram();
+    glState.uniform(_drawLocations.projViewMatrix, projViewMtx);
+    glState.uniform(_drawLocations.animationTime, animationTime);
+    glState.bindVertexArray(_vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+    glState.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(_commands.size()));
+}
+
+void GpuDrivenRenderer::drawImpostors(const ImpostorAtlas& impostors, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+                                      const glm::vec3& cameraPosition) const {
+    if (!_commandBuffer) {
+        return;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+    impostors.drawIndirect(_impostorBuffer, static_cast<GLintptr>(_commands.size() * sizeof(DrawElementsCommand)),
+                           viewMtx, projMtx, cameraPosition);
+}
+
+GpuDrivenRenderer::DrawCounts GpuDrivenRenderer::readLastDrawCounts() const {
+    DrawCounts counts{ 0, 0, 0 };
+    if (!_commandBuffer) {
+        return counts;
+    }
+    // the cull pass wrote the instance counts on the GPU; the CPU copy in _commands still has them at 0
+    std::vector<DrawElementsCommand> commands(_commands.size());
+    DrawArraysCommand impostorCommand{};
+    glGetNamedBufferSubData(_commandBuffer, 0, commands.size() * sizeof(DrawElementsCommand), commands.data());
+    glGetNamedBufferSubData(_commandBuffer, static_cast<GLintptr>(commands.size() * sizeof(DrawElementsCommand)),
+                            sizeof(DrawArraysCommand), &impostorCommand);
+    for (const DrawElementsCommand& command : commands) {
+        counts.instances += command.instanceCount;
+        counts.triangles += command.instanceCount * (command.count / 3);
+    }
+    counts.impostors = impostorCommand.instanceCount;
+    return counts;
+}
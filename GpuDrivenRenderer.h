@@ -0,0 +1,189 @@
+#ifndef GPU_DRIVEN_RENDERER_H
+#define GPU_DRIVEN_RENDERER_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "ImpostorAtlas.h"
+#include "LODMesh.h"
+#include "PackedVertex.h"
+#include "ShaderCache.h"
+#include "StreamBuffer.h"
+#include <vector>
+
+/// \desc draws every registered part in one glMultiDrawElementsIndirect, GL 4.5.
+///
+/// The meshes' levels are merged into one vertex and one index buffer, with
+/// one DrawElementsIndirectCommand per level. Each frame a compute pass
+/// (gpuCull.cs.glsl) tests every part's bounding sphere against the frustum,
+/// picks its level with the same thresholds and hysteresis as LODMesh, and
+/// appends the part to that level's instance list; the draw then reads each
+/// instance's part index as a per-instance attribute, so no culling result
+/// ever comes back to the CPU. Parts past the impostor coverage append their
+/// position to a buffer ImpostorAtlas::drawIndirect draws from.
+///
+/// Parts are static, or hang off an anchor whose position is written to the
+/// stream buffer every frame; that is the only data that moves. Everything is sized in upload(),
+/// so drawing never allocates.
+class GpuDrivenRenderer {
+public:
+    /// \desc what the shader needs from the context, checked before setup()
+    static bool isSupported();
+
+    struct Material {
+        glm::vec3 ambient;
+        glm::vec3 diffuse;
+        glm::vec3 specular;
+        float shininess;
+    };
+
+    enum PartFlags {
+        /// \desc the part disappears past the impostor coverage
+        PART_USES_IMPOSTOR = 1 << 0,
+        /// \desc and leaves an impostor at its model's origin; one part per prop sets it
+        PART_DRAWS_IMPOSTOR = 1 << 1,
+        /// \desc lit by bakedLight and the spot light instead of the directional and point lights
+        PART_BAKED = 1 << 2,
+        /// \desc model's translation is a beak offset turned and pulsed like FPEngine::_animateBeak
+        PART_BEAK = 1 << 3,
+        /// \desc the beak also bobs up and down, the top one does
+        PART_BEAK_BOBS = 1 << 4
+    };
+
+    struct Part {
+        /// \desc world transform, or relative to the anchor; rotation and uniform scale only
+        glm::mat4 model;
+        /// \desc bounding sphere, world space or relative to the anchor
+        glm::vec3 boundsCenter;
+        float boundsRadius;
+        /// \desc as returned by addMesh
+        GLuint mesh;
+        /// \desc index into the anchors given to draw(), NO_ANCHOR for a part that never moves
+        GLint anchor;
+        GLuint flags;
+        Material material;
+        /// \desc the ambient cube for PART_BAKED, see LightBaker::AmbientCube
+        glm::vec3 bakedLight[6];
+    };
+    static constexpr GLint NO_ANCHOR = -1;
+
+    GpuDrivenRenderer();
+    ~GpuDrivenRenderer();
+    GpuDrivenRenderer(const GpuDrivenRenderer&) = delete;
+    GpuDrivenRenderer& operator=(const GpuDrivenRenderer&) = delete;
+
+    /// \desc compiles the cull and draw programs; the draw program evaluates numPointLights
+    bool setup(ShaderCache& shaderCache, int numPointLights);
+    void cleanup();
+
+    /// \desc copies every level of the mesh into the shared buffers
+    GLuint addMesh(const LODMesh& mesh);
+    /// \desc a mesh with a single level from interleaved position + normal floats
+    GLuint addMesh(const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices);
+    void addPart(const Part& part);
+    /// \desc uploads the meshes and parts added so far; numAnchors is the most draw() will be given
+    void upload(size_t numAnchors);
+
+    /// \desc the program that draws the parts; FPEngine sends it the camera and lights like a lighting variant
+    CachedShaderProgram* getDrawProgram() const { return _drawProgram; }
+    size_t getNumParts() const { return _parts.size(); }
+
+    /// \desc culls and draws every part; the draw program has to have its lights already.
+    /// The anchors and the reset commands go through stream
+    void draw(const glm::vec3* anchors, size_t numAnchors, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+              float lodBias, float impostorCoverage, float animationTime, StreamBuffer& stream) const;
+    /// \desc the impostors the last draw() left, in one indirect draw
+    void drawImpostors(const ImpostorAtlas& impostors, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+                       const glm::vec3& cameraPosition) const;
+
+    struct DrawCounts {
+        GLuint instances;
+        GLuint triangles;
+        GLuint impostors;
+    };
+    /// \desc reads back the instance counts the last draw() left in its commands; waits for the GPU,
+    /// so only for statistics, never inside the frame
+    DrawCounts readLastDrawCounts() const;
+
+private:
+    /// \desc std430 layout of a part, shared with gpuCull.cs.glsl and gpuDraw.vs.glsl
+    struct GpuPart {
+        glm::mat4 model;
+        glm::vec4 bounds;
+        glm::vec4 ambient;
+        glm::vec4 diffuse;
+        /// \desc w is the shininess
+        glm::vec4 specular;
+        glm::vec4 bakedLight[6];
+        GLuint mesh;
+        GLint anchor;
+        GLuint flags;
+        /// \desc written by the cull pass, the level it picked last frame
+        GLuint level;
+    };
+    /// \desc std430 layout of a mesh
+    struct GpuMesh {
+        glm::vec4 positionScale;
+        glm::vec4 positionOffset;
+        GLuint firstCommand;
+        GLuint numLevels;
+        GLuint pad[2];
+    };
+    /// \desc as glMultiDrawElementsIndirect reads them
+    struct DrawElementsCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+    struct DrawArraysCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint first;
+        GLuint baseInstance;
+    };
+
+    std::vector<GpuMesh> _meshes;
+    std::vector<GpuPart> _parts;
+    /// \desc filled by addMesh, uploaded and released by upload()
+    std::vector<PackedVertex::PositionNormal> _vertices;
+    std::vector<GLuint> _indices;
+    /// \desc one per mesh level with its instance count at 0; _impostorCommand follows them in the buffer
+    std::vector<DrawElementsCommand> _commands;
+    DrawArraysCommand _impostorCommand;
+
+    GLuint _vao;
+    GLuint _vertexBuffer;
+    GLuint _indexBuffer;
+    GLuint _partBuffer;
+    GLuint _meshBuffer;
+    /// \desc the commands, reset from a copy of _commands in the stream every frame
+    GLuint _commandBuffer;
+    /// \desc part indices, each command's list starting at its baseInstance
+    GLuint _instanceBuffer;
+    /// \desc vec4 per impostor written by the cull pass
+    GLuint _impostorBuffer;
+    size_t _maxAnchors;
+
+    CachedShaderProgram* _cullProgram;
+    CachedShaderProgram* _drawProgram;
+    struct CullUniformLocations {
+        GLint numParts;
+        GLint numAnchors;
+        GLint frustumPlanes;
+        GLint viewMatrix;
+        GLint projectionScale;
+        GLint lodBias;
+        GLint impostorCoverage;
+        GLint impostorCommand;
+    } _cullLocations;
+    struct DrawUniformLocations {
+        GLint projViewMatrix;
+        GLint animationTime;
+    } _drawLocations;
+
+    /// \desc appends a level's packed vertices and 32-bit indices, returns its command
+    DrawElementsCommand _appendLevel(const PackedVertex::PositionNormal* vertices, GLsizei numVertices, const GLuint* indices, GLsizei numIndices);
+};
+
+#endif // GPU_DRIVEN_RENDERER_H
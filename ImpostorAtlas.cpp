@@ -0,0 +1,211 @@
+#include "ImpostorAtlas.h"
+#include "GLStateCache.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <cstdio>
+#include <cstring>
+
+#ifndef M_PI
+#define M_PI 3.14159265f
+#endif
+
+ImpostorAtlas::ImpostorAtlas(GLuint numViews, GLsizei cellWidth, GLsizei cellHeight)
+    : _numViews(numViews),
+      _cellWidth(cellWidth),
+      _cellHeight(cellHeight),
+      _halfWidth(1.0f),
+      _height(1.0f),
+      _fbo(0),
+      _colorTexture(0),
+      _depthRenderbuffer(0),
+      _vao(0),
+      _quadVBO(0),
+      _indirectVAO(0),
+      _indirectPositionBuffer(0),
+      _shaderProgram(nullptr)
+{}
+
+ImpostorAtlas::~ImpostorAtlas() {
+    delete _shaderProgram;
+}
+
+bool ImpostorAtlas::setup(GLfloat halfWidth, GLfloat height, ShaderCache& shaderCache) {
+    _halfWidth = halfWidth;
+    _height = height;
+    const GLsizei atlasWidth = _cellWidth * static_cast<GLsizei>(_numViews);
+
+    glGenTextures(1, &_colorTexture);
+    glBindTexture(GL_TEXTURE_2D, _colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasWidth, _cellHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &_depthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, _depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasWidth, _cellHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depthRenderbuffer);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status == GL_FRAMEBUFFER_COMPLETE) {
+        // start fully transparent so only the prop itself survives the alpha test
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "[ERROR]: impostor atlas framebuffer incomplete (0x%x), impostors disabled\n", status);
+        cleanup();
+        return false;
+    }
+
+    _shaderProgram = shaderCache.load("shaders/impostor.vs.glsl", "shaders/impostor.fs.glsl");
+    _uniformLocations.viewMatrix = _shaderProgram->getUniformLocation("viewMatrix");
+    _uniformLocations.projMatrix = _shaderProgram->getUniformLocation("projMatrix");
+    _uniformLocations.cameraPosition = _shaderProgram->getUniformLocation("cameraPosition");
+    _uniformLocations.size = _shaderProgram->getUniformLocation("size");
+    _uniformLocations.numViews = _shaderProgram->getUniformLocation("numViews");
+    _uniformLocations.atlas = _shaderProgram->getUniformLocation("atlas");
+
+    _shaderProgram->useProgram();
+    glUniform2f(_uniformLocations.size, _halfWidth, _height);
+    glUniform1i(_uniformLocations.numViews, static_cast<GLint>(_numViews));
+    glUniform1i(_uniformLocations.atlas, 0);
+
+    // quad spans x in [-1, 1] and y in [0, 1], scaled by the prop size in the shader
+    const GLfloat quadCorners[] = {
+        -1.0f, 0.0f,
+         1.0f, 0.0f,
+        -1.0f, 1.0f,
+         1.0f, 1.0f
+    };
+
+    glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+
+    glGenBuffers(1, &_quadVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, _quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadCorners), quadCorners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+
+    // the positions move around the stream buffer, draw() points this at them
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    fprintf(stdout, "[INFO]: impostor atlas created with %u views of %dx%d\n", _numViews, _cellWidth, _cellHeight);
+    return true;
+}
+
+void ImpostorAtlas::cleanup() {
+    glDeleteFramebuffers(1, &_fbo);
+    glDeleteTextures(1, &_colorTexture);
+    glDeleteRenderbuffers(1, &_depthRenderbuffer);
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_quadVBO);
+    glDeleteVertexArrays(1, &_indirectVAO);
+    _fbo = _colorTexture = _depthRenderbuffer = _vao = _quadVBO = _indirectVAO = _indirectPositionBuffer = 0;
+    delete _shaderProgram;
+    _shaderProgram = nullptr;
+}
+
+glm::vec3 ImpostorAtlas::getBakeEyePosition(GLuint view) const {
+    // view i looks at the prop from azimuth i / numViews around +Y
+    float azimuth = static_cast<float>(view) / _numViews * 2.0f * M_PI;
+    float distance = 2.0f * (_halfWidth + _height);
+    return glm::vec3(cos(azimuth) * distance, _height / 2.0f, sin(azimuth) * distance);
+}
+
+glm::mat4 ImpostorAtlas::getBakeViewMatrix(GLuint view) const {
+    return glm::lookAt(getBakeEyePosition(view), glm::vec3(0.0f, _height / 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+glm::mat4 ImpostorAtlas::getBakeProjectionMatrix() const {
+    float distance = 2.0f * (_halfWidth + _height);
+    return glm::ortho(-_halfWidth, _halfWidth, -_height / 2.0f, _height / 2.0f,
+                      distance - 2.0f * _halfWidth, distance + 2.0f * _halfWidth);
+}
+
+void ImpostorAtlas::beginBake(GLuint view) const {
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+    glViewport(static_cast<GLint>(view) * _cellWidth, 0, _cellWidth, _cellHeight);
+}
+
+void ImpostorAtlas::endBake() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, _colorTexture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ImpostorAtlas::draw(const glm::vec3* positions, size_t numPositions, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+                         const glm::vec3& cameraPosition, StreamBuffer& stream) const {
+    if (numPositions == 0 || !_shaderProgram || !_vao) {
+        return;
+    }
+    GLintptr offset = 0;
+    void* instances = stream.map(numPositions * sizeof(glm::vec3), alignof(glm::vec3), offset);
+    if (!instances) {
+        return;
+    }
+    memcpy(instances, positions, numPositions * sizeof(glm::vec3));
+    stream.unmap();
+
+    GLStateCache& glState = GLStateCache::instance();
+    _shaderProgram->useProgram();
+    glState.uniform(_uniformLocations.viewMatrix, viewMtx);
+    glState.uniform(_uniformLocations.projMatrix, projMtx);
+    glState.uniform(_uniformLocations.cameraPosition, cameraPosition);
+
+    glState.bindTexture(0, GL_TEXTURE_2D, _colorTexture);
+
+    glState.bindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState.drawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(numPositions));
+}
+
+void ImpostorAtlas::drawIndirect(GLuint positionBuffer, GLintptr commandOffset, const glm::mat4& viewMtx,
+                                 const glm::mat4& projMtx, const glm::vec3& cameraPosition) const {
+    if (!_shaderProgram || !_vao) {
+        return;
+    }
+
+    GLStateCache& glState = GLStateCache::instance();
+    if (_indirectPositionBuffer != positionBuffer) {
+        if (!_indirectVAO) {
+            glGenVertexArrays(1, &_indirectVAO);
+        }
+        glState.bindVertexArray(_indirectVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, _quadVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _indirectPositionBuffer = positionBuffer;
+    }
+
+    _shaderProgram->useProgram();
+    glState.uniform(_uniformLocations.viewMatrix, viewMtx);
+    glState.uniform(_uniformLocations.projMatrix, projMtx);
+    glState.uniform(_uniformLocations.cameraPosition, cameraPosition);
+
+    glState.bindTexture(0, GL_TEXTURE_2D, _colorTexture);
+
+    glState.bindVertexArray(_indirectVAO);
+    glState.drawArraysIndirect(GL_TRIANGLE_STRIP, (void*)commandOffset);
+}
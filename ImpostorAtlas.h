@@ -0,0 +1,70 @@
+#ifndef IMPOSTOR_ATLAS_H
+#define IMPOSTOR_ATLAS_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "ShaderCache.h"
+#include "StreamBuffer.h"
+#include <vector>
+
+/// \desc billboard impostors for a prop that is drawn many times far away.
+/// The prop is rendered once per view angle into a horizontal strip of an atlas
+/// texture; distant instances are then drawn as one instanced batch of
+/// quads that turn about +Y and pick the cell closest to the camera's azimuth.
+class ImpostorAtlas {
+public:
+    ImpostorAtlas(GLuint numViews, GLsizei cellWidth, GLsizei cellHeight);
+    ~ImpostorAtlas();
+
+    /// \desc allocates the atlas for a prop spanning [-halfWidth, halfWidth] around +Y from y = 0 to height
+    bool setup(GLfloat halfWidth, GLfloat height, ShaderCache& shaderCache);
+    void cleanup();
+
+    GLuint getNumViews() const { return _numViews; }
+    glm::mat4 getBakeViewMatrix(GLuint view) const;
+    glm::mat4 getBakeProjectionMatrix() const;
+    glm::vec3 getBakeEyePosition(GLuint view) const;
+
+    /// \desc redirects rendering into the atlas cell of the given view
+    void beginBake(GLuint view) const;
+    /// \desc restores the default framebuffer and builds the atlas mipmaps
+    void endBake() const;
+
+    /// \desc draws one impostor per position, copied into the frame's region of stream
+    void draw(const glm::vec3* positions, size_t numPositions, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+              const glm::vec3& cameraPosition, StreamBuffer& stream) const;
+    /// \desc same, with the positions and their number written on the GPU (GL 4.3+): positionBuffer
+    /// holds one vec4 per impostor, and a DrawArraysIndirectCommand sits at commandOffset in
+    /// the bound GL_DRAW_INDIRECT_BUFFER
+    void drawIndirect(GLuint positionBuffer, GLintptr commandOffset, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+                      const glm::vec3& cameraPosition) const;
+
+private:
+    const GLuint _numViews;
+    const GLsizei _cellWidth;
+    const GLsizei _cellHeight;
+    GLfloat _halfWidth;
+    GLfloat _height;
+
+    GLuint _fbo;
+    GLuint _colorTexture;
+    GLuint _depthRenderbuffer;
+
+    GLuint _vao;
+    GLuint _quadVBO;
+    /// \desc the quad with its instances read from the last buffer given to drawIndirect
+    mutable GLuint _indirectVAO;
+    mutable GLuint _indirectPositionBuffer;
+
+    CachedShaderProgram* _shaderProgram;
+    struct ImpostorUniformLocations {
+        GLint viewMatrix;
+        GLint projMatrix;
+        GLint cameraPosition;
+        GLint size;
+        GLint numViews;
+        GLint atlas;
+    } _uniformLocations;
+};
+
+#endif // IMPOSTOR_ATLAS_H
@@ -0,0 +1,184 @@
+#include "JobSystem.h"
+#include "AllocationTracker.h"
+#include "Profiler.h"
+
+#include <cstdio>
+
+namespace {
+    /// \desc the deque the calling thread owns in the job system it last used
+    struct ThreadDeque {
+        const JobSystem* system;
+        size_t deque;
+    };
+    thread_local ThreadDeque threadDeque{ nullptr, 0 };
+}
+
+bool JobSystem::Deque::pushBack(const Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == DEQUE_CAPACITY) {
+        return false;
+    }
+    jobs[(head + size) % DEQUE_CAPACITY] = job;
+    ++size;
+    return true;
+}
+
+bool JobSystem::Deque::popBack(Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == 0) {
+        return false;
+    }
+    --size;
+    job = jobs[(head + size) % DEQUE_CAPACITY];
+    return true;
+}
+
+bool JobSystem::Deque::popFront(Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == 0) {
+        return false;
+    }
+    job = jobs[head];
+    head = (head + 1) % DEQUE_CAPACITY;
+    --size;
+    return true;
+}
+
+bool JobSystem::Deque::popBackCountedOn(const Counter* counter, Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == 0 || jobs[(head + size - 1) % DEQUE_CAPACITY].counter != counter) {
+        return false;
+    }
+    --size;
+    job = jobs[(head + size) % DEQUE_CAPACITY];
+    return true;
+}
+
+JobSystem::JobSystem(unsigned numThreads) {
+    if (numThreads == 0) {
+        // hardware_concurrency may not know, which leaves everything on the caller
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t numWorkers = numThreads - 1;
+    _numDeques = numWorkers + MAX_EXTERNAL_THREADS;
+    _deques.reset(new Deque[_numDeques]);
+    _workers.reserve(numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i) {
+        _workers.emplace_back(&JobSystem::_workerLoop, this, i);
+    }
+    fprintf(stdout, "[INFO]: job system running %zu worker thread%s beside the caller\n",
+            numWorkers, numWorkers == 1 ? "" : "s");
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _running.store(false);
+    }
+    _wake.notify_all();
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::submit(JobFunction function, void* data, Counter& counter) {
+    const Job job{ function, data, &counter };
+    counter.fetch_add(1, std::memory_order_relaxed);
+    const size_t deque = _workers.empty() ? _numDeques : _threadDeque();
+    // counted before it is pushed, so whoever takes it never sees the count go below zero;
+    // a worker going to sleep bumps _numSleeping before it looks at _numQueued, so one of
+    // the two always sees the other
+    _numQueued.fetch_add(1);
+    if (deque == _numDeques || !_deques[deque].pushBack(job)) {
+        _numQueued.fetch_sub(1);
+        _runJob(job);
+        return;
+    }
+    if (_numSleeping.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+        }
+        _wake.notify_one();
+    }
+}
+
+void JobSystem::wait(const Counter& counter) {
+    const size_t deque = _workers.empty() ? _numDeques : _threadDeque();
+    Job job;
+    while (counter.load(std::memory_order_acquire) > 0) {
+        if (deque < _numDeques && _takeJob(deque, job)) {
+            _runJob(job);
+        } else {
+            // the last jobs are running elsewhere
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::_waitForOwnJobs(const Counter& counter) {
+    const size_t deque = _workers.empty() ? _numDeques : _threadDeque();
+    Job job;
+    while (counter.load(std::memory_order_acquire) > 0) {
+        // only this thread pushes to its deque and everything it pushed since has been waited
+        // for, so the jobs counted on counter that nobody stole are at the back
+        if (deque < _numDeques && _deques[deque].popBackCountedOn(&counter, job)) {
+            _numQueued.fetch_sub(1);
+            _runJob(job);
+        } else {
+            // the rest are running elsewhere, at most one range each
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::_workerLoop(size_t deque) {
+    FP_PROFILE_THREAD_NAME("job worker");
+    threadDeque = ThreadDeque{ this, deque };
+    Job job;
+    while (true) {
+        if (_takeJob(deque, job)) {
+            // a job belongs to the frame that submitted it
+            FP_TRACK_ALLOCATIONS_SCOPE();
+            _runJob(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _numSleeping.fetch_add(1);
+        _wake.wait(lock, [this] { return _numQueued.load() > 0 || !_running.load(); });
+        _numSleeping.fetch_sub(1);
+        if (!_running.load()) {
+            return;
+        }
+    }
+}
+
+size_t JobSystem::_threadDeque() {
+    if (threadDeque.system != this) {
+        const size_t external = _numExternalThreads.fetch_add(1);
+        if (external >= MAX_EXTERNAL_THREADS) {
+            fprintf(stderr, "[ERROR]: more than %zu threads submit jobs, the rest run theirs inline\n", MAX_EXTERNAL_THREADS);
+        }
+        threadDeque = ThreadDeque{ this, std::min(_workers.size() + external, _numDeques) };
+    }
+    return threadDeque.deque;
+}
+
+bool JobSystem::_takeJob(size_t deque, Job& job) {
+    if (_numQueued.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    bool found = _deques[deque].popBack(job);
+    for (size_t i = 1; i < _numDeques && !found; ++i) {
+        found = _deques[(deque + i) % _numDeques].popFront(job);
+    }
+    if (found) {
+        _numQueued.fetch_sub(1);
+    }
+    return found;
+}
+
+void JobSystem::_runJob(const Job& job) {
+    job.function(job.data);
+    job.counter->fetch_sub(1, std::memory_order_release);
+}
@@ -0,0 +1,141 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// \desc a pool of worker threads, one per hardware thread beside the caller,
+/// running small jobs.
+///
+/// Every thread that submits jobs owns a deque: it pushes and pops its own jobs
+/// at the back, so the freshest work stays in its cache, and steals from the
+/// front of the other deques when it runs dry. A thread waiting on a counter
+/// runs jobs instead of blocking, which lets jobs submit and wait on jobs of
+/// their own. parallelFor is the exception: its caller claims ranges until none
+/// are left and then only takes back its own helper jobs, so the render thread
+/// culling props never picks up a simulation task and holds up the frame by a
+/// whole tick. With one thread there are no workers and every job runs inline
+/// when it is submitted, in submission order.
+///
+/// Jobs are a function and a pointer, so submitting never allocates; whatever
+/// the pointer refers to has to outlive the wait on its counter.
+class JobSystem {
+public:
+    /// \desc counts the jobs submitted against it that have not finished
+    using Counter = std::atomic<uint32_t>;
+    using JobFunction = void (*)(void* data);
+
+    /// \desc jobs each deque holds; a job submitted to a full deque runs right away
+    static constexpr size_t DEQUE_CAPACITY = 1024;
+    /// \desc threads besides the workers that may submit, the render and simulation threads
+    static constexpr size_t MAX_EXTERNAL_THREADS = 4;
+
+    /// \desc numThreads counts the submitting thread; 0 means one per hardware thread
+    explicit JobSystem(unsigned numThreads = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /// \desc workers plus the submitting thread
+    unsigned getNumThreads() const { return static_cast<unsigned>(_workers.size()) + 1; }
+
+    /// \desc queues function(data) on the calling thread's deque and counts it on counter
+    void submit(JobFunction function, void* data, Counter& counter);
+    /// \desc runs queued jobs, this thread's first, until counter drops to zero
+    void wait(const Counter& counter);
+
+    /// \desc calls body(begin, end) over [0, count) in ranges of at most grain items, spread
+    /// over the workers and the calling thread; returns once every range has run
+    template<typename F>
+    void parallelFor(size_t count, size_t grain, const F& body);
+
+private:
+    struct Job {
+        JobFunction function;
+        void* data;
+        Counter* counter;
+    };
+
+    /// \desc fixed ring of jobs; the owner works the back, thieves take from the front
+    struct Deque {
+        std::mutex mutex;
+        Job jobs[DEQUE_CAPACITY];
+        size_t head = 0;
+        size_t size = 0;
+
+        bool pushBack(const Job& job);
+        bool popBack(Job& job);
+        bool popFront(Job& job);
+        /// \desc pops the back job only if it is counted on counter
+        bool popBackCountedOn(const Counter* counter, Job& job);
+    };
+
+    /// \desc one per worker, then one per external thread in the order they first submit
+    std::unique_ptr<Deque[]> _deques;
+    size_t _numDeques;
+    std::atomic<size_t> _numExternalThreads{0};
+    std::vector<std::thread> _workers;
+
+    /// \desc queued jobs not yet taken, so idle workers know when to sleep
+    std::atomic<size_t> _numQueued{0};
+    std::atomic<unsigned> _numSleeping{0};
+    std::atomic<bool> _running{true};
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+
+    void _workerLoop(size_t deque);
+    /// \desc the calling thread's deque, or _numDeques once every external slot is taken
+    size_t _threadDeque();
+    /// \desc pops from the own deque, else steals starting after it
+    bool _takeJob(size_t deque, Job& job);
+    static void _runJob(const Job& job);
+    /// \desc runs the jobs counted on counter still in this thread's deque, and nothing else,
+    /// until counter drops to zero
+    void _waitForOwnJobs(const Counter& counter);
+
+    template<typename F>
+    struct ParallelFor {
+        const F* body;
+        size_t count;
+        size_t grain;
+        std::atomic<size_t> next;
+
+        static void run(void* data) {
+            ParallelFor* range = static_cast<ParallelFor*>(data);
+            for (size_t begin = range->next.fetch_add(range->grain, std::memory_order_relaxed); begin < range->count;
+                 begin = range->next.fetch_add(range->grain, std::memory_order_relaxed)) {
+                (*range->body)(begin, std::min(begin + range->grain, range->count));
+            }
+        }
+    };
+};
+
+template<typename F>
+void JobSystem::parallelFor(size_t count, size_t grain, const F& body) {
+    grain = std::max<size_t>(grain, 1);
+    const size_t numRanges = (count + grain - 1) / grain;
+    if (numRanges <= 1 || _workers.empty()) {
+        if (count > 0) body(0, count);
+        return;
+    }
+
+    // one helper job per thread that could join, each claiming ranges until none are left;
+    // the caller claims them too, so a busy pool costs nothing but the submit
+    ParallelFor<F> range{ &body, count, grain, {0} };
+    Counter counter{0};
+    const size_t numHelpers = std::min<size_t>(numRanges - 1, _workers.size());
+    for (size_t i = 0; i < numHelpers; ++i) {
+        submit(&ParallelFor<F>::run, &range, counter);
+    }
+    ParallelFor<F>::run(&range);
+    _waitForOwnJobs(counter);
+}
+
+#endif // JOB_SYSTEM_H
@@ -0,0 +1,203 @@
+#include "LODMesh.h"
+#include "GLStateCache.h"
+#include "PackedVertex.h"
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265f
+#endif
+
+namespace {
+    /// \desc coverage needed to use levels 0, 1 and 2; anything smaller uses the last level
+    constexpr float LEVEL_THRESHOLDS[LODMesh::NUM_LEVELS - 1] = { 0.20f, 0.07f, 0.025f };
+    /// \desc how far past a threshold the coverage has to move before switching levels
+    constexpr float HYSTERESIS = 0.15f;
+
+    GLuint rawLevel(float coverage, float impostorThreshold) {
+        for (GLuint level = 0; level < LODMesh::NUM_LEVELS - 1; ++level) {
+            if (coverage >= LEVEL_THRESHOLDS[level]) return level;
+        }
+        if (coverage < impostorThreshold) return LODMesh::NUM_LEVELS;
+        return LODMesh::NUM_LEVELS - 1;
+    }
+}
+
+LODMesh::LODMesh()
+    : _positionScale(1.0f),
+      _positionOffset(0.0f)
+{
+    for (Level& level : _levels) {
+        level = Level{0, 0, 0, 0, 0, GL_UNSIGNED_INT};
+    }
+}
+
+void LODMesh::_setBounds(const glm::vec3& min, const glm::vec3& max) {
+    const PackedVertex::PositionDecode decode = PackedVertex::decodeForBounds(&min.x, &max.x);
+    _positionScale = glm::vec3(decode.scale[0], decode.scale[1], decode.scale[2]);
+    _positionOffset = glm::vec3(decode.offset[0], decode.offset[1], decode.offset[2]);
+}
+
+LODMesh LODMesh::createSphere(GLfloat radius) {
+    LODMesh mesh;
+    mesh._setBounds(glm::vec3(-radius), glm::vec3(radius));
+    for (GLuint level = 0; level < NUM_LEVELS; ++level) {
+        mesh._buildSphere(level, radius);
+    }
+    return mesh;
+}
+
+LODMesh LODMesh::createCylinder(GLfloat baseRadius, GLfloat topRadius, GLfloat height) {
+    LODMesh mesh;
+    const GLfloat radius = std::max(baseRadius, topRadius);
+    mesh._setBounds(glm::vec3(-radius, 0.0f, -radius), glm::vec3(radius, height, radius));
+    for (GLuint level = 0; level < NUM_LEVELS; ++level) {
+        mesh._buildRevolution(level, baseRadius, topRadius, height);
+    }
+    return mesh;
+}
+
+LODMesh LODMesh::createCone(GLfloat baseRadius, GLfloat height) {
+    return createCylinder(baseRadius, 0.0f, height);
+}
+
+void LODMesh::_buildSphere(GLuint level, GLfloat radius) {
+    const GLint stacks = LEVEL_TESSELLATION[level];
+    const GLint slices = LEVEL_TESSELLATION[level];
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+
+    for (GLint stack = 0; stack <= stacks; ++stack) {
+        float phi = static_cast<float>(stack) / stacks * M_PI;
+        for (GLint slice = 0; slice <= slices; ++slice) {
+            float theta = static_cast<float>(slice) / slices * 2.0f * M_PI;
+            glm::vec3 normal(std::sin(phi) * std::cos(theta), -std::cos(phi), std::sin(phi) * std::sin(theta));
+            glm::vec3 position = normal * radius;
+            vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z });
+
+            if (stack < stacks && slice < slices) {
+                GLuint current = stack * (slices + 1) + slice;
+                GLuint next = (stack + 1) * (slices + 1) + slice;
+                indices.insert(indices.end(), { current, next, current + 1, current + 1, next, next + 1 });
+            }
+        }
+    }
+    _upload(level, vertices, indices);
+}
+
+void LODMesh::_buildRevolution(GLuint level, GLfloat baseRadius, GLfloat topRadius, GLfloat height) {
+    const GLint stacks = LEVEL_TESSELLATION[level];
+    const GLint slices = LEVEL_TESSELLATION[level];
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+
+    // the side normal leans up by the slope of the radius
+    const float slope = (baseRadius - topRadius) / height;
+
+    for (GLint stack = 0; stack <= stacks; ++stack) {
+        float t = static_cast<float>(stack) / stacks;
+        float y = t * height;
+        float radius = baseRadius + (topRadius - baseRadius) * t;
+        for (GLint slice = 0; slice <= slices; ++slice) {
+            float theta = static_cast<float>(slice) / slices * 2.0f * M_PI;
+            glm::vec3 normal = glm::normalize(glm::vec3(std::cos(theta), slope, std::sin(theta)));
+            vertices.insert(vertices.end(), { radius * std::cos(theta), y, radius * std::sin(theta), normal.x, normal.y, normal.z });
+
+            if (stack < stacks && slice < slices) {
+                GLuint current = stack * (slices + 1) + slice;
+                GLuint next = (stack + 1) * (slices + 1) + slice;
+                indices.insert(indices.end(), { current, next, current + 1, current + 1, next, next + 1 });
+            }
+        }
+    }
+    _upload(level, vertices, indices);
+}
+
+void LODMesh::_upload(GLuint level, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices) {
+    Level& target = _levels[level];
+
+    std::vector<uint32_t> remap;
+    _cacheReport += MeshOptimizer::optimize(indices.data(), indices.size(), vertices.size() / 6, vertices.data(), 6, remap);
+    MeshOptimizer::remapVertices(remap, vertices, 6);
+
+    glGenVertexArrays(1, &target.vao);
+    glBindVertexArray(target.vao);
+
+    const PackedVertex::PositionDecode decode = {
+        { _positionScale.x, _positionScale.y, _positionScale.z },
+        { _positionOffset.x, _positionOffset.y, _positionOffset.z }
+    };
+    std::vector<PackedVertex::PositionNormal> packed(vertices.size() / 6);
+    for (size_t i = 0; i < packed.size(); ++i) {
+        PackedVertex::packPosition(decode, &vertices[i * 6], packed[i].position);
+        PackedVertex::packNormal(&vertices[i * 6 + 3], packed[i].normal);
+    }
+
+    glGenBuffers(1, &target.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, target.vbo);
+    glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex::PositionNormal), packed.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &target.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, target.ebo);
+    if (PackedVertex::fitsShortIndices(packed.size())) {
+        const std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+        target.indexType = GL_UNSIGNED_SHORT;
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        target.indexType = GL_UNSIGNED_INT;
+    }
+
+    // plain shorts, the shader applies the scale and offset and unfolds the normal
+    glEnableVertexAttribArray(0); // Position
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex::PositionNormal),
+                          (void*)offsetof(PackedVertex::PositionNormal, position));
+    glEnableVertexAttribArray(1); // Normal
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(PackedVertex::PositionNormal),
+                          (void*)offsetof(PackedVertex::PositionNormal, normal));
+
+    glBindVertexArray(0);
+
+    target.numVertices = static_cast<GLsizei>(packed.size());
+    target.numIndices = static_cast<GLsizei>(indices.size());
+}
+
+void LODMesh::draw(GLuint level) const {
+    const Level& source = _levels[level < NUM_LEVELS ? level : NUM_LEVELS - 1];
+    GLStateCache& glState = GLStateCache::instance();
+    glState.bindVertexArray(source.vao);
+    glState.drawElements(GL_TRIANGLES, source.numIndices, source.indexType, nullptr);
+}
+
+LODMesh::LevelBuffers LODMesh::getLevelBuffers(GLuint level) const {
+    const Level& source = _levels[level < NUM_LEVELS ? level : NUM_LEVELS - 1];
+    return LevelBuffers{ source.vbo, source.ebo, source.numVertices, source.numIndices, source.indexType };
+}
+
+void LODMesh::cleanup() {
+    for (Level& level : _levels) {
+        glDeleteVertexArrays(1, &level.vao);
+        glDeleteBuffers(1, &level.vbo);
+        glDeleteBuffers(1, &level.ebo);
+        level = Level{0, 0, 0, 0, 0, GL_UNSIGNED_INT};
+    }
+}
+
+float LODMesh::screenCoverage(const glm::vec3& center, float radius, const glm::mat4& viewMtx, const glm::mat4& projMtx) {
+    float distance = -(viewMtx * glm::vec4(center, 1.0f)).z;
+    if (distance <= radius) {
+        return 1.0f; // camera is inside or right next to the object
+    }
+    // projMtx[1][1] is cot(fovy / 2), so this is the diameter over the full viewport height
+    return radius * projMtx[1][1] / distance;
+}
+
+GLuint LODMesh::selectLevel(float screenCoverage, GLuint currentLevel, float impostorThreshold) {
+    // only refine once the coverage is clearly above a threshold,
+    // and only coarsen once it is clearly below one
+    GLuint finer = rawLevel(screenCoverage / (1.0f + HYSTERESIS), impostorThreshold);
+    GLuint coarser = rawLevel(screenCoverage * (1.0f + HYSTERESIS), impostorThreshold);
+
+    if (finer < currentLevel) return finer;
+    if (coarser > currentLevel) return coarser;
+    return currentLevel;
+}
@@ -0,0 +1,78 @@
+#ifndef LOD_MESH_H
+#define LOD_MESH_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "MeshOptimizer.h"
+#include <vector>
+
+/// \desc a primitive pre-built at several tessellation levels. Level 0 matches
+/// the old fixed 16x16 CSCI441 shapes, every following level is coarser.
+/// Vertices are packed as PackedVertex::PositionNormal at attribute locations
+/// 0 and 1, and draw with the lighting shader's PACKED_MESH permutation given
+/// getPositionScale() and getPositionOffset(). Indices are 16-bit whenever a
+/// level has few enough vertices, and every level goes through MeshOptimizer
+/// before it is uploaded.
+class LODMesh {
+public:
+    static constexpr GLuint NUM_LEVELS = 4;
+    /// \desc stacks and slices used for each level
+    static constexpr GLint LEVEL_TESSELLATION[NUM_LEVELS] = { 16, 10, 6, 4 };
+
+    static LODMesh createSphere(GLfloat radius);
+    static LODMesh createCylinder(GLfloat baseRadius, GLfloat topRadius, GLfloat height);
+    static LODMesh createCone(GLfloat baseRadius, GLfloat height);
+
+    LODMesh();
+
+    void draw(GLuint level) const;
+    void cleanup();
+
+    GLsizei getNumTriangles(GLuint level) const { return _levels[level].numIndices / 3; }
+    /// \desc a level's buffers, for copying it into a buffer shared with other meshes
+    struct LevelBuffers {
+        GLuint vbo;
+        GLuint ebo;
+        GLsizei numVertices;
+        GLsizei numIndices;
+        GLenum indexType;
+    };
+    LevelBuffers getLevelBuffers(GLuint level) const;
+    /// \desc shared by every level, they all fit the same bounds
+    const glm::vec3& getPositionScale() const { return _positionScale; }
+    const glm::vec3& getPositionOffset() const { return _positionOffset; }
+    /// \desc the vertex cache before and after MeshOptimizer, all levels together
+    const MeshOptimizer::Report& getCacheReport() const { return _cacheReport; }
+
+    /// \desc fraction of the viewport height covered by a bounding sphere
+    static float screenCoverage(const glm::vec3& center, float radius, const glm::mat4& viewMtx, const glm::mat4& projMtx);
+    /// \desc picks the level for the given coverage, only leaving currentLevel once the
+    /// coverage is clearly past a threshold so objects near a boundary do not flicker.
+    /// Returns NUM_LEVELS when the coverage is below impostorThreshold.
+    static GLuint selectLevel(float screenCoverage, GLuint currentLevel, float impostorThreshold = 0.0f);
+
+private:
+    struct Level {
+        GLuint vao;
+        GLuint vbo;
+        GLuint ebo;
+        GLsizei numVertices;
+        GLsizei numIndices;
+        GLenum indexType;
+    } _levels[NUM_LEVELS];
+    glm::vec3 _positionScale;
+    glm::vec3 _positionOffset;
+    MeshOptimizer::Report _cacheReport;
+
+    /// \desc the box every level's positions are quantized into
+    void _setBounds(const glm::vec3& min, const glm::vec3& max);
+
+    /// \desc generates a surface of revolution around +Y with the radius varying linearly
+    /// from baseRadius at y = 0 to topRadius at y = height
+    void _buildRevolution(GLuint level, GLfloat baseRadius, GLfloat topRadius, GLfloat height);
+    void _buildSphere(GLuint level, GLfloat radius);
+    /// \desc reorders interleaved position + normal floats and their indices for the GPU, packs and uploads them
+    void _upload(GLuint level, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices);
+};
+
+#endif // LOD_MESH_H
@@ -0,0 +1,73 @@
+#include "LatencyProbe.h"
+#include "FrameArena.h"
+
+#include <algorithm>
+
+namespace {
+    /// \desc events that are never applied, say because the input queue was full, are given up on
+    constexpr size_t MAX_PENDING = 1024;
+}
+
+LatencyProbe::LatencyProbe(size_t maxSamples)
+    : _pending(MAX_PENDING),
+      _firstPending(0),
+      _numPending(0),
+      _maxSamples(std::max<size_t>(1, maxSamples)),
+      _nextSample(0),
+      _lastSequence(0)
+{
+    _samples.reserve(_maxSamples);
+}
+
+uint64_t LatencyProbe::recordInput() {
+    if (_numPending == MAX_PENDING) {
+        _firstPending = (_firstPending + 1) % MAX_PENDING;
+        --_numPending;
+    }
+    _pending[(_firstPending + _numPending) % MAX_PENDING] = PendingInput{ ++_lastSequence, Clock::now() };
+    ++_numPending;
+    return _lastSequence;
+}
+
+void LatencyProbe::recordPresent(uint64_t appliedSequence) {
+    if (_numPending == 0 || _pending[_firstPending].sequence > appliedSequence) {
+        return;
+    }
+    const Clock::time_point presentTime = Clock::now();
+    while (_numPending > 0 && _pending[_firstPending].sequence <= appliedSequence) {
+        const float milliseconds = std::chrono::duration<float, std::milli>(presentTime - _pending[_firstPending].time).count();
+        if (_samples.size() < _maxSamples) {
+            _samples.push_back(milliseconds);
+        } else {
+            _samples[_nextSample] = milliseconds;
+        }
+        _nextSample = (_nextSample + 1) % _maxSamples;
+        _firstPending = (_firstPending + 1) % MAX_PENDING;
+        --_numPending;
+    }
+}
+
+LatencyProbe::Percentiles LatencyProbe::getPercentiles(FrameArena& scratch) const {
+    Percentiles percentiles{ _samples.size(), 0.0f, 0.0f, 0.0f, 0.0f };
+    if (_samples.empty()) {
+        return percentiles;
+    }
+    float* sorted = scratch.allocate<float>(_samples.size());
+    std::copy(_samples.begin(), _samples.end(), sorted);
+    std::sort(sorted, sorted + _samples.size());
+    auto at = [sorted, count = _samples.size()](float fraction) {
+        return sorted[static_cast<size_t>(fraction * static_cast<float>(count - 1) + 0.5f)];
+    };
+    percentiles.p50 = at(0.50f);
+    percentiles.p90 = at(0.90f);
+    percentiles.p99 = at(0.99f);
+    percentiles.max = sorted[_samples.size() - 1];
+    return percentiles;
+}
+
+void LatencyProbe::reset() {
+    _firstPending = 0;
+    _numPending = 0;
+    _samples.clear();
+    _nextSample = 0;
+}
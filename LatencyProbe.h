@@ -0,0 +1,57 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FrameArena;
+
+/// \desc input-to-photon latency. Each input event is stamped with a sequence
+/// number and the time it arrived; when the first frame built from a snapshot
+/// that applied it has been swapped, the time in between is one sample. The
+/// swap is the last point the game can see, the display's scanout comes on
+/// top of it. Used from the render thread only.
+class LatencyProbe {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// \desc in milliseconds
+    struct Percentiles {
+        size_t samples;
+        float p50;
+        float p90;
+        float p99;
+        float max;
+    };
+
+    /// \desc keeps the latest maxSamples samples
+    explicit LatencyProbe(size_t maxSamples = 4096);
+
+    /// \desc stamps a new event, returns its sequence number; the first one is 1
+    uint64_t recordInput();
+    /// \desc a frame reflecting every event up to appliedSequence was just presented
+    void recordPresent(uint64_t appliedSequence);
+
+    /// \desc sorts a copy of the samples in scratch
+    Percentiles getPercentiles(FrameArena& scratch) const;
+    void reset();
+
+private:
+    struct PendingInput {
+        uint64_t sequence;
+        Clock::time_point time;
+    };
+    /// \desc ring of the events not presented yet, oldest at _firstPending
+    std::vector<PendingInput> _pending;
+    size_t _firstPending;
+    size_t _numPending;
+    /// \desc ring of the latest samples, in milliseconds
+    std::vector<float> _samples;
+    size_t _maxSamples;
+    size_t _nextSample;
+    uint64_t _lastSequence;
+};
+
+#endif // LATENCY_PROBE_H
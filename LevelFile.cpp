@@ -0,0 +1,142 @@
+#include "LevelFile.h"
+#include "PackedVertex.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+LevelFile::~LevelFile() {
+    close();
+}
+
+bool LevelFile::open(const char* filename) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "[ERROR]: could not open level %s\n", filename);
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0
+                     ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data) {
+        fprintf(stderr, "[ERROR]: could not map level %s\n", filename);
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    _fileHandle = file;
+    _mappingHandle = mapping;
+    _size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int file = ::open(filename, O_RDONLY);
+    if (file == -1) {
+        fprintf(stderr, "[ERROR]: could not open level %s\n", filename);
+        return false;
+    }
+    struct stat status;
+    void* data = fstat(file, &status) == 0 && status.st_size > 0
+                 ? mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    // the mapping keeps the file alive on its own
+    ::close(file);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "[ERROR]: could not map level %s\n", filename);
+        return false;
+    }
+    _size = static_cast<size_t>(status.st_size);
+#endif
+    _data = static_cast<const unsigned char*>(data);
+
+    if (_size < sizeof(LevelFormat::Header) || getHeader().magic != LevelFormat::MAGIC) {
+        fprintf(stderr, "[ERROR]: %s is not a compiled level\n", filename);
+        close();
+        return false;
+    }
+    const LevelFormat::Header& header = getHeader();
+    if (header.version != LevelFormat::VERSION) {
+        fprintf(stderr, "[ERROR]: level %s is version %u, expected %u; recompile it with fp_levelc\n",
+                filename, header.version, LevelFormat::VERSION);
+        close();
+        return false;
+    }
+    bool valid = header.fileSize == _size
+            && _validSection(header.platforms, sizeof(LevelFormat::Platform))
+            && _validSection(header.vertices, sizeof(LevelFormat::Vertex))
+            && _validSection(header.indices, sizeof(uint16_t))
+            && _validSection(header.props, sizeof(LevelFormat::Prop))
+            && _validSection(header.pickups, sizeof(LevelFormat::Pickup))
+            && _validSection(header.spawns, sizeof(LevelFormat::Spawn))
+            && _validSection(header.gridCells, sizeof(LevelFormat::GridCell))
+            && _validSection(header.gridItems, sizeof(uint32_t))
+            && header.gridCells.count == static_cast<uint64_t>(header.grid.cellsX) * header.grid.cellsZ
+            && header.grid.cellSize > 0.0f
+            && _validReferences();
+    if (!valid) {
+        fprintf(stderr, "[ERROR]: level %s is damaged\n", filename);
+        close();
+        return false;
+    }
+
+    fprintf(stdout, "[INFO]: mapped level %s: %zu platforms, %zu props, %zu pickups, %zu bytes\n",
+            filename, getNumPlatforms(), getNumProps(), getNumPickups(), _size);
+    return true;
+}
+
+bool LevelFile::_validSection(const LevelFormat::Section& section, size_t recordSize) const {
+    return section.offset % 4 == 0 && section.offset <= _size
+           && section.count <= (_size - section.offset) / recordSize;
+}
+
+bool LevelFile::_validReferences() const {
+    // only the few records that index other sections, the vertex and index data are left to the GPU
+    const LevelFormat::Platform* platforms = getPlatforms();
+    for (size_t i = 0; i < getNumPlatforms(); ++i) {
+        if (platforms[i].firstIndex > getNumIndices() || platforms[i].numIndices > getNumIndices() - platforms[i].firstIndex) {
+            return false;
+        }
+        if (platforms[i].firstVertex > getNumVertices() || platforms[i].numVertices > getNumVertices() - platforms[i].firstVertex
+            || platforms[i].numVertices > PackedVertex::MAX_SHORT_INDEXED_VERTICES) {
+            return false;
+        }
+    }
+    const LevelFormat::Header& header = getHeader();
+    const LevelFormat::GridCell* cells = _section<LevelFormat::GridCell>(header.gridCells);
+    for (uint32_t i = 0; i < header.gridCells.count; ++i) {
+        if (cells[i].firstItem > header.gridItems.count || cells[i].numItems > header.gridItems.count - cells[i].firstItem) {
+            return false;
+        }
+    }
+    const uint32_t* items = _section<uint32_t>(header.gridItems);
+    for (uint32_t i = 0; i < header.gridItems.count; ++i) {
+        if (items[i] >= header.props.count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LevelFile::close() {
+    if (!_data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(static_cast<HANDLE>(_mappingHandle));
+    CloseHandle(static_cast<HANDLE>(_fileHandle));
+    _fileHandle = _mappingHandle = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+}
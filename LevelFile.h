@@ -0,0 +1,100 @@
+#ifndef LEVEL_FILE_H
+#define LEVEL_FILE_H
+
+#include "LevelFormat.h"
+
+#include <algorithm>
+#include <cstddef>
+
+/// \desc a compiled level mapped into memory. Nothing is parsed or copied:
+/// open() checks the header and that every section and cross reference lies
+/// inside the file, after that the records are read straight out of the
+/// mapping, which stays valid until close().
+class LevelFile {
+public:
+    LevelFile() = default;
+    ~LevelFile();
+    LevelFile(const LevelFile&) = delete;
+    LevelFile& operator=(const LevelFile&) = delete;
+
+    /// \desc maps the file, returns false and reports why when it is not a usable level
+    bool open(const char* filename);
+    void close();
+    bool isOpen() const { return _data != nullptr; }
+
+    const LevelFormat::Header& getHeader() const { return *reinterpret_cast<const LevelFormat::Header*>(_data); }
+
+    const LevelFormat::Platform* getPlatforms() const { return _section<LevelFormat::Platform>(getHeader().platforms); }
+    size_t getNumPlatforms() const { return _data ? getHeader().platforms.count : 0; }
+    const LevelFormat::Vertex* getVertices() const { return _section<LevelFormat::Vertex>(getHeader().vertices); }
+    size_t getNumVertices() const { return _data ? getHeader().vertices.count : 0; }
+    /// \desc 16-bit, relative to the first vertex of the platform they belong to
+    const uint16_t* getIndices() const { return _section<uint16_t>(getHeader().indices); }
+    size_t getNumIndices() const { return _data ? getHeader().indices.count : 0; }
+    const LevelFormat::Prop* getProps() const { return _section<LevelFormat::Prop>(getHeader().props); }
+    size_t getNumProps() const { return _data ? getHeader().props.count : 0; }
+    const LevelFormat::Pickup* getPickups() const { return _section<LevelFormat::Pickup>(getHeader().pickups); }
+    size_t getNumPickups() const { return _data ? getHeader().pickups.count : 0; }
+    const LevelFormat::Spawn* getSpawns() const { return _section<LevelFormat::Spawn>(getHeader().spawns); }
+    size_t getNumSpawns() const { return _data ? getHeader().spawns.count : 0; }
+
+    /// \desc calls visit(propIndex, prop) for the props filed in the grid cells around (x, z),
+    /// stops and returns true as soon as visit does. A prop near a cell border can be visited twice.
+    /// The counts above and this are safe to call on a closed file.
+    template<typename Visitor>
+    bool visitPropsNear(float x, float z, float radius, Visitor visit) const;
+
+private:
+    template<typename T>
+    const T* _section(const LevelFormat::Section& section) const {
+        return reinterpret_cast<const T*>(_data + section.offset);
+    }
+    /// \desc whether count records of recordSize bytes at the section's offset fit in the file
+    bool _validSection(const LevelFormat::Section& section, size_t recordSize) const;
+    /// \desc whether the platform index and vertex ranges and the grid stay inside their sections
+    bool _validReferences() const;
+
+    const unsigned char* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void* _fileHandle = nullptr;
+    void* _mappingHandle = nullptr;
+#endif
+};
+
+template<typename Visitor>
+bool LevelFile::visitPropsNear(float x, float z, float radius, Visitor visit) const {
+    if (!_data) {
+        return false;
+    }
+    const LevelFormat::Header& header = getHeader();
+    const LevelFormat::Grid& grid = header.grid;
+    if (grid.cellsX == 0 || grid.cellsZ == 0) {
+        return false;
+    }
+
+    // cells are clamped to the grid, props were filed in the border cells when they stick out
+    auto cellOf = [&grid](float coordinate, float origin, uint32_t cells) {
+        const float cell = (coordinate - origin) / grid.cellSize;
+        return cell <= 0.0f ? 0u : std::min(cells - 1, static_cast<uint32_t>(cell));
+    };
+    const uint32_t firstX = cellOf(x - radius, grid.originX, grid.cellsX), lastX = cellOf(x + radius, grid.originX, grid.cellsX);
+    const uint32_t firstZ = cellOf(z - radius, grid.originZ, grid.cellsZ), lastZ = cellOf(z + radius, grid.originZ, grid.cellsZ);
+
+    const LevelFormat::GridCell* cells = _section<LevelFormat::GridCell>(header.gridCells);
+    const uint32_t* items = _section<uint32_t>(header.gridItems);
+    const LevelFormat::Prop* props = getProps();
+    for (uint32_t cellZ = firstZ; cellZ <= lastZ; ++cellZ) {
+        for (uint32_t cellX = firstX; cellX <= lastX; ++cellX) {
+            const LevelFormat::GridCell& cell = cells[cellZ * grid.cellsX + cellX];
+            for (uint32_t i = cell.firstItem; i < cell.firstItem + cell.numItems; ++i) {
+                if (visit(items[i], props[items[i]])) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+#endif // LEVEL_FILE_H
@@ -0,0 +1,124 @@
+#ifndef LEVEL_FORMAT_H
+#define LEVEL_FORMAT_H
+
+#include <cstdint>
+
+/// \desc binary layout of a compiled level, written by fp_levelc and mapped by LevelFile.
+///
+/// A level is a Header followed by sections of fixed size records. Each
+/// section is located by a byte offset from the start of the file and is
+/// 4-byte aligned, every field is a fixed width little endian type and no
+/// record holds a pointer, so the engine reads the records where they lie
+/// in the mapping. Platform geometry is packed as described in PackedVertex.h,
+/// each platform carries its own decode and its 16-bit indices count from
+/// its first vertex, so both sections upload as is.
+namespace LevelFormat {
+    /// \desc "FPLV" read as a little endian word
+    constexpr uint32_t MAGIC = 0x564C5046;
+    /// \desc bumped whenever a record changes, older files are rejected
+    constexpr uint32_t VERSION = 2;
+
+    enum Texture : uint32_t {
+        TEXTURE_NONE = 0,
+        TEXTURE_RUG,
+        TEXTURE_MARBLE,
+        TEXTURE_RAINBOW,
+        TEXTURE_IRISES,
+        TEXTURE_QUARTZ
+    };
+    enum PlatformType : uint32_t { PLATFORM_DISK = 0, PLATFORM_RECT = 1 };
+    enum PropType : uint32_t { PROP_TREE = 0, PROP_LAMP = 1 };
+    enum PickupType : uint32_t { PICKUP_COIN = 0, PICKUP_BLUE_SPHERE = 1 };
+    enum SpawnType : uint32_t { SPAWN_VEHICLE = 0, SPAWN_MARBLE = 1 };
+
+    struct Section {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    /// \desc uniform grid over the xz plane. Every prop is filed in each cell
+    /// its square of half size propRadius touches, so a query only has to look
+    /// at the cells its own square touches.
+    struct Grid {
+        float originX;
+        float originZ;
+        float cellSize;
+        float propRadius;
+        uint32_t cellsX;
+        uint32_t cellsZ;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        /// \desc size of the whole file, catches truncated copies
+        uint32_t fileSize;
+        Section platforms;
+        Section vertices;
+        Section indices;
+        Section props;
+        Section pickups;
+        Section spawns;
+        /// \desc cellsX * cellsZ GridCells, row by row along x
+        Section gridCells;
+        /// \desc uint32_t prop indices the cells point into
+        Section gridItems;
+        Grid grid;
+    };
+
+    struct Platform {
+        uint32_t type;
+        uint32_t texture;
+        float position[3];
+        /// \desc inner and outer radius of a disk, x and z length of a rectangle
+        float size[2];
+        /// \desc how far past the edge the vehicle can drive before it falls
+        float fallBuffer;
+        /// \desc range of the index section holding this platform's triangles
+        uint32_t firstIndex;
+        uint32_t numIndices;
+        /// \desc range of the vertex section the indices count from, at most 65536 long
+        uint32_t firstVertex;
+        uint32_t numVertices;
+        /// \desc world position = positionOffset + packed position * positionScale
+        float positionScale[3];
+        float positionOffset[3];
+    };
+
+    /// \desc 12 bytes, the unpacked vertex took 20
+    struct Vertex {
+        /// \desc quantized inside the platform's bounds, w is padding
+        int16_t position[4];
+        /// \desc normalized to [0, 1]
+        uint16_t texCoord[2];
+    };
+
+    struct Prop {
+        uint32_t type;
+        float position[3];
+    };
+
+    struct Pickup {
+        uint32_t type;
+        float position[3];
+    };
+
+    struct Spawn {
+        uint32_t type;
+        float position[3];
+        /// \desc in radians
+        float heading;
+    };
+
+    struct GridCell {
+        uint32_t firstItem;
+        uint32_t numItems;
+    };
+
+    static_assert(sizeof(Header) == 100, "the header layout is part of the file format");
+    static_assert(sizeof(Platform) == 72 && sizeof(Vertex) == 12 && sizeof(Prop) == 16 &&
+                  sizeof(Pickup) == 16 && sizeof(Spawn) == 20 && sizeof(GridCell) == 8,
+                  "the record layouts are part of the file format");
+}
+
+#endif // LEVEL_FORMAT_H
@@ -0,0 +1,163 @@
+#include "LightBaker.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+    /// \desc the six axis directions in AmbientCube order
+    const glm::vec3 CUBE_NORMALS[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                        glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+    const glm::vec3 UP(0.0f, 1.0f, 0.0f);
+}
+
+LightBaker::LightBaker(const LevelFile& level, const Lights& lights, JobSystem& jobs)
+    : _level(level),
+      _lights(lights),
+      _jobs(jobs)
+{}
+
+size_t LightBaker::getNumLamps() const {
+    return static_cast<size_t>(std::count_if(_level.getProps(), _level.getProps() + _level.getNumProps(),
+                                             [](const LevelFormat::Prop& prop) { return prop.type == LevelFormat::PROP_LAMP; }));
+}
+
+bool LightBaker::bakeLightmap(const Surface* surfaces, size_t numSurfaces, const Material& material, float texelSize,
+                              Lightmap& lightmap) const {
+    // texels sit on the tile's edges, so bilinear filtering never reaches into the next tile
+    auto texelsAlong = [](float extent, float texelSize) {
+        return std::min(MAX_TILE_SIZE, std::max(2, static_cast<int>(std::ceil(extent / texelSize)) + 1));
+    };
+    std::vector<Tile> tiles(numSurfaces);
+    while (true) {
+        bool smallest = true;
+        for (size_t i = 0; i < numSurfaces; ++i) {
+            tiles[i].width = texelsAlong(surfaces[i].max.x - surfaces[i].min.x, texelSize);
+            tiles[i].height = texelsAlong(surfaces[i].max.y - surfaces[i].min.y, texelSize);
+            smallest = smallest && tiles[i].width == 2 && tiles[i].height == 2;
+        }
+        if (_packTiles(tiles, lightmap.height)) {
+            break;
+        }
+        if (smallest) {
+            fprintf(stderr, "[ERROR]: %zu surfaces are too many for one lightmap atlas\n", numSurfaces);
+            return false;
+        }
+        texelSize *= 2.0f;
+        fprintf(stdout, "[INFO]: lightmap tiles do not fit a %dx%d atlas, baking at %.2f units per texel\n",
+                ATLAS_WIDTH, MAX_ATLAS_HEIGHT, texelSize);
+    }
+    lightmap.width = ATLAS_WIDTH;
+    lightmap.texels.assign(static_cast<size_t>(lightmap.width) * lightmap.height, glm::vec3(0.0f));
+    lightmap.surfaceRects.resize(numSurfaces);
+
+    _jobs.parallelFor(numSurfaces, 1, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> lamps;
+        for (size_t i = begin; i < end; ++i) {
+            const Surface& surface = surfaces[i];
+            const Tile& tile = tiles[i];
+            const glm::vec2 extent(std::max(surface.max.x - surface.min.x, 1e-3f), std::max(surface.max.y - surface.min.y, 1e-3f));
+            const glm::vec2 texelStep(extent.x / (tile.width - 1), extent.y / (tile.height - 1));
+
+            const glm::vec2 scale(1.0f / (texelStep.x * lightmap.width), 1.0f / (texelStep.y * lightmap.height));
+            const glm::vec2 offset((tile.x + 0.5f) / lightmap.width - surface.min.x * scale.x,
+                                   (tile.y + 0.5f) / lightmap.height - surface.min.y * scale.y);
+            lightmap.surfaceRects[i] = glm::vec4(scale.x, scale.y, offset.x, offset.y);
+
+            _gatherLamps(surface.min, surface.max, lamps);
+            for (int y = 0; y < tile.height; ++y) {
+                for (int x = 0; x < tile.width; ++x) {
+                    const glm::vec3 position(surface.min.x + x * texelStep.x, surface.height, surface.min.y + y * texelStep.y);
+                    glm::vec3 ambient, diffuse;
+                    _irradiance(position, lamps, &UP, 1, ambient, &diffuse);
+                    lightmap.texels[static_cast<size_t>(tile.y + y) * lightmap.width + tile.x + x] =
+                            material.ambient * ambient + material.diffuse * diffuse;
+                }
+            }
+        }
+    });
+    return true;
+}
+
+void LightBaker::bakeProbes(const glm::vec3* centers, size_t count, const Material& material, AmbientCube* cubes) const {
+    _jobs.parallelFor(count, 64, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> lamps;
+        for (size_t i = begin; i < end; ++i) {
+            const glm::vec2 xz(centers[i].x, centers[i].z);
+            _gatherLamps(xz, xz, lamps);
+            glm::vec3 ambient, diffuse[6];
+            _irradiance(centers[i], lamps, CUBE_NORMALS, 6, ambient, diffuse);
+            for (int face = 0; face < 6; ++face) {
+                cubes[i].faces[face] = material.ambient * ambient + material.diffuse * diffuse[face];
+            }
+        }
+    });
+}
+
+void LightBaker::_gatherLamps(const glm::vec2& min, const glm::vec2& max, std::vector<uint32_t>& lamps) const {
+    lamps.clear();
+    const glm::vec2 center = (min + max) * 0.5f;
+    const float radius = glm::length(max - min) * 0.5f + _lights.lampRange;
+    _level.visitPropsNear(center.x, center.y, radius, [&](uint32_t index, const LevelFormat::Prop& prop) {
+        if (prop.type == LevelFormat::PROP_LAMP) {
+            lamps.push_back(index);
+        }
+        return false;
+    });
+    // a lamp on a cell border is visited once per cell
+    std::sort(lamps.begin(), lamps.end());
+    lamps.erase(std::unique(lamps.begin(), lamps.end()), lamps.end());
+}
+
+void LightBaker::_irradiance(const glm::vec3& position, const std::vector<uint32_t>& lamps,
+                             const glm::vec3* normals, size_t numNormals, glm::vec3& ambient, glm::vec3* diffuse) const {
+    const glm::vec3 toDirLight = glm::normalize(-_lights.dirLightDirection);
+    ambient = _lights.dirLightColor;
+    for (size_t i = 0; i < numNormals; ++i) {
+        diffuse[i] = std::max(glm::dot(normals[i], toDirLight), 0.0f) * _lights.dirLightColor;
+    }
+
+    const LevelFormat::Prop* props = _level.getProps();
+    const float range2 = _lights.lampRange * _lights.lampRange;
+    for (uint32_t lamp : lamps) {
+        const glm::vec3 toLight = glm::make_vec3(props[lamp].position) + _lights.lampLightOffset - position;
+        const float distance2 = glm::dot(toLight, toLight);
+        if (distance2 >= range2) continue;
+        const float distance = std::sqrt(distance2);
+        const float window = 1.0f - (distance2 * distance2) / (range2 * range2);
+        const float attenuation = window * window /
+                (_lights.lampConstant + _lights.lampLinear * distance + _lights.lampQuadratic * distance2);
+        const glm::vec3 light = _lights.lampColor * attenuation;
+
+        ambient += light;
+        // a point at the light itself, the lamp's own bulb, takes all of it from every side
+        const glm::vec3 direction = distance > 1e-3f ? toLight / distance : glm::vec3(0.0f);
+        for (size_t i = 0; i < numNormals; ++i) {
+            const float facing = distance > 1e-3f ? std::max(glm::dot(normals[i], direction), 0.0f) : 1.0f;
+            diffuse[i] += facing * light;
+        }
+    }
+}
+
+bool LightBaker::_packTiles(std::vector<Tile>& tiles, int& height) {
+    // tallest first, left to right in rows as tall as their first tile
+    std::vector<size_t> order(tiles.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&tiles](size_t a, size_t b) { return tiles[a].height > tiles[b].height; });
+
+    int x = 0, y = 0, rowHeight = 0;
+    for (size_t i : order) {
+        if (x + tiles[i].width > ATLAS_WIDTH) {
+            x = 0;
+            y += rowHeight;
+            rowHeight = 0;
+        }
+        tiles[i].x = x;
+        tiles[i].y = y;
+        x += tiles[i].width;
+        rowHeight = std::max(rowHeight, tiles[i].height);
+    }
+    height = std::max(1, y + rowHeight);
+    return height <= MAX_ATLAS_HEIGHT;
+}
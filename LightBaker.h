@@ -0,0 +1,104 @@
+#ifndef LIGHT_BAKER_H
+#define LIGHT_BAKER_H
+
+#include "JobSystem.h"
+#include "LevelFile.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// \desc bakes the light that never changes, the directional light and every
+/// lamp of the level, so the shaders are left with only the spot light.
+///
+/// Horizontal surfaces get a lightmap: a tile per surface in one shared atlas,
+/// each texel holding what an upward facing point there receives. Props get an
+/// ambient cube per part: what a surface facing each of the six axis directions
+/// receives at the part's center, which the vertex shader blends by the squared
+/// normal. Both use the lighting.vs.glsl model without the specular term, and
+/// like it nothing casts shadows. Nothing here touches OpenGL; the tiles and
+/// probes are spread over the job system.
+class LightBaker {
+public:
+    /// \desc how much of each light's ambient and diffuse term a surface takes
+    struct Material {
+        glm::vec3 ambient;
+        glm::vec3 diffuse;
+    };
+
+    struct Lights {
+        glm::vec3 dirLightDirection;
+        glm::vec3 dirLightColor;
+        /// \desc every lamp prop of the level shines from this far above its base
+        glm::vec3 lampLightOffset;
+        glm::vec3 lampColor;
+        float lampConstant;
+        float lampLinear;
+        float lampQuadratic;
+        /// \desc lamps further away add nothing; their attenuation fades out on the way so no edge shows
+        float lampRange;
+    };
+
+    /// \desc a horizontal surface lit from above, covering [min, max] in x and z
+    struct Surface {
+        glm::vec2 min;
+        glm::vec2 max;
+        float height;
+    };
+
+    struct Lightmap {
+        int width = 0;
+        int height = 0;
+        /// \desc row by row from the bottom, as glTexImage2D takes them
+        std::vector<glm::vec3> texels;
+        /// \desc per surface: world xz * xy + zw is its texture coordinate in the atlas
+        std::vector<glm::vec4> surfaceRects;
+    };
+
+    /// \desc the light arriving from +x, -x, +y, -y, +z and -z, already scaled by the material
+    struct AmbientCube {
+        glm::vec3 faces[6];
+    };
+
+    /// \desc texels along a tile's side at most, larger surfaces get coarser texels
+    static constexpr int MAX_TILE_SIZE = 64;
+    static constexpr int ATLAS_WIDTH = 2048;
+    /// \desc when the tiles do not fit, every surface is baked again at half the resolution
+    static constexpr int MAX_ATLAS_HEIGHT = 4096;
+
+    LightBaker(const LevelFile& level, const Lights& lights, JobSystem& jobs);
+
+    /// \desc one tile per surface, texelSize world units apart where the tile size allows;
+    /// false when even the smallest tiles do not fit the atlas
+    bool bakeLightmap(const Surface* surfaces, size_t numSurfaces, const Material& material, float texelSize,
+                      Lightmap& lightmap) const;
+    /// \desc one cube per center, all with the same material
+    void bakeProbes(const glm::vec3* centers, size_t count, const Material& material, AmbientCube* cubes) const;
+
+    /// \desc lamp props of the level, every one of them lights the bake
+    size_t getNumLamps() const;
+
+private:
+    const LevelFile& _level;
+    Lights _lights;
+    JobSystem& _jobs;
+
+    /// \desc indices of the lamp props within range of the xz box, each once
+    void _gatherLamps(const glm::vec2& min, const glm::vec2& max, std::vector<uint32_t>& lamps) const;
+    /// \desc the ambient term at position, which is the same whatever the normal, and the
+    /// diffuse term for each of the normals
+    void _irradiance(const glm::vec3& position, const std::vector<uint32_t>& lamps,
+                     const glm::vec3* normals, size_t numNormals, glm::vec3& ambient, glm::vec3* diffuse) const;
+    /// \desc a surface's texels in the atlas
+    struct Tile {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+    /// \desc places the tiles in rows, false when they do not fit under MAX_ATLAS_HEIGHT
+    static bool _packTiles(std::vector<Tile>& tiles, int& height);
+};
+
+#endif // LIGHT_BAKER_H
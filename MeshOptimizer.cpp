@@ -0,0 +1,347 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+    /// \desc a FIFO post-transform cache: a vertex is in it while fewer than cacheSize others
+    /// have been shaded since it was
+    class FifoCache {
+    public:
+        FifoCache(size_t numVertices, unsigned int cacheSize)
+            : _shadedAt(numVertices, 0),
+              _clock(cacheSize),
+              _cacheSize(cacheSize)
+        {}
+
+        /// \desc true when the vertex has to be shaded
+        bool access(size_t vertex) {
+            if (_clock - _shadedAt[vertex] < _cacheSize) {
+                return false;
+            }
+            _shadedAt[vertex] = ++_clock;
+            return true;
+        }
+        unsigned int accessTriangle(const size_t vertices[3]) {
+            return access(vertices[0]) + access(vertices[1]) + access(vertices[2]);
+        }
+        /// \desc everything drops out, as if cacheSize other vertices had just been shaded
+        void flush() {
+            _clock += _cacheSize;
+        }
+
+    private:
+        std::vector<size_t> _shadedAt;
+        size_t _clock;
+        size_t _cacheSize;
+    };
+
+    template<typename Index>
+    void triangleVertices(const Index* indices, size_t triangle, size_t vertices[3]) {
+        vertices[0] = indices[triangle * 3];
+        vertices[1] = indices[triangle * 3 + 1];
+        vertices[2] = indices[triangle * 3 + 2];
+    }
+
+    template<typename Index>
+    size_t countTransformsT(const Index* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize) {
+        FifoCache cache(numVertices, cacheSize);
+        size_t transforms = 0;
+        for (size_t i = 0; i < numIndices; ++i) {
+            transforms += cache.access(indices[i]);
+        }
+        return transforms;
+    }
+
+    template<typename Index>
+    void optimizeVertexCacheT(Index* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize) {
+        const size_t numTriangles = numIndices / 3;
+        if (numTriangles == 0 || numVertices == 0) {
+            return;
+        }
+
+        // the triangles around each vertex, one list with a range per vertex
+        std::vector<uint32_t> liveTriangles(numVertices, 0);
+        for (size_t i = 0; i < numTriangles * 3; ++i) {
+            ++liveTriangles[indices[i]];
+        }
+        std::vector<uint32_t> adjacencyStart(numVertices + 1, 0);
+        for (size_t vertex = 0; vertex < numVertices; ++vertex) {
+            adjacencyStart[vertex + 1] = adjacencyStart[vertex] + liveTriangles[vertex];
+        }
+        std::vector<uint32_t> adjacency(numTriangles * 3);
+        std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < numTriangles * 3; ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // a vertex is in the cache while fewer than cacheSize vertices were shaded since its time stamp
+        std::vector<size_t> cacheTime(numVertices, 0);
+        size_t time = cacheSize + 1;
+        std::vector<bool> emitted(numTriangles, false);
+        std::vector<uint32_t> deadEnds;
+        deadEnds.reserve(numTriangles * 3);
+        std::vector<uint32_t> candidates;
+        std::vector<Index> output;
+        output.reserve(numTriangles * 3);
+        size_t cursor = 0;
+
+        int64_t fanning = 0;
+        while (fanning >= 0) {
+            // every triangle still around the fanning vertex
+            candidates.clear();
+            for (uint32_t a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; ++a) {
+                const uint32_t triangle = adjacency[a];
+                if (emitted[triangle]) continue;
+                for (int corner = 0; corner < 3; ++corner) {
+                    const Index vertex = indices[triangle * 3 + corner];
+                    output.push_back(vertex);
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    --liveTriangles[vertex];
+                    if (time - cacheTime[vertex] > cacheSize) {
+                        cacheTime[vertex] = time++;
+                    }
+                }
+                emitted[triangle] = true;
+            }
+
+            // the next fan: the candidate that stays longest in the cache while its own fan is
+            // shaded, or else the most recent vertex that still has triangles, or else the next one in order
+            int64_t next = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t vertex : candidates) {
+                if (liveTriangles[vertex] == 0) continue;
+                int64_t priority = 0;
+                if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+                    priority = static_cast<int64_t>(time - cacheTime[vertex]);
+                }
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    next = vertex;
+                }
+            }
+            while (next < 0 && !deadEnds.empty()) {
+                const uint32_t vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[vertex] > 0) next = vertex;
+            }
+            while (next < 0 && cursor < numVertices) {
+                if (liveTriangles[cursor] > 0) next = static_cast<int64_t>(cursor);
+                ++cursor;
+            }
+            fanning = next;
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    template<typename Index>
+    void optimizeOverdrawT(Index* indices, size_t numIndices, const float* positions, size_t positionStride,
+                           size_t numVertices, float threshold, unsigned int cacheSize) {
+        const size_t numTriangles = numIndices / 3;
+        if (numTriangles < 2 || !positions) {
+            return;
+        }
+        size_t vertices[3];
+
+        // hard boundaries: triangles the cache order starts cold, all three vertices shaded anew
+        std::vector<size_t> hardBoundaries(1, 0);
+        FifoCache cache(numVertices, cacheSize);
+        size_t totalMisses = 0;
+        for (size_t triangle = 0; triangle < numTriangles; ++triangle) {
+            triangleVertices(indices, triangle, vertices);
+            const unsigned int misses = cache.accessTriangle(vertices);
+            if (misses == 3 && triangle > 0) {
+                hardBoundaries.push_back(triangle);
+            }
+            totalMisses += misses;
+        }
+        hardBoundaries.push_back(numTriangles);
+        // every cluster starts cold once they are shuffled, each has to pay for that itself
+        const float limit = threshold * static_cast<float>(totalMisses) / static_cast<float>(numTriangles);
+
+        // soft boundaries: within each, cut wherever the piece so far is no worse than the limit
+        std::vector<size_t> clusterStarts;
+        for (size_t hard = 0; hard + 1 < hardBoundaries.size(); ++hard) {
+            const size_t start = hardBoundaries[hard], end = hardBoundaries[hard + 1];
+            cache.flush();
+            clusterStarts.push_back(start);
+            size_t pieceStart = start, pieceMisses = 0;
+            for (size_t triangle = start; triangle + 1 < end; ++triangle) {
+                triangleVertices(indices, triangle, vertices);
+                pieceMisses += cache.accessTriangle(vertices);
+                if (static_cast<float>(pieceMisses) <= limit * static_cast<float>(triangle + 1 - pieceStart)) {
+                    clusterStarts.push_back(triangle + 1);
+                    pieceStart = triangle + 1;
+                    pieceMisses = 0;
+                    cache.flush();
+                }
+            }
+        }
+        clusterStarts.push_back(numTriangles);
+        const size_t numClusters = clusterStarts.size() - 1;
+        if (numClusters < 2) {
+            return;
+        }
+
+        // each cluster's area weighted centroid and normal
+        struct Cluster {
+            size_t start;
+            size_t end;
+            float centroid[3];
+            float normal[3];
+            float area;
+            float sortKey;
+        };
+        std::vector<Cluster> clusters(numClusters);
+        float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < numClusters; ++c) {
+            Cluster& cluster = clusters[c];
+            cluster = Cluster{ clusterStarts[c], clusterStarts[c + 1], { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0.0f, 0.0f };
+            for (size_t triangle = cluster.start; triangle < cluster.end; ++triangle) {
+                triangleVertices(indices, triangle, vertices);
+                const float* a = positions + vertices[0] * positionStride;
+                const float* b = positions + vertices[1] * positionStride;
+                const float* p = positions + vertices[2] * positionStride;
+                const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                const float ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+                const float normal[3] = { ab[1] * ap[2] - ab[2] * ap[1], ab[2] * ap[0] - ab[0] * ap[2], ab[0] * ap[1] - ab[1] * ap[0] };
+                const float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                for (int axis = 0; axis < 3; ++axis) {
+                    cluster.centroid[axis] += (a[axis] + b[axis] + p[axis]) / 3.0f * area;
+                    cluster.normal[axis] += normal[axis];
+                }
+                cluster.area += area;
+            }
+            for (int axis = 0; axis < 3; ++axis) {
+                meshCentroid[axis] += cluster.centroid[axis];
+            }
+            meshArea += cluster.area;
+        }
+        if (meshArea <= 0.0f) {
+            return;
+        }
+        for (float& axis : meshCentroid) {
+            axis /= meshArea;
+        }
+
+        // clusters facing away from the center go first, they are the ones hiding the rest
+        for (Cluster& cluster : clusters) {
+            const float length = std::sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] +
+                                           cluster.normal[2] * cluster.normal[2]);
+            if (cluster.area <= 0.0f || length <= 0.0f) continue;
+            for (int axis = 0; axis < 3; ++axis) {
+                cluster.sortKey += (cluster.centroid[axis] / cluster.area - meshCentroid[axis]) * cluster.normal[axis] / length;
+            }
+        }
+        std::stable_sort(clusters.begin(), clusters.end(),
+                         [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+        std::vector<Index> output;
+        output.reserve(numTriangles * 3);
+        for (const Cluster& cluster : clusters) {
+            output.insert(output.end(), indices + cluster.start * 3, indices + cluster.end * 3);
+        }
+        // a cluster that ends up worse than its own cold start lets the cost through; keep the cache order then
+        const size_t transforms = countTransformsT(output.data(), output.size(), numVertices, cacheSize);
+        if (static_cast<float>(transforms) <= threshold * static_cast<float>(totalMisses)) {
+            std::copy(output.begin(), output.end(), indices);
+        }
+    }
+
+    template<typename Index>
+    void optimizeVertexFetchT(Index* indices, size_t numIndices, size_t numVertices, std::vector<uint32_t>& remap) {
+        constexpr uint32_t UNUSED = UINT32_MAX;
+        remap.assign(numVertices, UNUSED);
+        uint32_t next = 0;
+        for (size_t i = 0; i < numIndices; ++i) {
+            uint32_t& target = remap[indices[i]];
+            if (target == UNUSED) target = next++;
+            indices[i] = static_cast<Index>(target);
+        }
+        for (uint32_t& target : remap) {
+            if (target == UNUSED) target = next++;
+        }
+    }
+
+    template<typename Index>
+    MeshOptimizer::Report optimizeT(Index* indices, size_t numIndices, size_t numVertices, const float* positions,
+                                    size_t positionStride, std::vector<uint32_t>& remap) {
+        MeshOptimizer::Report report;
+        report.numTriangles = numIndices / 3;
+        report.numVertices = numVertices;
+        report.transformsBefore = countTransformsT(indices, numIndices, numVertices, MeshOptimizer::CACHE_SIZE);
+        // small meshes can already be in a better order than Tipsify finds, those keep theirs
+        const std::vector<Index> given(indices, indices + numIndices);
+        optimizeVertexCacheT(indices, numIndices, numVertices, MeshOptimizer::CACHE_SIZE);
+        if (countTransformsT(indices, numIndices, numVertices, MeshOptimizer::CACHE_SIZE) > report.transformsBefore) {
+            std::copy(given.begin(), given.end(), indices);
+        }
+        if (positions) {
+            optimizeOverdrawT(indices, numIndices, positions, positionStride, numVertices, MeshOptimizer::OVERDRAW_THRESHOLD,
+                              MeshOptimizer::CACHE_SIZE);
+        }
+        optimizeVertexFetchT(indices, numIndices, numVertices, remap);
+        report.transformsAfter = countTransformsT(indices, numIndices, numVertices, MeshOptimizer::CACHE_SIZE);
+        return report;
+    }
+}
+
+MeshOptimizer::Report& MeshOptimizer::Report::operator+=(const Report& other) {
+    numTriangles += other.numTriangles;
+    numVertices += other.numVertices;
+    transformsBefore += other.transformsBefore;
+    transformsAfter += other.transformsAfter;
+    return *this;
+}
+
+void MeshOptimizer::logReport(const char* name, const Report& report) {
+    fprintf(stdout, "[INFO]: %s: %zu triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name, report.numTriangles,
+            report.acmrBefore(), report.acmrAfter(), report.atvrBefore(), report.atvrAfter());
+}
+
+size_t MeshOptimizer::countTransforms(const uint16_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize) {
+    return countTransformsT(indices, numIndices, numVertices, cacheSize);
+}
+
+size_t MeshOptimizer::countTransforms(const uint32_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize) {
+    return countTransformsT(indices, numIndices, numVertices, cacheSize);
+}
+
+void MeshOptimizer::optimizeVertexCache(uint16_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize) {
+    optimizeVertexCacheT(indices, numIndices, numVertices, cacheSize);
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize) {
+    optimizeVertexCacheT(indices, numIndices, numVertices, cacheSize);
+}
+
+void MeshOptimizer::optimizeOverdraw(uint16_t* indices, size_t numIndices, const float* positions, size_t positionStride,
+                                     size_t numVertices, float threshold) {
+    optimizeOverdrawT(indices, numIndices, positions, positionStride, numVertices, threshold, CACHE_SIZE);
+}
+
+void MeshOptimizer::optimizeOverdraw(uint32_t* indices, size_t numIndices, const float* positions, size_t positionStride,
+                                     size_t numVertices, float threshold) {
+    optimizeOverdrawT(indices, numIndices, positions, positionStride, numVertices, threshold, CACHE_SIZE);
+}
+
+void MeshOptimizer::optimizeVertexFetch(uint16_t* indices, size_t numIndices, size_t numVertices, std::vector<uint32_t>& remap) {
+    optimizeVertexFetchT(indices, numIndices, numVertices, remap);
+}
+
+void MeshOptimizer::optimizeVertexFetch(uint32_t* indices, size_t numIndices, size_t numVertices, std::vector<uint32_t>& remap) {
+    optimizeVertexFetchT(indices, numIndices, numVertices, remap);
+}
+
+MeshOptimizer::Report MeshOptimizer::optimize(uint16_t* indices, size_t numIndices, size_t numVertices, const float* positions,
+                                              size_t positionStride, std::vector<uint32_t>& remap) {
+    return optimizeT(indices, numIndices, numVertices, positions, positionStride, remap);
+}
+
+MeshOptimizer::Report MeshOptimizer::optimize(uint32_t* indices, size_t numIndices, size_t numVertices, const float* positions,
+                                              size_t positionStride, std::vector<uint32_t>& remap) {
+    return optimizeT(indices, numIndices, numVertices, positions, positionStride, remap);
+}
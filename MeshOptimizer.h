@@ -0,0 +1,86 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// \desc reorders indexed triangle lists for the GPU, shared by the level
+/// compiler and the engine; nothing here touches OpenGL.
+///
+/// Three passes, run in this order by optimize():
+///  - vertex cache: Tipsify (Sander, Nehab and Barczak 2007) emits the triangles
+///    fanning around one vertex after the other, preferring the next fan among
+///    the vertices still in a cache of CACHE_SIZE entries, so fewer vertices
+///    are shaded twice. The lighting runs per vertex, so this is where it pays.
+///  - overdraw: the cache order is cut into clusters wherever the cache would
+///    start cold anyway, or where the cut costs less than the threshold, and
+///    the clusters facing away from the mesh's center are drawn first so they
+///    hide what is behind them.
+///  - vertex fetch: vertices are renumbered in the order the indices first use
+///    them, so the vertex fetches walk the buffer forwards.
+///
+/// ACMR is vertices shaded per triangle and ATVR vertices shaded per vertex,
+/// both measured with a FIFO cache of CACHE_SIZE; 0.5 and 1.0 are the best a
+/// large closed mesh can do.
+namespace MeshOptimizer {
+    /// \desc entries of the post-transform cache the passes plan for and measure with
+    constexpr unsigned int CACHE_SIZE = 16;
+    /// \desc how much worse than the cache order a cluster cut may make the ACMR
+    constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    /// \desc vertex shader work before and after, adds up over several meshes
+    struct Report {
+        size_t numTriangles = 0;
+        size_t numVertices = 0;
+        size_t transformsBefore = 0;
+        size_t transformsAfter = 0;
+
+        float acmrBefore() const { return numTriangles ? static_cast<float>(transformsBefore) / numTriangles : 0.0f; }
+        float acmrAfter() const { return numTriangles ? static_cast<float>(transformsAfter) / numTriangles : 0.0f; }
+        float atvrBefore() const { return numVertices ? static_cast<float>(transformsBefore) / numVertices : 0.0f; }
+        float atvrAfter() const { return numVertices ? static_cast<float>(transformsAfter) / numVertices : 0.0f; }
+        Report& operator+=(const Report& other);
+    };
+    /// \desc one [INFO] line naming the mesh
+    void logReport(const char* name, const Report& report);
+
+    /// \desc vertices shaded by a FIFO cache of cacheSize drawing the indices
+    size_t countTransforms(const uint16_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize = CACHE_SIZE);
+    size_t countTransforms(const uint32_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize = CACHE_SIZE);
+
+    /// \desc reorders the triangles in place with Tipsify
+    void optimizeVertexCache(uint16_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize = CACHE_SIZE);
+    void optimizeVertexCache(uint32_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize = CACHE_SIZE);
+
+    /// \desc reorders clusters of an index list already in cache order; positions are three
+    /// floats every positionStride floats
+    void optimizeOverdraw(uint16_t* indices, size_t numIndices, const float* positions, size_t positionStride,
+                          size_t numVertices, float threshold = OVERDRAW_THRESHOLD);
+    void optimizeOverdraw(uint32_t* indices, size_t numIndices, const float* positions, size_t positionStride,
+                          size_t numVertices, float threshold = OVERDRAW_THRESHOLD);
+
+    /// \desc renumbers the indices in first use order; remap[old] is the new index, vertices no
+    /// index uses keep their order behind the rest. Apply it to the vertices with remapVertices
+    void optimizeVertexFetch(uint16_t* indices, size_t numIndices, size_t numVertices, std::vector<uint32_t>& remap);
+    void optimizeVertexFetch(uint32_t* indices, size_t numIndices, size_t numVertices, std::vector<uint32_t>& remap);
+
+    /// \desc all three passes, the overdraw one only when there are positions; remap as above
+    Report optimize(uint16_t* indices, size_t numIndices, size_t numVertices, const float* positions, size_t positionStride,
+                    std::vector<uint32_t>& remap);
+    Report optimize(uint32_t* indices, size_t numIndices, size_t numVertices, const float* positions, size_t positionStride,
+                    std::vector<uint32_t>& remap);
+
+    /// \desc moves each vertex, stride elements of T, to where remap sends it
+    template<typename T>
+    void remapVertices(const std::vector<uint32_t>& remap, std::vector<T>& vertices, size_t stride = 1) {
+        std::vector<T> source(vertices);
+        for (size_t vertex = 0; vertex < remap.size(); ++vertex) {
+            for (size_t i = 0; i < stride; ++i) {
+                vertices[remap[vertex] * stride + i] = source[vertex * stride + i];
+            }
+        }
+    }
+}
+
+#endif // MESH_OPTIMIZER_H
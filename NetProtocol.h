@@ -0,0 +1,118 @@
+#ifndef NET_PROTOCOL_H
+#define NET_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+/// \desc datagrams exchanged between fp_server and the clients of a shared session.
+///
+/// Every datagram starts with a PacketHeader. A client sends CONNECT until the
+/// server answers ACCEPT, then one INPUT per simulation tick; the server sends
+/// a SNAPSHOT to each client at SNAPSHOT_RATE. Nothing is resent: an INPUT
+/// repeats the last few commands so a lost one is covered by the next, and
+/// snapshots are deltas against whichever snapshot the client acknowledged
+/// last, so a lost one only makes the next delta a little larger. Multi-byte
+/// fields are little endian.
+namespace NetProtocol {
+    /// \desc "FPNT" read as a little endian word
+    constexpr uint32_t MAGIC = 0x544E5046;
+    /// \desc bumped whenever a packet changes, mismatched peers are ignored
+    constexpr uint8_t VERSION = 1;
+    constexpr uint16_t DEFAULT_PORT = 41730;
+    /// \desc stays under the smallest common path MTU once IP and UDP headers are added
+    constexpr size_t MAX_PACKET_SIZE = 1200;
+
+    /// \desc the server simulates at the game's tick rate and sends every third tick
+    constexpr uint32_t TICK_RATE = 60;
+    constexpr uint32_t SNAPSHOT_RATE = 20;
+    /// \desc a client not heard from for this long is dropped
+    constexpr uint32_t TIMEOUT_TICKS = TICK_RATE * 5;
+
+    /// \desc vehicles take entity ids 0 .. MAX_VEHICLES - 1, marbles the ids after that
+    constexpr uint16_t MAX_VEHICLES = 32;
+    /// \desc commands repeated in every INPUT
+    constexpr uint8_t MAX_INPUT_COMMANDS = 8;
+
+    enum PacketType : uint8_t {
+        CONNECT = 1,
+        ACCEPT,
+        INPUT,
+        SNAPSHOT,
+        DISCONNECT
+    };
+
+    /// \desc what the player held down during one simulation tick
+    enum Button : uint8_t {
+        BUTTON_FORWARD = 1 << 0,
+        BUTTON_BACK = 1 << 1,
+        BUTTON_LEFT = 1 << 2,
+        BUTTON_RIGHT = 1 << 3
+    };
+
+    struct PacketHeader {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t type;
+        /// \desc vehicle of the sender's client, 0xFF before ACCEPT
+        uint8_t client;
+        uint8_t reserved;
+    };
+
+    /// \desc client to server
+    struct ConnectPacket {
+        PacketHeader header;
+        /// \desc SessionWorld::getLevelHash of the client's level, both must play the same one
+        uint32_t levelHash;
+    };
+
+    /// \desc server to client, answers every CONNECT from the same address
+    struct AcceptPacket {
+        PacketHeader header;
+        uint32_t levelHash;
+        uint32_t serverTick;
+    };
+
+    /// \desc client to server, commands[i] belongs to tick sequence - i
+    struct InputPacket {
+        PacketHeader header;
+        /// \desc newest snapshot the client holds, the server deltas against it
+        uint32_t ackedSnapshot;
+        uint32_t sequence;
+        uint8_t numCommands;
+        uint8_t commands[MAX_INPUT_COMMANDS];
+        uint8_t padding[3];
+    };
+
+    /// \desc server to client, followed by numRecords SnapshotCodec records
+    struct SnapshotHeader {
+        PacketHeader header;
+        uint32_t serverTick;
+        /// \desc snapshot the records are a delta against, 0 when they are against nothing
+        uint32_t baselineTick;
+        /// \desc last input sequence applied to the client's vehicle, prediction replays the rest
+        uint32_t appliedInput;
+        uint16_t numRecords;
+        uint16_t reserved;
+    };
+
+    static_assert(sizeof(PacketHeader) == 8 && sizeof(ConnectPacket) == 12 && sizeof(AcceptPacket) == 16 &&
+                  sizeof(InputPacket) == 28 && sizeof(SnapshotHeader) == 24,
+                  "packet layouts are part of the protocol");
+
+    inline PacketHeader makeHeader(PacketType type, uint8_t client) {
+        return PacketHeader{ MAGIC, VERSION, type, client, 0 };
+    }
+
+    inline bool validHeader(const void* data, size_t size, PacketType type, size_t packetSize) {
+        const PacketHeader* header = static_cast<const PacketHeader*>(data);
+        return size >= packetSize && header->magic == MAGIC && header->version == VERSION && header->type == type;
+    }
+
+    /// \desc the type of a datagram that starts with a valid header, 0 otherwise
+    inline uint8_t packetType(const void* data, size_t size) {
+        const PacketHeader* header = static_cast<const PacketHeader*>(data);
+        return size >= sizeof(PacketHeader) && header->magic == MAGIC && header->version == VERSION ? header->type : 0;
+    }
+}
+
+#endif // NET_PROTOCOL_H
@@ -0,0 +1,185 @@
+#include "NetSocket.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+#ifdef _WIN32
+    constexpr intptr_t NO_SOCKET = static_cast<intptr_t>(INVALID_SOCKET);
+
+    /// \desc Winsock needs starting once before the first socket
+    bool startNetworking() {
+        static const bool started = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        return started;
+    }
+
+    /// \desc a datagram sent earlier bounced off a closed port, the next receive reports it
+    bool refused() {
+        return WSAGetLastError() == WSAECONNRESET;
+    }
+#else
+    constexpr intptr_t NO_SOCKET = -1;
+
+    bool startNetworking() {
+        return true;
+    }
+
+    bool refused() {
+        return errno == ECONNREFUSED;
+    }
+#endif
+
+    sockaddr_in toSockaddr(const NetAddress& address) {
+        sockaddr_in result{};
+        result.sin_family = AF_INET;
+        result.sin_addr.s_addr = htonl(address.ipv4);
+        result.sin_port = htons(address.port);
+        return result;
+    }
+}
+
+bool NetAddress::parse(const std::string& text, uint16_t defaultPort, NetAddress& address) {
+    std::string host = text;
+    address.port = defaultPort;
+    const size_t colon = text.rfind(':');
+    if (colon != std::string::npos) {
+        host = text.substr(0, colon);
+        const long port = std::strtol(text.c_str() + colon + 1, nullptr, 10);
+        if (port <= 0 || port > 65535) {
+            return false;
+        }
+        address.port = static_cast<uint16_t>(port);
+    }
+    if (host.empty() || !startNetworking()) {
+        return false;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* results = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &results) != 0 || !results) {
+        return false;
+    }
+    address.ipv4 = ntohl(reinterpret_cast<const sockaddr_in*>(results->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(results);
+    return true;
+}
+
+std::string NetAddress::toString() const {
+    char text[32];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u:%u", (ipv4 >> 24) & 0xFF, (ipv4 >> 16) & 0xFF,
+             (ipv4 >> 8) & 0xFF, ipv4 & 0xFF, port);
+    return text;
+}
+
+NetSocket::~NetSocket() {
+    close();
+}
+
+bool NetSocket::open(uint16_t port) {
+    close();
+    if (!startNetworking()) {
+        fprintf(stderr, "[ERROR]: could not start networking\n");
+        return false;
+    }
+
+    _socket = static_cast<intptr_t>(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (_socket == NO_SOCKET) {
+        fprintf(stderr, "[ERROR]: could not create a UDP socket\n");
+        return false;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        fprintf(stderr, "[ERROR]: could not bind UDP port %u\n", port);
+        close();
+        return false;
+    }
+
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    const bool configured = ioctlsocket(_socket, FIONBIO, &nonBlocking) == 0;
+#else
+    const bool configured = fcntl(static_cast<int>(_socket), F_SETFL, fcntl(static_cast<int>(_socket), F_GETFL) | O_NONBLOCK) == 0;
+#endif
+    if (!configured) {
+        fprintf(stderr, "[ERROR]: could not make the UDP socket nonblocking\n");
+        close();
+        return false;
+    }
+
+    socklen_t addressSize = sizeof(address);
+    getsockname(_socket, reinterpret_cast<sockaddr*>(&address), &addressSize);
+    _port = ntohs(address.sin_port);
+    return true;
+}
+
+void NetSocket::close() {
+    if (_socket == NO_SOCKET) {
+        return;
+    }
+#ifdef _WIN32
+    closesocket(_socket);
+#else
+    ::close(static_cast<int>(_socket));
+#endif
+    _socket = NO_SOCKET;
+    _port = 0;
+}
+
+bool NetSocket::isOpen() const {
+    return _socket != NO_SOCKET;
+}
+
+bool NetSocket::send(const NetAddress& to, const void* data, size_t size) {
+    const sockaddr_in address = toSockaddr(to);
+    const auto sent = sendto(_socket, static_cast<const char*>(data), static_cast<int>(size), 0,
+                             reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    if (sent < 0 || static_cast<size_t>(sent) != size) {
+        return false;
+    }
+    _bytesSent += size;
+    ++_packetsSent;
+    return true;
+}
+
+size_t NetSocket::receive(NetAddress& from, void* buffer, size_t capacity) {
+    for (;;) {
+        sockaddr_in address{};
+        socklen_t addressSize = sizeof(address);
+        const auto received = recvfrom(_socket, static_cast<char*>(buffer), static_cast<int>(capacity), 0,
+                                       reinterpret_cast<sockaddr*>(&address), &addressSize);
+        if (received < 0) {
+            // nothing waiting, or a real error; a refusal is not, what is queued behind it may still be good
+            if (refused()) {
+                continue;
+            }
+            return 0;
+        }
+        from.ipv4 = ntohl(address.sin_addr.s_addr);
+        from.port = ntohs(address.sin_port);
+        _bytesReceived += static_cast<uint64_t>(received);
+        ++_packetsReceived;
+        return static_cast<size_t>(received);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef NET_SOCKET_H
+#define NET_SOCKET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// \desc an IPv4 address and port, both in host byte order
+struct NetAddress {
+    uint32_t ipv4 = 0;
+    uint16_t port = 0;
+
+    /// \desc "host" or "host:port", the port defaults to defaultPort; false when the host does not resolve
+    static bool parse(const std::string& text, uint16_t defaultPort, NetAddress& address);
+    std::string toString() const;
+
+    bool operator==(const NetAddress& other) const { return ipv4 == other.ipv4 && port == other.port; }
+    bool operator!=(const NetAddress& other) const { return !(*this == other); }
+};
+
+/// \desc a nonblocking UDP socket, counting what goes through it
+class NetSocket {
+public:
+    NetSocket() = default;
+    ~NetSocket();
+    NetSocket(const NetSocket&) = delete;
+    NetSocket& operator=(const NetSocket&) = delete;
+
+    /// \desc binds to the port on every interface, 0 lets the system pick one
+    bool open(uint16_t port);
+    void close();
+    bool isOpen() const;
+    /// \desc the port bound, useful after open(0)
+    uint16_t getPort() const { return _port; }
+
+    bool send(const NetAddress& to, const void* data, size_t size);
+    /// \desc the size of the next waiting datagram, 0 when there is none
+    size_t receive(NetAddress& from, void* buffer, size_t capacity);
+
+    uint64_t getBytesSent() const { return _bytesSent; }
+    uint64_t getBytesReceived() const { return _bytesReceived; }
+    uint64_t getPacketsSent() const { return _packetsSent; }
+    uint64_t getPacketsReceived() const { return _packetsReceived; }
+
+private:
+    /// \desc a SOCKET on Windows, a file descriptor elsewhere
+    intptr_t _socket = -1;
+    uint16_t _port = 0;
+
+    uint64_t _bytesSent = 0;
+    uint64_t _bytesReceived = 0;
+    uint64_t _packetsSent = 0;
+    uint64_t _packetsReceived = 0;
+};
+
+#endif // NET_SOCKET_H
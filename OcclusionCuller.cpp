@@ -0,0 +1,246 @@
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+// FP_OCCLUSION_SCALAR keeps the scalar loop on SSE2 machines too, so both can be tested
+#if !defined(FP_OCCLUSION_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FP_OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    /// \desc boxes larger than this many texels per side are tested on a coarser level
+    constexpr int MAX_TEST_TEXELS = 4;
+    /// \desc how many finer levels an undecided test may descend
+    constexpr int MAX_REFINEMENTS = 2;
+
+    /// \desc projects to window coordinates, returns false if the point is in front of the near plane
+    bool toWindow(const glm::vec4& clip, int width, int height, glm::vec3& window) {
+        if (clip.z < -clip.w || clip.w <= 0.0f) {
+            return false;
+        }
+        window.x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+        window.y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+        window.z = clip.z / clip.w * 0.5f + 0.5f;
+        return true;
+    }
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+    : _width((std::max(width, 4) + 3) & ~3),
+      _height(std::max(height, 1)),
+      _viewProjMtx(1.0f),
+      _numTested(0),
+      _numCulled(0)
+{
+    // halve down to a single texel, rounding up so odd edges stay covered
+    int levelWidth = _width;
+    int levelHeight = _height;
+    while (true) {
+        Level level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.minDepth.assign(levelWidth * levelHeight, 1.0f);
+        level.maxDepth.assign(levelWidth * levelHeight, 1.0f);
+        _levels.push_back(level);
+        if (levelWidth == 1 && levelHeight == 1) break;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+}
+
+bool OcclusionCuller::usesSSE2() {
+#ifdef FP_OCCLUSION_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4& viewProjMtx) {
+    _viewProjMtx = viewProjMtx;
+    std::fill(_levels[0].maxDepth.begin(), _levels[0].maxDepth.end(), 1.0f);
+    _numTested.store(0, std::memory_order_relaxed);
+    _numCulled.store(0, std::memory_order_relaxed);
+}
+
+void OcclusionCuller::rasterizeTriangles(const glm::vec3* vertices, size_t numVertices, const glm::mat4& modelMtx) {
+    const glm::mat4 mvpMtx = _viewProjMtx * modelMtx;
+    for (size_t i = 0; i + 2 < numVertices; i += 3) {
+        glm::vec3 window[3];
+        bool inFront = true;
+        for (int corner = 0; corner < 3 && inFront; ++corner) {
+            inFront = toWindow(mvpMtx * glm::vec4(vertices[i + corner], 1.0f), _width, _height, window[corner]);
+        }
+        if (inFront) {
+            _rasterizeTriangle(window[0], window[1], window[2]);
+        }
+    }
+}
+
+void OcclusionCuller::_rasterizeTriangle(const glm::vec3& v0, const glm::vec3& in1, const glm::vec3& in2) {
+    // orient counter-clockwise so all three edge functions are positive inside
+    float area = (in1.x - v0.x) * (in2.y - v0.y) - (in1.y - v0.y) * (in2.x - v0.x);
+    if (std::fabs(area) < 1e-6f) {
+        return;
+    }
+    const glm::vec3& v1 = area > 0.0f ? in1 : in2;
+    const glm::vec3& v2 = area > 0.0f ? in2 : in1;
+    area = std::fabs(area);
+
+    int minX = std::max(0, static_cast<int>(std::floor(std::min({v0.x, v1.x, v2.x}))));
+    int maxX = std::min(_width - 1, static_cast<int>(std::ceil(std::max({v0.x, v1.x, v2.x}))));
+    int minY = std::max(0, static_cast<int>(std::floor(std::min({v0.y, v1.y, v2.y}))));
+    int maxY = std::min(_height - 1, static_cast<int>(std::ceil(std::max({v0.y, v1.y, v2.y}))));
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    // edge i is e(x, y) = a[i] x + b[i] y + c[i], zero along the edge opposite vertex i
+    const float a[3] = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+    const float b[3] = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+    const float c[3] = { v1.x * v2.y - v2.x * v1.y, v2.x * v0.y - v0.x * v2.y, v0.x * v1.y - v1.x * v0.y };
+
+    // the edge functions are the barycentric weights scaled by the area, so depth is a plane too
+    const float za = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) / area;
+    const float zb = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) / area;
+    const float zc = (c[0] * v0.z + c[1] * v1.z + c[2] * v2.z) / area;
+
+    std::vector<float>& depth = _levels[0].maxDepth;
+    const int startX = minX & ~3;
+
+#ifdef FP_OCCLUSION_SSE2
+    const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+    const __m128 zaLanes = _mm_set1_ps(za);
+
+    for (int y = minY; y <= maxY; ++y) {
+        const float py = y + 0.5f;
+        const __m128 rowE0 = _mm_set1_ps(b[0] * py + c[0]);
+        const __m128 rowE1 = _mm_set1_ps(b[1] * py + c[1]);
+        const __m128 rowE2 = _mm_set1_ps(b[2] * py + c[2]);
+        const __m128 rowZ = _mm_set1_ps(zb * py + zc);
+        float* row = depth.data() + y * _width;
+
+        for (int x = startX; x <= maxX; x += 4) {
+            const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), rowE0), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), rowE1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), rowE2), zero));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+
+            const __m128 z = _mm_add_ps(_mm_mul_ps(zaLanes, px), rowZ);
+            const __m128 current = _mm_loadu_ps(row + x);
+            const __m128 nearest = _mm_min_ps(current, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; ++y) {
+        const float py = y + 0.5f;
+        float* row = depth.data() + y * _width;
+        for (int x = startX; x <= maxX; ++x) {
+            const float px = x + 0.5f;
+            if (a[0] * px + b[0] * py + c[0] < 0.0f ||
+                a[1] * px + b[1] * py + c[1] < 0.0f ||
+                a[2] * px + b[2] * py + c[2] < 0.0f) {
+                continue;
+            }
+            row[x] = std::min(row[x], za * px + zb * py + zc);
+        }
+    }
+#endif
+}
+
+void OcclusionCuller::buildPyramid() {
+    FP_PROFILE_SCOPE("OcclusionCuller::buildPyramid");
+    _levels[0].minDepth = _levels[0].maxDepth;
+
+    for (size_t i = 1; i < _levels.size(); ++i) {
+        const Level& source = _levels[i - 1];
+        Level& target = _levels[i];
+        for (int y = 0; y < target.height; ++y) {
+            const int sy0 = 2 * y;
+            const int sy1 = std::min(2 * y + 1, source.height - 1);
+            for (int x = 0; x < target.width; ++x) {
+                const int sx0 = 2 * x;
+                const int sx1 = std::min(2 * x + 1, source.width - 1);
+                const int i00 = sy0 * source.width + sx0, i01 = sy0 * source.width + sx1;
+                const int i10 = sy1 * source.width + sx0, i11 = sy1 * source.width + sx1;
+
+                target.minDepth[y * target.width + x] = std::min({source.minDepth[i00], source.minDepth[i01],
+                                                                  source.minDepth[i10], source.minDepth[i11]});
+                target.maxDepth[y * target.width + x] = std::max({source.maxDepth[i00], source.maxDepth[i01],
+                                                                  source.maxDepth[i10], source.maxDepth[i11]});
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+    _numTested.fetch_add(1, std::memory_order_relaxed);
+
+    glm::vec3 windowMin(static_cast<float>(_width), static_cast<float>(_height), 1.0f);
+    glm::vec3 windowMax(0.0f, 0.0f, 0.0f);
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 point((corner & 1) ? boxMax.x : boxMin.x,
+                        (corner & 2) ? boxMax.y : boxMin.y,
+                        (corner & 4) ? boxMax.z : boxMin.z);
+        glm::vec3 window;
+        if (!toWindow(_viewProjMtx * glm::vec4(point, 1.0f), _width, _height, window)) {
+            return true; // box reaches the camera, nothing can be in front of all of it
+        }
+        windowMin = glm::min(windowMin, window);
+        windowMax = glm::max(windowMax, window);
+    }
+
+    if (windowMax.x < 0.0f || windowMax.y < 0.0f || windowMin.x >= _width || windowMin.y >= _height || windowMin.z > 1.0f) {
+        _numCulled.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const int x0 = std::max(0, static_cast<int>(windowMin.x));
+    const int y0 = std::max(0, static_cast<int>(windowMin.y));
+    const int x1 = std::min(_width - 1, static_cast<int>(windowMax.x));
+    const int y1 = std::min(_height - 1, static_cast<int>(windowMax.y));
+
+    // start on the level where the box covers only a few texels, then refine while undecided
+    int level = 0;
+    while (level + 1 < static_cast<int>(_levels.size()) &&
+           ((x1 >> level) - (x0 >> level) >= MAX_TEST_TEXELS || (y1 >> level) - (y0 >> level) >= MAX_TEST_TEXELS)) {
+        ++level;
+    }
+
+    const int lastLevel = std::max(0, level - MAX_REFINEMENTS);
+    for (; level >= lastLevel; --level) {
+        int result = _testLevel(level, x0 >> level, y0 >> level, x1 >> level, y1 >> level, windowMin.z);
+        if (result < 0) {
+            _numCulled.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (result > 0) {
+            return true;
+        }
+    }
+    return true;
+}
+
+int OcclusionCuller::_testLevel(int level, int x0, int y0, int x1, int y1, float depth) const {
+    const Level& source = _levels[level];
+    float nearest = 1.0f;
+    float farthest = 0.0f;
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            nearest = std::min(nearest, source.minDepth[y * source.width + x]);
+            farthest = std::max(farthest, source.maxDepth[y * source.width + x]);
+        }
+    }
+
+    if (depth > farthest) return -1;  // behind every occluder in the rect
+    if (depth <= nearest) return 1;   // in front of every occluder in the rect
+    return 0;
+}
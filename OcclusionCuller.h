@@ -0,0 +1,68 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/// \desc CPU occlusion culling against a small software depth buffer.
+/// Each frame a handful of large occluders are rasterized into the buffer,
+/// a min/max depth pyramid is built from it, and object bounding boxes are
+/// tested against the pyramid before any draw call is issued.
+/// Rasterization runs four pixels at a time with SSE2 when it is available
+/// and falls back to plain scalar code otherwise, or when FP_OCCLUSION_SCALAR
+/// is defined. Nothing here touches OpenGL.
+class OcclusionCuller {
+public:
+    /// \desc width is rounded up to a multiple of four so rows split evenly into SIMD lanes
+    OcclusionCuller(int width = 128, int height = 64);
+
+    /// \desc clears the depth buffer and sets the camera used for the rest of the frame
+    void beginFrame(const glm::mat4& viewProjMtx);
+    /// \desc rasterizes a triangle list (three vertices per triangle) placed by modelMtx.
+    /// Occluders should lie inside the geometry they stand for; triangles crossing the
+    /// near plane are skipped, which only ever makes the culling less aggressive.
+    void rasterizeTriangles(const glm::vec3* vertices, size_t numVertices, const glm::mat4& modelMtx);
+    /// \desc builds the min/max pyramid, call once after the last occluder
+    void buildPyramid();
+
+    /// \desc false when the world space box is outside the view or behind the occluders;
+    /// safe to call from several threads at once once the pyramid is built
+    bool isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+    /// \desc whether this build rasterizes with SSE2 rather than the scalar loop
+    static bool usesSSE2();
+
+    int getWidth() const { return _width; }
+    int getHeight() const { return _height; }
+    /// \desc depth buffer after rasterization, window depth in [0, 1] with 1 meaning empty
+    const std::vector<float>& getDepthBuffer() const { return _levels[0].maxDepth; }
+
+    size_t getNumTested() const { return _numTested.load(std::memory_order_relaxed); }
+    size_t getNumCulled() const { return _numCulled.load(std::memory_order_relaxed); }
+
+private:
+    /// \desc one level of the depth pyramid, holding the nearest and farthest
+    /// occluder depth of the level 0 pixels it covers
+    struct Level {
+        int width;
+        int height;
+        std::vector<float> minDepth;
+        std::vector<float> maxDepth;
+    };
+
+    const int _width;
+    const int _height;
+    std::vector<Level> _levels;
+    glm::mat4 _viewProjMtx;
+
+    mutable std::atomic<size_t> _numTested;
+    mutable std::atomic<size_t> _numCulled;
+
+    void _rasterizeTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+    /// \desc -1 when the rect is certainly occluded, 1 when it is certainly visible, 0 when undecided
+    int _testLevel(int level, int x0, int y0, int x1, int y1, float depth) const;
+};
+
+#endif // OCCLUSION_CULLER_H
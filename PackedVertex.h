@@ -0,0 +1,85 @@
+#ifndef PACKED_VERTEX_H
+#define PACKED_VERTEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/// \desc compact vertex encodings shared by the level compiler and the engine,
+/// the shaders decode them.
+///
+/// Positions are 16-bit integers inside the mesh's bounding box. They are
+/// handed to GL as plain, not normalized, shorts and the shader applies
+/// position = offset + value * scale: the signed normalized conversion
+/// differs between GL 4.1 and 4.2, the plain one is exact everywhere.
+/// Normals are octahedral encoded into two shorts the same way. Texture
+/// coordinates in [0, 1] are normalized unsigned shorts.
+namespace PackedVertex {
+    constexpr float SHORT_MAX = 32767.0f;
+    constexpr float USHORT_MAX = 65535.0f;
+    /// \desc meshes with more vertices than this need 32-bit indices
+    constexpr size_t MAX_SHORT_INDEXED_VERTICES = 65536;
+
+    /// \desc position and normal, 12 bytes where three floats each take 24
+    struct PositionNormal {
+        /// \desc w is padding that keeps the normal 4-byte aligned
+        int16_t position[4];
+        int16_t normal[2];
+    };
+    static_assert(sizeof(PositionNormal) == 12, "attribute offsets assume a packed layout");
+
+    /// \desc what the shader needs to undo the position quantization
+    struct PositionDecode {
+        float scale[3];
+        float offset[3];
+    };
+
+    inline bool fitsShortIndices(size_t numVertices) {
+        return numVertices <= MAX_SHORT_INDEXED_VERTICES;
+    }
+
+    /// \desc the box centered on [min, max], an empty axis is kept at a scale of 0
+    inline PositionDecode decodeForBounds(const float min[3], const float max[3]) {
+        PositionDecode decode;
+        for (int axis = 0; axis < 3; ++axis) {
+            decode.offset[axis] = (min[axis] + max[axis]) * 0.5f;
+            decode.scale[axis] = (max[axis] - min[axis]) * 0.5f / SHORT_MAX;
+        }
+        return decode;
+    }
+
+    inline int16_t packSnorm(float value) {
+        return static_cast<int16_t>(std::lround(std::max(-1.0f, std::min(1.0f, value)) * SHORT_MAX));
+    }
+
+    inline uint16_t packUnorm(float value) {
+        return static_cast<uint16_t>(std::lround(std::max(0.0f, std::min(1.0f, value)) * USHORT_MAX));
+    }
+
+    inline void packPosition(const PositionDecode& decode, const float position[3], int16_t packed[4]) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const float scale = decode.scale[axis] * SHORT_MAX;
+            packed[axis] = packSnorm(scale > 0.0f ? (position[axis] - decode.offset[axis]) / scale : 0.0f);
+        }
+        packed[3] = 0;
+    }
+
+    /// \desc projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and folds
+    /// the lower half over the upper one, decoded by octahedralDecode in the shaders
+    inline void packNormal(const float normal[3], int16_t packed[2]) {
+        const float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+        float x = length > 0.0f ? normal[0] / length : 0.0f;
+        float y = length > 0.0f ? normal[1] / length : 0.0f;
+        if (length > 0.0f && normal[2] < 0.0f) {
+            const float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            const float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+        packed[0] = packSnorm(x);
+        packed[1] = packSnorm(y);
+    }
+}
+
+#endif // PACKED_VERTEX_H
@@ -0,0 +1,226 @@
+#include "ParticleSystem.h"
+#include "GLStateCache.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <cstdio>
+#include <vector>
+
+ParticleSystem::ParticleSystem(GLuint maxParticles)
+    : _maxParticles(maxParticles),
+      _currentBuffer(0),
+      _seed(0.0f),
+      _activeFraction(1.0f),
+      _quadVBO(0),
+      _spriteTexture(0),
+      _updateShaderProgram(nullptr),
+      _renderShaderProgram(nullptr)
+{
+    // half of the pool sparkles around the coin, the rest is split between the bursts
+    GLint coinCount = static_cast<GLint>(maxParticles / 2);
+    GLint pickupCount = static_cast<GLint>(maxParticles / 4);
+    GLint landingCount = static_cast<GLint>(maxParticles) - coinCount - pickupCount;
+
+    _emitterRanges[COIN * 2 + 0] = 0;
+    _emitterRanges[COIN * 2 + 1] = coinCount;
+    _emitterRanges[PICKUP * 2 + 0] = coinCount;
+    _emitterRanges[PICKUP * 2 + 1] = pickupCount;
+    _emitterRanges[LANDING * 2 + 0] = coinCount + pickupCount;
+    _emitterRanges[LANDING * 2 + 1] = landingCount;
+
+    _emitterSources[COIN] = glm::vec4(0.0f, 0.0f, 0.0f, 0.8f);
+    _emitterSources[PICKUP] = glm::vec4(0.0f, 0.0f, 0.0f, 0.3f);
+    _emitterSources[LANDING] = glm::vec4(0.0f, 0.0f, 0.0f, 1.2f);
+
+    for (GLint& mode : _emitterModes) mode = 0;
+    for (GLuint i = 0; i < 2; ++i) {
+        _particleVBOs[i] = 0;
+        _updateVAOs[i] = 0;
+        _renderVAOs[i] = 0;
+        _transformFeedbacks[i] = 0;
+    }
+}
+
+ParticleSystem::~ParticleSystem() {
+    delete _updateShaderProgram;
+    delete _renderShaderProgram;
+}
+
+void ParticleSystem::setup(GLuint spriteTexture, ShaderCache& shaderCache) {
+    _spriteTexture = spriteTexture;
+
+    //***************************************************************************
+    // Shader programs
+
+    // the update pass has no fragment shader, its outputs are captured with transform feedback
+    _updateShaderProgram = shaderCache.load("shaders/particleUpdate.vs.glsl", nullptr, { "outPosAge", "outVelLife" });
+    _renderShaderProgram = shaderCache.load("shaders/particleRender.vs.glsl", "shaders/particleRender.fs.glsl");
+
+    _updateUniformLocations.dt = _updateShaderProgram->getUniformLocation("dt");
+    _updateUniformLocations.seed = _updateShaderProgram->getUniformLocation("seed");
+    _updateUniformLocations.emitterRanges = _updateShaderProgram->getUniformLocation("emitterRanges");
+    _updateUniformLocations.emitterSources = _updateShaderProgram->getUniformLocation("emitterSources");
+    _updateUniformLocations.emitterModes = _updateShaderProgram->getUniformLocation("emitterModes");
+    _updateUniformLocations.activeFraction = _updateShaderProgram->getUniformLocation("activeFraction");
+
+    _renderUniformLocations.viewMatrix = _renderShaderProgram->getUniformLocation("viewMatrix");
+    _renderUniformLocations.projMatrix = _renderShaderProgram->getUniformLocation("projMatrix");
+    _renderUniformLocations.particleSize = _renderShaderProgram->getUniformLocation("particleSize");
+    _renderUniformLocations.emitterRanges = _renderShaderProgram->getUniformLocation("emitterRanges");
+    _renderUniformLocations.emitterColors = _renderShaderProgram->getUniformLocation("emitterColors");
+    _renderUniformLocations.image = _renderShaderProgram->getUniformLocation("image");
+
+    // set static uniforms
+    const glm::vec3 emitterColors[NUM_EMITTERS] = {
+        glm::vec3(1.0f, 0.9f, 0.4f),  // coin sparkle
+        glm::vec3(1.0f, 0.84f, 0.0f), // gold pickup
+        glm::vec3(0.7f, 0.6f, 0.5f)   // landing dust
+    };
+    _renderShaderProgram->useProgram();
+    glUniform2iv(_renderUniformLocations.emitterRanges, NUM_EMITTERS, _emitterRanges);
+    glUniform3fv(_renderUniformLocations.emitterColors, NUM_EMITTERS, glm::value_ptr(emitterColors[0]));
+    glUniform1f(_renderUniformLocations.particleSize, 0.15f);
+    glUniform1i(_renderUniformLocations.image, 0);
+
+    _updateShaderProgram->useProgram();
+    glUniform2iv(_updateUniformLocations.emitterRanges, NUM_EMITTERS, _emitterRanges);
+
+    //***************************************************************************
+    // Buffers
+
+    // every particle starts dead: age == lifetime == 0
+    std::vector<glm::vec4> initialState(_maxParticles * 2, glm::vec4(0.0f));
+
+    const GLfloat quadCorners[] = {
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+        -1.0f,  1.0f,
+         1.0f,  1.0f
+    };
+    glGenBuffers(1, &_quadVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, _quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadCorners), quadCorners, GL_STATIC_DRAW);
+
+    glGenBuffers(2, _particleVBOs);
+    glGenVertexArrays(2, _updateVAOs);
+    glGenVertexArrays(2, _renderVAOs);
+    glGenTransformFeedbacks(2, _transformFeedbacks);
+
+    const GLsizei STRIDE = 2 * sizeof(glm::vec4);
+    for (GLuint i = 0; i < 2; ++i) {
+        glBindBuffer(GL_ARRAY_BUFFER, _particleVBOs[i]);
+        glBufferData(GL_ARRAY_BUFFER, initialState.size() * sizeof(glm::vec4), initialState.data(), GL_DYNAMIC_COPY);
+
+        // update VAO reads the particle state as plain vertices
+        glBindVertexArray(_updateVAOs[i]);
+        glEnableVertexAttribArray(0); // position + age
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, STRIDE, (void*)0);
+        glEnableVertexAttribArray(1); // velocity + lifetime
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, STRIDE, (void*)sizeof(glm::vec4));
+
+        // render VAO reads the quad per vertex and the particle state per instance
+        glBindVertexArray(_renderVAOs[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, _quadVBO);
+        glEnableVertexAttribArray(0); // quad corner
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, _particleVBOs[i]);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, STRIDE, (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, STRIDE, (void*)sizeof(glm::vec4));
+        glVertexAttribDivisor(2, 1);
+
+        // transform feedback object i captures into buffer i
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, _transformFeedbacks[i]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, _particleVBOs[i]);
+    }
+
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    fprintf(stdout, "[INFO]: particle system created with %u particles in VBOs %u/%u\n",
+            _maxParticles, _particleVBOs[0], _particleVBOs[1]);
+}
+
+void ParticleSystem::cleanup() {
+    glDeleteVertexArrays(2, _updateVAOs);
+    glDeleteVertexArrays(2, _renderVAOs);
+    glDeleteTransformFeedbacks(2, _transformFeedbacks);
+    glDeleteBuffers(2, _particleVBOs);
+    glDeleteBuffers(1, &_quadVBO);
+    delete _updateShaderProgram;
+    _updateShaderProgram = nullptr;
+    delete _renderShaderProgram;
+    _renderShaderProgram = nullptr;
+}
+
+void ParticleSystem::setCoinEmitter(const glm::vec3& position, bool active) {
+    _emitterSources[COIN] = glm::vec4(position, _emitterSources[COIN].w);
+    _emitterModes[COIN] = active ? 1 : 0;
+}
+
+void ParticleSystem::emitBurst(EmitterType type, const glm::vec3& position) {
+    _emitterSources[type] = glm::vec4(position, _emitterSources[type].w);
+    _emitterModes[type] = 2;
+}
+
+void ParticleSystem::setActiveFraction(GLfloat fraction) {
+    _activeFraction = glm::clamp(fraction, 0.0f, 1.0f);
+}
+
+void ParticleSystem::update(float dt) {
+    if (!_updateShaderProgram) {
+        return;
+    }
+    _seed += 1.0f;
+    if (_seed > 65535.0f) _seed = 0.0f;
+
+    GLuint destination = 1 - _currentBuffer;
+
+    GLStateCache& glState = GLStateCache::instance();
+    _updateShaderProgram->useProgram();
+    glState.uniform(_updateUniformLocations.dt, dt);
+    glState.uniform(_updateUniformLocations.seed, _seed);
+    glState.uniform(_updateUniformLocations.emitterSources, NUM_EMITTERS, _emitterSources);
+    glState.uniform(_updateUniformLocations.emitterModes, NUM_EMITTERS, _emitterModes);
+    glState.uniform(_updateUniformLocations.activeFraction, _activeFraction);
+
+    glState.setEnabled(GL_RASTERIZER_DISCARD, true);
+    glState.bindVertexArray(_updateVAOs[_currentBuffer]);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, _transformFeedbacks[destination]);
+    glBeginTransformFeedback(GL_POINTS);
+    glState.drawArrays(GL_POINTS, 0, static_cast<GLsizei>(_maxParticles));
+    glEndTransformFeedback();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glState.setEnabled(GL_RASTERIZER_DISCARD, false);
+
+    _currentBuffer = destination;
+
+    // bursts only fire for a single step
+    for (GLint& mode : _emitterModes) {
+        if (mode == 2) mode = 0;
+    }
+}
+
+void ParticleSystem::draw(const glm::mat4& viewMtx, const glm::mat4& projMtx) const {
+    if (!_renderShaderProgram) {
+        return;
+    }
+
+    // additive blending is order independent, so the particles never need sorting
+    GLStateCache& glState = GLStateCache::instance();
+    glState.setBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    glState.setDepthMask(GL_FALSE);
+
+    _renderShaderProgram->useProgram();
+    glState.uniform(_renderUniformLocations.viewMatrix, viewMtx);
+    glState.uniform(_renderUniformLocations.projMatrix, projMtx);
+
+    glState.bindTexture(0, GL_TEXTURE_2D, _spriteTexture);
+
+    glState.bindVertexArray(_renderVAOs[_currentBuffer]);
+    glState.drawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(_maxParticles));
+
+    glState.setDepthMask(GL_TRUE);
+    glState.setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
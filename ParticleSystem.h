@@ -0,0 +1,91 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "ShaderCache.h"
+
+/// \desc GPU particle system. Particle state lives in two ping-pong buffers
+/// that are advanced with transform feedback and drawn as instanced,
+/// camera-facing quads. The CPU only sets a handful of uniforms per frame,
+/// so the cost does not grow with the number of particles.
+class ParticleSystem {
+public:
+    /// \desc the emitters that own a slice of the particle pool
+    enum EmitterType {
+        /// \desc continuous sparkles swirling around the active coin
+        COIN = 0,
+        /// \desc one-shot burst when a coin is collected
+        PICKUP = 1,
+        /// \desc one-shot ring of dust when the vehicle lands from a jump
+        LANDING = 2
+    };
+    static constexpr GLuint NUM_EMITTERS = 3;
+
+    explicit ParticleSystem(GLuint maxParticles);
+    ~ParticleSystem();
+
+    /// \desc creates the shader programs and the ping-pong buffers
+    void setup(GLuint spriteTexture, ShaderCache& shaderCache);
+    void cleanup();
+
+    /// \desc moves the continuous coin emitter, or stops it when there is no coin left
+    void setCoinEmitter(const glm::vec3& position, bool active);
+    /// \desc restarts every particle owned by a burst emitter at the given position
+    void emitBurst(EmitterType type, const glm::vec3& position);
+
+    /// \desc advances every particle by one step on the GPU
+    void update(float dt);
+    void draw(const glm::mat4& viewMtx, const glm::mat4& projMtx) const;
+
+    GLuint getMaxParticles() const { return _maxParticles; }
+
+    /// \desc limits every emitter to this share of its slice; particles past it
+    /// are no longer respawned and drop out as they die
+    void setActiveFraction(GLfloat fraction);
+    GLfloat getActiveFraction() const { return _activeFraction; }
+
+private:
+    const GLuint _maxParticles;
+
+    /// \desc first particle and particle count of each emitter's slice
+    GLint _emitterRanges[NUM_EMITTERS * 2];
+    /// \desc xyz origin and w spawn radius of each emitter
+    glm::vec4 _emitterSources[NUM_EMITTERS];
+    /// \desc 0 idle, 1 continuous, 2 burst on the next update
+    GLint _emitterModes[NUM_EMITTERS];
+
+    /// \desc index of the buffer holding the current particle state
+    GLuint _currentBuffer;
+    GLfloat _seed;
+    GLfloat _activeFraction;
+
+    GLuint _particleVBOs[2];
+    GLuint _updateVAOs[2];
+    GLuint _renderVAOs[2];
+    GLuint _transformFeedbacks[2];
+    GLuint _quadVBO;
+    GLuint _spriteTexture;
+
+    CachedShaderProgram* _updateShaderProgram;
+    struct UpdateUniformLocations {
+        GLint dt;
+        GLint seed;
+        GLint emitterRanges;
+        GLint emitterSources;
+        GLint emitterModes;
+        GLint activeFraction;
+    } _updateUniformLocations;
+
+    CachedShaderProgram* _renderShaderProgram;
+    struct RenderUniformLocations {
+        GLint viewMatrix;
+        GLint projMatrix;
+        GLint particleSize;
+        GLint emitterRanges;
+        GLint emitterColors;
+        GLint image;
+    } _renderUniformLocations;
+};
+
+#endif // PARTICLE_SYSTEM_H
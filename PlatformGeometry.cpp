@@ -0,0 +1,89 @@
+#include "PlatformGeometry.h"
+#include "PackedVertex.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265f
+#endif
+
+namespace {
+    void addVertex(std::vector<PlatformGeometry::SourceVertex>& vertices, const float position[3], float x, float z, float u, float v) {
+        vertices.push_back(PlatformGeometry::SourceVertex{ { position[0] + x, position[1], position[2] + z }, u, v });
+    }
+}
+
+void PlatformGeometry::generateDisk(const LevelFormat::Platform& disk, int numSegments, Mesh& mesh) {
+    const float innerRadius = disk.size[0], outerRadius = disk.size[1];
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    for (int i = 0; i <= numSegments; ++i) {
+        float angle = static_cast<float>(i) / numSegments * 2.0f * M_PI;
+        float cosAngle = std::cos(angle);
+        float sinAngle = std::sin(angle);
+
+        addVertex(mesh.vertices, disk.position, innerRadius * cosAngle, innerRadius * sinAngle,
+                  0.5f + cosAngle * 0.5f * (innerRadius / outerRadius),
+                  0.5f + sinAngle * 0.5f * (innerRadius / outerRadius));
+        addVertex(mesh.vertices, disk.position, outerRadius * cosAngle, outerRadius * sinAngle,
+                  0.5f + cosAngle * 0.5f, 0.5f + sinAngle * 0.5f);
+
+        if (i < numSegments) {
+            const uint16_t inner = static_cast<uint16_t>(i * 2), outer = inner + 1;
+            mesh.indices.insert(mesh.indices.end(), { inner, outer, static_cast<uint16_t>(inner + 2),
+                                                      outer, static_cast<uint16_t>(outer + 2), static_cast<uint16_t>(inner + 2) });
+        }
+    }
+}
+
+void PlatformGeometry::generateRectangle(const LevelFormat::Platform& rect, Mesh& mesh) {
+    const float halfX = rect.size[0] / 2.0f, halfZ = rect.size[1] / 2.0f;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    addVertex(mesh.vertices, rect.position, -halfX, -halfZ, 0.0f, 0.0f);
+    addVertex(mesh.vertices, rect.position, halfX, -halfZ, 1.0f, 0.0f);
+    addVertex(mesh.vertices, rect.position, halfX, halfZ, 1.0f, 1.0f);
+    addVertex(mesh.vertices, rect.position, -halfX, halfZ, 0.0f, 1.0f);
+    mesh.indices.insert(mesh.indices.end(), { 0, 1, 2, 2, 3, 0 });
+}
+
+MeshOptimizer::Report PlatformGeometry::optimize(Mesh& mesh) {
+    std::vector<uint32_t> remap;
+    const MeshOptimizer::Report report = MeshOptimizer::optimize(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(),
+                                                                 mesh.vertices[0].position, sizeof(SourceVertex) / sizeof(float), remap);
+    MeshOptimizer::remapVertices(remap, mesh.vertices);
+    return report;
+}
+
+void PlatformGeometry::pack(const Mesh& mesh, LevelFormat::Platform& platform,
+                            std::vector<LevelFormat::Vertex>& vertices, std::vector<uint16_t>& indices) {
+    float min[3], max[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        min[axis] = max[axis] = mesh.vertices[0].position[axis];
+    }
+    for (const SourceVertex& vertex : mesh.vertices) {
+        for (int axis = 0; axis < 3; ++axis) {
+            min[axis] = std::min(min[axis], vertex.position[axis]);
+            max[axis] = std::max(max[axis], vertex.position[axis]);
+        }
+    }
+    const PackedVertex::PositionDecode decode = PackedVertex::decodeForBounds(min, max);
+    std::copy(decode.scale, decode.scale + 3, platform.positionScale);
+    std::copy(decode.offset, decode.offset + 3, platform.positionOffset);
+
+    platform.firstVertex = static_cast<uint32_t>(vertices.size());
+    platform.numVertices = static_cast<uint32_t>(mesh.vertices.size());
+    for (const SourceVertex& vertex : mesh.vertices) {
+        LevelFormat::Vertex packed;
+        PackedVertex::packPosition(decode, vertex.position, packed.position);
+        packed.texCoord[0] = PackedVertex::packUnorm(vertex.u);
+        packed.texCoord[1] = PackedVertex::packUnorm(vertex.v);
+        vertices.push_back(packed);
+    }
+    platform.firstIndex = static_cast<uint32_t>(indices.size());
+    platform.numIndices = static_cast<uint32_t>(mesh.indices.size());
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+}
@@ -0,0 +1,38 @@
+#ifndef PLATFORM_GEOMETRY_H
+#define PLATFORM_GEOMETRY_H
+
+#include "LevelFormat.h"
+#include "MeshOptimizer.h"
+
+#include <cstdint>
+#include <vector>
+
+/// \desc triangles of the level's platforms. fp_levelc builds them from the
+/// level description and packs them into the level file; they are kept apart
+/// from the compiler so fp_bench can time them too.
+namespace PlatformGeometry {
+    /// \desc a platform vertex before it is packed
+    struct SourceVertex {
+        float position[3];
+        float u, v;
+    };
+
+    /// \desc generating into a mesh that is reused keeps its capacity
+    struct Mesh {
+        std::vector<SourceVertex> vertices;
+        std::vector<uint16_t> indices;
+    };
+
+    /// \desc a flat ring, textured like the disk used to be generated at startup
+    void generateDisk(const LevelFormat::Platform& disk, int numSegments, Mesh& mesh);
+    void generateRectangle(const LevelFormat::Platform& rect, Mesh& mesh);
+    /// \desc reorders the triangles and vertices for the GPU's caches, see MeshOptimizer
+    MeshOptimizer::Report optimize(Mesh& mesh);
+
+    /// \desc quantizes the mesh inside its bounds, records the decode and the vertex and
+    /// index ranges in the platform and appends the packed vertices and indices
+    void pack(const Mesh& mesh, LevelFormat::Platform& platform,
+              std::vector<LevelFormat::Vertex>& vertices, std::vector<uint16_t>& indices);
+}
+
+#endif // PLATFORM_GEOMETRY_H
@@ -0,0 +1,153 @@
+#include "Profiler.h"
+
+#ifdef FP_ENABLE_PROFILER
+
+#include <chrono>
+#include <cstdio>
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    : _startTime(now()),
+      _gpuQueriesUsed{0, 0},
+      _gpuFrame(0),
+      _gpuZoneOpen(false)
+{}
+
+uint64_t Profiler::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+Profiler::ThreadEvents& Profiler::_threadEvents() {
+    thread_local ThreadEvents* local = nullptr;
+    if (!local) {
+        std::lock_guard<std::mutex> lock(_threadsMutex);
+        _threads.emplace_back(new ThreadEvents{static_cast<uint32_t>(_threads.size() + 1), "", {}});
+        local = _threads.back().get();
+        local->events.reserve(4096);
+    }
+    return *local;
+}
+
+void Profiler::setThreadName(const char* name) {
+    ThreadEvents& thread = _threadEvents();
+    std::lock_guard<std::mutex> lock(_threadsMutex);
+    thread.name = name;
+}
+
+void Profiler::recordCpuZone(const char* name, uint64_t start, uint64_t end) {
+    ThreadEvents& thread = _threadEvents();
+    if (thread.events.size() < MAX_EVENTS_PER_THREAD) {
+        thread.events.push_back(Event{name, start, end - start});
+    }
+}
+
+void Profiler::beginGpuZone(const char* name) {
+    // GL_TIME_ELAPSED queries cannot nest, so only the outermost zone is timed
+    if (_gpuZoneOpen) {
+        return;
+    }
+
+    std::vector<GpuQuery>& queries = _gpuQueries[_gpuFrame];
+    size_t& used = _gpuQueriesUsed[_gpuFrame];
+    if (used == queries.size()) {
+        GpuQuery query{0, nullptr, 0};
+        glGenQueries(1, &query.query);
+        queries.push_back(query);
+    }
+
+    GpuQuery& query = queries[used++];
+    query.name = name;
+    query.cpuStart = now();
+    glBeginQuery(GL_TIME_ELAPSED, query.query);
+    _gpuZoneOpen = true;
+}
+
+void Profiler::endGpuZone() {
+    if (_gpuZoneOpen) {
+        glEndQuery(GL_TIME_ELAPSED);
+        _gpuZoneOpen = false;
+    }
+}
+
+void Profiler::endFrame() {
+    _gpuFrame ^= 1;
+
+    // these were issued a full frame ago; any still in flight are dropped rather than waited on
+    std::vector<GpuQuery>& queries = _gpuQueries[_gpuFrame];
+    for (size_t i = 0; i < _gpuQueriesUsed[_gpuFrame]; ++i) {
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[i].query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[i].query, GL_QUERY_RESULT, &elapsed);
+        // placed at the CPU submit time, the GPU has no shared clock with steady_clock
+        if (_gpuEvents.size() < MAX_EVENTS_PER_THREAD) {
+            _gpuEvents.push_back(Event{queries[i].name, queries[i].cpuStart, elapsed});
+        }
+    }
+    _gpuQueriesUsed[_gpuFrame] = 0;
+}
+
+void Profiler::cleanupGpu() {
+    for (std::vector<GpuQuery>& queries : _gpuQueries) {
+        for (GpuQuery& query : queries) {
+            glDeleteQueries(1, &query.query);
+        }
+        queries.clear();
+    }
+    _gpuQueriesUsed[0] = _gpuQueriesUsed[1] = 0;
+}
+
+bool Profiler::writeChromeTrace(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "[ERROR]: could not open %s to write the profile\n", path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_threadsMutex);
+
+    // Chrome trace timestamps are microseconds; keep the nanoseconds as fractions
+    auto writeEvent = [&](const Event& event, uint32_t tid, bool& first) {
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",", event.name, tid,
+                static_cast<int64_t>(event.start - _startTime) / 1000.0, event.duration / 1000.0);
+        first = false;
+    };
+
+    const uint32_t gpuTrack = static_cast<uint32_t>(_threads.size() + 1);
+    size_t numEvents = 0;
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (const std::unique_ptr<ThreadEvents>& thread : _threads) {
+        const char* name = thread->name.empty() ? "thread" : thread->name.c_str();
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",", thread->id, name);
+        first = false;
+        for (const Event& event : thread->events) {
+            writeEvent(event, thread->id, first);
+        }
+        numEvents += thread->events.size();
+    }
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}",
+            first ? "" : ",", gpuTrack);
+    first = false;
+    for (const Event& event : _gpuEvents) {
+        writeEvent(event, gpuTrack, first);
+    }
+    numEvents += _gpuEvents.size();
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    fprintf(stdout, "[INFO]: wrote %zu profile events to %s\n", numEvents, path);
+    return true;
+}
+
+#endif // FP_ENABLE_PROFILER
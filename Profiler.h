@@ -0,0 +1,121 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/// \desc Scoped CPU and GPU profiling zones with Chrome Trace export.
+///
+/// Everything here is compiled out unless FP_ENABLE_PROFILER is defined
+/// (cmake -DFP_ENABLE_PROFILER=ON); the macros then expand to nothing.
+///
+///   FP_PROFILE_SCOPE("name")      times the enclosing scope on the calling thread
+///   FP_PROFILE_GPU_SCOPE("name")  times the GL commands issued in the enclosing scope,
+///                                 render thread only and never nested
+///   FP_PROFILE_THREAD_NAME("name") labels the calling thread in the trace
+///   FP_PROFILE_FRAME_END()         collects GPU timings, once per frame on the render thread
+///   FP_PROFILE_GPU_CLEANUP()       releases the query objects while the context is alive
+///   FP_PROFILE_WRITE_TRACE("path") writes the capture as Chrome Trace / Perfetto JSON
+
+#ifdef FP_ENABLE_PROFILER
+
+#include <glad/gl.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Profiler {
+public:
+    static Profiler& instance();
+
+    /// \desc monotonic CPU time in nanoseconds
+    static uint64_t now();
+
+    void setThreadName(const char* name);
+    void recordCpuZone(const char* name, uint64_t start, uint64_t end);
+
+    void beginGpuZone(const char* name);
+    void endGpuZone();
+    void endFrame();
+    void cleanupGpu();
+
+    bool writeChromeTrace(const char* path) const;
+
+    /// \desc times its own lifetime
+    class CpuZone {
+    public:
+        explicit CpuZone(const char* name) : _name(name), _start(Profiler::now()) {}
+        ~CpuZone() { Profiler::instance().recordCpuZone(_name, _start, Profiler::now()); }
+    private:
+        const char* _name;
+        uint64_t _start;
+    };
+
+    /// \desc wraps a GL_TIME_ELAPSED query around its own lifetime
+    class GpuZone {
+    public:
+        explicit GpuZone(const char* name) { Profiler::instance().beginGpuZone(name); }
+        ~GpuZone() { Profiler::instance().endGpuZone(); }
+    };
+
+private:
+    Profiler();
+
+    /// \desc zone names are string literals, so only the pointer is kept
+    struct Event {
+        const char* name;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    /// \desc events of one thread, only ever appended to by that thread
+    struct ThreadEvents {
+        uint32_t id;
+        std::string name;
+        std::vector<Event> events;
+    };
+
+    struct GpuQuery {
+        GLuint query;
+        const char* name;
+        uint64_t cpuStart;
+    };
+
+    /// \desc caps memory use of long captures
+    static constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+    ThreadEvents& _threadEvents();
+
+    mutable std::mutex _threadsMutex;
+    std::vector<std::unique_ptr<ThreadEvents>> _threads;
+    uint64_t _startTime;
+
+    // queries are double buffered: the set issued last frame is read while
+    // this frame's set is being recorded, so reading never stalls the pipeline
+    std::vector<GpuQuery> _gpuQueries[2];
+    size_t _gpuQueriesUsed[2];
+    int _gpuFrame;
+    bool _gpuZoneOpen;
+    std::vector<Event> _gpuEvents;
+};
+
+#define FP_PROFILE_CONCAT_INNER(a, b) a##b
+#define FP_PROFILE_CONCAT(a, b) FP_PROFILE_CONCAT_INNER(a, b)
+#define FP_PROFILE_SCOPE(name) Profiler::CpuZone FP_PROFILE_CONCAT(_fpProfileZone, __LINE__)(name)
+#define FP_PROFILE_GPU_SCOPE(name) Profiler::GpuZone FP_PROFILE_CONCAT(_fpProfileGpuZone, __LINE__)(name)
+#define FP_PROFILE_THREAD_NAME(name) Profiler::instance().setThreadName(name)
+#define FP_PROFILE_FRAME_END() Profiler::instance().endFrame()
+#define FP_PROFILE_GPU_CLEANUP() Profiler::instance().cleanupGpu()
+#define FP_PROFILE_WRITE_TRACE(path) Profiler::instance().writeChromeTrace(path)
+
+#else
+
+#define FP_PROFILE_SCOPE(name) ((void)0)
+#define FP_PROFILE_GPU_SCOPE(name) ((void)0)
+#define FP_PROFILE_THREAD_NAME(name) ((void)0)
+#define FP_PROFILE_FRAME_END() ((void)0)
+#define FP_PROFILE_GPU_CLEANUP() ((void)0)
+#define FP_PROFILE_WRITE_TRACE(path) ((void)0)
+
+#endif // FP_ENABLE_PROFILER
+
+#endif // PROFILER_H
@@ -0,0 +1,93 @@
+#include "QualityGovernor.h"
+#include <algorithm>
+
+namespace {
+    /// \desc frames ignored at startup while shaders and buffers warm up
+    constexpr int WARMUP_FRAMES = 30;
+    /// \desc weight of the newest frame in the running average
+    constexpr float AVERAGE_WEIGHT = 0.1f;
+    /// \desc the average has to stay above this share of the budget to downgrade...
+    constexpr float OVER_BUDGET = 1.15f;
+    constexpr int DOWNGRADE_FRAMES = 15;
+    /// \desc ...and below this share of it to upgrade
+    constexpr float UNDER_BUDGET = 1.05f;
+    constexpr int MIN_UPGRADE_WAIT = 180;
+    constexpr int MAX_UPGRADE_WAIT = 3600;
+    /// \desc a downgrade this soon after an upgrade means the upgrade did not fit
+    constexpr int FAILED_UPGRADE_FRAMES = 120;
+    /// \desc no decision is made this soon after a change, the average needs time to follow
+    constexpr int SETTLE_FRAMES = 30;
+}
+
+const QualityGovernor::Settings QualityGovernor::LEVELS[NUM_LEVELS] = {
+    // resolution, LOD bias, particles, minimap interval
+    { 1.00f, 1.00f, 1.00f, 1 },
+    { 0.85f, 0.85f, 0.75f, 2 },
+    { 0.70f, 0.70f, 0.50f, 3 },
+    { 0.60f, 0.55f, 0.35f, 4 },
+    { 0.50f, 0.40f, 0.25f, 6 }
+};
+
+QualityGovernor::QualityGovernor(float targetFrameSeconds)
+    : _targetFrameSeconds(targetFrameSeconds),
+      _enabled(true)
+{
+    reset();
+}
+
+void QualityGovernor::reset() {
+    _level = 0;
+    _averageFrameSeconds = _targetFrameSeconds;
+    _framesSeen = 0;
+    _framesOverBudget = 0;
+    _framesUnderBudget = 0;
+    _framesSinceChange = 0;
+    _lastChangeWasUpgrade = false;
+    _upgradeWait = MIN_UPGRADE_WAIT;
+}
+
+void QualityGovernor::setEnabled(bool enabled) {
+    _enabled = enabled;
+    reset();
+}
+
+bool QualityGovernor::update(float frameSeconds) {
+    if (!_enabled) {
+        return false;
+    }
+    if (++_framesSeen <= WARMUP_FRAMES) {
+        return false;
+    }
+
+    _averageFrameSeconds += (frameSeconds - _averageFrameSeconds) * AVERAGE_WEIGHT;
+    ++_framesSinceChange;
+
+    _framesOverBudget = _averageFrameSeconds > _targetFrameSeconds * OVER_BUDGET ? _framesOverBudget + 1 : 0;
+    _framesUnderBudget = _averageFrameSeconds < _targetFrameSeconds * UNDER_BUDGET ? _framesUnderBudget + 1 : 0;
+
+    if (_framesSinceChange < SETTLE_FRAMES) {
+        return false;
+    }
+
+    if (_framesOverBudget >= DOWNGRADE_FRAMES && _level + 1 < NUM_LEVELS) {
+        if (_lastChangeWasUpgrade && _framesSinceChange < FAILED_UPGRADE_FRAMES) {
+            _upgradeWait = std::min(_upgradeWait * 2, MAX_UPGRADE_WAIT);
+        }
+        ++_level;
+        _lastChangeWasUpgrade = false;
+    } else if (_framesUnderBudget >= _upgradeWait && _level > 0) {
+        --_level;
+        _lastChangeWasUpgrade = true;
+    } else {
+        // an upgrade that has held for a while resets the back-off
+        if (_lastChangeWasUpgrade && _framesSinceChange == FAILED_UPGRADE_FRAMES) {
+            _upgradeWait = MIN_UPGRADE_WAIT;
+        }
+        return false;
+    }
+
+    _framesSinceChange = 0;
+    _framesOverBudget = 0;
+    _framesUnderBudget = 0;
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef QUALITY_GOVERNOR_H
+#define QUALITY_GOVERNOR_H
+
+/// \desc frame budget governor. It is fed the measured time of every frame and
+/// steps through a fixed ladder of quality levels: down quickly when frames
+/// keep running over budget, back up slowly once they fit again. An upgrade
+/// that immediately has to be undone doubles the wait before the next try,
+/// so the level settles instead of oscillating around the budget.
+class QualityGovernor {
+public:
+    /// \desc what the renderer should use at the current level
+    struct Settings {
+        /// \desc scene render target size relative to the framebuffer
+        float resolutionScale;
+        /// \desc multiplies screen coverage before picking a LOD
+        float lodBias;
+        /// \desc share of each particle emitter that may be alive
+        float particleFraction;
+        /// \desc the minimap is redrawn once every this many frames
+        int minimapInterval;
+    };
+
+    static constexpr int NUM_LEVELS = 5;
+    static const Settings LEVELS[NUM_LEVELS];
+
+    explicit QualityGovernor(float targetFrameSeconds = 1.0f / 60.0f);
+
+    /// \desc feeds one frame time, returns true when the level changed
+    bool update(float frameSeconds);
+    /// \desc goes back to full quality and restarts the measurements
+    void reset();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return _enabled; }
+
+    int getLevel() const { return _level; }
+    const Settings& getSettings() const { return LEVELS[_level]; }
+    float getAverageFrameSeconds() const { return _averageFrameSeconds; }
+
+private:
+    const float _targetFrameSeconds;
+    bool _enabled;
+    int _level;
+    float _averageFrameSeconds;
+    int _framesSeen;
+    int _framesOverBudget;
+    int _framesUnderBudget;
+    /// \desc frames since the last level change
+    int _framesSinceChange;
+    bool _lastChangeWasUpgrade;
+    /// \desc frames of headroom required before trying a higher level
+    int _upgradeWait;
+};
+
+#endif // QUALITY_GOVERNOR_H
@@ -0,0 +1,225 @@
+#include "SessionClient.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace NetProtocol;
+
+namespace {
+    constexpr uint32_t TICKS_PER_SNAPSHOT = TICK_RATE / SNAPSHOT_RATE;
+    /// \desc CONNECT is repeated this often until the server answers
+    constexpr uint32_t CONNECT_RETRY_TICKS = TICK_RATE / 2;
+
+    /// \desc the short way round between two headings in radians
+    float lerpHeading(float from, float to, float t) {
+        const float TWO_PI = 6.28318530718f;
+        float change = std::fmod(to - from, TWO_PI);
+        if (change > TWO_PI / 2.0f) change -= TWO_PI;
+        if (change < -TWO_PI / 2.0f) change += TWO_PI;
+        return from + change * t;
+    }
+}
+
+bool SessionClient::connect(const NetAddress& server, const char* levelPath) {
+    if (!_world.load(levelPath) || !_socket.open(0)) {
+        return false;
+    }
+    _server = server;
+    _world.respawnVehicle(_predicted);
+    // sized for every entity up front, so the ticks never allocate
+    const size_t maxEntities = MAX_VEHICLES + _world.getNumMarbles();
+    _remote.reserve(maxEntities);
+    for (ReceivedSnapshot& snapshot : _snapshots) {
+        snapshot.states.reserve(maxEntities);
+    }
+    _decodeScratch.states.reserve(maxEntities);
+    fprintf(stdout, "[INFO]: joining the session at %s\n", server.toString().c_str());
+    return true;
+}
+
+void SessionClient::disconnect() {
+    if (_socket.isOpen() && _vehicleID != SessionWorld::NO_VEHICLE) {
+        const PacketHeader header = makeHeader(DISCONNECT, _vehicleID);
+        _socket.send(_server, &header, sizeof(header));
+    }
+    _socket.close();
+    _vehicleID = SessionWorld::NO_VEHICLE;
+}
+
+void SessionClient::tick(uint8_t buttons) {
+    if (!_socket.isOpen() || _failed) {
+        return;
+    }
+    ++_ticksSinceConnect;
+    _receive();
+
+    if (_vehicleID == SessionWorld::NO_VEHICLE) {
+        if (_ticksSinceConnect > TIMEOUT_TICKS) {
+            fprintf(stderr, "[ERROR]: no answer from %s\n", _server.toString().c_str());
+            _failed = true;
+        } else if (_ticksSinceConnect % CONNECT_RETRY_TICKS == 1) {
+            const ConnectPacket connect{ makeHeader(CONNECT, 0xFF), _world.getLevelHash() };
+            _socket.send(_server, &connect, sizeof(connect));
+        }
+        return;
+    }
+    if (_ticksSinceConnect - _lastHeardTick > TIMEOUT_TICKS) {
+        fprintf(stderr, "[ERROR]: lost the server at %s\n", _server.toString().c_str());
+        _failed = true;
+        return;
+    }
+
+    // the new command is applied locally right away and sent with the ones before it
+    ++_inputSequence;
+    _inputs[_inputSequence % INPUT_HISTORY] = buttons;
+    _world.stepVehicle(_predicted, buttons);
+
+    InputPacket input{};
+    input.header = makeHeader(INPUT, _vehicleID);
+    input.ackedSnapshot = _newestSnapshot;
+    input.sequence = _inputSequence;
+    input.numCommands = static_cast<uint8_t>(std::min<uint32_t>(_inputSequence, MAX_INPUT_COMMANDS));
+    for (uint8_t i = 0; i < input.numCommands; ++i) {
+        input.commands[i] = _inputs[(_inputSequence - i) % INPUT_HISTORY];
+    }
+    _socket.send(_server, &input, sizeof(input));
+
+    _renderTick += 1.0f;
+    _interpolate();
+}
+
+void SessionClient::_receive() {
+    NetAddress from;
+    size_t size;
+    while ((size = _socket.receive(from, _packet, sizeof(_packet))) > 0) {
+        if (from != _server) continue;
+        const uint8_t type = packetType(_packet, size);
+        if (type == ACCEPT && validHeader(_packet, size, ACCEPT, sizeof(AcceptPacket))) {
+            AcceptPacket accept;
+            memcpy(&accept, _packet, sizeof(accept));
+            if (_vehicleID == SessionWorld::NO_VEHICLE) {
+                _vehicleID = accept.header.client;
+                _lastHeardTick = _ticksSinceConnect;
+                fprintf(stdout, "[INFO]: joined the session as player %u\n", _vehicleID);
+            }
+        } else if (type == SNAPSHOT && _vehicleID != SessionWorld::NO_VEHICLE &&
+                   validHeader(_packet, size, SNAPSHOT, sizeof(SnapshotHeader))) {
+            _handleSnapshot(size);
+        } else if (type == DISCONNECT) {
+            fprintf(stderr, "[ERROR]: the server at %s refused or dropped the client\n", _server.toString().c_str());
+            _failed = true;
+            _vehicleID = SessionWorld::NO_VEHICLE;
+            return;
+        }
+    }
+}
+
+void SessionClient::_handleSnapshot(size_t size) {
+    SnapshotHeader header;
+    memcpy(&header, _packet, sizeof(header));
+    ++_stats.snapshotsReceived;
+    _lastHeardTick = _ticksSinceConnect;
+
+    // a snapshot older than the newest is only useful while it can still be interpolated from
+    const bool newest = header.serverTick > _newestSnapshot;
+    if (!newest && (_findSnapshot(header.serverTick) || header.serverTick + INTERPOLATION_DELAY < _renderTick)) {
+        ++_stats.snapshotsDropped;
+        return;
+    }
+
+    static const std::vector<SnapshotCodec::EntityState> NO_BASELINE;
+    const ReceivedSnapshot* baseline = header.baselineTick != 0 ? _findSnapshot(header.baselineTick) : nullptr;
+    if (header.baselineTick != 0 && !baseline) {
+        ++_stats.snapshotsDropped;
+        return;
+    }
+    if (!SnapshotCodec::decode(baseline ? baseline->states : NO_BASELINE, _packet + sizeof(header), size - sizeof(header),
+                               header.numRecords, _decodeScratch.states)) {
+        fprintf(stderr, "[ERROR]: malformed snapshot %u from the server\n", header.serverTick);
+        ++_stats.snapshotsDropped;
+        return;
+    }
+    ReceivedSnapshot& slot = _snapshots[(header.serverTick / TICKS_PER_SNAPSHOT) % SNAPSHOT_HISTORY];
+    slot.tick = header.serverTick;
+    std::swap(slot.states, _decodeScratch.states);
+    if (!newest) {
+        return;
+    }
+
+    // the remote entities' clock follows the snapshots, jumping only after a stall
+    const bool first = _newestSnapshot == 0;
+    _newestSnapshot = header.serverTick;
+    const float target = static_cast<float>(_newestSnapshot) - static_cast<float>(INTERPOLATION_DELAY);
+    if (first || std::fabs(_renderTick - target) > static_cast<float>(INTERPOLATION_DELAY)) {
+        _renderTick = target;
+    } else {
+        _renderTick += (target - _renderTick) * 0.05f;
+    }
+
+    const SnapshotCodec::EntityState* own = SnapshotCodec::find(slot.states, _vehicleID);
+    if (own) {
+        _predict(*own, header.appliedInput);
+    }
+}
+
+void SessionClient::_predict(const SnapshotCodec::EntityState& server, uint32_t appliedInput) {
+    // what the server says the vehicle looked like after appliedInput, plus every command since
+    const Vehicle before = _predicted;
+    _predicted.setPosition(SnapshotCodec::positionOf(server));
+    _predicted.setHeading(SnapshotCodec::headingOf(server));
+    const uint32_t firstReplayed = std::max(appliedInput + 1, _inputSequence > INPUT_HISTORY ? _inputSequence - INPUT_HISTORY + 1 : 1u);
+    for (uint32_t sequence = firstReplayed; sequence <= _inputSequence; ++sequence) {
+        _world.stepVehicle(_predicted, _inputs[sequence % INPUT_HISTORY]);
+    }
+    _stats.predictionError += glm::length(_predicted.getPosition() - before.getPosition());
+    ++_stats.predictionCorrections;
+}
+
+void SessionClient::_interpolate() {
+    // the snapshots on either side of the render tick
+    const ReceivedSnapshot* from = nullptr;
+    const ReceivedSnapshot* to = nullptr;
+    for (const ReceivedSnapshot& snapshot : _snapshots) {
+        if (snapshot.tick == 0) continue;
+        if (static_cast<float>(snapshot.tick) <= _renderTick) {
+            if (!from || snapshot.tick > from->tick) from = &snapshot;
+        } else if (!to || snapshot.tick < to->tick) {
+            to = &snapshot;
+        }
+    }
+    if (!to) {
+        // nothing newer arrived in time, hold the newest rather than guess
+        ++_stats.interpolationStarvedTicks;
+        to = from;
+    }
+    if (!from) {
+        from = to;
+    }
+
+    _remote.clear();
+    if (!to) {
+        return;
+    }
+    const float t = to == from ? 1.0f : (_renderTick - static_cast<float>(from->tick)) / static_cast<float>(to->tick - from->tick);
+    for (const SnapshotCodec::EntityState& state : to->states) {
+        if (state.id == _vehicleID) continue;
+        RemoteEntity entity{ state.id, SnapshotCodec::positionOf(state), SnapshotCodec::headingOf(state) };
+        const SnapshotCodec::EntityState* previous = SnapshotCodec::find(from->states, state.id);
+        if (previous) {
+            const glm::vec3 previousPosition = SnapshotCodec::positionOf(*previous);
+            // a jump back to the spawn point is shown as a jump, not a slide
+            if (glm::length(entity.position - previousPosition) < 10.0f) {
+                entity.position = glm::mix(previousPosition, entity.position, t);
+                entity.heading = lerpHeading(SnapshotCodec::headingOf(*previous), entity.heading, t);
+            }
+        }
+        _remote.push_back(entity);
+    }
+}
+
+const SessionClient::ReceivedSnapshot* SessionClient::_findSnapshot(uint32_t tick) const {
+    const ReceivedSnapshot& snapshot = _snapshots[(tick / TICKS_PER_SNAPSHOT) % SNAPSHOT_HISTORY];
+    return snapshot.tick == tick ? &snapshot : nullptr;
+}
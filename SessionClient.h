@@ -0,0 +1,99 @@
+#ifndef SESSION_CLIENT_H
+#define SESSION_CLIENT_H
+
+#include "NetProtocol.h"
+#include "NetSocket.h"
+#include "SessionWorld.h"
+#include "SnapshotCodec.h"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/// \desc one player's side of a shared session.
+///
+/// tick() is called once per simulation tick with the buttons held: it sends
+/// them to the server, predicts the player's own vehicle by replaying the inputs
+/// the server has not applied yet on top of the last state it sent, and
+/// interpolates everything else INTERPOLATION_DELAY ticks in the past, between
+/// the two snapshots on either side of that time.
+class SessionClient {
+public:
+    /// \desc two snapshot intervals, so one lost snapshot still leaves a pair to interpolate between
+    static constexpr uint32_t INTERPOLATION_DELAY = 2 * NetProtocol::TICK_RATE / NetProtocol::SNAPSHOT_RATE;
+    /// \desc received snapshots kept, for baselines and for interpolation
+    static constexpr uint32_t SNAPSHOT_HISTORY = 32;
+    /// \desc inputs kept for replay, a power of two
+    static constexpr uint32_t INPUT_HISTORY = 64;
+
+    /// \desc a remote vehicle or marble, where it is drawn this tick
+    struct RemoteEntity {
+        uint16_t id;
+        glm::vec3 position;
+        float heading;
+    };
+
+    /// \desc loads the same level as the server and starts asking to join
+    bool connect(const NetAddress& server, const char* levelPath);
+    void disconnect();
+    void tick(uint8_t buttons);
+
+    /// \desc the server accepted the client and sent a first snapshot
+    bool isConnected() const { return _vehicleID != SessionWorld::NO_VEHICLE && _newestSnapshot != 0; }
+    /// \desc the server refused the client or the client gave up
+    bool hasFailed() const { return _failed; }
+    uint8_t getVehicleID() const { return _vehicleID; }
+    const Vehicle& getPredictedVehicle() const { return _predicted; }
+    /// \desc every entity the server considers relevant except the own vehicle, by id
+    const std::vector<RemoteEntity>& getRemoteEntities() const { return _remote; }
+    const SessionWorld& getWorld() const { return _world; }
+    const NetSocket& getSocket() const { return _socket; }
+
+    struct Stats {
+        uint64_t snapshotsReceived;
+        /// \desc snapshots whose baseline had already left the history, or that arrived too late to use
+        uint64_t snapshotsDropped;
+        /// \desc ticks the interpolation had no newer snapshot and held the newest one
+        uint64_t interpolationStarvedTicks;
+        /// \desc summed distance between the predicted own vehicle and the server's state at each correction
+        double predictionError;
+        uint64_t predictionCorrections;
+    };
+    const Stats& getStats() const { return _stats; }
+
+private:
+    struct ReceivedSnapshot {
+        uint32_t tick = 0;
+        std::vector<SnapshotCodec::EntityState> states;
+    };
+
+    SessionWorld _world;
+    NetSocket _socket;
+    NetAddress _server;
+    uint8_t _vehicleID = SessionWorld::NO_VEHICLE;
+    bool _failed = false;
+    uint32_t _ticksSinceConnect = 0;
+    uint32_t _lastHeardTick = 0;
+
+    ReceivedSnapshot _snapshots[SNAPSHOT_HISTORY];
+    ReceivedSnapshot _decodeScratch;
+    uint32_t _newestSnapshot = 0;
+    /// \desc server tick being drawn for the remote entities, kept INTERPOLATION_DELAY behind the newest snapshot
+    float _renderTick = 0.0f;
+
+    uint32_t _inputSequence = 0;
+    uint8_t _inputs[INPUT_HISTORY] = {};
+    Vehicle _predicted;
+
+    std::vector<RemoteEntity> _remote;
+    Stats _stats{};
+    alignas(8) uint8_t _packet[NetProtocol::MAX_PACKET_SIZE];
+
+    void _receive();
+    void _handleSnapshot(size_t size);
+    void _predict(const SnapshotCodec::EntityState& server, uint32_t appliedInput);
+    void _interpolate();
+    const ReceivedSnapshot* _findSnapshot(uint32_t tick) const;
+};
+
+#endif // SESSION_CLIENT_H
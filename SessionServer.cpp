@@ -0,0 +1,228 @@
+#include "SessionServer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace NetProtocol;
+
+namespace {
+    constexpr uint32_t TICKS_PER_SNAPSHOT = TICK_RATE / SNAPSHOT_RATE;
+}
+
+bool SessionServer::start(const char* levelPath, uint16_t port) {
+    if (!_world.load(levelPath) || !_socket.open(port)) {
+        return false;
+    }
+    _clients.assign(_world.getMaxVehicles(), Client());
+    _relevant.reserve(MAX_VEHICLES + _world.getNumMarbles());
+    _current.reserve(MAX_VEHICLES + _world.getNumMarbles());
+    fprintf(stdout, "[INFO]: session server on UDP port %u, level %s (%zu marbles, hash %08x)\n",
+            _socket.getPort(), levelPath, _world.getNumMarbles(), _world.getLevelHash());
+    return true;
+}
+
+size_t SessionServer::getNumClients() const {
+    return static_cast<size_t>(std::count_if(_clients.begin(), _clients.end(),
+                                             [](const Client& client) { return client.connected; }));
+}
+
+void SessionServer::tick() {
+    ++_tick;
+    _receive();
+
+    // one buffered command per client per tick; a client whose next command has not arrived
+    // keeps its last buttons, and one that fell too far behind skips ahead
+    for (uint8_t vehicle = 0; vehicle < _clients.size(); ++vehicle) {
+        Client& client = _clients[vehicle];
+        if (!client.connected) continue;
+        if (_tick - client.lastHeardTick > TIMEOUT_TICKS) {
+            fprintf(stdout, "[INFO]: client %u at %s timed out\n", vehicle, client.address.toString().c_str());
+            _disconnect(vehicle);
+            continue;
+        }
+        if (client.newestInput > client.appliedInput + INPUT_BUFFER / 2) {
+            client.appliedInput = client.newestInput - MAX_INPUT_COMMANDS;
+        }
+        const uint32_t next = client.appliedInput + 1;
+        if (client.inputSequences[next % INPUT_BUFFER] == next) {
+            client.lastButtons = client.inputs[next % INPUT_BUFFER];
+            client.appliedInput = next;
+        } else {
+            ++_stats.inputStarvedTicks;
+        }
+        _buttons[vehicle] = client.lastButtons;
+    }
+    _world.step(_buttons);
+
+    if (_tick % TICKS_PER_SNAPSHOT == 0) {
+        for (uint8_t vehicle = 0; vehicle < _clients.size(); ++vehicle) {
+            if (_clients[vehicle].connected) {
+                _sendSnapshot(vehicle);
+            }
+        }
+    }
+}
+
+void SessionServer::_receive() {
+    NetAddress from;
+    size_t size;
+    while ((size = _socket.receive(from, _packet, sizeof(_packet))) > 0) {
+        const uint8_t type = packetType(_packet, size);
+        if (type == CONNECT && validHeader(_packet, size, CONNECT, sizeof(ConnectPacket))) {
+            ConnectPacket packet;
+            memcpy(&packet, _packet, sizeof(packet));
+            _handleConnect(from, packet);
+            continue;
+        }
+
+        // everything else has to come from a connected client, as the vehicle it was given
+        const uint8_t vehicle = _findClient(from);
+        if (vehicle == SessionWorld::NO_VEHICLE || reinterpret_cast<const PacketHeader*>(_packet)->client != vehicle) {
+            continue;
+        }
+        if (type == INPUT && validHeader(_packet, size, INPUT, sizeof(InputPacket))) {
+            InputPacket packet;
+            memcpy(&packet, _packet, sizeof(packet));
+            _handleInput(vehicle, packet);
+        } else if (type == DISCONNECT) {
+            fprintf(stdout, "[INFO]: client %u at %s left\n", vehicle, from.toString().c_str());
+            _disconnect(vehicle);
+        }
+    }
+}
+
+void SessionServer::_handleConnect(const NetAddress& from, const ConnectPacket& packet) {
+    if (packet.levelHash != _world.getLevelHash()) {
+        fprintf(stderr, "[ERROR]: %s plays a different level (hash %08x, expected %08x)\n",
+                from.toString().c_str(), packet.levelHash, _world.getLevelHash());
+        const PacketHeader refusal = makeHeader(DISCONNECT, 0xFF);
+        _socket.send(from, &refusal, sizeof(refusal));
+        return;
+    }
+
+    // a repeated CONNECT means the ACCEPT was lost, the client keeps its vehicle
+    uint8_t vehicle = _findClient(from);
+    if (vehicle == SessionWorld::NO_VEHICLE) {
+        vehicle = _world.addVehicle();
+        if (vehicle == SessionWorld::NO_VEHICLE) {
+            fprintf(stderr, "[ERROR]: session full, refusing %s\n", from.toString().c_str());
+            const PacketHeader refusal = makeHeader(DISCONNECT, 0xFF);
+            _socket.send(from, &refusal, sizeof(refusal));
+            return;
+        }
+        Client& client = _clients[vehicle];
+        client = Client();
+        client.connected = true;
+        client.address = from;
+        client.lastHeardTick = _tick;
+        client.updatedTick.assign(MAX_VEHICLES + _world.getNumMarbles(), _tick);
+        fprintf(stdout, "[INFO]: client %u joined from %s\n", vehicle, from.toString().c_str());
+    }
+
+    const AcceptPacket accept{ makeHeader(ACCEPT, vehicle), _world.getLevelHash(), _tick };
+    _socket.send(from, &accept, sizeof(accept));
+}
+
+void SessionServer::_handleInput(uint8_t vehicle, const InputPacket& packet) {
+    Client& client = _clients[vehicle];
+    client.lastHeardTick = _tick;
+    client.ackedSnapshot = std::max(client.ackedSnapshot, packet.ackedSnapshot);
+
+    // the packet repeats the last few commands, keep the ones not seen or applied yet
+    const uint8_t numCommands = std::min(packet.numCommands, MAX_INPUT_COMMANDS);
+    for (uint8_t i = 0; i < numCommands && i < packet.sequence; ++i) {
+        const uint32_t sequence = packet.sequence - i;
+        if (sequence <= client.appliedInput) break;
+        client.inputs[sequence % INPUT_BUFFER] = packet.commands[i];
+        client.inputSequences[sequence % INPUT_BUFFER] = sequence;
+    }
+    client.newestInput = std::max(client.newestInput, packet.sequence);
+}
+
+void SessionServer::_disconnect(uint8_t vehicle) {
+    _clients[vehicle].connected = false;
+    _buttons[vehicle] = 0;
+    _world.removeVehicle(vehicle);
+}
+
+uint8_t SessionServer::_findClient(const NetAddress& address) const {
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        if (_clients[i].connected && _clients[i].address == address) {
+            return static_cast<uint8_t>(i);
+        }
+    }
+    return SessionWorld::NO_VEHICLE;
+}
+
+void SessionServer::_sendSnapshot(uint8_t vehicle) {
+    Client& client = _clients[vehicle];
+
+    // the client's own vehicle always goes first, then the nearest of everything in range,
+    // each snapshot an entity waits counting as if it were that much closer
+    const glm::vec3 center = _world.getVehicle(vehicle).getPosition();
+    const float relevancyRadius2 = RELEVANCY_RADIUS * RELEVANCY_RADIUS;
+    auto priority = [&](uint16_t id, float distance2) {
+        const float waited = static_cast<float>(_tick - client.updatedTick[id]) / TICKS_PER_SNAPSHOT;
+        return distance2 / ((1.0f + waited) * (1.0f + waited));
+    };
+    _relevant.clear();
+    for (uint8_t other = 0; other < _clients.size(); ++other) {
+        if (!_world.hasVehicle(other)) continue;
+        const Vehicle& otherVehicle = _world.getVehicle(other);
+        const glm::vec3 offset = otherVehicle.getPosition() - center;
+        const float distance2 = glm::dot(offset, offset);
+        if (other == vehicle || distance2 <= relevancyRadius2) {
+            _relevant.push_back(RelevantEntity{ other == vehicle ? -1.0f : priority(other, distance2),
+                                                SnapshotCodec::quantize(other, otherVehicle.getPosition(), otherVehicle.getHeading()) });
+        }
+    }
+    const glm::vec3* marbles = _world.getMarbleLocations();
+    for (size_t i = 0; i < _world.getNumMarbles(); ++i) {
+        const glm::vec3 offset = marbles[i] - center;
+        const float distance2 = glm::dot(offset, offset);
+        if (distance2 <= relevancyRadius2) {
+            // marbles are drawn without a heading, so none is sent
+            const uint16_t id = static_cast<uint16_t>(MAX_VEHICLES + i);
+            _relevant.push_back(RelevantEntity{ priority(id, distance2), SnapshotCodec::quantize(id, marbles[i], 0.0f) });
+        }
+    }
+    std::sort(_relevant.begin(), _relevant.end(),
+              [](const RelevantEntity& a, const RelevantEntity& b) { return a.priority < b.priority; });
+    _current.clear();
+    for (const RelevantEntity& entity : _relevant) {
+        _current.push_back(entity.state);
+    }
+
+    // delta against the acknowledged snapshot while it is still in the history, else against nothing
+    const SentSnapshot& acked = client.history[(client.ackedSnapshot / TICKS_PER_SNAPSHOT) % SNAPSHOT_HISTORY];
+    const bool haveBaseline = client.ackedSnapshot != 0 && acked.tick == client.ackedSnapshot &&
+                              _tick - client.ackedSnapshot < SNAPSHOT_HISTORY * TICKS_PER_SNAPSHOT;
+    if (!haveBaseline) {
+        ++_stats.fullSnapshots;
+    }
+
+    SentSnapshot& sent = client.history[(_tick / TICKS_PER_SNAPSHOT) % SNAPSHOT_HISTORY];
+    sent.tick = _tick;
+    const SnapshotCodec::Result result = SnapshotCodec::encode(haveBaseline ? acked.states : _emptyBaseline, _current,
+                                                               _packet + sizeof(SnapshotHeader),
+                                                               sizeof(_packet) - sizeof(SnapshotHeader),
+                                                               sent.states, _encodeScratch);
+
+    const SnapshotHeader header{ makeHeader(SNAPSHOT, vehicle), _tick, haveBaseline ? client.ackedSnapshot : 0,
+                                 client.appliedInput, result.numRecords, 0 };
+    memcpy(_packet, &header, sizeof(header));
+    for (const SnapshotCodec::EntityState& state : _current) {
+        const SnapshotCodec::EntityState* decoded = SnapshotCodec::find(sent.states, state.id);
+        if (decoded && *decoded == state) {
+            client.updatedTick[state.id] = _tick;
+        }
+    }
+    _socket.send(client.address, _packet, sizeof(header) + result.bytes);
+
+    ++_stats.snapshotsSent;
+    _stats.snapshotBytes += sizeof(header) + result.bytes;
+    _stats.recordsSent += result.numRecords;
+    _stats.recordsDeferred += result.numDeferred;
+}
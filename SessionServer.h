@@ -0,0 +1,102 @@
+#ifndef SESSION_SERVER_H
+#define SESSION_SERVER_H
+
+#include "NetProtocol.h"
+#include "NetSocket.h"
+#include "SessionWorld.h"
+#include "SnapshotCodec.h"
+
+#include <cstdint>
+#include <vector>
+
+/// \desc the authoritative side of a shared session.
+///
+/// Every tick() reads the waiting datagrams, steps the SessionWorld with one
+/// buffered input per client and, every TICK_RATE / SNAPSHOT_RATE ticks, sends
+/// each client the entities within RELEVANCY_RADIUS of its vehicle as a delta
+/// against the last snapshot it acknowledged. When they do not all fit in a
+/// packet the nearest go first, with distance discounted by how long an entity
+/// has waited so the far ones still arrive. The caller paces the ticks.
+class SessionServer {
+public:
+    /// \desc entities farther than this from a client's vehicle are not sent to it
+    static constexpr float RELEVANCY_RADIUS = 150.0f;
+    /// \desc sent snapshots kept per client to delta against, enough for over a second of acknowledgements
+    static constexpr uint32_t SNAPSHOT_HISTORY = 32;
+    /// \desc inputs buffered per client, a power of two
+    static constexpr uint32_t INPUT_BUFFER = 64;
+
+    bool start(const char* levelPath, uint16_t port);
+    void tick();
+
+    uint32_t getTick() const { return _tick; }
+    uint16_t getPort() const { return _socket.getPort(); }
+    size_t getNumClients() const;
+    const NetSocket& getSocket() const { return _socket; }
+    const SessionWorld& getWorld() const { return _world; }
+
+    struct Stats {
+        uint64_t snapshotsSent;
+        uint64_t snapshotBytes;
+        uint64_t recordsSent;
+        /// \desc relevant entities left for a later snapshot because the packet was full
+        uint64_t recordsDeferred;
+        /// \desc snapshots sent against nothing, because no acknowledged one was still in the history
+        uint64_t fullSnapshots;
+        /// \desc ticks a client had no input for and repeated its last one
+        uint64_t inputStarvedTicks;
+    };
+    const Stats& getStats() const { return _stats; }
+
+private:
+    struct SentSnapshot {
+        uint32_t tick = 0;
+        std::vector<SnapshotCodec::EntityState> states;
+    };
+
+    /// \desc a client drives the vehicle with its index in _clients
+    struct Client {
+        bool connected = false;
+        NetAddress address;
+        uint32_t lastHeardTick = 0;
+        uint32_t ackedSnapshot = 0;
+        /// \desc commands by sequence, inputSequences says which sequence a slot holds
+        uint8_t inputs[INPUT_BUFFER] = {};
+        uint32_t inputSequences[INPUT_BUFFER] = {};
+        uint32_t newestInput = 0;
+        /// \desc the last sequence applied, 0 before the first
+        uint32_t appliedInput = 0;
+        uint8_t lastButtons = 0;
+        SentSnapshot history[SNAPSHOT_HISTORY];
+        /// \desc by entity id, the last tick a snapshot brought the client up to date on it
+        std::vector<uint32_t> updatedTick;
+    };
+
+    SessionWorld _world;
+    NetSocket _socket;
+    uint32_t _tick = 0;
+    std::vector<Client> _clients;
+    Stats _stats{};
+
+    /// \desc scratch reused by every snapshot
+    struct RelevantEntity {
+        float priority;
+        SnapshotCodec::EntityState state;
+    };
+    std::vector<RelevantEntity> _relevant;
+    std::vector<SnapshotCodec::EntityState> _current;
+    std::vector<SnapshotCodec::EntityState> _encodeScratch;
+    std::vector<SnapshotCodec::EntityState> _emptyBaseline;
+    alignas(8) uint8_t _packet[NetProtocol::MAX_PACKET_SIZE];
+    uint8_t _buttons[NetProtocol::MAX_VEHICLES] = {};
+
+    void _receive();
+    void _handleConnect(const NetAddress& from, const NetProtocol::ConnectPacket& packet);
+    void _handleInput(uint8_t vehicle, const NetProtocol::InputPacket& packet);
+    void _disconnect(uint8_t vehicle);
+    /// \desc the vehicle of the client at the address, SessionWorld::NO_VEHICLE when there is none
+    uint8_t _findClient(const NetAddress& address) const;
+    void _sendSnapshot(uint8_t vehicle);
+};
+
+#endif // SESSION_SERVER_H
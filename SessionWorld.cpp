@@ -0,0 +1,162 @@
+#include "SessionWorld.h"
+#include "NetProtocol.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <cstdio>
+
+namespace {
+    uint32_t fnv1a(uint32_t hash, const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+}
+
+bool SessionWorld::load(const char* levelPath) {
+    if (!_level.open(levelPath)) {
+        fprintf(stderr, "[ERROR]: could not load level %s\n", levelPath);
+        return false;
+    }
+
+    // collision only needs the shapes, the draw ranges stay empty
+    _rectPlatforms.clear();
+    _diskPlatforms.clear();
+    for (size_t i = 0; i < _level.getNumPlatforms(); ++i) {
+        const LevelFormat::Platform& platform = _level.getPlatforms()[i];
+        if (platform.type == LevelFormat::PLATFORM_DISK) {
+            _diskPlatforms.push_back(DiskPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                   0, 0, 0, glm::vec3(1.0f), glm::vec3(0.0f), 0, platform.fallBuffer });
+        } else {
+            _rectPlatforms.push_back(RectPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                   0, 0, 0, glm::vec3(1.0f), glm::vec3(0.0f), 0, platform.fallBuffer });
+        }
+    }
+    _levelHash = fnv1a(2166136261u, _level.getPlatforms(), _level.getNumPlatforms() * sizeof(LevelFormat::Platform));
+    _levelHash = fnv1a(_levelHash, _level.getProps(), _level.getNumProps() * sizeof(LevelFormat::Prop));
+
+    // the first vehicle spawn is shared by every player, as in FPEngine::_loadLevel
+    size_t numMarbles = 0;
+    bool vehicleSpawned = false;
+    for (size_t i = 0; i < _level.getNumSpawns(); ++i) {
+        const LevelFormat::Spawn& spawn = _level.getSpawns()[i];
+        if (spawn.type == LevelFormat::SPAWN_MARBLE) {
+            ++numMarbles;
+        } else if (spawn.type == LevelFormat::SPAWN_VEHICLE && !vehicleSpawned) {
+            _vehicleSpawnPosition = glm::make_vec3(spawn.position);
+            _vehicleSpawnHeading = spawn.heading;
+            vehicleSpawned = true;
+        }
+    }
+
+    _vehicles = std::vector<Vehicle>(NetProtocol::MAX_VEHICLES);
+    _vehicleActive.assign(NetProtocol::MAX_VEHICLES, false);
+    _marbleLocations.resize(numMarbles);
+    _marbleDirections.resize(numMarbles);
+    _random.seed(_levelHash);
+    _resetMarbles();
+    return true;
+}
+
+uint8_t SessionWorld::addVehicle() {
+    for (size_t i = 0; i < _vehicles.size(); ++i) {
+        if (!_vehicleActive[i]) {
+            _vehicleActive[i] = true;
+            respawnVehicle(_vehicles[i]);
+            return static_cast<uint8_t>(i);
+        }
+    }
+    return NO_VEHICLE;
+}
+
+void SessionWorld::removeVehicle(uint8_t vehicle) {
+    if (vehicle < _vehicleActive.size()) {
+        _vehicleActive[vehicle] = false;
+    }
+}
+
+void SessionWorld::respawnVehicle(Vehicle& vehicle) const {
+    vehicle.setPosition(_vehicleSpawnPosition);
+    vehicle.setHeading(_vehicleSpawnHeading);
+}
+
+void SessionWorld::stepVehicle(Vehicle& vehicle, uint8_t buttons) const {
+    // the movement of FPEngine::_updateScene, minus the animations
+    const float heading = vehicle.getHeading();
+    glm::vec3 movementVector(0.0f);
+    if (buttons & NetProtocol::BUTTON_FORWARD) movementVector += glm::vec3(sin(heading), 0.0f, cos(heading)) * 0.2f;
+    if (buttons & NetProtocol::BUTTON_BACK) movementVector += glm::vec3(-sin(heading), 0.0f, -cos(heading)) * 0.2f;
+    if (buttons & NetProtocol::BUTTON_LEFT) vehicle.turnLeft();
+    if (buttons & NetProtocol::BUTTON_RIGHT) vehicle.turnRight();
+
+    glm::vec3 newPosition = vehicle.getPosition() + movementVector;
+    glm::vec3 propPosition;
+    if (SimKernels::findPropCollision(_level, newPosition, vehicle.getBoundingRadius(), propPosition)) {
+        newPosition -= movementVector * 1.5f;
+    }
+
+    if (SimKernels::isOnPlatform(newPosition, _diskPlatforms.data(), _diskPlatforms.size(),
+                                 _rectPlatforms.data(), _rectPlatforms.size())) {
+        vehicle.setPosition(newPosition);
+    } else {
+        respawnVehicle(vehicle);
+    }
+}
+
+void SessionWorld::step(const uint8_t* buttons) {
+    for (size_t i = 0; i < _vehicles.size(); ++i) {
+        if (_vehicleActive[i]) {
+            stepVehicle(_vehicles[i], buttons[i]);
+        }
+    }
+
+    // every marble chases whichever vehicle is closest, and idles when nobody is playing
+    std::uniform_real_distribution<float> wander(-0.05f, 0.05f);
+    for (size_t marble = 0; marble < _marbleLocations.size(); ++marble) {
+        _marbleLocations[marble] += glm::vec3(wander(_random), 0.0f, wander(_random));
+
+        const Vehicle* target = nullptr;
+        float targetDistance = 0.0f;
+        for (size_t i = 0; i < _vehicles.size(); ++i) {
+            if (!_vehicleActive[i]) continue;
+            const glm::vec3 offset = _vehicles[i].getPosition() - _marbleLocations[marble];
+            const float distance = glm::dot(offset, offset);
+            if (!target || distance < targetDistance) {
+                target = &_vehicles[i];
+                targetDistance = distance;
+            }
+        }
+        if (target) {
+            SimKernels::steerMarbles(&_marbleLocations[marble], &_marbleDirections[marble], 1,
+                                     target->getPosition(), 0.1f * 0.35f, MARBLE_RADIUS);
+        }
+    }
+    SimKernels::bounceMarblesOffWalls(_marbleLocations.data(), _marbleDirections.data(), _marbleLocations.size(),
+                                      WORLD_SIZE / 2.0f, MARBLE_RADIUS);
+    SimKernels::collideMarbles(_marbleLocations.data(), _marbleDirections.data(), _marbleLocations.size(), MARBLE_RADIUS);
+
+    // a caught vehicle starts over, the marbles keep chasing
+    for (size_t i = 0; i < _vehicles.size(); ++i) {
+        if (!_vehicleActive[i]) continue;
+        for (const glm::vec3& location : _marbleLocations) {
+            if (SimKernels::spheresOverlap(_vehicles[i].getPosition(), _vehicles[i].getBoundingRadius(), location, MARBLE_RADIUS)) {
+                respawnVehicle(_vehicles[i]);
+                break;
+            }
+        }
+    }
+}
+
+void SessionWorld::_resetMarbles() {
+    size_t marble = 0;
+    for (size_t i = 0; i < _level.getNumSpawns(); ++i) {
+        const LevelFormat::Spawn& spawn = _level.getSpawns()[i];
+        if (spawn.type != LevelFormat::SPAWN_MARBLE) continue;
+        _marbleLocations[marble] = glm::make_vec3(spawn.position);
+        // heading for the vehicle spawn, a marble already on it heads off along +z
+        const glm::vec3 toSpawn = _vehicleSpawnPosition - _marbleLocations[marble];
+        _marbleDirections[marble] = glm::dot(toSpawn, toSpawn) > 0.0f ? glm::normalize(toSpawn) : glm::vec3(0.0f, 0.0f, 1.0f);
+        ++marble;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef SESSION_WORLD_H
+#define SESSION_WORLD_H
+
+#include "LevelFile.h"
+#include "SimKernels.h"
+#include "Vehicle.h"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/// \desc the part of the game a shared session agrees on: the level, one vehicle
+/// per player and the marbles chasing them, with no GL so fp_server can run it.
+///
+/// The server steps it authoritatively; clients step their own vehicle with
+/// stepVehicle to predict it. Coins, blue spheres, jumps and the fall and blink
+/// animations stay local to FPEngine, here a vehicle that drives off a
+/// platform or is caught by a marble goes straight back to the spawn point.
+class SessionWorld {
+public:
+    /// \desc matches FPEngine::WORLD_SIZE, the marbles bounce off its walls
+    static constexpr float WORLD_SIZE = 300.0f;
+    /// \desc matches Marble::RADIUS
+    static constexpr float MARBLE_RADIUS = 0.5f;
+    static constexpr uint8_t NO_VEHICLE = 0xFF;
+
+    bool load(const char* levelPath);
+    const LevelFile& getLevel() const { return _level; }
+    /// \desc FNV-1a over the platforms and props, a client and server must agree on it
+    uint32_t getLevelHash() const { return _levelHash; }
+
+    /// \desc a free vehicle slot placed at the spawn point, NO_VEHICLE when every slot is taken
+    uint8_t addVehicle();
+    void removeVehicle(uint8_t vehicle);
+    bool hasVehicle(uint8_t vehicle) const { return vehicle < _vehicles.size() && _vehicleActive[vehicle]; }
+    const Vehicle& getVehicle(uint8_t vehicle) const { return _vehicles[vehicle]; }
+    size_t getMaxVehicles() const { return _vehicles.size(); }
+
+    size_t getNumMarbles() const { return _marbleLocations.size(); }
+    const glm::vec3* getMarbleLocations() const { return _marbleLocations.data(); }
+    const glm::vec3* getMarbleDirections() const { return _marbleDirections.data(); }
+
+    /// \desc one simulation tick, buttons holds the NetProtocol::Button mask of every vehicle slot
+    void step(const uint8_t* buttons);
+
+    /// \desc one tick of a vehicle under the buttons, the same on the server and in client prediction
+    void stepVehicle(Vehicle& vehicle, uint8_t buttons) const;
+    void respawnVehicle(Vehicle& vehicle) const;
+
+private:
+    LevelFile _level;
+    uint32_t _levelHash = 0;
+    std::vector<RectPlatform> _rectPlatforms;
+    std::vector<DiskPlatform> _diskPlatforms;
+    glm::vec3 _vehicleSpawnPosition = glm::vec3(0.0f);
+    float _vehicleSpawnHeading = 0.0f;
+
+    std::vector<Vehicle> _vehicles;
+    std::vector<bool> _vehicleActive;
+
+    std::vector<glm::vec3> _marbleLocations;
+    std::vector<glm::vec3> _marbleDirections;
+    /// \desc the marbles' wander, seeded so a server run can be repeated
+    std::minstd_rand _random;
+
+    void _resetMarbles();
+};
+
+#endif // SESSION_WORLD_H
@@ -0,0 +1,336 @@
+#include "ShaderCache.h"
+#include "GLStateCache.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    /// \desc identifies a cache file written by this code
+    constexpr uint32_t BINARY_MAGIC = 0x46505342; // "FPSB"
+
+    /// \desc 64 bit FNV-1a, stable across runs and platforms
+    uint64_t hashString(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    GLuint compileShader(GLenum type, const std::string& source) {
+        const char* sourcePtr = source.c_str();
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &sourcePtr, nullptr);
+        // the status is not queried here so the driver is free to finish the compile in the background
+        glCompileShader(shader);
+        return shader;
+    }
+}
+
+//***************************************************************************
+// CachedShaderProgram
+
+CachedShaderProgram::CachedShaderProgram(GLuint handle, std::string name)
+    : _handle(handle),
+      _name(std::move(name)),
+      _pending(false)
+{}
+
+CachedShaderProgram::~CachedShaderProgram() {
+    for (GLuint shader : _shaders) {
+        glDeleteShader(shader);
+    }
+    glDeleteProgram(_handle);
+}
+
+GLuint CachedShaderProgram::getShaderProgramHandle() const {
+    _finishLink();
+    return _handle;
+}
+
+void CachedShaderProgram::useProgram() const {
+    GLStateCache::instance().useProgram(getShaderProgramHandle());
+}
+
+GLint CachedShaderProgram::getUniformLocation(const char* name) const {
+    GLint location = glGetUniformLocation(getShaderProgramHandle(), name);
+    if (location == -1) {
+        fprintf(stderr, "[ERROR]: uniform %s not found in %s\n", name, _name.c_str());
+    }
+    return location;
+}
+
+GLint CachedShaderProgram::getAttributeLocation(const char* name) const {
+    GLint location = glGetAttribLocation(getShaderProgramHandle(), name);
+    if (location == -1) {
+        fprintf(stderr, "[ERROR]: attribute %s not found in %s\n", name, _name.c_str());
+    }
+    return location;
+}
+
+void CachedShaderProgram::_finishLink() const {
+    if (!_pending) {
+        return;
+    }
+    _pending = false;
+
+    GLint status = GL_FALSE;
+    char infoLog[1024];
+    glGetProgramiv(_handle, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        for (GLuint shader : _shaders) {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+            if (status != GL_TRUE) {
+                glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+                fprintf(stderr, "[ERROR]: %s failed to compile:\n%s\n", _name.c_str(), infoLog);
+            }
+        }
+        glGetProgramInfoLog(_handle, sizeof(infoLog), nullptr, infoLog);
+        fprintf(stderr, "[ERROR]: %s failed to link:\n%s\n", _name.c_str(), infoLog);
+    } else if (!_cacheFile.empty()) {
+        ShaderCache::_storeBinary(_handle, _cacheFile);
+    }
+
+    for (GLuint shader : _shaders) {
+        glDetachShader(_handle, shader);
+        glDeleteShader(shader);
+    }
+    _shaders.clear();
+    _cacheFile.clear();
+}
+
+//***************************************************************************
+// ShaderCache
+
+ShaderCache::ShaderCache(const std::string& directory)
+    : _directory(directory),
+      _binariesSupported(false),
+      _numHits(0),
+      _numMisses(0)
+{
+    _driver = std::string(reinterpret_cast<const char*>(glGetString(GL_VENDOR))) + "|" +
+              reinterpret_cast<const char*>(glGetString(GL_RENDERER)) + "|" +
+              reinterpret_cast<const char*>(glGetString(GL_VERSION));
+
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    _binariesSupported = numFormats > 0;
+    if (_binariesSupported) {
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+        if (error) {
+            fprintf(stderr, "[ERROR]: could not create shader cache %s: %s\n", _directory.c_str(), error.message().c_str());
+            _binariesSupported = false;
+        }
+    } else {
+        fprintf(stdout, "[INFO]: driver exposes no program binary formats, shaders are always compiled\n");
+    }
+
+    // let the driver compile on as many threads as it likes
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 ||
+            strcmp(extension, "GL_ARB_parallel_shader_compile") == 0) {
+            typedef void (*MaxShaderCompilerThreadsProc)(GLuint);
+            auto maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(
+                    glfwGetProcAddress(extension[3] == 'K' ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB"));
+            if (maxShaderCompilerThreads) {
+                maxShaderCompilerThreads(0xFFFFFFFF);
+                fprintf(stdout, "[INFO]: parallel shader compilation enabled (%s)\n", extension);
+            }
+            break;
+        }
+    }
+}
+
+bool ShaderCache::_readFile(const char* filename, std::string& contents) {
+    std::ifstream file(filename);
+    if (!file) {
+        fprintf(stderr, "[ERROR]: Could not open shader %s\n", filename);
+        return false;
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+    contents = source.str();
+    return true;
+}
+
+void ShaderCache::_insertDefines(std::string& source, const std::vector<std::string>& defines) {
+    if (defines.empty()) {
+        return;
+    }
+    std::string block;
+    for (const std::string& define : defines) {
+        block += "#define " + define + "\n";
+    }
+
+    // #version has to stay the first statement; #line keeps the compiler's line numbers matching the file
+    size_t versionLine = source.find("#version");
+    if (versionLine == std::string::npos) {
+        source.insert(0, block + "#line 1\n");
+        return;
+    }
+    size_t lineEnd = source.find('\n', versionLine);
+    if (lineEnd == std::string::npos) {
+        source += "\n";
+        lineEnd = source.size() - 1;
+    }
+    const int versionLineNumber = 1 + static_cast<int>(std::count(source.begin(), source.begin() + lineEnd, '\n'));
+    source.insert(lineEnd + 1, block + "#line " + std::to_string(versionLineNumber + 1) + "\n");
+}
+
+CachedShaderProgram* ShaderCache::load(const char* vertexFile, const char* fragmentFile,
+                                       const std::vector<const char*>& feedbackVaryings,
+                                       const std::vector<std::string>& defines) {
+    std::string name = vertexFile;
+    if (fragmentFile) {
+        name += std::string(" + ") + fragmentFile;
+    }
+    for (const std::string& define : defines) {
+        name += " [" + define + "]";
+    }
+
+    std::vector<Stage> stages(1, Stage{ GL_VERTEX_SHADER, std::string() });
+    if (fragmentFile) {
+        stages.push_back(Stage{ GL_FRAGMENT_SHADER, std::string() });
+    }
+    if (!_readFile(vertexFile, stages[0].source) || (fragmentFile && !_readFile(fragmentFile, stages[1].source))) {
+        return new CachedShaderProgram(glCreateProgram(), name);
+    }
+    for (Stage& stage : stages) {
+        _insertDefines(stage.source, defines);
+    }
+    return _build(name, stages, feedbackVaryings);
+}
+
+CachedShaderProgram* ShaderCache::loadCompute(const char* computeFile, const std::vector<std::string>& defines) {
+    std::string name = computeFile;
+    for (const std::string& define : defines) {
+        name += " [" + define + "]";
+    }
+
+    std::vector<Stage> stages(1, Stage{ GL_COMPUTE_SHADER, std::string() });
+    if (!_readFile(computeFile, stages[0].source)) {
+        return new CachedShaderProgram(glCreateProgram(), name);
+    }
+    _insertDefines(stages[0].source, defines);
+    return _build(name, stages, {});
+}
+
+CachedShaderProgram* ShaderCache::_build(const std::string& name, const std::vector<Stage>& stages,
+                                         const std::vector<const char*>& feedbackVaryings) {
+    uint64_t key = hashString(_driver);
+    for (const Stage& stage : stages) {
+        key = hashString(stage.source, key);
+    }
+    for (const char* varying : feedbackVaryings) {
+        key = hashString(varying, key);
+    }
+    char keyString[17];
+    snprintf(keyString, sizeof(keyString), "%016" PRIx64, key);
+    const std::string cacheFile = (std::filesystem::path(_directory) / (std::string(keyString) + ".bin")).string();
+
+    GLuint program = glCreateProgram();
+    CachedShaderProgram* shaderProgram = new CachedShaderProgram(program, name);
+
+    if (_binariesSupported) {
+        std::ifstream file(cacheFile, std::ios::binary);
+        uint32_t header[3] = {0, 0, 0}; // magic, format, length
+        if (file.read(reinterpret_cast<char*>(header), sizeof(header)) && header[0] == BINARY_MAGIC) {
+            std::vector<char> binary(header[2]);
+            if (file.read(binary.data(), static_cast<std::streamsize>(binary.size()))) {
+                glProgramBinary(program, header[1], binary.data(), static_cast<GLsizei>(binary.size()));
+                GLint status = GL_FALSE;
+                glGetProgramiv(program, GL_LINK_STATUS, &status);
+                if (status == GL_TRUE) {
+                    ++_numHits;
+                    return shaderProgram;
+                }
+                fprintf(stdout, "[INFO]: cached binary of %s was rejected, compiling it\n", name.c_str());
+            }
+        }
+    }
+    ++_numMisses;
+
+    for (const Stage& stage : stages) {
+        shaderProgram->_shaders.push_back(compileShader(stage.type, stage.source));
+    }
+    for (GLuint shader : shaderProgram->_shaders) {
+        glAttachShader(program, shader);
+    }
+    if (!feedbackVaryings.empty()) {
+        // the transform feedback outputs must be declared before linking
+        glTransformFeedbackVaryings(program, static_cast<GLsizei>(feedbackVaryings.size()),
+                                    feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+    }
+    if (_binariesSupported) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        shaderProgram->_cacheFile = cacheFile;
+    }
+    glLinkProgram(program);
+    shaderProgram->_pending = true;
+
+    return shaderProgram;
+}
+
+void ShaderCache::_storeBinary(GLuint program, const std::string& cacheFile) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    // written under a temporary name first so an interrupted write never leaves a truncated entry
+    const std::string temporaryFile = cacheFile + ".tmp";
+    std::ofstream file(temporaryFile, std::ios::binary | std::ios::trunc);
+    const uint32_t header[3] = { BINARY_MAGIC, format, static_cast<uint32_t>(length) };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+    file.close();
+    if (!file) {
+        fprintf(stderr, "[ERROR]: could not write shader cache entry %s\n", cacheFile.c_str());
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryFile, cacheFile, error);
+}
+
+//***************************************************************************
+// ShaderPermutations
+
+ShaderPermutations::ShaderPermutations(ShaderCache& shaderCache, const char* vertexFile, const char* fragmentFile)
+    : _shaderCache(shaderCache),
+      _vertexFile(vertexFile),
+      _fragmentFile(fragmentFile)
+{}
+
+ShaderPermutations::~ShaderPermutations() {
+    for (auto& variant : _variants) {
+        delete variant.second;
+    }
+}
+
+CachedShaderProgram* ShaderPermutations::get(const std::vector<std::string>& defines) {
+    std::string key;
+    for (const std::string& define : defines) {
+        key += define + "\n";
+    }
+
+    auto variant = _variants.find(key);
+    if (variant == _variants.end()) {
+        variant = _variants.emplace(key, _shaderCache.load(_vertexFile.c_str(), _fragmentFile.c_str(), {}, defines)).first;
+    }
+    return variant->second;
+}
@@ -0,0 +1,109 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/gl.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class ShaderCache;
+
+/// \desc a linked program handed out by the ShaderCache. Programs compiled
+/// from source link in the background where the driver allows it; the link
+/// is only waited on the first time the program is actually used, so
+/// several programs requested back to back compile in parallel.
+class CachedShaderProgram {
+public:
+    ~CachedShaderProgram();
+    CachedShaderProgram(const CachedShaderProgram&) = delete;
+    CachedShaderProgram& operator=(const CachedShaderProgram&) = delete;
+
+    GLuint getShaderProgramHandle() const;
+    void useProgram() const;
+    GLint getUniformLocation(const char* name) const;
+    GLint getAttributeLocation(const char* name) const;
+
+private:
+    friend class ShaderCache;
+    CachedShaderProgram(GLuint handle, std::string name);
+
+    /// \desc waits for a pending link, reports errors and stores the binary
+    void _finishLink() const;
+
+    mutable GLuint _handle;
+    const std::string _name;
+    /// \desc shaders still attached while the link is pending
+    mutable std::vector<GLuint> _shaders;
+    /// \desc binary file to write once the link succeeds, empty when loaded from it
+    mutable std::string _cacheFile;
+    mutable bool _pending;
+};
+
+/// \desc loads shader programs, reusing linked program binaries from disk.
+/// Binaries are keyed by a hash of the sources, the transform feedback
+/// outputs and the GL vendor, renderer and version strings, so a driver
+/// update or an edited shader recompiles. A binary the driver rejects falls
+/// back to compiling the sources.
+class ShaderCache {
+public:
+    /// \desc needs a current context; binaries are kept in directory
+    explicit ShaderCache(const std::string& directory = "shader_cache");
+
+    /// \desc vertex + fragment program, fragmentFile may be nullptr for transform feedback only programs.
+    /// Each define ("NAME" or "NAME VALUE") is inserted into both stages right after #version.
+    CachedShaderProgram* load(const char* vertexFile, const char* fragmentFile,
+                              const std::vector<const char*>& feedbackVaryings = {},
+                              const std::vector<std::string>& defines = {});
+
+    /// \desc compute program, GL 4.3+; defines as for load()
+    CachedShaderProgram* loadCompute(const char* computeFile, const std::vector<std::string>& defines = {});
+
+    size_t getNumHits() const { return _numHits; }
+    size_t getNumMisses() const { return _numMisses; }
+
+private:
+    friend class CachedShaderProgram;
+
+    struct Stage {
+        GLenum type;
+        std::string source;
+    };
+
+    static bool _readFile(const char* filename, std::string& contents);
+    /// \desc links the stages, or loads the binary a previous run stored for the same sources
+    CachedShaderProgram* _build(const std::string& name, const std::vector<Stage>& stages,
+                                const std::vector<const char*>& feedbackVaryings);
+    static void _insertDefines(std::string& source, const std::vector<std::string>& defines);
+    static void _storeBinary(GLuint program, const std::string& cacheFile);
+
+    std::string _directory;
+    /// \desc vendor, renderer and version of the driver, part of every key
+    std::string _driver;
+    /// \desc false when the driver exposes no binary formats
+    bool _binariesSupported;
+    size_t _numHits;
+    size_t _numMisses;
+};
+
+/// \desc #define specialized variants of one program, compiled the first time
+/// a combination is asked for and kept for the lifetime of the object
+class ShaderPermutations {
+public:
+    ShaderPermutations(ShaderCache& shaderCache, const char* vertexFile, const char* fragmentFile);
+    ~ShaderPermutations();
+    ShaderPermutations(const ShaderPermutations&) = delete;
+    ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+    CachedShaderProgram* get(const std::vector<std::string>& defines);
+
+    size_t getNumVariants() const { return _variants.size(); }
+
+private:
+    ShaderCache& _shaderCache;
+    const std::string _vertexFile;
+    const std::string _fragmentFile;
+    /// \desc keyed by the defines joined in the order given
+    std::map<std::string, CachedShaderProgram*> _variants;
+};
+
+#endif // SHADER_CACHE_H
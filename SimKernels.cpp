@@ -0,0 +1,105 @@
+#include "SimKernels.h"
+#include "LevelFile.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <cmath>
+
+glm::vec3 SimKernels::evalBezierCurve(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t) {
+    float oneMinusT = 1.0f - t;
+    float b0 = oneMinusT * oneMinusT * oneMinusT;
+    float b1 = 3 * oneMinusT * oneMinusT * t;
+    float b2 = 3 * oneMinusT * t * t;
+    float b3 = t * t * t;
+
+    return b0 * p0 + b1 * p1 + b2 * p2 + b3 * p3;
+}
+
+void SimKernels::steerMarbles(glm::vec3* locations, glm::vec3* directions, size_t count,
+                              const glm::vec3& target, float speed, float height) {
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 toTarget = glm::normalize(target - locations[i]); // Vector pointing to the target
+        glm::vec3 currentDirection = directions[i];                 // Current heading of the marble
+
+        // Calculate the angular step toward the target
+        const float angleStep = 0.07f; // Adjust this value to control turning speed
+        float dotProduct = glm::dot(currentDirection, toTarget); // Cosine of the angle between current heading and target direction
+        dotProduct = glm::clamp(dotProduct, -1.0f, 1.0f); // Clamp to avoid numerical issues
+        float angleToTarget = std::acos(dotProduct);      // Calculate the angle to the target
+
+        // Check if adjustment is needed
+        if (angleToTarget > 0.001f) { // Threshold to avoid jitter when nearly aligned
+            glm::vec3 rotationAxis = glm::normalize(glm::cross(currentDirection, toTarget)); // Axis of rotation
+            if (glm::length(rotationAxis) > 0.0f) { // Ensure the vectors are not parallel
+                glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::min(angleStep, angleToTarget), rotationAxis);
+                glm::vec4 newDirection = rotationMatrix * glm::vec4(currentDirection, 0.0f); // Apply the rotation
+                directions[i] = glm::normalize(glm::vec3(newDirection)); // Update marble heading
+            }
+        }
+
+        // Move the marble forward along its new heading
+        locations[i] += directions[i] * speed;
+
+        // Keep the marbles at the correct height (on the ground)
+        locations[i].y = height;
+    }
+}
+
+void SimKernels::bounceMarblesOffWalls(const glm::vec3* locations, glm::vec3* directions, size_t count,
+                                       float halfSize, float radius) {
+    for (size_t i = 0; i < count; ++i) {
+        if (locations[i].x > halfSize - radius || locations[i].x < -halfSize + radius) {
+            directions[i].x *= -1.0f;
+        }
+        if (locations[i].z > halfSize - radius || locations[i].z < -halfSize + radius) {
+            directions[i].z *= -1.0f;
+        }
+    }
+}
+
+void SimKernels::collideMarbles(const glm::vec3* locations, glm::vec3* directions, size_t count, float radius) {
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = i + 1; j < count; ++j) {
+            glm::vec3 diff = locations[j] - locations[i];
+            float dist = glm::length(diff);
+            if (dist < 2 * radius) {
+                glm::vec3 normal = glm::normalize(diff);
+                glm::vec3 relativeVel = directions[j] - directions[i];
+                float dot = glm::dot(relativeVel, normal);
+                directions[i] += dot * normal;
+                directions[j] -= dot * normal;
+            }
+        }
+    }
+}
+
+bool SimKernels::isOnPlatform(const glm::vec3& position, const DiskPlatform* disks, size_t numDisks,
+                              const RectPlatform* rects, size_t numRects) {
+    for (size_t i = 0; i < numDisks; ++i) {
+        const DiskPlatform& disk = disks[i];
+        glm::vec3 relativePos = position - disk.position;
+        float distToCenter = glm::length(glm::vec2(relativePos.x, relativePos.z));
+        if (distToCenter >= (disk.inner_radius - disk.fallBuffer) && distToCenter <= (disk.outer_radius + disk.fallBuffer)) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < numRects; ++i) {
+        const RectPlatform& rect = rects[i];
+        glm::vec3 relativePos = position - rect.position;
+        if (glm::abs(relativePos.x) <= (rect.lengthX / 2.0f + rect.fallBuffer) &&
+            glm::abs(relativePos.z) <= (rect.lengthZ / 2.0f + rect.fallBuffer)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SimKernels::findPropCollision(const LevelFile& level, const glm::vec3& position, float radius, glm::vec3& propPosition) {
+    // trees and lamps are all this wide at the base
+    const float propRadius = level.isOpen() ? level.getHeader().grid.propRadius : 0.0f;
+    return level.visitPropsNear(position.x, position.z, radius + propRadius,
+                                [&](uint32_t, const LevelFormat::Prop& prop) {
+        propPosition = glm::make_vec3(prop.position);
+        return spheresOverlap(position, radius, propPosition, propRadius);
+    });
+}
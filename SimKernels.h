@@ -0,0 +1,73 @@
+#ifndef SIM_KERNELS_H
+#define SIM_KERNELS_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+class LevelFile;
+
+struct RectPlatform {
+    glm::vec3 position;
+    float lengthX;
+    float lengthZ;
+    /// \desc range of the level's index buffer holding the platform, the 16-bit indices count from baseVertex
+    uint32_t firstIndex;
+    int32_t numIndices;
+    int32_t baseVertex;
+    /// \desc undoes the quantization of the platform's vertices, see PackedVertex.h
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+    uint32_t textureID;
+    float fallBuffer;
+};
+
+struct DiskPlatform {
+    glm::vec3 position;
+    float inner_radius;
+    float outer_radius;
+    /// \desc range of the level's index buffer holding the platform, the 16-bit indices count from baseVertex
+    uint32_t firstIndex;
+    int32_t numIndices;
+    int32_t baseVertex;
+    /// \desc undoes the quantization of the platform's vertices, see PackedVertex.h
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+    uint32_t textureID;
+    float fallBuffer;
+};
+
+/// \desc the simulation's inner loops, free of GL and of the engine so
+/// fp_bench can time exactly the code a tick runs
+namespace SimKernels {
+    inline bool spheresOverlap(const glm::vec3& pos1, float radius1, const glm::vec3& pos2, float radius2) {
+        const glm::vec3 offset = pos1 - pos2;
+        const float combinedRadii = radius1 + radius2;
+        return glm::dot(offset, offset) <= combinedRadii * combinedRadii;
+    }
+
+    /// \desc cubic Bézier curve through the four control points at t in [0, 1]
+    glm::vec3 evalBezierCurve(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t);
+
+    /// \desc turns each marble's heading a little toward the target, moves it by speed along
+    /// the heading and puts it back at height
+    void steerMarbles(glm::vec3* locations, glm::vec3* directions, size_t count,
+                      const glm::vec3& target, float speed, float height);
+
+    /// \desc reverses the heading components of the marbles that reached the walls of a square
+    /// world halfSize across from the origin
+    void bounceMarblesOffWalls(const glm::vec3* locations, glm::vec3* directions, size_t count,
+                               float halfSize, float radius);
+
+    /// \desc exchanges the heading components along the line between every pair of touching marbles
+    void collideMarbles(const glm::vec3* locations, glm::vec3* directions, size_t count, float radius);
+
+    /// \desc whether the position is over a platform, within its fall buffer
+    bool isOnPlatform(const glm::vec3& position, const DiskPlatform* disks, size_t numDisks,
+                      const RectPlatform* rects, size_t numRects);
+
+    /// \desc finds a prop of the level that a sphere at position overlaps, returns false when there is none
+    bool findPropCollision(const LevelFile& level, const glm::vec3& position, float radius, glm::vec3& propPosition);
+}
+
+#endif // SIM_KERNELS_H
@@ -0,0 +1,200 @@
+#include "SnapshotCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    enum RecordFlags : uint8_t {
+        REMOVED = 1 << 0,
+        POSITION_X = 1 << 1,
+        POSITION_Y = 1 << 2,
+        POSITION_Z = 1 << 3,
+        HEADING = 1 << 4
+    };
+    /// \desc id and flags, the rest is optional
+    constexpr size_t RECORD_HEADER_SIZE = 3;
+    /// \desc the largest record: header, three 5-byte varints and a 3-byte heading
+    constexpr size_t MAX_RECORD_SIZE = RECORD_HEADER_SIZE + 3 * 5 + 3;
+
+    constexpr float TWO_PI = 6.28318530718f;
+
+    uint32_t zigzag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    int32_t unzigzag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    size_t writeVarint(uint8_t* out, uint32_t value) {
+        size_t size = 0;
+        while (value >= 0x80) {
+            out[size++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        out[size++] = static_cast<uint8_t>(value);
+        return size;
+    }
+
+    bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35 && data < end; shift += 7) {
+            const uint8_t byte = *data++;
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool byId(const SnapshotCodec::EntityState& a, const SnapshotCodec::EntityState& b) {
+        return a.id < b.id;
+    }
+
+    /// \desc the record taking from to to, from is all zero for a new entity
+    size_t writeRecord(uint8_t* out, const SnapshotCodec::EntityState& from, const SnapshotCodec::EntityState& to) {
+        out[0] = static_cast<uint8_t>(to.id);
+        out[1] = static_cast<uint8_t>(to.id >> 8);
+        uint8_t flags = 0;
+        size_t size = RECORD_HEADER_SIZE;
+        for (int axis = 0; axis < 3; ++axis) {
+            const int32_t change = to.position[axis] - from.position[axis];
+            if (change != 0) {
+                flags |= POSITION_X << axis;
+                size += writeVarint(out + size, zigzag(change));
+            }
+        }
+        if (to.heading != from.heading) {
+            flags |= HEADING;
+            // headings wrap, the short way round is at most half a turn
+            size += writeVarint(out + size, zigzag(static_cast<int16_t>(static_cast<uint16_t>(to.heading - from.heading))));
+        }
+        out[2] = flags;
+        return size;
+    }
+}
+
+SnapshotCodec::EntityState SnapshotCodec::quantize(uint16_t id, const glm::vec3& position, float heading) {
+    EntityState state;
+    state.id = id;
+    for (int axis = 0; axis < 3; ++axis) {
+        state.position[axis] = static_cast<int32_t>(std::lround(position[axis] * POSITION_UNITS_PER_METER));
+    }
+    float turns = heading / TWO_PI;
+    turns -= std::floor(turns);
+    state.heading = static_cast<uint16_t>(static_cast<uint32_t>(std::lround(turns * 65536.0f)) & 0xFFFF);
+    return state;
+}
+
+glm::vec3 SnapshotCodec::positionOf(const EntityState& state) {
+    return glm::vec3(static_cast<float>(state.position[0]), static_cast<float>(state.position[1]),
+                     static_cast<float>(state.position[2])) / POSITION_UNITS_PER_METER;
+}
+
+float SnapshotCodec::headingOf(const EntityState& state) {
+    return static_cast<float>(state.heading) / 65536.0f * TWO_PI;
+}
+
+const SnapshotCodec::EntityState* SnapshotCodec::find(const std::vector<EntityState>& states, uint16_t id) {
+    EntityState key{};
+    key.id = id;
+    auto it = std::lower_bound(states.begin(), states.end(), key, byId);
+    return it != states.end() && it->id == id ? &*it : nullptr;
+}
+
+SnapshotCodec::Result SnapshotCodec::encode(const std::vector<EntityState>& baseline, const std::vector<EntityState>& current,
+                                            uint8_t* out, size_t capacity, std::vector<EntityState>& decoded,
+                                            std::vector<EntityState>& scratch) {
+    Result result{ 0, 0, 0 };
+    decoded.clear();
+
+    // entities in the baseline that are no longer due are removed first, they are the cheapest
+    scratch.assign(current.begin(), current.end());
+    std::sort(scratch.begin(), scratch.end(), byId);
+    for (const EntityState& old : baseline) {
+        if (find(scratch, old.id)) {
+            continue;
+        }
+        if (result.bytes + RECORD_HEADER_SIZE > capacity) {
+            // the client keeps showing it until a later snapshot has room
+            decoded.push_back(old);
+            continue;
+        }
+        out[result.bytes] = static_cast<uint8_t>(old.id);
+        out[result.bytes + 1] = static_cast<uint8_t>(old.id >> 8);
+        out[result.bytes + 2] = REMOVED;
+        result.bytes += RECORD_HEADER_SIZE;
+        ++result.numRecords;
+    }
+
+    // then everything due, most important first, until the packet is full
+    const EntityState zero{};
+    for (const EntityState& state : current) {
+        const EntityState* old = find(baseline, state.id);
+        if (old && *old == state) {
+            decoded.push_back(state);
+            continue;
+        }
+        if (result.bytes + MAX_RECORD_SIZE > capacity || result.numRecords == UINT16_MAX) {
+            ++result.numDeferred;
+            if (old) {
+                decoded.push_back(*old);
+            }
+            continue;
+        }
+        EntityState from = old ? *old : zero;
+        from.id = state.id;
+        result.bytes += writeRecord(out + result.bytes, from, state);
+        ++result.numRecords;
+        decoded.push_back(state);
+    }
+    std::sort(decoded.begin(), decoded.end(), byId);
+    return result;
+}
+
+bool SnapshotCodec::decode(const std::vector<EntityState>& baseline, const uint8_t* data, size_t size, uint16_t numRecords,
+                           std::vector<EntityState>& decoded) {
+    decoded.assign(baseline.begin(), baseline.end());
+    const uint8_t* end = data + size;
+    for (uint16_t record = 0; record < numRecords; ++record) {
+        if (end - data < static_cast<ptrdiff_t>(RECORD_HEADER_SIZE)) {
+            return false;
+        }
+        const uint16_t id = static_cast<uint16_t>(data[0] | (data[1] << 8));
+        const uint8_t flags = data[2];
+        data += RECORD_HEADER_SIZE;
+
+        EntityState key{};
+        key.id = id;
+        auto it = std::lower_bound(decoded.begin(), decoded.end(), key, byId);
+        const bool known = it != decoded.end() && it->id == id;
+        if (flags & REMOVED) {
+            if (known) {
+                decoded.erase(it);
+            }
+            continue;
+        }
+        if (!known) {
+            it = decoded.insert(it, key);
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            uint32_t value;
+            if ((flags & (POSITION_X << axis)) && !readVarint(data, end, value)) {
+                return false;
+            }
+            if (flags & (POSITION_X << axis)) {
+                it->position[axis] += unzigzag(value);
+            }
+        }
+        if (flags & HEADING) {
+            uint32_t value;
+            if (!readVarint(data, end, value)) {
+                return false;
+            }
+            it->heading = static_cast<uint16_t>(it->heading + unzigzag(value));
+        }
+    }
+    return data == end;
+}
@@ -0,0 +1,63 @@
+#ifndef SNAPSHOT_CODEC_H
+#define SNAPSHOT_CODEC_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// \desc quantized entity states and their delta encoding for snapshots.
+///
+/// Positions are fixed point at 1/64 m and headings a 16-bit fraction of a
+/// turn. A snapshot is encoded against a baseline, the last one the client
+/// acknowledged: entities that did not change cost nothing, changed ones
+/// send the zigzag varint difference of the fields that moved, new ones
+/// send their fields as a difference from zero and entities that left the
+/// client's view send their id alone. Each record is
+///   uint16 id, uint8 flags, then a varint per flagged field.
+namespace SnapshotCodec {
+    constexpr float POSITION_UNITS_PER_METER = 64.0f;
+
+    struct EntityState {
+        uint16_t id;
+        uint16_t heading;
+        int32_t position[3];
+    };
+
+    inline bool operator==(const EntityState& a, const EntityState& b) {
+        return a.id == b.id && a.heading == b.heading && a.position[0] == b.position[0] &&
+               a.position[1] == b.position[1] && a.position[2] == b.position[2];
+    }
+
+    EntityState quantize(uint16_t id, const glm::vec3& position, float heading);
+    glm::vec3 positionOf(const EntityState& state);
+    /// \desc in radians, in [0, 2 pi)
+    float headingOf(const EntityState& state);
+
+    /// \desc what one encode wrote and what the client will hold after decoding it
+    struct Result {
+        size_t bytes;
+        uint16_t numRecords;
+        /// \desc entities that were due but did not fit in the packet
+        size_t numDeferred;
+    };
+
+    /// \desc writes the records taking baseline to current into out, at most capacity bytes.
+    /// baseline is sorted by id; current is in priority order, what does not fit is left
+    /// for the next snapshot. decoded receives what the client will hold, sorted by id,
+    /// which becomes the baseline once the client acknowledges it. scratch keeps its
+    /// capacity between calls.
+    Result encode(const std::vector<EntityState>& baseline, const std::vector<EntityState>& current,
+                  uint8_t* out, size_t capacity, std::vector<EntityState>& decoded,
+                  std::vector<EntityState>& scratch);
+
+    /// \desc applies numRecords records to baseline, sorted by id, into decoded, sorted by
+    /// id; false when the records are malformed
+    bool decode(const std::vector<EntityState>& baseline, const uint8_t* data, size_t size, uint16_t numRecords,
+                std::vector<EntityState>& decoded);
+
+    /// \desc the state with the id in a list sorted by id, or nullptr
+    const EntityState* find(const std::vector<EntityState>& states, uint16_t id);
+}
+
+#endif // SNAPSHOT_CODEC_H
@@ -0,0 +1,50 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/// \desc bounded lock-free queue for exactly one producer thread and one
+/// consumer thread. CAPACITY must be a power of two; one slot is kept free
+/// to tell a full queue from an empty one.
+template<typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue()
+        : _head(0),
+          _tail(0)
+    {}
+
+    /// \desc called by the producer, returns false and drops the item when the queue is full
+    bool push(const T& item) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & (CAPACITY - 1);
+        if (next == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        _items[tail] = item;
+        _tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /// \desc called by the consumer, returns false when there is nothing to take
+    bool pop(T& item) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _items[head];
+        _head.store((head + 1) & (CAPACITY - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    T _items[CAPACITY];
+    /// \desc producer and consumer indices on separate cache lines so they do not false share
+    alignas(64) std::atomic<size_t> _head;
+    alignas(64) std::atomic<size_t> _tail;
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,148 @@
+#include "StreamBuffer.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    /// \desc how long beginFrame() waits on a region's fence before giving up and reusing it anyway
+    constexpr GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+}
+
+StreamBuffer::StreamBuffer(GLsizeiptr regionSize)
+    : _regionSize(regionSize),
+      _buffer(0),
+      _persistent(false),
+      _persistentData(nullptr),
+      _fences{},
+      _region(0),
+      _used(0),
+      _uniformAlignment(256),
+      _storageAlignment(256),
+      _mapped(false),
+      _numStalls(0),
+      _numOverflows(0)
+{}
+
+StreamBuffer::~StreamBuffer() = default;
+
+bool StreamBuffer::_hasBufferStorage() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4)) {
+        return true;
+    }
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && strcmp(extension, "GL_ARB_buffer_storage") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StreamBuffer::setup() {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    _uniformAlignment = alignment > 0 ? alignment : 256;
+    // storage buffers are GL 4.3, before that nobody binds a range of this buffer as one
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    _storageAlignment = _uniformAlignment;
+    if (major > 4 || (major == 4 && minor >= 3)) {
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        _storageAlignment = alignment > 0 ? alignment : _uniformAlignment;
+    }
+
+    const GLsizeiptr size = _regionSize * NUM_REGIONS;
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+    _persistent = _hasBufferStorage();
+    if (_persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+        _persistentData = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+        _persistent = _persistentData != nullptr;
+    }
+    if (!_persistent) {
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    fprintf(stdout, "[INFO]: stream buffer: %d regions of %ld KB, %s\n", NUM_REGIONS, static_cast<long>(_regionSize / 1024),
+            _persistent ? "persistently mapped" : "mapped unsynchronized per allocation");
+}
+
+void StreamBuffer::cleanup() {
+    for (GLsync& fence : _fences) {
+        if (fence) glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (_persistentData) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        _persistentData = nullptr;
+    }
+    glDeleteBuffers(1, &_buffer);
+    _buffer = 0;
+}
+
+void StreamBuffer::beginFrame() {
+    _region = (_region + 1) % NUM_REGIONS;
+    _used = 0;
+    GLsync& fence = _fences[_region];
+    if (!fence) {
+        return;
+    }
+    // the frame NUM_REGIONS - 1 back is normally done; if not, this is where the CPU runs too far ahead
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        ++_numStalls;
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    }
+    if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+        fprintf(stderr, "[ERROR]: stream buffer region %u is still in use, overwriting it anyway\n", _region);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void StreamBuffer::endFrame() {
+    if (_used > 0) {
+        _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+void* StreamBuffer::map(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) {
+    const GLsizeiptr start = (_used + alignment - 1) & ~(alignment - 1);
+    if (!_buffer || size <= 0 || start + size > _regionSize) {
+        if (size > 0) ++_numOverflows;
+        return nullptr;
+    }
+    _used = start + size;
+    offset = static_cast<GLintptr>(_region) * _regionSize + start;
+    if (_persistent) {
+        return _persistentData + offset;
+    }
+
+    // the fences already keep this range away from the GPU, the driver need not check
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+    void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    _mapped = data != nullptr;
+    return data;
+}
+
+void StreamBuffer::unmap() {
+    if (!_mapped) {
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    _mapped = false;
+}
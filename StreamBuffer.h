@@ -0,0 +1,76 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/gl.h>
+
+/// \desc one GL buffer the CPU writes every frame's dynamic data into: instance
+/// attributes, index lists, uniform blocks, anything that is rebuilt per frame.
+///
+/// The buffer is split into NUM_REGIONS regions used round robin, one per
+/// frame. The fence placed at endFrame() is waited on when the region comes
+/// round again, by which time the GPU has long finished with it, so writing
+/// never waits on the driver the way glBufferSubData or orphaning with
+/// glBufferData on a buffer still in use can. Where GL 4.4 or
+/// ARB_buffer_storage is there the buffer is mapped once, persistently and
+/// coherently; elsewhere each allocation maps its own range unsynchronized
+/// and invalidated, the fences standing in for the synchronization the
+/// driver was told to skip, and unmap() hands it back before it is drawn from.
+///
+/// Allocations only live until the end of the frame, like FrameArena's.
+class StreamBuffer {
+public:
+    static constexpr GLuint NUM_REGIONS = 3;
+
+    /// \desc regionSize bytes are available to each frame
+    explicit StreamBuffer(GLsizeiptr regionSize);
+    ~StreamBuffer();
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    /// \desc needs a current context
+    void setup();
+    void cleanup();
+
+    /// \desc waits for the GPU to let go of the region this frame writes into
+    void beginFrame();
+    /// \desc fences everything the frame submitted; call after the last draw reading from it
+    void endFrame();
+
+    /// \desc size writable bytes at an offset into getBuffer() that is a multiple of alignment,
+    /// a power of two; nullptr when the frame's region is full. Call unmap() before drawing from it
+    void* map(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
+    /// \desc ends the write started by the last map(); nothing to do for a persistent mapping
+    void unmap();
+
+    GLuint getBuffer() const { return _buffer; }
+    bool isPersistent() const { return _persistent; }
+    /// \desc offset alignment glBindBufferRange asks for on each target
+    GLsizeiptr getUniformAlignment() const { return _uniformAlignment; }
+    GLsizeiptr getStorageAlignment() const { return _storageAlignment; }
+
+    /// \desc bytes handed out this frame so far
+    GLsizeiptr getBytesUsed() const { return _used; }
+    /// \desc frames whose region the GPU still held when they began
+    unsigned int getNumStalls() const { return _numStalls; }
+    /// \desc map() calls refused because the region was full
+    unsigned int getNumOverflows() const { return _numOverflows; }
+
+private:
+    const GLsizeiptr _regionSize;
+    GLuint _buffer;
+    bool _persistent;
+    /// \desc the whole buffer when persistent
+    unsigned char* _persistentData;
+    GLsync _fences[NUM_REGIONS];
+    GLuint _region;
+    GLsizeiptr _used;
+    GLsizeiptr _uniformAlignment;
+    GLsizeiptr _storageAlignment;
+    bool _mapped;
+    unsigned int _numStalls;
+    unsigned int _numOverflows;
+
+    static bool _hasBufferStorage();
+};
+
+#endif // STREAM_BUFFER_H
@@ -0,0 +1,46 @@
+#include "TaskGraph.h"
+#include "Profiler.h"
+
+#include <cassert>
+
+TaskGraph::TaskID TaskGraph::addTask(const char* name, std::function<void()> work) {
+    _tasks.emplace_back(new Task{ this, name, std::move(work), {}, 0, {0} });
+    return _tasks.size() - 1;
+}
+
+void TaskGraph::addDependency(TaskID before, TaskID after) {
+    // tasks only wait on ones added earlier, which keeps the graph free of cycles
+    assert(before < after && after < _tasks.size());
+    _tasks[before]->successors.push_back(after);
+    ++_tasks[after]->numPredecessors;
+}
+
+void TaskGraph::run(JobSystem& jobs) {
+    _jobs = &jobs;
+    for (const std::unique_ptr<Task>& task : _tasks) {
+        task->waitingOn.store(task->numPredecessors, std::memory_order_relaxed);
+    }
+    for (const std::unique_ptr<Task>& task : _tasks) {
+        if (task->numPredecessors == 0) {
+            jobs.submit(&TaskGraph::_runTask, task.get(), _running);
+        }
+    }
+    jobs.wait(_running);
+}
+
+void TaskGraph::_runTask(void* data) {
+    Task* task = static_cast<Task*>(data);
+    {
+        FP_PROFILE_SCOPE(task->name);
+        task->work();
+    }
+
+    TaskGraph* graph = task->graph;
+    for (TaskID successor : task->successors) {
+        Task* next = graph->_tasks[successor].get();
+        // acq_rel hands everything the predecessors wrote to the successor
+        if (next->waitingOn.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            graph->_jobs->submit(&TaskGraph::_runTask, next, graph->_running);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/// \desc the stages of a frame or tick and what each waits for, declared once
+/// and then run as often as needed.
+///
+/// Tasks are added before the first run and never after; run() submits every
+/// task without predecessors, and each finished task submits the successors it
+/// was the last to wait for. Tasks with no path between them may run at the
+/// same time on different threads, so they must not touch the same state.
+/// Running the graph does not allocate.
+class TaskGraph {
+public:
+    using TaskID = size_t;
+
+    /// \desc name shows up in the profiler and has to outlive the graph
+    TaskID addTask(const char* name, std::function<void()> work);
+    /// \desc after does not start until before has finished
+    void addDependency(TaskID before, TaskID after);
+
+    /// \desc runs every task once and returns when all have finished; the calling thread helps
+    void run(JobSystem& jobs);
+
+    size_t getNumTasks() const { return _tasks.size(); }
+
+private:
+    struct Task {
+        TaskGraph* graph;
+        const char* name;
+        std::function<void()> work;
+        std::vector<TaskID> successors;
+        size_t numPredecessors;
+        /// \desc predecessors still running in this run
+        std::atomic<size_t> waitingOn;
+    };
+
+    /// \desc owned one by one, so a task's address stays put while the graph grows
+    std::vector<std::unique_ptr<Task>> _tasks;
+    JobSystem* _jobs = nullptr;
+    JobSystem::Counter _running{0};
+
+    static void _runTask(void* data);
+};
+
+#endif // TASK_GRAPH_H
@@ -0,0 +1,87 @@
+#include "TransformHierarchy.h"
+
+TransformHierarchy::Node TransformHierarchy::addNode(Node parent, const glm::vec3& position,
+                                                     const glm::quat& rotation, const glm::vec3& scale) {
+    NodeData node;
+    node.parent = parent < _nodes.size() ? parent : NO_PARENT;
+    node.position = position;
+    node.rotation = rotation;
+    node.scale = scale;
+    node.world = glm::mat4(1.0f);
+    node.normal = glm::mat3(1.0f);
+    node.dirty = true;
+    node.updated = false;
+    node.rigid = true;
+    _nodes.push_back(node);
+    _anyDirty = true;
+    return static_cast<Node>(_nodes.size() - 1);
+}
+
+void TransformHierarchy::_markDirty(Node node) {
+    _nodes[node].dirty = true;
+    _anyDirty = true;
+}
+
+void TransformHierarchy::setPosition(Node node, const glm::vec3& position) {
+    if (_nodes[node].position != position) {
+        _nodes[node].position = position;
+        _markDirty(node);
+    }
+}
+
+void TransformHierarchy::setRotation(Node node, const glm::quat& rotation) {
+    if (_nodes[node].rotation != rotation) {
+        _nodes[node].rotation = rotation;
+        _markDirty(node);
+    }
+}
+
+void TransformHierarchy::setScale(Node node, const glm::vec3& scale) {
+    if (_nodes[node].scale != scale) {
+        _nodes[node].scale = scale;
+        _markDirty(node);
+    }
+}
+
+void TransformHierarchy::update() {
+    _numUpdated = 0;
+    if (!_anyDirty) {
+        return;
+    }
+    _anyDirty = false;
+
+    for (NodeData& node : _nodes) {
+        const NodeData* parent = node.parent == NO_PARENT ? nullptr : &_nodes[node.parent];
+        node.updated = node.dirty || (parent && parent->updated);
+        if (!node.updated) {
+            continue;
+        }
+        node.dirty = false;
+        ++_numUpdated;
+
+        // T * R * S without building and multiplying the three matrices
+        const glm::mat3 rotation = glm::mat3_cast(node.rotation);
+        glm::mat4 local(1.0f);
+        local[0] = glm::vec4(rotation[0] * node.scale.x, 0.0f);
+        local[1] = glm::vec4(rotation[1] * node.scale.y, 0.0f);
+        local[2] = glm::vec4(rotation[2] * node.scale.z, 0.0f);
+        local[3] = glm::vec4(node.position, 1.0f);
+
+        const bool unscaled = node.scale == glm::vec3(1.0f);
+        node.rigid = unscaled && (!parent || parent->rigid);
+        node.world = parent ? parent->world * local : local;
+
+        if (node.rigid) {
+            // only rotations and translations so far: the normal matrix is the rotation
+            node.normal = glm::mat3(node.world);
+        } else {
+            glm::mat3 localNormal = rotation;
+            if (!unscaled) {
+                localNormal[0] /= node.scale.x;
+                localNormal[1] /= node.scale.y;
+                localNormal[2] /= node.scale.z;
+            }
+            node.normal = parent ? parent->normal * localNormal : localNormal;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <vector>
+
+/// \desc parent/child transforms with cached world and normal matrices.
+///
+/// Each node has a local position, rotation and scale. Setting one marks the
+/// node dirty; update() recomputes the dirty nodes and everything below them,
+/// and leaves the rest untouched, so static objects are computed once and
+/// moving ones only in the frames they move.
+///
+/// Normal matrices are never inverted: the inverse transpose of R*S is
+/// R*S^-1, so they are accumulated down the hierarchy like the world
+/// matrices. Nodes without scale anywhere up their chain are rigid and take
+/// the upper 3x3 of the world matrix as is.
+class TransformHierarchy {
+public:
+    typedef uint32_t Node;
+    static constexpr Node NO_PARENT = 0xFFFFFFFF;
+
+    /// \desc parents have to be added before their children
+    Node addNode(Node parent = NO_PARENT,
+                 const glm::vec3& position = glm::vec3(0.0f),
+                 const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                 const glm::vec3& scale = glm::vec3(1.0f));
+
+    /// \desc setting the value a node already has does not dirty it
+    void setPosition(Node node, const glm::vec3& position);
+    void setRotation(Node node, const glm::quat& rotation);
+    void setScale(Node node, const glm::vec3& scale);
+
+    const glm::vec3& getPosition(Node node) const { return _nodes[node].position; }
+    const glm::quat& getRotation(Node node) const { return _nodes[node].rotation; }
+    const glm::vec3& getScale(Node node) const { return _nodes[node].scale; }
+
+    /// \desc brings the cached matrices of every dirty node and its descendants up to date
+    void update();
+
+    /// \desc valid after update()
+    const glm::mat4& getWorldMatrix(Node node) const { return _nodes[node].world; }
+    const glm::mat3& getNormalMatrix(Node node) const { return _nodes[node].normal; }
+
+    size_t getNumNodes() const { return _nodes.size(); }
+    /// \desc nodes recomputed by the last update()
+    size_t getNumUpdated() const { return _numUpdated; }
+
+private:
+    struct NodeData {
+        Node parent;
+        glm::vec3 position;
+        glm::quat rotation;
+        glm::vec3 scale;
+        glm::mat4 world;
+        glm::mat3 normal;
+        /// \desc local values changed since the last update
+        bool dirty;
+        /// \desc recomputed by the last update, so its children follow
+        bool updated;
+        /// \desc no scale on this node or above it
+        bool rigid;
+    };
+
+    void _markDirty(Node node);
+
+    /// \desc in the order added, so a parent is always visited before its children
+    std::vector<NodeData> _nodes;
+    bool _anyDirty = false;
+    size_t _numUpdated = 0;
+};
+
+#endif // TRANSFORM_HIERARCHY_H
@@ -0,0 +1,53 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/// \desc lock-free triple buffer handing whole values from one writer thread
+/// to one reader thread. The writer fills its back slot and publishes it;
+/// the reader picks up the newest published slot whenever it wants. Neither
+/// side ever waits, and a slot is never touched by both threads at once.
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer()
+        : _writeIndex(0),
+          _middle(1),
+          _readIndex(2)
+    {}
+
+    /// \desc slot owned by the writer, fill it in before calling publish()
+    T& writeBuffer() { return _slots[_writeIndex]; }
+
+    /// \desc hands the write slot to the reader and takes back the stale middle slot
+    void publish() {
+        uint8_t previous = _middle.exchange(_writeIndex | FRESH_BIT, std::memory_order_acq_rel);
+        _writeIndex = previous & INDEX_MASK;
+    }
+
+    /// \desc swaps in the newest published slot, returns false if nothing new was published
+    bool fetch() {
+        if ((_middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0) {
+            return false;
+        }
+        uint8_t previous = _middle.exchange(_readIndex, std::memory_order_acq_rel);
+        _readIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    /// \desc slot owned by the reader, valid until the next fetch()
+    const T& readBuffer() const { return _slots[_readIndex]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH_BIT = 0x4;
+
+    T _slots[3];
+    uint8_t _writeIndex;
+    /// \desc index of the slot between the two threads, flagged when it holds unread data
+    std::atomic<uint8_t> _middle;
+    uint8_t _readIndex;
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -2,19 +2,23 @@
 #define VEHICLE_H
 
 #include <glm/glm.hpp>
-#include <CSCI441/objects.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-
 
 
 class Vehicle {
 public:
-    Vehicle(GLuint shaderProgramHandle, GLint mvpMatrixLocation, GLint normalMatrixLocation,
-            GLint materialAmbientLocation, GLint materialDiffuseLocation,
-            GLint materialSpecularLocation, GLint materialShininessLocation);
+    Vehicle();
+
+    /// \desc everything needed to draw the vehicle, copied out so the
+    /// render thread can draw it while the simulation keeps moving it;
+    /// the model itself is drawn by VehicleMesh
+    struct Pose {
+        glm::vec3 position;
+        float heading;
+        float wheelRotation;
+        bool visible;
+    };
+    Pose getPose() const { return Pose{_position, _heading, _wheelRotation, _isVisible}; }
 
-    void drawVehicle(glm::mat4 viewMtx, glm::mat4 projMtx) const;
     void driveForward();
     void driveBackward();
     void turnLeft();
@@ -41,13 +45,6 @@ public:
 
 private:
     bool _isVisible = true;
-    GLuint _shaderProgramHandle;
-    GLint _mvpMatrixLocation;
-    GLint _normalMatrixLocation;
-    GLint _materialAmbientLocation;
-    GLint _materialDiffuseLocation;
-    GLint _materialSpecularLocation;
-    GLint _materialShininessLocation;
 
     glm::vec3 _position;
     float _boundingRadius = 1.0;
@@ -56,11 +53,7 @@ private:
     // Animation state
     float _wheelRotation;
 
-    int coinCount;
-
-    void _drawBody(glm::mat4 modelMtx, glm::mat4 viewMtx, glm::mat4 projMtx) const;
-    void _drawRoof(glm::mat4 modelMtx, glm::mat4 viewMtx, glm::mat4 projMtx) const;
-    void _drawWheels(glm::mat4 modelMtx, glm::mat4 viewMtx, glm::mat4 projMtx) const;
+    int coinCount = 0;
 
 };
 
@@ -0,0 +1,223 @@
+#include "VehicleMesh.h"
+#include "GLStateCache.h"
+#include "ShaderCache.h"
+#include "MeshOptimizer.h"
+#include "TransformHierarchy.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#ifndef M_PI
+#define M_PI 3.14159265f
+#endif
+
+namespace {
+    enum VehicleMaterial { BODY = 0, ROOF = 1, WHEEL = 2 };
+
+    struct MaterialData {
+        glm::vec3 ambient;
+        glm::vec3 diffuse;
+        glm::vec3 specular;
+        GLfloat shininess;
+    };
+
+    const MaterialData MATERIALS[VehicleMesh::NUM_MATERIALS] = {
+        { glm::vec3(0.6f, 0.0f, 0.6f), glm::vec3(1.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), 32.0f },  // body, hot pink
+        { glm::vec3(0.4f, 0.3f, 0.3f), glm::vec3(1.0f, 0.75f, 0.8f), glm::vec3(1.0f, 1.0f, 1.0f), 16.0f }, // roof, light pink
+        { glm::vec3(0.2f, 0.2f, 0.2f), glm::vec3(0.1f, 0.1f, 0.1f), glm::vec3(0.5f, 0.5f, 0.5f), 8.0f }     // wheels, dark gray
+    };
+
+    /// \desc the same stacks and slices the CSCI441 cylinder was drawn with
+    constexpr GLint WHEEL_TESSELLATION = 16;
+}
+
+VehicleMesh::VehicleMesh()
+    : _vao(0),
+      _vbo(0),
+      _ebo(0),
+      _numIndices(0),
+      _mvpMatrixLocation(-1)
+{}
+
+void VehicleMesh::_appendCube(std::vector<Vertex>& vertices, std::vector<GLushort>& indices,
+                              const glm::mat4& worldMtx, const glm::mat3& normalMtx, GLfloat material) {
+    const glm::vec3 faceNormals[6] = {
+        glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0),
+        glm::vec3(0, 1, 0), glm::vec3(0, -1, 0),
+        glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)
+    };
+    for (const glm::vec3& faceNormal : faceNormals) {
+        const glm::vec3 up = std::fabs(faceNormal.y) > 0.5f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+        const glm::vec3 right = glm::cross(up, faceNormal);
+        const glm::vec3 corners[4] = {
+            faceNormal - right - up, faceNormal + right - up,
+            faceNormal + right + up, faceNormal - right + up
+        };
+
+        const GLushort first = static_cast<GLushort>(vertices.size());
+        const glm::vec3 normal = glm::normalize(normalMtx * faceNormal);
+        for (const glm::vec3& corner : corners) {
+            // unit cube centered on the origin, like CSCI441::drawSolidCube(1.0f)
+            vertices.push_back(Vertex{ glm::vec3(worldMtx * glm::vec4(corner * 0.5f, 1.0f)), normal, material, glm::vec4(0.0f) });
+        }
+        indices.insert(indices.end(), { first, static_cast<GLushort>(first + 1), static_cast<GLushort>(first + 2),
+                                        first, static_cast<GLushort>(first + 2), static_cast<GLushort>(first + 3) });
+    }
+}
+
+void VehicleMesh::_appendCylinder(std::vector<Vertex>& vertices, std::vector<GLushort>& indices,
+                                  const glm::mat4& worldMtx, const glm::mat3& normalMtx, GLfloat material,
+                                  GLfloat radius, GLfloat height, GLint stacks, GLint slices) {
+    // the axle is the cylinder axis; every point of it stays put while the wheel spins
+    const glm::vec4 hub(glm::vec3(worldMtx[3]), 1.0f);
+    const GLushort first = static_cast<GLushort>(vertices.size());
+
+    // open tube around +Y from y = 0 to height, like CSCI441::drawSolidCylinder
+    for (GLint stack = 0; stack <= stacks; ++stack) {
+        float y = static_cast<float>(stack) / stacks * height;
+        for (GLint slice = 0; slice <= slices; ++slice) {
+            float theta = static_cast<float>(slice) / slices * 2.0f * M_PI;
+            glm::vec3 direction(std::cos(theta), 0.0f, std::sin(theta));
+            vertices.push_back(Vertex{ glm::vec3(worldMtx * glm::vec4(direction * radius + glm::vec3(0.0f, y, 0.0f), 1.0f)),
+                                       glm::normalize(normalMtx * direction), material, hub });
+
+            if (stack < stacks && slice < slices) {
+                GLushort current = static_cast<GLushort>(first + stack * (slices + 1) + slice);
+                GLushort next = static_cast<GLushort>(current + slices + 1);
+                indices.insert(indices.end(), { current, next, static_cast<GLushort>(current + 1),
+                                                static_cast<GLushort>(current + 1), next, static_cast<GLushort>(next + 1) });
+            }
+        }
+    }
+}
+
+void VehicleMesh::setup(const CachedShaderProgram* shaderProgram) {
+    // the parts are placed with the transforms the vehicle used to be drawn with
+    TransformHierarchy parts;
+    const TransformHierarchy::Node root = parts.addNode(TransformHierarchy::NO_PARENT, glm::vec3(0.0f, 0.85f, 0.0f),
+                                                        glm::angleAxis(glm::radians(90.0f), glm::vec3(0, 1, 0)));
+    const TransformHierarchy::Node body = parts.addNode(root, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                                                        glm::vec3(3.0f, 0.5f, 1.5f));
+    // Position the roof exactly at the top of the car body
+    const TransformHierarchy::Node roof = parts.addNode(root, glm::vec3(0.0f, 0.5f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                                                        glm::vec3(1.0f, 0.5f, 1.0f));
+    const glm::vec3 wheelOffsets[4] = {
+        glm::vec3(-1.0f, -0.5f, -0.82f), // Front Left (FL)
+        glm::vec3(1.0f, -0.5f, -0.82f),  // Front Right (FR)
+        glm::vec3(-1.0f, -0.5f, 0.62f),  // Rear Left (RL)
+        glm::vec3(1.0f, -0.5f, 0.62f)    // Rear Right (RR)
+    };
+    TransformHierarchy::Node wheels[4];
+    for (int i = 0; i < 4; ++i) {
+        // Rotate the wheel by 90 degrees around the X-axis to align horizontally; the spin is added by the shader
+        wheels[i] = parts.addNode(root, wheelOffsets[i], glm::angleAxis(glm::radians(90.0f), glm::vec3(1, 0, 0)),
+                                  glm::vec3(0.5f, 0.2f, 0.5f));
+    }
+    parts.update();
+
+    std::vector<Vertex> vertices;
+    std::vector<GLushort> indices;
+    _appendCube(vertices, indices, parts.getWorldMatrix(body), parts.getNormalMatrix(body), BODY);
+    _appendCube(vertices, indices, parts.getWorldMatrix(roof), parts.getNormalMatrix(roof), ROOF);
+    for (TransformHierarchy::Node wheel : wheels) {
+        _appendCylinder(vertices, indices, parts.getWorldMatrix(wheel), parts.getNormalMatrix(wheel), WHEEL,
+                        0.5f, 1.0f, WHEEL_TESSELLATION, WHEEL_TESSELLATION);
+    }
+    _numIndices = static_cast<GLsizei>(indices.size());
+
+    std::vector<uint32_t> remap;
+    const MeshOptimizer::Report cacheReport = MeshOptimizer::optimize(indices.data(), indices.size(), vertices.size(),
+                                                                      &vertices[0].position.x, sizeof(Vertex) / sizeof(GLfloat), remap);
+    MeshOptimizer::remapVertices(remap, vertices);
+
+    glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+
+    glGenBuffers(1, &_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, material));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, wheelHub));
+
+    glGenBuffers(1, &_ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+    // the instances move around the stream buffer, draw() points these at them
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+    glEnableVertexAttribArray(5);
+    glVertexAttribDivisor(5, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // the material table never changes, so it is uploaded once
+    shaderProgram->useProgram();
+    const GLuint handle = shaderProgram->getShaderProgramHandle();
+    for (GLuint i = 0; i < NUM_MATERIALS; ++i) {
+        const std::string prefix = "vehicleMaterials[" + std::to_string(i) + "].";
+        glUniform3fv(glGetUniformLocation(handle, (prefix + "ambient").c_str()), 1, glm::value_ptr(MATERIALS[i].ambient));
+        glUniform3fv(glGetUniformLocation(handle, (prefix + "diffuse").c_str()), 1, glm::value_ptr(MATERIALS[i].diffuse));
+        glUniform3fv(glGetUniformLocation(handle, (prefix + "specular").c_str()), 1, glm::value_ptr(MATERIALS[i].specular));
+        glUniform1f(glGetUniformLocation(handle, (prefix + "shininess").c_str()), MATERIALS[i].shininess);
+    }
+    _mvpMatrixLocation = shaderProgram->getUniformLocation("mvpMatrix");
+
+    fprintf(stdout, "[INFO]: vehicle baked into %zu vertices and %d triangles\n", vertices.size(), getNumTriangles());
+    MeshOptimizer::logReport("vehicle", cacheReport);
+}
+
+void VehicleMesh::draw(const Vehicle::Pose* poses, size_t numPoses, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+                       StreamBuffer& stream) const {
+    if (!_vao) {
+        return;
+    }
+
+    GLsizei numInstances = 0;
+    for (size_t i = 0; i < numPoses; ++i) {
+        if (poses[i].visible) ++numInstances;
+    }
+    numInstances = std::min<GLsizei>(numInstances, MAX_INSTANCES);
+    GLintptr offset = 0;
+    Instance* instances = numInstances > 0
+            ? static_cast<Instance*>(stream.map(numInstances * sizeof(Instance), alignof(Instance), offset))
+            : nullptr;
+    if (!instances) {
+        return;
+    }
+    GLsizei written = 0;
+    for (size_t i = 0; i < numPoses && written < numInstances; ++i) {
+        if (poses[i].visible) {
+            instances[written++] = Instance{ glm::vec4(poses[i].position, poses[i].heading), poses[i].wheelRotation };
+        }
+    }
+    stream.unmap();
+
+    // each instance adds its own placement in the shader, only the camera is left for the uniform
+    GLStateCache& glState = GLStateCache::instance();
+    glState.uniform(_mvpMatrixLocation, projMtx * viewMtx);
+    glState.bindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, positionHeading)));
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, wheelRotation)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState.drawElementsInstanced(GL_TRIANGLES, _numIndices, GL_UNSIGNED_SHORT, nullptr, numInstances);
+}
+
+void VehicleMesh::cleanup() {
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vbo);
+    glDeleteBuffers(1, &_ebo);
+    _vao = _vbo = _ebo = 0;
+    _numIndices = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef VEHICLE_MESH_H
+#define VEHICLE_MESH_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Vehicle.h"
+#include "StreamBuffer.h"
+
+class CachedShaderProgram;
+
+/// \desc the vehicle baked into one indexed mesh. Body, roof and wheels are
+/// pre-transformed into vehicle space and each vertex carries an index into
+/// a material table held by the shader, so a whole vehicle is one draw.
+/// Every instance is a pose (position, heading, wheel rotation) read as a
+/// per-instance attribute; the wheels spin in the vertex shader.
+///
+/// The poses are written into the frame's StreamBuffer region and the
+/// instance attributes pointed at them.
+///
+/// Drawn with the VEHICLE_MESH variant of the lighting program:
+///   0 position, 1 normal, 2 material index, 3 wheel hub (w = 1 on wheels),
+///   4 instance position + heading, 5 instance wheel rotation
+class VehicleMesh {
+public:
+    /// \desc size of vehicleMaterials[] in lighting.vs.glsl
+    static constexpr GLuint NUM_MATERIALS = 3;
+    static constexpr GLuint MAX_INSTANCES = 64;
+
+    VehicleMesh();
+
+    /// \desc builds the mesh and uploads the material table to shaderProgram
+    void setup(const CachedShaderProgram* shaderProgram);
+    /// \desc draws every visible pose with one instanced draw; the VEHICLE_MESH program has to be bound
+    void draw(const Vehicle::Pose* poses, size_t numPoses, const glm::mat4& viewMtx, const glm::mat4& projMtx,
+              StreamBuffer& stream) const;
+    void cleanup();
+
+    GLsizei getNumTriangles() const { return _numIndices / 3; }
+
+private:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        GLfloat material;
+        glm::vec4 wheelHub;
+    };
+    struct Instance {
+        glm::vec4 positionHeading;
+        GLfloat wheelRotation;
+    };
+
+    /// \desc appends a shape, transformed by the given world and normal matrices
+    static void _appendCube(std::vector<Vertex>& vertices, std::vector<GLushort>& indices,
+                            const glm::mat4& worldMtx, const glm::mat3& normalMtx, GLfloat material);
+    static void _appendCylinder(std::vector<Vertex>& vertices, std::vector<GLushort>& indices,
+                                const glm::mat4& worldMtx, const glm::mat3& normalMtx, GLfloat material,
+                                GLfloat radius, GLfloat height, GLint stacks, GLint slices);
+
+    GLuint _vao;
+    GLuint _vbo;
+    GLuint _ebo;
+    GLsizei _numIndices;
+    GLint _mvpMatrixLocation;
+};
+
+#endif // VEHICLE_MESH_H
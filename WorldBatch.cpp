@@ -0,0 +1,369 @@
+#include "WorldBatch.h"
+#include "NetProtocol.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+    /// \desc Vehicle's bounding radius, speed and turn per tick
+    constexpr float VEHICLE_RADIUS = 1.0f;
+    constexpr float VEHICLE_SPEED = 0.2f;
+    constexpr float VEHICLE_TURN = 2.0f * 3.14159265f / 180.0f;
+    constexpr float TWO_PI = 2.0f * 3.14159265f;
+    /// \desc a marble's random drift per tick is up to this far along each axis
+    constexpr float MARBLE_WANDER = 0.05f;
+    /// \desc SimKernels::steerMarbles' turn per tick, as a cosine so the steering needs no acos
+    const float COS_MARBLE_TURN = std::cos(0.07f);
+    /// \desc keeps the divisions by a length finite without a branch
+    constexpr float MIN_LENGTH_SQUARED = 1e-12f;
+
+    /// \desc xorshift32 mapped to [0, 1); the top 24 bits go through a signed conversion, which SSE2 has
+    inline float nextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return static_cast<float>(static_cast<int32_t>(state >> 8)) * (1.0f / 16777216.0f);
+    }
+
+    inline bool overlaps(float dx, float dy, float dz, float radii) {
+        return dx * dx + dy * dy + dz * dz <= radii * radii;
+    }
+
+    // The loops over worlds. Restrict parameters, selects in place of branches and no calls
+    // but sqrt let the compiler give each SIMD lane its own world; CMakeLists.txt builds this
+    // file so that sqrt needs neither errno nor trap checks. Release builds (-O3) vectorize
+    // all four, -fopt-info-vec shows it.
+
+    /// \desc marks the worlds whose vehicle touches a blue sphere it has not taken yet
+    void touchBlueSphere(const float* __restrict vehicleX, const float* __restrict vehicleZ, float sphereX, float sphereZ,
+                         uint8_t* __restrict taken, uint8_t* __restrict events, size_t count) {
+        const float reach = (VEHICLE_RADIUS + WorldBatch::BLUE_SPHERE_RADIUS) * (VEHICLE_RADIUS + WorldBatch::BLUE_SPHERE_RADIUS);
+        for (size_t world = 0; world < count; ++world) {
+            const float dx = vehicleX[world] - sphereX, dz = vehicleZ[world] - sphereZ;
+            const uint8_t touched = dx * dx + dz * dz <= reach ? WorldBatch::EVENT_BLUE_SPHERE : 0;
+            events[world] |= touched & ~taken[world];
+            taken[world] |= touched;
+        }
+    }
+
+    /// \desc one marble of every world drifts, turns toward its vehicle by at most
+    /// SimKernels::steerMarbles' turn, rolls on and bounces off the walls
+    void steerMarble(float* __restrict x, float* __restrict z, float* __restrict directionX, float* __restrict directionZ,
+                     const float* __restrict vehicleX, const float* __restrict vehicleZ, uint32_t* __restrict random,
+                     size_t count) {
+        const float wall = WorldBatch::WORLD_SIZE / 2.0f - WorldBatch::MARBLE_RADIUS;
+        for (size_t world = 0; world < count; ++world) {
+            float marbleX = x[world] + (nextRandom(random[world]) - 0.5f) * 2.0f * MARBLE_WANDER;
+            float marbleZ = z[world] + (nextRandom(random[world]) - 0.5f) * 2.0f * MARBLE_WANDER;
+
+            float toX = vehicleX[world] - marbleX, toZ = vehicleZ[world] - marbleZ;
+            const float inverse = 1.0f / std::sqrt(toX * toX + toZ * toZ + MIN_LENGTH_SQUARED);
+            toX *= inverse;
+            toZ *= inverse;
+
+            // the full turn when the vehicle is further round than that, else right onto it,
+            // on whichever side it is
+            const float dx = directionX[world], dz = directionZ[world];
+            const float cosAngle = std::max(-1.0f, std::min(1.0f, dx * toX + dz * toZ));
+            const float cosTurn = std::max(cosAngle, COS_MARBLE_TURN);
+            const float sinTurn = std::copysign(std::sqrt(1.0f - cosTurn * cosTurn), dx * toZ - dz * toX);
+            const float newX = dx * cosTurn - dz * sinTurn;
+            const float newZ = dx * sinTurn + dz * cosTurn;
+
+            marbleX += newX * WorldBatch::MARBLE_STEP;
+            marbleZ += newZ * WorldBatch::MARBLE_STEP;
+            x[world] = marbleX;
+            z[world] = marbleZ;
+            directionX[world] = std::fabs(marbleX) > wall ? -newX : newX;
+            directionZ[world] = std::fabs(marbleZ) > wall ? -newZ : newZ;
+        }
+    }
+
+    /// \desc marbles a and b of every world exchange their heading along the line between
+    /// them where they touch, as SimKernels::collideMarbles; elsewhere the normal is zero
+    void collideMarblePair(const float* __restrict ax, const float* __restrict az,
+                           const float* __restrict bx, const float* __restrict bz,
+                           float* __restrict aDirectionX, float* __restrict aDirectionZ,
+                           float* __restrict bDirectionX, float* __restrict bDirectionZ, size_t count) {
+        const float touching = 4.0f * WorldBatch::MARBLE_RADIUS * WorldBatch::MARBLE_RADIUS;
+        for (size_t world = 0; world < count; ++world) {
+            const float dx = bx[world] - ax[world], dz = bz[world] - az[world];
+            const float distanceSquared = dx * dx + dz * dz;
+            const float weight = distanceSquared < touching && distanceSquared > 0.0f ? 1.0f : 0.0f;
+            const float inverse = weight / std::sqrt(distanceSquared + MIN_LENGTH_SQUARED);
+            const float normalX = dx * inverse, normalZ = dz * inverse;
+            const float dot = (bDirectionX[world] - aDirectionX[world]) * normalX +
+                              (bDirectionZ[world] - aDirectionZ[world]) * normalZ;
+            aDirectionX[world] += dot * normalX;
+            aDirectionZ[world] += dot * normalZ;
+            bDirectionX[world] -= dot * normalX;
+            bDirectionZ[world] -= dot * normalZ;
+        }
+    }
+
+    /// \desc marks the worlds whose vehicle one of their marbles touches; height is the
+    /// vehicle's above the marble's center
+    void catchVehicle(const float* __restrict x, const float* __restrict z,
+                      const float* __restrict vehicleX, const float* __restrict vehicleZ, float height,
+                      uint8_t* __restrict events, size_t count) {
+        const float reach = (VEHICLE_RADIUS + WorldBatch::MARBLE_RADIUS) * (VEHICLE_RADIUS + WorldBatch::MARBLE_RADIUS)
+                            - height * height;
+        for (size_t world = 0; world < count; ++world) {
+            const float dx = vehicleX[world] - x[world], dz = vehicleZ[world] - z[world];
+            events[world] |= dx * dx + dz * dz <= reach ? WorldBatch::EVENT_CAUGHT : 0;
+        }
+    }
+}
+
+bool WorldBatch::load(const char* levelPath, size_t numWorlds, uint32_t seed) {
+    if (!_level.open(levelPath)) {
+        fprintf(stderr, "[ERROR]: could not load level %s\n", levelPath);
+        return false;
+    }
+
+    // collision only needs the shapes, as in SessionWorld
+    _rectPlatforms.clear();
+    _diskPlatforms.clear();
+    for (size_t i = 0; i < _level.getNumPlatforms(); ++i) {
+        const LevelFormat::Platform& platform = _level.getPlatforms()[i];
+        if (platform.type == LevelFormat::PLATFORM_DISK) {
+            _diskPlatforms.push_back(DiskPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                   0, 0, 0, glm::vec3(1.0f), glm::vec3(0.0f), 0, platform.fallBuffer });
+        } else {
+            _rectPlatforms.push_back(RectPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                   0, 0, 0, glm::vec3(1.0f), glm::vec3(0.0f), 0, platform.fallBuffer });
+        }
+    }
+
+    _coins.clear();
+    _blueSpheres.clear();
+    for (size_t i = 0; i < _level.getNumPickups(); ++i) {
+        const LevelFormat::Pickup& pickup = _level.getPickups()[i];
+        (pickup.type == LevelFormat::PICKUP_COIN ? _coins : _blueSpheres).push_back(glm::make_vec3(pickup.position));
+    }
+    // FPEngine collects the back of its list first
+    std::reverse(_coins.begin(), _coins.end());
+    _marbleSpawns.clear();
+    bool vehicleSpawned = false;
+    for (size_t i = 0; i < _level.getNumSpawns(); ++i) {
+        const LevelFormat::Spawn& spawn = _level.getSpawns()[i];
+        if (spawn.type == LevelFormat::SPAWN_MARBLE) {
+            _marbleSpawns.push_back(glm::make_vec3(spawn.position));
+        } else if (spawn.type == LevelFormat::SPAWN_VEHICLE && !vehicleSpawned) {
+            _vehicleSpawnPosition = glm::make_vec3(spawn.position);
+            _vehicleSpawnHeading = spawn.heading;
+            vehicleSpawned = true;
+        }
+    }
+
+    _numWorlds = numWorlds;
+    _numWorldSteps = 0;
+    _vehicleX.assign(numWorlds, 0.0f);
+    _vehicleZ.assign(numWorlds, 0.0f);
+    _vehicleHeading.assign(numWorlds, 0.0f);
+    _nextCoin.assign(numWorlds, 0);
+    _random.resize(numWorlds);
+    _actions.assign(numWorlds, 0);
+    _events.assign(numWorlds, 0);
+    _observations.assign(numWorlds * NUM_OBSERVATIONS, 0.0f);
+    const size_t numMarbles = _marbleSpawns.size() * numWorlds;
+    _marbleX.assign(numMarbles, 0.0f);
+    _marbleZ.assign(numMarbles, 0.0f);
+    _marbleDirectionX.assign(numMarbles, 0.0f);
+    _marbleDirectionZ.assign(numMarbles, 0.0f);
+    _blueSphereTaken.assign(_blueSpheres.size() * numWorlds, 0);
+
+    for (size_t world = 0; world < numWorlds; ++world) {
+        // xorshift must not start at zero
+        _random[world] = (seed ^ static_cast<uint32_t>(world * 2654435761u)) | 1u;
+        reset(world);
+    }
+
+    fprintf(stdout, "[INFO]: %zu worlds of %zu marbles, %zu coins and %zu blue spheres on %s\n", numWorlds,
+            _marbleSpawns.size(), _coins.size(), _blueSpheres.size(), levelPath);
+    return true;
+}
+
+void WorldBatch::reset(size_t world) {
+    _resetVehicle(world);
+    _resetMarbles(world);
+    _nextCoin[world] = 0;
+    for (size_t sphere = 0; sphere < _blueSpheres.size(); ++sphere) {
+        _blueSphereTaken[sphere * _numWorlds + world] = 0;
+    }
+    _events[world] = 0;
+    _observe(world, world + 1);
+}
+
+void WorldBatch::_resetVehicle(size_t world) {
+    _vehicleX[world] = _vehicleSpawnPosition.x;
+    _vehicleZ[world] = _vehicleSpawnPosition.z;
+    _vehicleHeading[world] = _vehicleSpawnHeading;
+}
+
+void WorldBatch::_resetMarbles(size_t world) {
+    for (size_t marble = 0; marble < _marbleSpawns.size(); ++marble) {
+        const size_t i = marble * _numWorlds + world;
+        _marbleX[i] = _marbleSpawns[marble].x;
+        _marbleZ[i] = _marbleSpawns[marble].z;
+        // heading for the vehicle spawn, a marble already on it heads off along +z
+        const float dx = _vehicleSpawnPosition.x - _marbleX[i], dz = _vehicleSpawnPosition.z - _marbleZ[i];
+        const float length = std::sqrt(dx * dx + dz * dz);
+        _marbleDirectionX[i] = length > 0.0f ? dx / length : 0.0f;
+        _marbleDirectionZ[i] = length > 0.0f ? dz / length : 1.0f;
+    }
+}
+
+void WorldBatch::step(JobSystem& jobs) {
+    // worlds that were cleared last step start over first
+    for (size_t world = 0; world < _numWorlds; ++world) {
+        if (_events[world] & EVENT_CLEARED) reset(world);
+    }
+    jobs.parallelFor(_numWorlds, WORLDS_PER_JOB, [this](size_t begin, size_t end) {
+        _stepWorlds(begin, end);
+    });
+    _numWorldSteps += _numWorlds;
+}
+
+void WorldBatch::_stepWorlds(size_t begin, size_t end) {
+    const size_t stride = _numWorlds;
+    const size_t numMarbles = _marbleSpawns.size();
+    const float vehicleY = _vehicleSpawnPosition.y;
+    const size_t count = end - begin;
+    const float* vehicleX = _vehicleX.data() + begin;
+    const float* vehicleZ = _vehicleZ.data() + begin;
+    uint8_t* worldEvents = _events.data() + begin;
+
+    // pickups, at where the vehicle was when the tick began; with no jumps they are
+    // measured in the ground plane, so the coins up where a jump goes still count
+    std::fill(worldEvents, worldEvents + count, static_cast<uint8_t>(0));
+    for (size_t sphere = 0; sphere < _blueSpheres.size(); ++sphere) {
+        touchBlueSphere(vehicleX, vehicleZ, _blueSpheres[sphere].x, _blueSpheres[sphere].z,
+                        _blueSphereTaken.data() + sphere * stride + begin, worldEvents, count);
+    }
+    // each world waits on a different coin, a gather SSE2 does not have; this one stays scalar
+    for (size_t world = begin; world < end; ++world) {
+        if (_nextCoin[world] < _coins.size()) {
+            const glm::vec3& coin = _coins[_nextCoin[world]];
+            if (overlaps(_vehicleX[world] - coin.x, 0.0f, _vehicleZ[world] - coin.z, VEHICLE_RADIUS + COIN_RADIUS)) {
+                _events[world] |= EVENT_COIN;
+                if (++_nextCoin[world] == _coins.size()) _events[world] |= EVENT_CLEARED;
+            }
+        }
+    }
+
+    // the marbles steer for the vehicle, then touching ones exchange their heading
+    for (size_t marble = 0; marble < numMarbles; ++marble) {
+        const size_t row = marble * stride + begin;
+        steerMarble(_marbleX.data() + row, _marbleZ.data() + row, _marbleDirectionX.data() + row,
+                    _marbleDirectionZ.data() + row, vehicleX, vehicleZ, _random.data() + begin, count);
+    }
+    for (size_t i = 0; i < numMarbles; ++i) {
+        for (size_t j = i + 1; j < numMarbles; ++j) {
+            const size_t a = i * stride + begin, b = j * stride + begin;
+            collideMarblePair(_marbleX.data() + a, _marbleZ.data() + a, _marbleX.data() + b, _marbleZ.data() + b,
+                              _marbleDirectionX.data() + a, _marbleDirectionZ.data() + a,
+                              _marbleDirectionX.data() + b, _marbleDirectionZ.data() + b, count);
+        }
+    }
+
+    // a marble touching the vehicle where it was catches it
+    for (size_t marble = 0; marble < numMarbles; ++marble) {
+        const size_t row = marble * stride + begin;
+        catchVehicle(_marbleX.data() + row, _marbleZ.data() + row, vehicleX, vehicleZ, vehicleY - MARBLE_RADIUS,
+                     worldEvents, count);
+    }
+
+    // the vehicle drives under its buttons, the movement of SessionWorld::stepVehicle; the prop grid
+    // and platform lookups keep this loop scalar
+    for (size_t world = begin; world < end; ++world) {
+        const uint8_t buttons = _actions[world];
+        float& heading = _vehicleHeading[world];
+        float moveX = 0.0f, moveZ = 0.0f;
+        if (buttons & NetProtocol::BUTTON_FORWARD) {
+            moveX += std::sin(heading) * VEHICLE_SPEED;
+            moveZ += std::cos(heading) * VEHICLE_SPEED;
+        }
+        if (buttons & NetProtocol::BUTTON_BACK) {
+            moveX -= std::sin(heading) * VEHICLE_SPEED;
+            moveZ -= std::cos(heading) * VEHICLE_SPEED;
+        }
+        if (buttons & NetProtocol::BUTTON_LEFT) {
+            heading += VEHICLE_TURN;
+            if (heading >= TWO_PI) heading -= TWO_PI;
+        }
+        if (buttons & NetProtocol::BUTTON_RIGHT) {
+            heading -= VEHICLE_TURN;
+            if (heading < 0.0f) heading += TWO_PI;
+        }
+
+        glm::vec3 newPosition(_vehicleX[world] + moveX, vehicleY, _vehicleZ[world] + moveZ);
+        glm::vec3 propPosition;
+        if (SimKernels::findPropCollision(_level, newPosition, VEHICLE_RADIUS, propPosition)) {
+            newPosition -= glm::vec3(moveX, 0.0f, moveZ) * 1.5f;
+        }
+        const bool onPlatform = SimKernels::isOnPlatform(newPosition, _diskPlatforms.data(), _diskPlatforms.size(),
+                                                         _rectPlatforms.data(), _rectPlatforms.size());
+
+        // caught or fallen, the vehicle starts over; caught, the marbles do too, as after FPEngine's blink
+        uint8_t& events = _events[world];
+        if (!onPlatform && !(events & EVENT_CAUGHT)) {
+            events |= EVENT_FELL;
+        }
+        if (events & (EVENT_CAUGHT | EVENT_FELL)) {
+            _resetVehicle(world);
+        } else {
+            _vehicleX[world] = newPosition.x;
+            _vehicleZ[world] = newPosition.z;
+        }
+        if (events & (EVENT_CAUGHT | EVENT_BLUE_SPHERE)) {
+            _resetMarbles(world);
+        }
+    }
+
+    _observe(begin, end);
+}
+
+void WorldBatch::_observe(size_t begin, size_t end) {
+    const size_t stride = _numWorlds;
+    for (size_t world = begin; world < end; ++world) {
+        float* observation = &_observations[world * NUM_OBSERVATIONS];
+        const float x = _vehicleX[world], z = _vehicleZ[world];
+        observation[OBS_VEHICLE_X] = x;
+        observation[OBS_VEHICLE_Z] = z;
+        observation[OBS_HEADING_SIN] = std::sin(_vehicleHeading[world]);
+        observation[OBS_HEADING_COS] = std::cos(_vehicleHeading[world]);
+
+        const bool coinsLeft = _nextCoin[world] < _coins.size();
+        observation[OBS_COIN_DX] = coinsLeft ? _coins[_nextCoin[world]].x - x : 0.0f;
+        observation[OBS_COIN_DZ] = coinsLeft ? _coins[_nextCoin[world]].z - z : 0.0f;
+        observation[OBS_COINS_LEFT] = static_cast<float>(_coins.size() - _nextCoin[world]);
+
+        float nearestDistance = -1.0f;
+        observation[OBS_MARBLE_DX] = observation[OBS_MARBLE_DZ] = 0.0f;
+        for (size_t marble = 0; marble < _marbleSpawns.size(); ++marble) {
+            const float dx = _marbleX[marble * stride + world] - x, dz = _marbleZ[marble * stride + world] - z;
+            const float distance = dx * dx + dz * dz;
+            if (nearestDistance < 0.0f || distance < nearestDistance) {
+                nearestDistance = distance;
+                observation[OBS_MARBLE_DX] = dx;
+                observation[OBS_MARBLE_DZ] = dz;
+            }
+        }
+
+        nearestDistance = -1.0f;
+        observation[OBS_BLUE_SPHERE_DX] = observation[OBS_BLUE_SPHERE_DZ] = 0.0f;
+        for (size_t sphere = 0; sphere < _blueSpheres.size(); ++sphere) {
+            if (_blueSphereTaken[sphere * stride + world]) continue;
+            const float dx = _blueSpheres[sphere].x - x, dz = _blueSpheres[sphere].z - z;
+            const float distance = dx * dx + dz * dz;
+            if (nearestDistance < 0.0f || distance < nearestDistance) {
+                nearestDistance = distance;
+                observation[OBS_BLUE_SPHERE_DX] = dx;
+                observation[OBS_BLUE_SPHERE_DZ] = dz;
+            }
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef WORLD_BATCH_H
+#define WORLD_BATCH_H
+
+#include "JobSystem.h"
+#include "LevelFile.h"
+#include "SimKernels.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// \desc many independent single player games on one level, stepped together,
+/// for bots and tuning runs that want thousands of sessions without a window.
+///
+/// Each world has its own vehicle, marbles, coins and blue spheres and plays by
+/// the rules of FPEngine's tick: the next coin, last in the level first, is
+/// collected on contact, a blue sphere sends the marbles back to their spawns,
+/// and a vehicle caught by a marble or off a platform starts over at the spawn
+/// point. Like SessionWorld it skips the fall and blink animations and the
+/// jumps, so pickups are collected by their distance in the ground plane, and
+/// the marbles steer in the ground plane they are kept on anyway. A world that
+/// has collected its last coin starts over on the next step.
+///
+/// State is kept as structure of arrays. Per marble arrays hold the marble of
+/// every world side by side, element marble * getNumWorlds() + world, so the
+/// inner loops run over worlds. The marble steering, the marble collisions and
+/// the blue sphere and catch tests are written so that the compiler vectorizes
+/// them, a world per SIMD lane, in Release builds; the coin test, the vehicle's
+/// move through the prop grid and the observations stay scalar. step() hands
+/// ranges of WORLDS_PER_JOB worlds to the job system.
+///
+/// Actions and observations are flat arrays indexed by world: a
+/// NetProtocol::Button mask per world in, NUM_OBSERVATIONS floats and an
+/// Event mask per world out.
+class WorldBatch {
+public:
+    /// \desc matches FPEngine::WORLD_SIZE, the marbles bounce off its walls
+    static constexpr float WORLD_SIZE = 300.0f;
+    /// \desc matches Marble::RADIUS
+    static constexpr float MARBLE_RADIUS = 0.5f;
+    /// \desc how far a marble rolls in a tick, FPEngine's MARBLE_SPEED * 0.35
+    static constexpr float MARBLE_STEP = 0.035f;
+    static constexpr float COIN_RADIUS = 1.0f;
+    static constexpr float BLUE_SPHERE_RADIUS = 0.5f;
+    /// \desc a few cache lines of floats per array, so neighbouring jobs seldom write the same line
+    static constexpr size_t WORLDS_PER_JOB = 64;
+
+    /// \desc the floats of a world's observation, offsets are from the vehicle to the thing
+    /// in the ground plane and 0 when there is none
+    enum Observation : size_t {
+        OBS_VEHICLE_X,
+        OBS_VEHICLE_Z,
+        OBS_HEADING_SIN,
+        OBS_HEADING_COS,
+        OBS_COIN_DX,
+        OBS_COIN_DZ,
+        OBS_MARBLE_DX,
+        OBS_MARBLE_DZ,
+        OBS_BLUE_SPHERE_DX,
+        OBS_BLUE_SPHERE_DZ,
+        OBS_COINS_LEFT,
+        NUM_OBSERVATIONS
+    };
+
+    /// \desc what happened to a world during the last step
+    enum Event : uint8_t {
+        EVENT_COIN = 1 << 0,
+        EVENT_BLUE_SPHERE = 1 << 1,
+        EVENT_CAUGHT = 1 << 2,
+        EVENT_FELL = 1 << 3,
+        /// \desc the last coin was collected, the world is reset before the next step
+        EVENT_CLEARED = 1 << 4
+    };
+
+    /// \desc numWorlds fresh worlds on the level; seed picks the marbles' wander
+    bool load(const char* levelPath, size_t numWorlds, uint32_t seed);
+    const LevelFile& getLevel() const { return _level; }
+    size_t getNumWorlds() const { return _numWorlds; }
+    size_t getNumMarbles() const { return _marbleSpawns.size(); }
+
+    /// \desc puts a world back to how load() left it
+    void reset(size_t world);
+
+    /// \desc one tick of every world under getActions(), spread over the job system
+    void step(JobSystem& jobs);
+
+    /// \desc a NetProtocol::Button mask per world, the next step reads them
+    uint8_t* getActions() { return _actions.data(); }
+    /// \desc an Event mask per world, from the last step
+    const uint8_t* getEvents() const { return _events.data(); }
+    /// \desc NUM_OBSERVATIONS floats per world, world after world, as of the last step or reset
+    const float* getObservations() const { return _observations.data(); }
+
+    /// \desc world steps taken so far, every world counted once per step
+    uint64_t getNumWorldSteps() const { return _numWorldSteps; }
+
+private:
+    LevelFile _level;
+    std::vector<RectPlatform> _rectPlatforms;
+    std::vector<DiskPlatform> _diskPlatforms;
+    glm::vec3 _vehicleSpawnPosition = glm::vec3(0.0f);
+    float _vehicleSpawnHeading = 0.0f;
+    /// \desc in the order they are collected
+    std::vector<glm::vec3> _coins;
+    std::vector<glm::vec3> _blueSpheres;
+    std::vector<glm::vec3> _marbleSpawns;
+
+    size_t _numWorlds = 0;
+    uint64_t _numWorldSteps = 0;
+
+    // one per world; the vehicles never leave the spawn's height
+    std::vector<float> _vehicleX;
+    std::vector<float> _vehicleZ;
+    std::vector<float> _vehicleHeading;
+    std::vector<uint32_t> _nextCoin;
+    /// \desc xorshift state of the marbles' wander
+    std::vector<uint32_t> _random;
+    std::vector<uint8_t> _actions;
+    std::vector<uint8_t> _events;
+    std::vector<float> _observations;
+
+    // one per marble or blue sphere of every world, world innermost
+    std::vector<float> _marbleX;
+    std::vector<float> _marbleZ;
+    std::vector<float> _marbleDirectionX;
+    std::vector<float> _marbleDirectionZ;
+    std::vector<uint8_t> _blueSphereTaken;
+
+    /// \desc a job's share of step()
+    void _stepWorlds(size_t begin, size_t end);
+    void _resetVehicle(size_t world);
+    void _resetMarbles(size_t world);
+    void _observe(size_t begin, size_t end);
+};
+
+#endif // WORLD_BATCH_H
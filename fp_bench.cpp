@@ -0,0 +1,406 @@
+// fp_bench: times the simulation and geometry kernels at several entity counts.
+//
+//   fp_bench [--filter TEXT] [--min-time SECONDS] [--label TEXT] [--json FILE]
+//
+// Every benchmark runs once per count. One op is one call of the kernel, or
+// one batch of queries for the kernels that answer a single question; items
+// are what the op processed (marbles, queries, samples, triangles). An op is
+// repeated until a run lasts min-time (0.2 s by default) and the fastest of
+// three runs is kept. Allocations per op are what the kernel asked of the heap
+// once warmed up.
+//
+// The table goes to stdout and the same numbers to fp_bench.json, labelled so
+// runs on two commits can be put side by side. The prop collision benchmark
+// maps stress_s/m/l/xl.fplevel from the working directory (make stress_levels,
+// which building fp_bench does), the world batch grey_havens.fplevel.
+
+#include "AllocationTracker.h"
+#include "JobSystem.h"
+#include "LevelFile.h"
+#include "MeshOptimizer.h"
+#include "PlatformGeometry.h"
+#include "SimKernels.h"
+#include "WorldBatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265f
+#endif
+
+#ifndef FP_TRACK_ALLOCATIONS
+#error "fp_bench reports allocations, build it with FP_TRACK_ALLOCATIONS defined"
+#endif
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /// \desc runs kept per benchmark, the fastest one is reported
+    constexpr int REPETITIONS = 3;
+    /// \desc queries per op for the kernels that answer one position at a time
+    constexpr size_t QUERIES_PER_OP = 256;
+    /// \desc FPEngine::MARBLE_SPEED * 0.35 and Marble::RADIUS
+    constexpr float MARBLE_STEP = 0.035f;
+    constexpr float MARBLE_RADIUS = 0.5f;
+    constexpr float VEHICLE_RADIUS = 1.0f;
+    /// \desc FPEngine::MARBLES_PER_JOB
+    constexpr size_t MARBLES_PER_JOB = 256;
+
+    /// \desc keeps the compiler from dropping a result nobody reads
+    volatile float sink;
+
+    /// \desc xorshift, the same seed gives the same inputs on every run
+    class BenchRandom {
+    public:
+        explicit BenchRandom(uint32_t seed) : _state(seed ? seed : 1) {}
+        float next() {
+            _state ^= _state << 13;
+            _state ^= _state >> 17;
+            _state ^= _state << 5;
+            return static_cast<float>(_state >> 8) / static_cast<float>(1 << 24);
+        }
+        float range(float low, float high) { return low + (high - low) * next(); }
+    private:
+        uint32_t _state;
+    };
+
+    struct Options {
+        const char* filter = nullptr;
+        double minTime = 0.2;
+        const char* label = "";
+        const char* jsonPath = "fp_bench.json";
+    };
+
+    struct Result {
+        std::string name;
+        size_t count;
+        uint64_t iterations;
+        double nanosecondsPerOp;
+        double itemsPerSecond;
+        double allocationsPerOp;
+        double bytesPerOp;
+    };
+
+    class Harness {
+    public:
+        explicit Harness(const Options& options) : _options(options) {
+            fprintf(stdout, "%-26s %8s %14s %14s %10s %12s\n", "benchmark", "count", "ns/op", "items/s", "allocs/op", "bytes/op");
+        }
+
+        /// \desc times op, which processes itemsPerOp items on every call
+        template<typename Op>
+        void run(const char* name, size_t count, size_t itemsPerOp, Op op) {
+            if (_options.filter && !strstr(name, _options.filter)) {
+                return;
+            }
+
+            // the first call fills caches and grows buffers, it is not what steady state costs
+            op();
+
+            uint64_t iterations = 1;
+            double seconds = _time(op, iterations);
+            while (seconds < _options.minTime) {
+                const double scale = seconds > 0.0 ? _options.minTime / seconds * 1.2 : 10.0;
+                iterations = std::max(iterations + 1, static_cast<uint64_t>(static_cast<double>(iterations) * std::min(scale, 10.0)));
+                seconds = _time(op, iterations);
+            }
+
+            AllocationTracker::instance().takeCounts();
+            double fastest = seconds;
+            {
+                AllocationTracker::Scope scope;
+                for (int i = 0; i < REPETITIONS; ++i) {
+                    fastest = std::min(fastest, _time(op, iterations));
+                }
+            }
+            const AllocationTracker::Counts counts = AllocationTracker::instance().takeCounts();
+            const double ops = static_cast<double>(iterations) * REPETITIONS;
+
+            Result result{ name, count, iterations,
+                           fastest * 1e9 / static_cast<double>(iterations),
+                           static_cast<double>(itemsPerOp) * static_cast<double>(iterations) / fastest,
+                           static_cast<double>(counts.allocations) / ops,
+                           static_cast<double>(counts.bytes) / ops };
+            fprintf(stdout, "%-26s %8zu %14.1f %14.4g %10.2f %12.1f\n", result.name.c_str(), result.count,
+                    result.nanosecondsPerOp, result.itemsPerSecond, result.allocationsPerOp, result.bytesPerOp);
+            fflush(stdout);
+            _results.push_back(result);
+        }
+
+        bool writeJson() const {
+            FILE* file = fopen(_options.jsonPath, "w");
+            if (!file) {
+                fprintf(stderr, "[ERROR]: could not open %s\n", _options.jsonPath);
+                return false;
+            }
+            fprintf(file, "{\n  \"label\": \"");
+            for (const char* c = _options.label; *c; ++c) {
+                if (*c == '"' || *c == '\\') fputc('\\', file);
+                if (static_cast<unsigned char>(*c) >= 0x20) fputc(*c, file);
+            }
+            fprintf(file, "\",\n  \"min_time\": %g,\n  \"benchmarks\": [\n", _options.minTime);
+            for (size_t i = 0; i < _results.size(); ++i) {
+                const Result& result = _results[i];
+                fprintf(file, "    { \"name\": \"%s\", \"count\": %zu, \"iterations\": %llu, \"ns_per_op\": %.3f, "
+                              "\"items_per_second\": %.6g, \"allocations_per_op\": %.3f, \"bytes_per_op\": %.1f }%s\n",
+                        result.name.c_str(), result.count, static_cast<unsigned long long>(result.iterations),
+                        result.nanosecondsPerOp, result.itemsPerSecond, result.allocationsPerOp, result.bytesPerOp,
+                        i + 1 < _results.size() ? "," : "");
+            }
+            fprintf(file, "  ]\n}\n");
+            fclose(file);
+            fprintf(stdout, "[INFO]: wrote %zu results to %s\n", _results.size(), _options.jsonPath);
+            return true;
+        }
+
+    private:
+        template<typename Op>
+        static double _time(Op& op, uint64_t iterations) {
+            const Clock::time_point start = Clock::now();
+            for (uint64_t i = 0; i < iterations; ++i) {
+                op();
+            }
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        Options _options;
+        std::vector<Result> _results;
+    };
+
+    /// \desc count marbles at the density the stress levels spawn them, heading anywhere
+    void scatterMarbles(size_t count, std::vector<glm::vec3>& locations, std::vector<glm::vec3>& directions) {
+        BenchRandom random(static_cast<uint32_t>(count));
+        const float halfExtent = std::max(10.0f, std::sqrt(static_cast<float>(count)) * 2.0f);
+        locations.resize(count);
+        directions.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            locations[i] = glm::vec3(random.range(-halfExtent, halfExtent), MARBLE_RADIUS, random.range(-halfExtent, halfExtent));
+            directions[i] = glm::normalize(glm::vec3(random.range(-1.0f, 1.0f), 0.0f, random.range(-1.0f, 1.0f)) + glm::vec3(1e-3f, 0.0f, 0.0f));
+        }
+    }
+
+    void benchMarbles(Harness& harness) {
+        for (size_t count : { 100, 1000, 10000 }) {
+            std::vector<glm::vec3> locations, directions;
+            scatterMarbles(count, locations, directions);
+            const glm::vec3 target(0.0f, 0.0f, 0.0f);
+            harness.run("moveMarbles", count, count, [&] {
+                SimKernels::steerMarbles(locations.data(), directions.data(), count, target, MARBLE_STEP, MARBLE_RADIUS);
+            });
+        }
+        // the same steering spread over every hardware thread, as FPEngine::_moveMarbles does it
+        JobSystem jobs;
+        for (size_t count : { 100, 1000, 10000 }) {
+            std::vector<glm::vec3> locations, directions;
+            scatterMarbles(count, locations, directions);
+            const glm::vec3 target(0.0f, 0.0f, 0.0f);
+            harness.run("moveMarblesJobs", count, count, [&] {
+                jobs.parallelFor(count, MARBLES_PER_JOB, [&](size_t begin, size_t end) {
+                    SimKernels::steerMarbles(locations.data() + begin, directions.data() + begin, end - begin,
+                                             target, MARBLE_STEP, MARBLE_RADIUS);
+                });
+            });
+        }
+        for (size_t count : { 100, 1000, 10000 }) {
+            std::vector<glm::vec3> locations, directions;
+            scatterMarbles(count, locations, directions);
+            harness.run("collideMarblesWithMarbles", count, count, [&] {
+                SimKernels::collideMarbles(locations.data(), directions.data(), count, MARBLE_RADIUS);
+            });
+        }
+    }
+
+    void benchPlatforms(Harness& harness) {
+        for (size_t count : { 16, 256, 4096 }) {
+            // half disks and half rects on a grid, the queries land on about half of them
+            BenchRandom random(static_cast<uint32_t>(count));
+            const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+            const float pitch = 100.0f;
+            std::vector<DiskPlatform> disks;
+            std::vector<RectPlatform> rects;
+            for (size_t i = 0; i < count; ++i) {
+                const glm::vec3 position(static_cast<float>(i % side) * pitch, 0.0f, static_cast<float>(i / side) * pitch);
+                if (i % 2 == 0) {
+                    DiskPlatform disk{};
+                    disk.position = position;
+                    disk.inner_radius = random.range(5.0f, 15.0f);
+                    disk.outer_radius = disk.inner_radius + random.range(10.0f, 30.0f);
+                    disk.fallBuffer = 1.0f;
+                    disks.push_back(disk);
+                } else {
+                    RectPlatform rect{};
+                    rect.position = position;
+                    rect.lengthX = random.range(20.0f, 60.0f);
+                    rect.lengthZ = random.range(20.0f, 60.0f);
+                    rect.fallBuffer = 1.0f;
+                    rects.push_back(rect);
+                }
+            }
+            std::vector<glm::vec3> queries(QUERIES_PER_OP);
+            for (glm::vec3& query : queries) {
+                query = glm::vec3(random.range(-pitch * 0.5f, side * pitch), 0.0f, random.range(-pitch * 0.5f, side * pitch));
+            }
+            harness.run("isOnPlatform", count, QUERIES_PER_OP, [&] {
+                size_t on = 0;
+                for (const glm::vec3& query : queries) {
+                    on += SimKernels::isOnPlatform(query, disks.data(), disks.size(), rects.data(), rects.size());
+                }
+                sink = static_cast<float>(on);
+            });
+        }
+    }
+
+    void benchPropCollisions(Harness& harness) {
+        for (const char* path : { "stress_s.fplevel", "stress_m.fplevel", "stress_l.fplevel", "stress_xl.fplevel" }) {
+            LevelFile level;
+            if (!level.open(path)) {
+                fprintf(stderr, "[ERROR]: skipping isMovementValid on %s, build it with make stress_levels\n", path);
+                continue;
+            }
+            // the vehicle only ever drives over the grid, so the queries stay inside it too
+            const LevelFormat::Grid& grid = level.getHeader().grid;
+            BenchRandom random(static_cast<uint32_t>(level.getNumProps()));
+            std::vector<glm::vec3> queries(QUERIES_PER_OP);
+            for (glm::vec3& query : queries) {
+                query = glm::vec3(random.range(grid.originX, grid.originX + grid.cellsX * grid.cellSize), 0.0f,
+                                  random.range(grid.originZ, grid.originZ + grid.cellsZ * grid.cellSize));
+            }
+            harness.run("isMovementValid", level.getNumProps(), QUERIES_PER_OP, [&] {
+                size_t hits = 0;
+                glm::vec3 propPosition;
+                for (const glm::vec3& query : queries) {
+                    hits += SimKernels::findPropCollision(level, query, VEHICLE_RADIUS, propPosition);
+                }
+                sink = static_cast<float>(hits);
+            });
+        }
+    }
+
+    void benchBezier(Harness& harness) {
+        const glm::vec3 p0(0.0f, 0.0f, 0.0f), p1(5.0f, 10.0f, 0.0f), p2(10.0f, 10.0f, 5.0f), p3(15.0f, 0.0f, 5.0f);
+        for (size_t count : { 64, 1024, 16384 }) {
+            const float step = 1.0f / static_cast<float>(count - 1);
+            harness.run("evalBezierCurve", count, count, [&] {
+                glm::vec3 sum(0.0f);
+                for (size_t i = 0; i < count; ++i) {
+                    sum += SimKernels::evalBezierCurve(p0, p1, p2, p3, static_cast<float>(i) * step);
+                }
+                sink = sum.x + sum.y + sum.z;
+            });
+        }
+    }
+
+    void benchPlatformGeometry(Harness& harness) {
+        for (int segments : { 16, 100, 1000 }) {
+            LevelFormat::Platform disk{};
+            disk.size[0] = 10.0f;
+            disk.size[1] = 40.0f;
+            PlatformGeometry::Mesh mesh;
+            std::vector<LevelFormat::Vertex> vertices;
+            std::vector<uint16_t> indices;
+            harness.run("generateDisk", static_cast<size_t>(segments), static_cast<size_t>(segments) * 2, [&] {
+                vertices.clear();
+                indices.clear();
+                PlatformGeometry::generateDisk(disk, segments, mesh);
+                PlatformGeometry::pack(mesh, disk, vertices, indices);
+            });
+        }
+    }
+
+    void benchMeshOptimizer(Harness& harness) {
+        // a sphere in plain stack by slice order, like LODMesh generates it
+        for (uint32_t tessellation : { 16u, 64u, 256u }) {
+            std::vector<float> positions;
+            std::vector<uint32_t> sphereIndices;
+            for (uint32_t stack = 0; stack <= tessellation; ++stack) {
+                const float phi = static_cast<float>(stack) / tessellation * static_cast<float>(M_PI);
+                for (uint32_t slice = 0; slice <= tessellation; ++slice) {
+                    const float theta = static_cast<float>(slice) / tessellation * 2.0f * static_cast<float>(M_PI);
+                    positions.insert(positions.end(), { std::sin(phi) * std::cos(theta), -std::cos(phi), std::sin(phi) * std::sin(theta) });
+                    if (stack < tessellation && slice < tessellation) {
+                        const uint32_t current = stack * (tessellation + 1) + slice, next = current + tessellation + 1;
+                        sphereIndices.insert(sphereIndices.end(), { current, next, current + 1, current + 1, next, next + 1 });
+                    }
+                }
+            }
+            const size_t numVertices = positions.size() / 3;
+            std::vector<uint32_t> indices;
+            std::vector<uint32_t> remap;
+            harness.run("MeshOptimizer::optimize", numVertices, sphereIndices.size() / 3, [&] {
+                indices = sphereIndices;
+                sink = MeshOptimizer::optimize(indices.data(), indices.size(), numVertices, positions.data(), 3, remap).acmrAfter();
+            });
+        }
+    }
+
+    void benchWorldBatch(Harness& harness) {
+        // every world drives under its own fixed buttons, so some fall, some get caught and some
+        // go round in circles; one item is one world stepped once
+        for (bool allThreads : { false, true }) {
+            JobSystem jobs(allThreads ? 0 : 1);
+            for (size_t count : { 64, 1024, 8192 }) {
+                WorldBatch batch;
+                if (!batch.load("grey_havens.fplevel", count, static_cast<uint32_t>(count))) {
+                    fprintf(stderr, "[ERROR]: skipping WorldBatch, build grey_havens.fplevel with make levels\n");
+                    return;
+                }
+                BenchRandom random(static_cast<uint32_t>(count));
+                for (size_t world = 0; world < count; ++world) {
+                    batch.getActions()[world] = static_cast<uint8_t>(random.range(0.0f, 16.0f));
+                }
+                // on one thread items/s is world steps per second per core
+                harness.run(allThreads ? "WorldBatchJobs" : "WorldBatch::step", count, count, [&] {
+                    batch.step(jobs);
+                });
+            }
+        }
+    }
+
+    bool parseArguments(int argc, char* argv[], Options& options) {
+        for (int i = 1; i < argc; i += 2) {
+            if (i + 1 >= argc) {
+                return false;
+            }
+            const char* arg = argv[i];
+            const char* value = argv[i + 1];
+            if (strcmp(arg, "--filter") == 0) {
+                options.filter = value;
+            } else if (strcmp(arg, "--min-time") == 0 && atof(value) > 0.0) {
+                options.minTime = atof(value);
+            } else if (strcmp(arg, "--label") == 0) {
+                options.label = value;
+            } else if (strcmp(arg, "--json") == 0) {
+                options.jsonPath = value;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--filter TEXT] [--min-time SECONDS] [--label TEXT] [--json FILE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Harness harness(options);
+    benchMarbles(harness);
+    benchPlatforms(harness);
+    benchPropCollisions(harness);
+    benchBezier(harness);
+    benchPlatformGeometry(harness);
+    benchMeshOptimizer(harness);
+    benchWorldBatch(harness);
+    return harness.writeJson() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
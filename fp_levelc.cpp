@@ -0,0 +1,498 @@
+// fp_levelc: compiles a text level description into the binary LevelFile maps.
+//
+//   fp_levelc <input.level> <output.fplevel>
+//   fp_levelc --stress S|M|L|XL [--seed N] [--platforms N] [--props N]
+//             [--coins N] [--enemies N] <output.fplevel>
+//
+// The second form generates a large seeded world for scale testing instead;
+// the preset picks the sizes and any of them can be overridden.
+//
+// One statement per line, # starts a comment, angles are in degrees:
+//   disk   x y z  innerRadius outerRadius  texture fallBuffer [segments]
+//   rect   x y z  lengthX lengthZ          texture fallBuffer
+//   tree   x y z
+//   lamp   x y z
+//   coin   x y z
+//   sphere x y z
+//   spawn  vehicle x y z heading
+//   spawn  marble  x y z
+// Textures are none, rug, marble, rainbow, irises or quartz.
+
+#include "LevelFormat.h"
+#include "PackedVertex.h"
+#include "PlatformGeometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265f
+#endif
+
+namespace {
+    /// \desc segments of a disk when the level does not say
+    constexpr int DEFAULT_DISK_SEGMENTS = 100;
+    constexpr int MAX_DISK_SEGMENTS = static_cast<int>(PackedVertex::MAX_SHORT_INDEXED_VERTICES / 2);
+    /// \desc collision radius of the largest prop, the grid files props this far around them
+    constexpr float PROP_RADIUS = 0.5f;
+    constexpr float GRID_CELL_SIZE = 10.0f;
+
+    /// \desc FPEngine::WORLD_SIZE, the engine keeps the marbles inside it around the origin
+    constexpr float MARBLE_WORLD_SIZE = 300.0f;
+    constexpr float MARBLE_RADIUS = 0.5f;
+    /// \desc distance between the centers of neighbouring stress platforms
+    constexpr float STRESS_PLATFORM_PITCH = 100.0f;
+    /// \desc fewer than the hand-made disks, the stress worlds have thousands of them
+    constexpr int STRESS_DISK_SEGMENTS = 64;
+
+    struct Level {
+        std::vector<LevelFormat::Platform> platforms;
+        std::vector<LevelFormat::Vertex> vertices;
+        std::vector<uint16_t> indices;
+        /// \desc what MeshOptimizer made of the platforms' vertex cache use
+        MeshOptimizer::Report cacheReport;
+        std::vector<LevelFormat::Prop> props;
+        std::vector<LevelFormat::Pickup> pickups;
+        std::vector<LevelFormat::Spawn> spawns;
+        LevelFormat::Grid grid{};
+        std::vector<LevelFormat::GridCell> gridCells;
+        std::vector<uint32_t> gridItems;
+    };
+
+    bool parseTexture(const std::string& name, uint32_t& texture) {
+        static const char* const NAMES[] = { "none", "rug", "marble", "rainbow", "irises", "quartz" };
+        for (uint32_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); ++i) {
+            if (name == NAMES[i]) {
+                texture = LevelFormat::TEXTURE_NONE + i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void generateDisk(Level& level, LevelFormat::Platform& disk, int numSegments) {
+        PlatformGeometry::Mesh mesh;
+        PlatformGeometry::generateDisk(disk, numSegments, mesh);
+        level.cacheReport += PlatformGeometry::optimize(mesh);
+        PlatformGeometry::pack(mesh, disk, level.vertices, level.indices);
+    }
+
+    void generateRectangle(Level& level, LevelFormat::Platform& rect) {
+        PlatformGeometry::Mesh mesh;
+        PlatformGeometry::generateRectangle(rect, mesh);
+        level.cacheReport += PlatformGeometry::optimize(mesh);
+        PlatformGeometry::pack(mesh, rect, level.vertices, level.indices);
+    }
+
+    bool readPosition(std::istringstream& line, float position[3]) {
+        return static_cast<bool>(line >> position[0] >> position[1] >> position[2]);
+    }
+
+    bool parseLevel(const char* filename, Level& level) {
+        std::ifstream file(filename);
+        if (!file) {
+            fprintf(stderr, "[ERROR]: could not open %s\n", filename);
+            return false;
+        }
+
+        std::string text;
+        for (int lineNumber = 1; std::getline(file, text); ++lineNumber) {
+            const size_t comment = text.find('#');
+            if (comment != std::string::npos) {
+                text.erase(comment);
+            }
+            std::istringstream line(text);
+            std::string keyword;
+            if (!(line >> keyword)) {
+                continue;
+            }
+
+            bool valid = false;
+            if (keyword == "disk" || keyword == "rect") {
+                LevelFormat::Platform platform{};
+                std::string texture;
+                platform.type = keyword == "disk" ? LevelFormat::PLATFORM_DISK : LevelFormat::PLATFORM_RECT;
+                valid = readPosition(line, platform.position) && line >> platform.size[0] >> platform.size[1] >> texture >> platform.fallBuffer
+                        && parseTexture(texture, platform.texture) && platform.size[0] >= 0.0f && platform.size[1] > 0.0f;
+                if (valid && platform.type == LevelFormat::PLATFORM_DISK) {
+                    int segments = DEFAULT_DISK_SEGMENTS;
+                    if (!(line >> segments)) {
+                        line.clear();
+                        segments = DEFAULT_DISK_SEGMENTS;
+                    }
+                    // a disk has 2 * (segments + 1) vertices and its indices are 16-bit
+                    valid = segments >= 3 && segments < MAX_DISK_SEGMENTS && platform.size[0] < platform.size[1];
+                    if (valid) generateDisk(level, platform, segments);
+                } else if (valid) {
+                    valid = platform.size[0] > 0.0f;
+                    if (valid) generateRectangle(level, platform);
+                }
+                if (valid) level.platforms.push_back(platform);
+            } else if (keyword == "tree" || keyword == "lamp") {
+                LevelFormat::Prop prop{};
+                prop.type = keyword == "tree" ? LevelFormat::PROP_TREE : LevelFormat::PROP_LAMP;
+                valid = readPosition(line, prop.position);
+                if (valid) level.props.push_back(prop);
+            } else if (keyword == "coin" || keyword == "sphere") {
+                LevelFormat::Pickup pickup{};
+                pickup.type = keyword == "coin" ? LevelFormat::PICKUP_COIN : LevelFormat::PICKUP_BLUE_SPHERE;
+                valid = readPosition(line, pickup.position);
+                if (valid) level.pickups.push_back(pickup);
+            } else if (keyword == "spawn") {
+                LevelFormat::Spawn spawn{};
+                std::string what;
+                line >> what;
+                if (what == "vehicle") {
+                    float heading = 0.0f;
+                    spawn.type = LevelFormat::SPAWN_VEHICLE;
+                    valid = readPosition(line, spawn.position) && line >> heading;
+                    spawn.heading = heading * static_cast<float>(M_PI) / 180.0f;
+                } else if (what == "marble") {
+                    spawn.type = LevelFormat::SPAWN_MARBLE;
+                    valid = readPosition(line, spawn.position);
+                }
+                if (valid) level.spawns.push_back(spawn);
+            }
+
+            std::string trailing;
+            if (!valid || line >> trailing) {
+                fprintf(stderr, "[ERROR]: %s:%d: cannot read \"%s\"\n", filename, lineNumber, text.c_str());
+                return false;
+            }
+        }
+
+        if (level.platforms.empty()) {
+            fprintf(stderr, "[ERROR]: %s: a level needs at least one platform\n", filename);
+            return false;
+        }
+        if (std::none_of(level.spawns.begin(), level.spawns.end(),
+                         [](const LevelFormat::Spawn& spawn) { return spawn.type == LevelFormat::SPAWN_VEHICLE; })) {
+            fprintf(stderr, "[ERROR]: %s: a level needs a vehicle spawn point\n", filename);
+            return false;
+        }
+        return true;
+    }
+
+    /// \desc files every prop in the cells its collision square touches
+    void buildGrid(Level& level) {
+        // the platforms' decode boxes are their bounds
+        auto extent = [](const LevelFormat::Platform& platform, int axis) {
+            return platform.positionScale[axis] * PackedVertex::SHORT_MAX;
+        };
+        float minX = level.platforms[0].positionOffset[0] - extent(level.platforms[0], 0), maxX = minX;
+        float minZ = level.platforms[0].positionOffset[2] - extent(level.platforms[0], 2), maxZ = minZ;
+        for (const LevelFormat::Platform& platform : level.platforms) {
+            minX = std::min(minX, platform.positionOffset[0] - extent(platform, 0));
+            maxX = std::max(maxX, platform.positionOffset[0] + extent(platform, 0));
+            minZ = std::min(minZ, platform.positionOffset[2] - extent(platform, 2));
+            maxZ = std::max(maxZ, platform.positionOffset[2] + extent(platform, 2));
+        }
+        for (const LevelFormat::Prop& prop : level.props) {
+            minX = std::min(minX, prop.position[0] - PROP_RADIUS);
+            maxX = std::max(maxX, prop.position[0] + PROP_RADIUS);
+            minZ = std::min(minZ, prop.position[2] - PROP_RADIUS);
+            maxZ = std::max(maxZ, prop.position[2] + PROP_RADIUS);
+        }
+
+        LevelFormat::Grid& grid = level.grid;
+        grid.originX = minX;
+        grid.originZ = minZ;
+        grid.cellSize = GRID_CELL_SIZE;
+        grid.propRadius = PROP_RADIUS;
+        grid.cellsX = static_cast<uint32_t>((maxX - minX) / GRID_CELL_SIZE) + 1;
+        grid.cellsZ = static_cast<uint32_t>((maxZ - minZ) / GRID_CELL_SIZE) + 1;
+
+        auto cellRange = [&grid](float center, float origin, uint32_t cells, uint32_t& first, uint32_t& last) {
+            first = static_cast<uint32_t>(std::max(0.0f, (center - grid.propRadius - origin) / grid.cellSize));
+            last = std::min(cells - 1, static_cast<uint32_t>(std::max(0.0f, (center + grid.propRadius - origin) / grid.cellSize)));
+        };
+
+        // every cell's items are laid out back to back in one array
+        std::vector<std::vector<uint32_t>> cells(grid.cellsX * grid.cellsZ);
+        for (uint32_t i = 0; i < level.props.size(); ++i) {
+            uint32_t firstX, lastX, firstZ, lastZ;
+            cellRange(level.props[i].position[0], grid.originX, grid.cellsX, firstX, lastX);
+            cellRange(level.props[i].position[2], grid.originZ, grid.cellsZ, firstZ, lastZ);
+            for (uint32_t z = firstZ; z <= lastZ; ++z) {
+                for (uint32_t x = firstX; x <= lastX; ++x) {
+                    cells[z * grid.cellsX + x].push_back(i);
+                }
+            }
+        }
+        for (const std::vector<uint32_t>& items : cells) {
+            level.gridCells.push_back(LevelFormat::GridCell{ static_cast<uint32_t>(level.gridItems.size()), static_cast<uint32_t>(items.size()) });
+            level.gridItems.insert(level.gridItems.end(), items.begin(), items.end());
+        }
+    }
+
+    struct StressParameters {
+        uint32_t seed;
+        uint32_t platforms;
+        uint32_t props;
+        uint32_t coins;
+        uint32_t enemies;
+    };
+
+    /// \desc the benchmark ladder, each step roughly four times the one before
+    struct StressPreset {
+        const char* name;
+        StressParameters parameters;
+    };
+    const StressPreset STRESS_PRESETS[] = {
+        { "S",  { 1, 64, 2000, 500, 100 } },
+        { "M",  { 1, 256, 8000, 2000, 500 } },
+        { "L",  { 1, 1024, 30000, 5000, 2500 } },
+        { "XL", { 1, 4096, 100000, 10000, 10000 } }
+    };
+
+    /// \desc xorshift32, spelled out so a seed gives the same world with every compiler
+    class StressRandom {
+    public:
+        explicit StressRandom(uint32_t seed) : _state(seed ? seed : 0x9E3779B9u) {}
+        /// \desc uniform in [0, 1)
+        float next() {
+            _state ^= _state << 13;
+            _state ^= _state >> 17;
+            _state ^= _state << 5;
+            return static_cast<float>(_state >> 8) / 16777216.0f;
+        }
+        float range(float low, float high) { return low + next() * (high - low); }
+
+    private:
+        uint32_t _state;
+    };
+
+    void addProp(Level& level, uint32_t type, float x, float z) {
+        level.props.push_back(LevelFormat::Prop{ type, { x, 0.0f, z } });
+    }
+
+    /// \desc a random point on the walkable part of a platform
+    void randomPointOn(const LevelFormat::Platform& platform, StressRandom& random, float margin, float& x, float& z) {
+        if (platform.type == LevelFormat::PLATFORM_DISK) {
+            const float angle = random.range(0.0f, 2.0f * M_PI);
+            const float radius = random.range(platform.size[0] + margin, platform.size[1] - margin);
+            x = platform.position[0] + radius * std::cos(angle);
+            z = platform.position[2] + radius * std::sin(angle);
+        } else {
+            x = platform.position[0] + random.range(-platform.size[0] / 2.0f + margin, platform.size[0] / 2.0f - margin);
+            z = platform.position[2] + random.range(-platform.size[1] / 2.0f + margin, platform.size[1] / 2.0f - margin);
+        }
+    }
+
+    /// \desc platforms on a square lattice around the origin, half disks and half rectangles.
+    /// Props go around the edges of the disks and are scattered over the rectangles, the
+    /// same way the original world placed them, alternating trees and lamps.
+    void generateStressLevel(const StressParameters& parameters, Level& level) {
+        StressRandom random(parameters.seed);
+        const uint32_t TEXTURES[] = { LevelFormat::TEXTURE_RUG, LevelFormat::TEXTURE_RAINBOW, LevelFormat::TEXTURE_IRISES,
+                                      LevelFormat::TEXTURE_QUARTZ, LevelFormat::TEXTURE_MARBLE };
+
+        const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(parameters.platforms))));
+        const float start = -static_cast<float>(side - 1) * STRESS_PLATFORM_PITCH / 2.0f;
+        uint32_t nearest = 0;
+        for (uint32_t i = 0; i < parameters.platforms; ++i) {
+            LevelFormat::Platform platform{};
+            platform.position[0] = start + (i % side) * STRESS_PLATFORM_PITCH;
+            platform.position[2] = start + (i / side) * STRESS_PLATFORM_PITCH;
+            platform.texture = TEXTURES[i % (sizeof(TEXTURES) / sizeof(TEXTURES[0]))];
+            platform.fallBuffer = 0.8f;
+            if (random.next() < 0.5f) {
+                platform.type = LevelFormat::PLATFORM_DISK;
+                platform.size[0] = random.range(5.0f, 15.0f);
+                platform.size[1] = platform.size[0] + random.range(15.0f, 30.0f);
+                generateDisk(level, platform, STRESS_DISK_SEGMENTS);
+            } else {
+                platform.type = LevelFormat::PLATFORM_RECT;
+                platform.size[0] = random.range(20.0f, 80.0f);
+                platform.size[1] = random.range(20.0f, 80.0f);
+                generateRectangle(level, platform);
+            }
+            level.platforms.push_back(platform);
+
+            const float distance = std::hypot(platform.position[0], platform.position[2]);
+            const LevelFormat::Platform& best = level.platforms[nearest];
+            if (distance < std::hypot(best.position[0], best.position[2])) {
+                nearest = i;
+            }
+        }
+
+        uint32_t propType = LevelFormat::PROP_TREE;
+        for (uint32_t i = 0; i < parameters.platforms; ++i) {
+            const LevelFormat::Platform& platform = level.platforms[i];
+            const uint32_t numProps = parameters.props / parameters.platforms + (i < parameters.props % parameters.platforms ? 1 : 0);
+            for (uint32_t j = 0; j < numProps; ++j) {
+                float x, z;
+                if (platform.type == LevelFormat::PLATFORM_DISK) {
+                    // even ones on the inner edge, odd ones on the outer edge
+                    const uint32_t perEdge = (numProps + 1) / 2;
+                    const float angle = static_cast<float>(j / 2) / perEdge * 2.0f * M_PI;
+                    const float radius = platform.size[j % 2];
+                    x = platform.position[0] + radius * std::cos(angle);
+                    z = platform.position[2] + radius * std::sin(angle);
+                } else {
+                    randomPointOn(platform, random, 0.0f, x, z);
+                }
+                addProp(level, propType, x, z);
+                propType = propType == LevelFormat::PROP_TREE ? LevelFormat::PROP_LAMP : LevelFormat::PROP_TREE;
+            }
+        }
+
+        for (uint32_t i = 0; i < parameters.coins; ++i) {
+            const LevelFormat::Platform& platform = level.platforms[static_cast<uint32_t>(random.next() * parameters.platforms)];
+            LevelFormat::Pickup coin{ LevelFormat::PICKUP_COIN, { 0.0f, random.next() > 0.7f ? 4.0f : 1.0f, 0.0f } };
+            randomPointOn(platform, random, 1.0f, coin.position[0], coin.position[2]);
+            level.pickups.push_back(coin);
+        }
+        for (const LevelFormat::Platform& platform : level.platforms) {
+            LevelFormat::Pickup sphere{ LevelFormat::PICKUP_BLUE_SPHERE, { 0.0f, 1.0f, 0.0f } };
+            randomPointOn(platform, random, 0.0f, sphere.position[0], sphere.position[2]);
+            level.pickups.push_back(sphere);
+        }
+
+        // the vehicle starts halfway across the platform closest to the origin, like in the hand-made world
+        const LevelFormat::Platform& home = level.platforms[nearest];
+        LevelFormat::Spawn vehicle{ LevelFormat::SPAWN_VEHICLE, { home.position[0], 0.0f, home.position[2] }, static_cast<float>(M_PI) };
+        if (home.type == LevelFormat::PLATFORM_DISK) {
+            vehicle.position[0] += (home.size[0] + home.size[1]) / 2.0f;
+        }
+        level.spawns.push_back(vehicle);
+        for (uint32_t i = 0; i < parameters.enemies; ++i) {
+            const float extent = MARBLE_WORLD_SIZE / 2.0f - MARBLE_RADIUS;
+            level.spawns.push_back(LevelFormat::Spawn{ LevelFormat::SPAWN_MARBLE,
+                                                       { random.range(-extent, extent), MARBLE_RADIUS, random.range(-extent, extent) }, 0.0f });
+        }
+    }
+
+    /// \desc fills the parameters from the preset and the overrides, returns the output file or null
+    const char* parseStressArguments(int argc, char* argv[], StressParameters& parameters) {
+        const StressPreset* preset = nullptr;
+        for (const StressPreset& candidate : STRESS_PRESETS) {
+            if (argc > 2 && strcmp(argv[2], candidate.name) == 0) {
+                preset = &candidate;
+            }
+        }
+        if (!preset) {
+            return nullptr;
+        }
+        parameters = preset->parameters;
+
+        int i = 3;
+        for (; i + 2 < argc; i += 2) {
+            const long value = strtol(argv[i + 1], nullptr, 10);
+            uint32_t* parameter = strcmp(argv[i], "--seed") == 0 ? &parameters.seed
+                                : strcmp(argv[i], "--platforms") == 0 ? &parameters.platforms
+                                : strcmp(argv[i], "--props") == 0 ? &parameters.props
+                                : strcmp(argv[i], "--coins") == 0 ? &parameters.coins
+                                : strcmp(argv[i], "--enemies") == 0 ? &parameters.enemies
+                                : nullptr;
+            if (!parameter || value < 0 || value > 10000000) {
+                return nullptr;
+            }
+            *parameter = static_cast<uint32_t>(value);
+        }
+        return i + 1 == argc && parameters.platforms > 0 ? argv[i] : nullptr;
+    }
+
+    /// \desc bytes of zeros that bring a section to a multiple of 4
+    template<typename T>
+    size_t sectionPadding(const std::vector<T>& records) {
+        return (4 - records.size() * sizeof(T) % 4) % 4;
+    }
+
+    template<typename T>
+    void placeSection(LevelFormat::Section& section, const std::vector<T>& records, uint32_t& offset) {
+        section.offset = offset;
+        section.count = static_cast<uint32_t>(records.size());
+        offset += static_cast<uint32_t>(records.size() * sizeof(T) + sectionPadding(records));
+    }
+
+    template<typename T>
+    void writeSection(FILE* file, const std::vector<T>& records) {
+        static const unsigned char ZEROS[4] = {};
+        if (!records.empty()) {
+            fwrite(records.data(), sizeof(T), records.size(), file);
+        }
+        fwrite(ZEROS, 1, sectionPadding(records), file);
+    }
+
+    bool writeLevel(const char* filename, const Level& level) {
+        // the 16-bit indices are the only records that are not a multiple of 4 bytes, each section is padded to keep the next aligned
+        LevelFormat::Header header{};
+        header.magic = LevelFormat::MAGIC;
+        header.version = LevelFormat::VERSION;
+        uint32_t offset = sizeof(LevelFormat::Header);
+        placeSection(header.platforms, level.platforms, offset);
+        placeSection(header.vertices, level.vertices, offset);
+        placeSection(header.indices, level.indices, offset);
+        placeSection(header.props, level.props, offset);
+        placeSection(header.pickups, level.pickups, offset);
+        placeSection(header.spawns, level.spawns, offset);
+        placeSection(header.gridCells, level.gridCells, offset);
+        placeSection(header.gridItems, level.gridItems, offset);
+        header.grid = level.grid;
+        header.fileSize = offset;
+
+        FILE* file = fopen(filename, "wb");
+        if (!file) {
+            fprintf(stderr, "[ERROR]: could not write %s\n", filename);
+            return false;
+        }
+        fwrite(&header, sizeof(header), 1, file);
+        writeSection(file, level.platforms);
+        writeSection(file, level.vertices);
+        writeSection(file, level.indices);
+        writeSection(file, level.props);
+        writeSection(file, level.pickups);
+        writeSection(file, level.spawns);
+        writeSection(file, level.gridCells);
+        writeSection(file, level.gridItems);
+        const bool written = ferror(file) == 0;
+        if (fclose(file) != 0 || !written) {
+            fprintf(stderr, "[ERROR]: could not write %s\n", filename);
+            remove(filename);
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Level level;
+    const char* output = nullptr;
+    if (argc > 1 && strcmp(argv[1], "--stress") == 0) {
+        StressParameters parameters{};
+        output = parseStressArguments(argc, argv, parameters);
+        if (output) {
+            generateStressLevel(parameters, level);
+        }
+    } else if (argc == 3) {
+        if (!parseLevel(argv[1], level)) {
+            return EXIT_FAILURE;
+        }
+        output = argv[2];
+    }
+    if (!output) {
+        fprintf(stderr, "usage: %s <input.level> <output.fplevel>\n"
+                        "       %s --stress S|M|L|XL [--seed N] [--platforms N] [--props N] [--coins N] [--enemies N] <output.fplevel>\n",
+                argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    buildGrid(level);
+    if (!writeLevel(output, level)) {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "[INFO]: %s: %zu platforms, %zu triangles, %zu props, %zu pickups, %zu spawn points, %ux%u grid\n",
+            output, level.platforms.size(), level.indices.size() / 3, level.props.size(),
+            level.pickups.size(), level.spawns.size(), level.grid.cellsX, level.grid.cellsZ);
+    MeshOptimizer::logReport("platforms", level.cacheReport);
+    return EXIT_SUCCESS;
+}
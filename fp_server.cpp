@@ -0,0 +1,273 @@
+// fp_server: runs a shared session headless, with no window and no GL.
+//
+//   fp_server [--port N] [--level FILE]
+//   fp_server --loopback CLIENTS [--seconds S] [--level FILE]
+//
+// The first form serves the level (grey_havens.fplevel by default) on UDP port
+// 41730 until it is killed; players join with fp --connect HOST[:PORT].
+//
+// The second runs the server and CLIENTS scripted players on this machine,
+// talking over real loopback UDP, for S seconds (10 by default) after a one
+// second warm up. The server ticks on one thread and every client on another;
+// both are paced at the game's tick rate. It reports the bytes each client
+// receives and sends per second, as payload and with the IP and UDP headers,
+// and the CPU time the server and the clients spent per client, which is what
+// sizing a server takes.
+
+#include "NetProtocol.h"
+#include "SessionClient.h"
+#include "SessionServer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /// \desc IPv4 and UDP headers, what each datagram costs on the wire beyond its payload
+    constexpr uint64_t PACKET_OVERHEAD = 28;
+    constexpr int WARM_UP_SECONDS = 1;
+
+    struct Options {
+        uint16_t port = NetProtocol::DEFAULT_PORT;
+        std::string levelPath = "grey_havens.fplevel";
+        int loopbackClients = 0;
+        double seconds = 10.0;
+    };
+
+    /// \desc CPU time the calling thread has used, in seconds
+    double threadCPUSeconds() {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+        const auto toSeconds = [](const FILETIME& time) {
+            return static_cast<double>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7;
+        };
+        return toSeconds(kernel) + toSeconds(user);
+#else
+        timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) * 1e-9;
+#endif
+    }
+
+    /// \desc calls step once per simulation tick, for ticks ticks
+    template <typename Step>
+    void runTicks(uint64_t ticks, Step step) {
+        const Clock::duration tickDuration = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / NetProtocol::TICK_RATE));
+        Clock::time_point next = Clock::now();
+        for (uint64_t tick = 0; tick < ticks; ++tick) {
+            step(tick);
+            next += tickDuration;
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    /// \desc drives in long arcs, each player on its own schedule
+    uint8_t botButtons(int bot, uint64_t tick) {
+        const uint64_t phase = (tick + static_cast<uint64_t>(bot) * 37) % 240;
+        uint8_t buttons = NetProtocol::BUTTON_FORWARD;
+        if (phase < 40) buttons |= bot % 2 ? NetProtocol::BUTTON_LEFT : NetProtocol::BUTTON_RIGHT;
+        else if (phase >= 200) buttons = NetProtocol::BUTTON_BACK;
+        return buttons;
+    }
+
+    int serve(const Options& options) {
+        SessionServer server;
+        if (!server.start(options.levelPath.c_str(), options.port)) {
+            return EXIT_FAILURE;
+        }
+        const uint64_t REPORT_TICKS = NetProtocol::TICK_RATE * 10;
+        uint64_t lastBytesSent = 0;
+        runTicks(UINT64_MAX, [&](uint64_t tick) {
+            server.tick();
+            if (tick % REPORT_TICKS == REPORT_TICKS - 1) {
+                const uint64_t bytesSent = server.getSocket().getBytesSent();
+                fprintf(stdout, "[INFO]: %zu clients, %.1f KB/s sent\n", server.getNumClients(),
+                        static_cast<double>(bytesSent - lastBytesSent) / 1024.0 / 10.0);
+                lastBytesSent = bytesSent;
+            }
+        });
+        return EXIT_SUCCESS;
+    }
+
+    /// \desc what one thread measured over the timed part of a loopback run
+    struct Measurement {
+        double cpuSeconds = 0.0;
+        double wallSeconds = 0.0;
+        uint64_t bytesSent = 0;
+        uint64_t bytesReceived = 0;
+        uint64_t packetsSent = 0;
+        uint64_t packetsReceived = 0;
+
+        void begin(const NetSocket& socket) {
+            cpuSeconds = threadCPUSeconds();
+            wallSeconds = std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+            bytesSent = socket.getBytesSent();
+            bytesReceived = socket.getBytesReceived();
+            packetsSent = socket.getPacketsSent();
+            packetsReceived = socket.getPacketsReceived();
+        }
+        void end(const NetSocket& socket) {
+            cpuSeconds = threadCPUSeconds() - cpuSeconds;
+            wallSeconds = std::chrono::duration<double>(Clock::now().time_since_epoch()).count() - wallSeconds;
+            bytesSent = socket.getBytesSent() - bytesSent;
+            bytesReceived = socket.getBytesReceived() - bytesReceived;
+            packetsSent = socket.getPacketsSent() - packetsSent;
+            packetsReceived = socket.getPacketsReceived() - packetsReceived;
+        }
+    };
+
+    int loopback(const Options& options) {
+        SessionServer server;
+        if (!server.start(options.levelPath.c_str(), 0)) {
+            return EXIT_FAILURE;
+        }
+        NetAddress serverAddress;
+        NetAddress::parse("127.0.0.1", server.getPort(), serverAddress);
+
+        const int numClients = options.loopbackClients;
+        std::vector<std::unique_ptr<SessionClient>> clients;
+        for (int i = 0; i < numClients; ++i) {
+            clients.emplace_back(new SessionClient());
+            if (!clients.back()->connect(serverAddress, options.levelPath.c_str())) {
+                return EXIT_FAILURE;
+            }
+        }
+
+        const uint64_t warmUpTicks = WARM_UP_SECONDS * NetProtocol::TICK_RATE;
+        const uint64_t totalTicks = warmUpTicks + static_cast<uint64_t>(options.seconds * NetProtocol::TICK_RATE);
+        Measurement serverMeasurement;
+        SessionServer::Stats serverStatsBefore{};
+        std::thread serverThread([&] {
+            runTicks(totalTicks + NetProtocol::TICK_RATE / 4, [&](uint64_t tick) {
+                if (tick == warmUpTicks) {
+                    serverMeasurement.begin(server.getSocket());
+                    serverStatsBefore = server.getStats();
+                }
+                server.tick();
+                if (tick + 1 == totalTicks) {
+                    serverMeasurement.end(server.getSocket());
+                }
+            });
+        });
+
+        // the clients stop a little before the server so their last inputs are all read
+        double clientCPUSeconds = 0.0;
+        size_t connectedClients = 0;
+        runTicks(totalTicks, [&](uint64_t tick) {
+            if (tick == warmUpTicks) {
+                clientCPUSeconds = threadCPUSeconds();
+            }
+            for (int i = 0; i < numClients; ++i) {
+                clients[i]->tick(botButtons(i, tick));
+            }
+            if (tick + 1 == totalTicks) {
+                clientCPUSeconds = threadCPUSeconds() - clientCPUSeconds;
+                for (const auto& client : clients) {
+                    connectedClients += client->isConnected() ? 1 : 0;
+                }
+            }
+        });
+        for (const auto& client : clients) {
+            client->disconnect();
+        }
+        serverThread.join();
+
+        if (connectedClients != static_cast<size_t>(numClients)) {
+            fprintf(stderr, "[ERROR]: only %zu of %d clients stayed connected\n", connectedClients, numClients);
+        }
+
+        const SessionServer::Stats& serverStats = server.getStats();
+        const double perClientSecond = 1.0 / (static_cast<double>(numClients) * options.seconds);
+        const uint64_t snapshots = serverStats.snapshotsSent - serverStatsBefore.snapshotsSent;
+        const uint64_t snapshotBytes = serverStats.snapshotBytes - serverStatsBefore.snapshotBytes;
+        const uint64_t records = serverStats.recordsSent - serverStatsBefore.recordsSent;
+
+        uint64_t snapshotsReceived = 0, snapshotsDropped = 0, starvedTicks = 0, corrections = 0;
+        double predictionError = 0.0;
+        for (const auto& client : clients) {
+            const SessionClient::Stats& stats = client->getStats();
+            snapshotsReceived += stats.snapshotsReceived;
+            snapshotsDropped += stats.snapshotsDropped;
+            starvedTicks += stats.interpolationStarvedTicks;
+            corrections += stats.predictionCorrections;
+            predictionError += stats.predictionError;
+        }
+
+        fprintf(stdout, "[INFO]: %d clients for %.1f s on %s, %zu marbles, relevancy radius %.0f m\n",
+                numClients, options.seconds, options.levelPath.c_str(), server.getWorld().getNumMarbles(),
+                SessionServer::RELEVANCY_RADIUS);
+        fprintf(stdout, "[INFO]: per client down %8.1f B/s payload, %8.1f B/s on the wire\n",
+                static_cast<double>(serverMeasurement.bytesSent) * perClientSecond,
+                static_cast<double>(serverMeasurement.bytesSent + serverMeasurement.packetsSent * PACKET_OVERHEAD) * perClientSecond);
+        fprintf(stdout, "[INFO]: per client up   %8.1f B/s payload, %8.1f B/s on the wire\n",
+                static_cast<double>(serverMeasurement.bytesReceived) * perClientSecond,
+                static_cast<double>(serverMeasurement.bytesReceived + serverMeasurement.packetsReceived * PACKET_OVERHEAD) * perClientSecond);
+        fprintf(stdout, "[INFO]: per client CPU  server %.3f ms/s, client %.3f ms/s\n",
+                serverMeasurement.cpuSeconds * 1000.0 * perClientSecond,
+                clientCPUSeconds * 1000.0 * perClientSecond);
+        // a server that cannot keep up ticks late, and everything per second above reads low
+        const double tickRate = options.seconds * NetProtocol::TICK_RATE / serverMeasurement.wallSeconds;
+        const bool keptUp = tickRate >= NetProtocol::TICK_RATE * 0.95;
+        fflush(stdout);
+        fprintf(keptUp ? stdout : stderr, "%s: server ran %.1f ticks/s of %u\n", keptUp ? "[INFO]" : "[ERROR]",
+                tickRate, NetProtocol::TICK_RATE);
+        fprintf(stdout, "[INFO]: snapshots %.1f B on average, %.1f records, %llu sent in full, %llu records deferred\n",
+                snapshots ? static_cast<double>(snapshotBytes) / static_cast<double>(snapshots) : 0.0,
+                snapshots ? static_cast<double>(records) / static_cast<double>(snapshots) : 0.0,
+                static_cast<unsigned long long>(serverStats.fullSnapshots - serverStatsBefore.fullSnapshots),
+                static_cast<unsigned long long>(serverStats.recordsDeferred - serverStatsBefore.recordsDeferred));
+        fprintf(stdout, "[INFO]: clients received %llu snapshots, dropped %llu, held interpolation %llu ticks, "
+                        "mean prediction correction %.3f m\n",
+                static_cast<unsigned long long>(snapshotsReceived), static_cast<unsigned long long>(snapshotsDropped),
+                static_cast<unsigned long long>(starvedTicks), corrections ? predictionError / static_cast<double>(corrections) : 0.0);
+        return keptUp && connectedClients == static_cast<size_t>(numClients) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    bool parseArguments(int argc, char* argv[], Options& options) {
+        for (int i = 1; i < argc; i += 2) {
+            if (i + 1 >= argc) {
+                return false;
+            }
+            const char* arg = argv[i];
+            const char* value = argv[i + 1];
+            if (strcmp(arg, "--port") == 0 && atoi(value) > 0 && atoi(value) < 65536) {
+                options.port = static_cast<uint16_t>(atoi(value));
+            } else if (strcmp(arg, "--level") == 0) {
+                options.levelPath = value;
+            } else if (strcmp(arg, "--loopback") == 0 && atoi(value) > 0 && atoi(value) <= NetProtocol::MAX_VEHICLES) {
+                options.loopbackClients = atoi(value);
+            } else if (strcmp(arg, "--seconds") == 0 && atof(value) > 0.0) {
+                options.seconds = atof(value);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--port N] [--level FILE]\n"
+                        "       %s --loopback CLIENTS [--seconds S] [--level FILE]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    return options.loopbackClients > 0 ? loopback(options) : serve(options);
+}
@@ -0,0 +1,256 @@
+// fp_test_allocations: the frame loop's steady state heap check, without a window or GL.
+//
+//   fp_test_allocations [--frames N] [--level FILE]
+//
+// Runs the CPU side of a frame N times (600 by default) under AllocationTracker:
+// a tick TaskGraph shaped like FPEngine::_buildTickGraph whose tasks run the
+// SimKernels the engine's tick runs, marbles spread over the job system with
+// parallelFor, then the frame arena and the latency probe the way the render
+// loop uses them. The first AllocationTracker::WARM_UP_FRAMES frames may grow
+// the pools; any frame after them that allocates fails the test. Maps the level
+// from the working directory, grey_havens.fplevel by default (make levels).
+
+#include "AllocationTracker.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "LatencyProbe.h"
+#include "LevelFile.h"
+#include "SimKernels.h"
+#include "TaskGraph.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifndef FP_TRACK_ALLOCATIONS
+#error "fp_test_allocations counts allocations, build it with FP_TRACK_ALLOCATIONS defined"
+#endif
+
+namespace {
+    /// \desc as in fp_bench, FPEngine's tick constants
+    constexpr float MARBLE_STEP = 0.035f;
+    constexpr float MARBLE_RADIUS = 0.5f;
+    constexpr float VEHICLE_RADIUS = 1.0f;
+    constexpr float VEHICLE_SPEED = 0.2f;
+    constexpr float WORLD_SIZE = 300.0f;
+    constexpr size_t MARBLES_PER_JOB = 256;
+    /// \desc enough marbles that parallelFor hands out more than one range
+    constexpr size_t NUM_MARBLES = 512;
+    /// \desc far below FPEngine's 1 MB, so the arena has to grow during the warm up
+    constexpr size_t ARENA_CAPACITY = 1024;
+    /// \desc full long before the warm up ends; the percentiles sort a copy of every sample in
+    /// the arena, so a probe still filling up would need a little more of it each frame
+    constexpr size_t LATENCY_SAMPLES = 64;
+
+    /// \desc xorshift, the same seed gives the same run every time
+    class TestRandom {
+    public:
+        explicit TestRandom(uint32_t seed) : _state(seed ? seed : 1) {}
+        float next() {
+            _state ^= _state << 13;
+            _state ^= _state >> 17;
+            _state ^= _state << 5;
+            return static_cast<float>(_state >> 8) / static_cast<float>(1 << 24);
+        }
+        float range(float low, float high) { return low + (high - low) * next(); }
+    private:
+        uint32_t _state;
+    };
+
+    /// \desc what one tick works on, shared by the tasks the way FPEngine's members are
+    struct World {
+        explicit World(const LevelFile& level) : level(level), random(7) {}
+
+        const LevelFile& level;
+        JobSystem* jobs = nullptr;
+        TestRandom random;
+        std::vector<DiskPlatform> disks;
+        std::vector<RectPlatform> rects;
+        std::vector<glm::vec3> coins;
+        std::vector<glm::vec3> marbleLocations;
+        std::vector<glm::vec3> marbleDirections;
+
+        glm::vec3 vehiclePosition = glm::vec3(0.0f);
+        glm::vec3 vehicleSpawn = glm::vec3(0.0f);
+        float vehicleHeading = 0.0f;
+        size_t coinsTaken = 0;
+        size_t falls = 0;
+        bool hitProp = false;
+    };
+
+    void tickInput(World& world) {
+        world.vehicleHeading += world.random.range(-0.05f, 0.05f);
+    }
+
+    void tickPickups(World& world) {
+        for (size_t i = 0; i < world.coins.size(); ++i) {
+            if (SimKernels::spheresOverlap(world.vehiclePosition, VEHICLE_RADIUS, world.coins[i], 1.0f)) {
+                ++world.coinsTaken;
+            }
+        }
+    }
+
+    void tickMarbles(World& world) {
+        glm::vec3* locations = world.marbleLocations.data();
+        glm::vec3* directions = world.marbleDirections.data();
+        const glm::vec3 target = world.vehiclePosition;
+        world.jobs->parallelFor(world.marbleLocations.size(), MARBLES_PER_JOB, [=](size_t begin, size_t end) {
+            SimKernels::steerMarbles(locations + begin, directions + begin, end - begin, target, MARBLE_STEP, MARBLE_RADIUS);
+            SimKernels::bounceMarblesOffWalls(locations + begin, directions + begin, end - begin, WORLD_SIZE / 2.0f,
+                                              MARBLE_RADIUS);
+        });
+        SimKernels::collideMarbles(locations, directions, world.marbleLocations.size(), MARBLE_RADIUS);
+    }
+
+    void tickVehicle(World& world) {
+        glm::vec3 next = world.vehiclePosition
+                         + glm::vec3(std::sin(world.vehicleHeading), 0.0f, std::cos(world.vehicleHeading)) * VEHICLE_SPEED;
+        glm::vec3 propPosition;
+        world.hitProp = SimKernels::findPropCollision(world.level, next, VEHICLE_RADIUS, propPosition);
+        if (world.hitProp) {
+            next = world.vehiclePosition;
+        }
+        if (!SimKernels::isOnPlatform(next, world.disks.data(), world.disks.size(), world.rects.data(), world.rects.size())) {
+            ++world.falls;
+            next = world.vehicleSpawn;
+        }
+        world.vehiclePosition = next;
+    }
+
+    void tickResolve(World& world) {
+        if (world.hitProp) {
+            world.vehicleHeading += 3.14159265f;
+        }
+    }
+
+    bool loadWorld(World& world) {
+        const LevelFile& level = world.level;
+        for (size_t i = 0; i < level.getNumPlatforms(); ++i) {
+            const LevelFormat::Platform& platform = level.getPlatforms()[i];
+            if (platform.type == LevelFormat::PLATFORM_DISK) {
+                world.disks.push_back(DiskPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                    0, 0, 0, glm::vec3(1.0f), glm::vec3(0.0f), 0, platform.fallBuffer });
+            } else {
+                world.rects.push_back(RectPlatform{ glm::make_vec3(platform.position), platform.size[0], platform.size[1],
+                                                    0, 0, 0, glm::vec3(1.0f), glm::vec3(0.0f), 0, platform.fallBuffer });
+            }
+        }
+        for (size_t i = 0; i < level.getNumPickups(); ++i) {
+            const LevelFormat::Pickup& pickup = level.getPickups()[i];
+            if (pickup.type == LevelFormat::PICKUP_COIN) {
+                world.coins.push_back(glm::make_vec3(pickup.position));
+            }
+        }
+        for (size_t i = 0; i < level.getNumSpawns(); ++i) {
+            const LevelFormat::Spawn& spawn = level.getSpawns()[i];
+            if (spawn.type == LevelFormat::SPAWN_VEHICLE) {
+                world.vehicleSpawn = glm::make_vec3(spawn.position);
+                world.vehicleHeading = spawn.heading;
+                break;
+            }
+        }
+        world.vehiclePosition = world.vehicleSpawn;
+
+        for (size_t i = 0; i < NUM_MARBLES; ++i) {
+            world.marbleLocations.emplace_back(world.random.range(-140.0f, 140.0f), MARBLE_RADIUS,
+                                               world.random.range(-140.0f, 140.0f));
+            world.marbleDirections.emplace_back(glm::normalize(glm::vec3(world.random.range(-1.0f, 1.0f), 0.0f, 1.0f)));
+        }
+        return !world.disks.empty() || !world.rects.empty();
+    }
+
+    /// \desc the render side of a frame: draw lists in the arena, input stamped and presented,
+    /// and the percentiles _logFrameStatistics asks for
+    void renderFrame(const World& world, FrameArena& arena, LatencyProbe& probe, uint64_t& lastInput, uint32_t frame) {
+        arena.reset();
+        // the first frames ask for more each time, past what the block holds, like a scene filling up
+        const size_t numVisible = frame < 60 ? world.marbleLocations.size() * frame / 60 : world.marbleLocations.size();
+        FrameList<glm::vec3> visible(arena, world.marbleLocations.size());
+        for (size_t i = 0; i < numVisible; ++i) {
+            visible.push_back(world.marbleLocations[i]);
+        }
+        FrameList<uint32_t> drawOrder(arena, visible.size());
+        for (size_t i = 0; i < visible.size(); ++i) {
+            drawOrder.push_back(static_cast<uint32_t>(i));
+        }
+
+        // input arrives every other frame and shows up in the frame after
+        if (frame % 2 == 0) {
+            lastInput = probe.recordInput();
+        } else {
+            probe.recordPresent(lastInput);
+        }
+        const LatencyProbe::Percentiles latency = probe.getPercentiles(arena);
+        (void)latency;
+    }
+
+    bool parseArguments(int argc, char* argv[], uint32_t& frames, const char*& levelPath) {
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+                frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+                levelPath = argv[++i];
+            } else {
+                return false;
+            }
+        }
+        return frames > AllocationTracker::WARM_UP_FRAMES;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t frames = 600;
+    const char* levelPath = "grey_havens.fplevel";
+    if (!parseArguments(argc, argv, frames, levelPath)) {
+        fprintf(stderr, "usage: %s [--frames N, more than %u] [--level FILE]\n", argv[0], AllocationTracker::WARM_UP_FRAMES);
+        return EXIT_FAILURE;
+    }
+
+    LevelFile level;
+    if (!level.open(levelPath)) {
+        fprintf(stderr, "[ERROR]: could not load level %s\n", levelPath);
+        return EXIT_FAILURE;
+    }
+    World world(level);
+    if (!loadWorld(world)) {
+        fprintf(stderr, "[ERROR]: level %s has no platforms\n", levelPath);
+        return EXIT_FAILURE;
+    }
+
+    // workers even on a one core machine, so their deques and the stealing are part of the check
+    JobSystem jobs(std::max(4u, std::thread::hardware_concurrency()));
+    world.jobs = &jobs;
+    TaskGraph tickGraph;
+    const TaskGraph::TaskID input = tickGraph.addTask("tick input", [&world] { tickInput(world); });
+    const TaskGraph::TaskID pickups = tickGraph.addTask("tick pickups", [&world] { tickPickups(world); });
+    const TaskGraph::TaskID marbles = tickGraph.addTask("tick marbles", [&world] { tickMarbles(world); });
+    const TaskGraph::TaskID vehicle = tickGraph.addTask("tick vehicle", [&world] { tickVehicle(world); });
+    const TaskGraph::TaskID resolve = tickGraph.addTask("tick resolve", [&world] { tickResolve(world); });
+    for (TaskGraph::TaskID task : { pickups, marbles, vehicle }) {
+        tickGraph.addDependency(input, task);
+        tickGraph.addDependency(task, resolve);
+    }
+
+    FrameArena arena(ARENA_CAPACITY);
+    LatencyProbe probe(LATENCY_SAMPLES);
+    uint64_t lastInput = 0;
+    for (uint32_t frame = 1; frame <= frames; ++frame) {
+        {
+            FP_TRACK_ALLOCATIONS_SCOPE();
+            tickGraph.run(jobs);
+            renderFrame(world, arena, probe, lastInput, frame);
+        }
+        FP_TRACK_ALLOCATIONS_FRAME_END(frame);
+    }
+
+    fprintf(stdout, "[INFO]: %u frames on %u threads: %zu coins touched, %zu falls, arena high water mark %zu bytes\n",
+            frames, jobs.getNumThreads(), world.coinsTaken, world.falls, arena.getHighWaterMark());
+    FP_TRACK_ALLOCATIONS_REPORT();
+    return FP_TRACK_ALLOCATIONS_PASSED() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
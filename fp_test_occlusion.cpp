@@ -0,0 +1,74 @@
+// fp_test_occlusion: OcclusionCuller against a scene whose answers are known, without a GPU.
+//
+//   fp_test_occlusion
+//
+// A wall of two triangles stands between the camera and the origin. A box hidden
+// right behind it has to be culled; a box beside it at the same distance, a box in
+// front of it and a box reaching the camera have to stay visible. The build compiles
+// this twice, once as fp_test_occlusion_scalar with FP_OCCLUSION_SCALAR, so the SSE2
+// rasterizer and the scalar one answer the same questions.
+
+#include "OcclusionCuller.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    /// \desc a 10 by 6 wall across the view, 10 in front of the camera
+    const glm::vec3 WALL[] = {
+        glm::vec3(-5.0f, -3.0f, 0.0f), glm::vec3(5.0f, -3.0f, 0.0f), glm::vec3(5.0f, 3.0f, 0.0f),
+        glm::vec3(-5.0f, -3.0f, 0.0f), glm::vec3(5.0f, 3.0f, 0.0f), glm::vec3(-5.0f, 3.0f, 0.0f)
+    };
+
+    int failures = 0;
+
+    void expect(bool condition, const char* what) {
+        if (!condition) {
+            fprintf(stderr, "[ERROR]: %s\n", what);
+            ++failures;
+        }
+    }
+}
+
+int main() {
+#if defined(FP_OCCLUSION_SCALAR)
+    expect(!OcclusionCuller::usesSSE2(), "built with FP_OCCLUSION_SCALAR but rasterizing with SSE2");
+#elif defined(__SSE2__) || defined(_M_X64)
+    expect(OcclusionCuller::usesSSE2(), "SSE2 is available but the scalar rasterizer is built");
+#endif
+    fprintf(stdout, "[INFO]: testing the %s rasterizer\n", OcclusionCuller::usesSSE2() ? "SSE2" : "scalar");
+
+    const glm::mat4 viewMtx = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projMtx = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f);
+
+    OcclusionCuller culler;
+    culler.beginFrame(projMtx * viewMtx);
+    culler.rasterizeTriangles(WALL, sizeof(WALL) / sizeof(WALL[0]), glm::mat4(1.0f));
+    culler.buildPyramid();
+
+    // the wall covers the middle of the buffer and nothing else
+    const std::vector<float>& depth = culler.getDepthBuffer();
+    const int width = culler.getWidth();
+    const int height = culler.getHeight();
+    expect(depth[(height / 2) * width + width / 2] < 1.0f, "the wall is missing from the middle of the depth buffer");
+    expect(depth[0] == 1.0f, "the depth buffer's corner is covered");
+
+    expect(!culler.isVisible(glm::vec3(-0.5f, -0.5f, -5.5f), glm::vec3(0.5f, 0.5f, -4.5f)),
+           "a box right behind the wall is visible");
+    expect(culler.isVisible(glm::vec3(11.5f, -0.5f, -5.5f), glm::vec3(12.5f, 0.5f, -4.5f)),
+           "a box beside the wall is culled");
+    expect(culler.isVisible(glm::vec3(-0.5f, -0.5f, 2.5f), glm::vec3(0.5f, 0.5f, 3.5f)),
+           "a box in front of the wall is culled");
+    expect(culler.isVisible(glm::vec3(-1.0f, -1.0f, 9.0f), glm::vec3(1.0f, 1.0f, 11.0f)),
+           "a box around the camera is culled");
+    expect(culler.getNumTested() == 4 && culler.getNumCulled() == 1, "the culled count is off");
+
+    if (failures > 0) {
+        fprintf(stderr, "[ERROR]: %d occlusion checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout, "[INFO]: all occlusion checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -17,9 +17,86 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-int main() {
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-    auto mpEngine = new FPEngine();
+void printUsage(const char* program) {
+    fprintf(stdout, "usage: %s [options]\n"
+                    "  --headless              render offscreen without a window\n"
+                    "  --context egl|osmesa    context API used when headless (default egl)\n"
+                    "  --frames N              exit after N frames\n"
+                    "  --size WxH              framebuffer size (default 1280x720)\n"
+                    "  --dump DIR              write every frame to DIR\n"
+                    "  --dump-format ppm|raw   image format of the dumped frames (default ppm)\n"
+                    "  --level FILE            compiled level to play (default grey_havens.fplevel)\n"
+                    "  --connect HOST[:PORT]   join the fp_server session at HOST (default port 41730)\n"
+                    "  --threads N             threads for the job system, 1 runs every job inline (default one per core)\n"
+                    "  --no-late-latch         render with the newest snapshot instead of waiting for fresh input\n"
+                    "  --gpu-driven            cull and draw the props on the GPU (needs OpenGL 4.5)\n",
+            program);
+}
+
+/// \desc fills the launch options from the command line, returns false on a bad argument
+bool parseArguments(int argc, char* argv[], LaunchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--help") == 0) {
+            return false;
+        }
+        if (strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+            continue;
+        }
+        if (strcmp(arg, "--no-late-latch") == 0) {
+            options.lateLatch = false;
+            continue;
+        }
+        if (strcmp(arg, "--gpu-driven") == 0) {
+            options.gpuDriven = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "[ERROR]: unknown argument or missing value: %s\n", arg);
+            return false;
+        }
+        ++i;
+
+        if (strcmp(arg, "--context") == 0 && (strcmp(value, "egl") == 0 || strcmp(value, "osmesa") == 0)) {
+            options.contextAPI = strcmp(value, "egl") == 0 ? LaunchOptions::ContextAPI::EGL : LaunchOptions::ContextAPI::OSMESA;
+        } else if (strcmp(arg, "--frames") == 0 && atoi(value) > 0) {
+            options.frameLimit = static_cast<GLuint>(atoi(value));
+        } else if (strcmp(arg, "--size") == 0 && sscanf(value, "%dx%d", &options.width, &options.height) == 2
+                   && options.width > 0 && options.height > 0) {
+            // parsed in the condition
+        } else if (strcmp(arg, "--dump") == 0) {
+            options.dumpDirectory = value;
+        } else if (strcmp(arg, "--dump-format") == 0 && (strcmp(value, "ppm") == 0 || strcmp(value, "raw") == 0)) {
+            options.dumpFormat = strcmp(value, "ppm") == 0 ? LaunchOptions::DumpFormat::PPM : LaunchOptions::DumpFormat::RAW;
+        } else if (strcmp(arg, "--level") == 0) {
+            options.levelPath = value;
+        } else if (strcmp(arg, "--connect") == 0) {
+            options.connectAddress = value;
+        } else if (strcmp(arg, "--threads") == 0 && atoi(value) > 0) {
+            options.jobThreads = static_cast<unsigned>(atoi(value));
+        } else {
+            fprintf(stderr, "[ERROR]: bad argument: %s %s\n", arg, value);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    LaunchOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto mpEngine = new FPEngine(options);
     mpEngine->initialize();
     if (mpEngine->getError() == CSCI441::OpenGLEngine::OPENGL_ENGINE_ERROR_NO_ERROR) {
         mpEngine->run();
@@ -27,6 +104,7 @@ int main() {
     mpEngine->shutdown();
     delete mpEngine;
 
-    return EXIT_SUCCESS;
+    // builds with FP_TRACK_ALLOCATIONS fail the run when a steady state frame touched the heap
+    return FP_TRACK_ALLOCATIONS_PASSED() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
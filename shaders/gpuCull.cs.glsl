@@ -0,0 +1,111 @@
+#version 450 core
+
+// Culls every part GpuDrivenRenderer knows and picks its level of detail, the
+// same way FPEngine does on the CPU: a frustum test against the bounding sphere,
+// then LODMesh::selectLevel on its screen coverage. A visible part is appended
+// to the instance list of its mesh level and counted in that level's
+// DrawElementsIndirectCommand; a prop past the impostor coverage is appended to
+// the impostor list instead.
+
+layout(local_size_x = 64) in;
+
+// ***** keep in step with GpuDrivenRenderer::GpuPart and GpuMesh *****
+struct Part {
+    mat4 model;
+    vec4 bounds;        // center relative to the anchor, radius
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;      // w is the shininess
+    vec4 bakedLight[6];
+    uint mesh;
+    int anchor;         // -1 for a part that never moves
+    uint flags;
+    uint level;         // picked last frame, for the hysteresis
+};
+struct Mesh {
+    vec4 positionScale;
+    vec4 positionOffset;
+    uint firstCommand;
+    uint numLevels;
+    uint pad0;
+    uint pad1;
+};
+const uint PART_USES_IMPOSTOR = 1u;
+const uint PART_DRAWS_IMPOSTOR = 2u;
+
+layout(std430, binding = 0) buffer Parts { Part parts[]; };
+layout(std430, binding = 1) readonly buffer Meshes { Mesh meshes[]; };
+layout(std430, binding = 2) readonly buffer Anchors { vec4 anchors[]; };
+// five uints per command: count, instanceCount, firstIndex, baseVertex, baseInstance
+layout(std430, binding = 3) buffer Commands { uint commands[]; };
+layout(std430, binding = 4) writeonly buffer Instances { uint instances[]; };
+layout(std430, binding = 5) writeonly buffer Impostors { vec4 impostorPositions[]; };
+
+uniform int numParts;
+uniform int numAnchors;              // anchored parts past it are not drawn
+uniform vec4 frustumPlanes[6];      // normalized, pointing inwards
+uniform mat4 viewMatrix;
+uniform float projectionScale;      // projection[1][1], cot(fovy / 2)
+uniform float lodBias;
+uniform float impostorCoverage;     // 0 when there are no impostors
+uniform int impostorCommand;        // first uint of the impostors' DrawArraysIndirectCommand
+
+// ***** LODMesh's thresholds *****
+const uint NUM_LEVELS = 4u;
+const float LEVEL_THRESHOLDS[3] = float[3](0.20, 0.07, 0.025);
+const float HYSTERESIS = 0.15;
+
+uint rawLevel(float coverage, float impostorThreshold) {
+    for (uint level = 0u; level < NUM_LEVELS - 1u; ++level) {
+        if (coverage >= LEVEL_THRESHOLDS[level]) return level;
+    }
+    if (coverage < impostorThreshold) return NUM_LEVELS;
+    return NUM_LEVELS - 1u;
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(numParts)) {
+        return;
+    }
+
+    int anchorIndex = parts[index].anchor;
+    if (anchorIndex >= numAnchors) {
+        return;
+    }
+    vec3 anchor = anchorIndex >= 0 ? anchors[anchorIndex].xyz : vec3(0.0);
+    vec3 center = anchor + parts[index].bounds.xyz;
+    float radius = parts[index].bounds.w;
+    for (int plane = 0; plane < 6; ++plane) {
+        if (dot(frustumPlanes[plane].xyz, center) + frustumPlanes[plane].w < -radius) {
+            return;
+        }
+    }
+
+    float distance = -(viewMatrix * vec4(center, 1.0)).z;
+    float coverage = (distance <= radius ? 1.0 : radius * projectionScale / distance) * lodBias;
+    uint flags = parts[index].flags;
+    float impostorThreshold = (flags & PART_USES_IMPOSTOR) != 0u ? impostorCoverage : 0.0;
+    uint finer = rawLevel(coverage / (1.0 + HYSTERESIS), impostorThreshold);
+    uint coarser = rawLevel(coverage * (1.0 + HYSTERESIS), impostorThreshold);
+    uint level = parts[index].level;
+    if (finer < level) {
+        level = finer;
+    } else if (coarser > level) {
+        level = coarser;
+    }
+    parts[index].level = level;
+
+    if (level == NUM_LEVELS) {
+        if ((flags & PART_DRAWS_IMPOSTOR) != 0u) {
+            uint slot = atomicAdd(commands[impostorCommand + 1], 1u);
+            impostorPositions[slot] = vec4(anchor + parts[index].model[3].xyz, 1.0);
+        }
+        return;
+    }
+
+    uint mesh = parts[index].mesh;
+    uint command = (meshes[mesh].firstCommand + min(level, meshes[mesh].numLevels - 1u)) * 5u;
+    uint slot = atomicAdd(commands[command + 1u], 1u);
+    instances[commands[command + 4u] + slot] = index;
+}
@@ -0,0 +1,156 @@
+#version 450 core
+
+// Draws the parts gpuCull.cs.glsl left in the instance lists, one multi-draw
+// for all of them. Lights like lighting.vs.glsl with PACKED_MESH and
+// SPOT_LIGHT, taking the transform and material of each instance from the
+// part it names; PART_BAKED parts take the directional light and the lamps
+// from their ambient cube, like BAKED_LIGHT.
+//
+// Permutations, defined by the engine when it compiles the program:
+//   NUM_POINT_LIGHTS  point lights evaluated for the parts that are not baked
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 10
+#endif
+
+layout(location = 0) in vec3 vPackedPos;     // quantized inside the mesh's bounds
+layout(location = 1) in vec2 vPackedNormal;  // octahedral
+layout(location = 2) in uint vPart;          // per instance, from the draw's instance list
+
+// ***** keep in step with GpuDrivenRenderer::GpuPart and GpuMesh *****
+struct Part {
+    mat4 model;
+    vec4 bounds;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;      // w is the shininess
+    vec4 bakedLight[6]; // +x, -x, +y, -y, +z, -z, the material already applied
+    uint mesh;
+    int anchor;
+    uint flags;
+    uint level;
+};
+struct Mesh {
+    vec4 positionScale;
+    vec4 positionOffset;
+    uint firstCommand;
+    uint numLevels;
+    uint pad0;
+    uint pad1;
+};
+const uint PART_BAKED = 4u;
+const uint PART_BEAK = 8u;
+const uint PART_BEAK_BOBS = 16u;
+
+layout(std430, binding = 0) readonly buffer Parts { Part parts[]; };
+layout(std430, binding = 1) readonly buffer Meshes { Mesh meshes[]; };
+layout(std430, binding = 2) readonly buffer Anchors { vec4 anchors[]; };
+
+uniform mat4 projViewMatrix;
+uniform vec3 viewPos;
+uniform float animationTime;
+
+struct DirectionalLight {
+    vec3 direction;
+    vec3 color;
+};
+uniform DirectionalLight dirLight;
+
+#if NUM_POINT_LIGHTS > 0
+uniform vec3 pointLightPositions[NUM_POINT_LIGHTS];
+uniform vec3 pointLightColors[NUM_POINT_LIGHTS];
+uniform float pointLightConstants[NUM_POINT_LIGHTS];
+uniform float pointLightLinears[NUM_POINT_LIGHTS];
+uniform float pointLightQuadratics[NUM_POINT_LIGHTS];
+#endif
+
+uniform vec3 spotLightPosition;
+uniform vec3 spotLightDirection;
+uniform vec3 spotLightColor;
+uniform float spotLightWidth;
+
+out vec3 vertexColor;
+
+vec3 octahedralDecode(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    // the lower half of the sphere was folded over the diagonals
+    float fold = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
+
+void main() {
+    Part part = parts[vPart];
+    Mesh mesh = meshes[part.mesh];
+    vec3 vPos = mesh.positionOffset.xyz + vPackedPos * mesh.positionScale.xyz;
+    vec3 vNormal = octahedralDecode(vPackedNormal / 32767.0);
+
+    // every part is rotated and uniformly scaled at most, so its normals take the upper 3x3
+    mat4 model = part.model;
+    if ((part.flags & PART_BEAK) != 0u) {
+        // FPEngine::_animateBeak: model holds the beak's offset, spun and pulsed about the marble
+        float angle = animationTime * radians(45.0);
+        float scale = 1.0 + sin(animationTime * 3.0) * 0.1;
+        float c = cos(angle);
+        float s = sin(angle);
+        vec3 offset = model[3].xyz;
+        if ((part.flags & PART_BEAK_BOBS) != 0u) {
+            offset.y += sin(animationTime * 2.0) * 0.05;
+        }
+        mat3 spin = mat3(c, 0.0, -s,
+                         0.0, 1.0, 0.0,
+                         s, 0.0, c) * scale;
+        model = mat4(vec4(spin[0], 0.0), vec4(spin[1], 0.0), vec4(spin[2], 0.0), vec4(spin * offset, 1.0));
+    }
+    if (part.anchor >= 0) {
+        model[3].xyz += anchors[part.anchor].xyz;
+    }
+
+    vec3 worldPos = vec3(model * vec4(vPos, 1.0));
+    gl_Position = projViewMatrix * vec4(worldPos, 1.0);
+    vec3 normal = normalize(mat3(model) * vNormal);
+    vec3 viewDir = normalize(viewPos - worldPos);
+
+    vec3 ambientColor = part.ambient.xyz;
+    vec3 diffuseColor = part.diffuse.xyz;
+    vec3 specularColor = part.specular.xyz;
+    float shininess = part.specular.w;
+
+    vertexColor = vec3(0.0);
+    if ((part.flags & PART_BAKED) != 0u) {
+        vec3 weights = normal * normal;
+        vertexColor += weights.x * part.bakedLight[normal.x >= 0.0 ? 0 : 1].xyz
+                     + weights.y * part.bakedLight[normal.y >= 0.0 ? 2 : 3].xyz
+                     + weights.z * part.bakedLight[normal.z >= 0.0 ? 4 : 5].xyz;
+    } else {
+        // Directional Light
+        vec3 lightDir = normalize(-dirLight.direction);
+        float diff = max(dot(normal, lightDir), 0.0);
+        vec3 reflectDir = reflect(-lightDir, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+        vertexColor += (ambientColor + diffuseColor * diff + specularColor * spec) * dirLight.color;
+
+        // Point Lights
+#if NUM_POINT_LIGHTS > 0
+        for (int i = 0; i < NUM_POINT_LIGHTS; i++) {
+            vec3 pointDir = normalize(pointLightPositions[i] - worldPos);
+            float pointDiff = max(dot(normal, pointDir), 0.0);
+            float pointSpec = pow(max(dot(viewDir, reflect(-pointDir, normal)), 0.0), shininess);
+            float distance = length(pointLightPositions[i] - worldPos);
+            float attenuation = 1.0 / (pointLightConstants[i] + pointLightLinears[i] * distance + pointLightQuadratics[i] * (distance * distance));
+            vertexColor += (ambientColor + diffuseColor * pointDiff + specularColor * pointSpec) * pointLightColors[i] * attenuation;
+        }
+#endif
+    }
+
+    // Spot Light
+    {
+        vec3 lightDir = normalize(spotLightPosition - worldPos);
+        float diff = max(dot(normal, lightDir), 0.0);
+        vec3 reflectDir = reflect(-lightDir, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), 5);
+
+        if (dot(lightDir, normalize(-spotLightDirection)) > spotLightWidth) {
+            vertexColor += 2.0 * (ambientColor + diffuseColor * diff + specularColor * spec) * spotLightColor;
+        }
+    }
+}
@@ -0,0 +1,28 @@
+/*
+ *  File: impostor.fs.glsl
+ *
+ *  Description:
+ *      Fragment Shader that samples the impostor atlas and discards the
+ *      transparent border so impostors depth test like solid geometry
+ */
+
+// we are using OpenGL 4.1 Core profile
+#version 410 core
+
+// ***** FRAGMENT SHADER UNIFORMS *****
+uniform sampler2D atlas;
+
+// ***** FRAGMENT SHADER INPUT *****
+in vec2 texCoord;
+
+// ***** FRAGMENT SHADER OUTPUT *****
+out vec4 fragColorOut;
+
+// ***** FRAGMENT SHADER MAIN FUNCTION *****
+void main() {
+    vec4 texel = texture(atlas, texCoord);
+    if(texel.a < 0.5) {
+        discard;
+    }
+    fragColorOut = vec4(texel.rgb, 1.0);
+}
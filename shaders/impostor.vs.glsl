@@ -0,0 +1,46 @@
+/*
+ *  File: impostor.vs.glsl
+ *
+ *  Description:
+ *      Vertex Shader that turns each impostor quad about +Y to face the
+ *      camera and selects the atlas cell baked closest to the camera's
+ *      azimuth around the instance
+ */
+
+// we are using OpenGL 4.1 Core profile
+#version 410 core
+
+// ***** VERTEX SHADER UNIFORMS *****
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform vec3 cameraPosition;
+uniform vec2 size;          // half width, height of the baked prop
+uniform int numViews;
+
+// ***** VERTEX SHADER INPUT *****
+layout(location = 0) in vec2 corner;            // per vertex, x in [-1, 1], y in [0, 1]
+layout(location = 1) in vec3 instancePosition;  // per instance base of the prop
+
+// ***** VERTEX SHADER OUTPUT *****
+out vec2 texCoord;
+
+// ***** VERTEX SHADER MAIN FUNCTION *****
+void main() {
+    vec2 toCamera = cameraPosition.xz - instancePosition.xz;
+    if(dot(toCamera, toCamera) < 1e-6) {
+        toCamera = vec2(1.0, 0.0);
+    }
+    toCamera = normalize(toCamera);
+
+    // matches the bake camera, which looks from (cos a, 0, sin a) toward the prop
+    float azimuth = atan(toCamera.y, toCamera.x);
+    float step = 6.2831853 / float(numViews);
+    int view = int(floor(azimuth / step + 0.5));
+    view = (view % numViews + numViews) % numViews;
+
+    vec3 right = vec3(toCamera.y, 0.0, -toCamera.x);
+    vec3 worldPos = instancePosition + right * corner.x * size.x + vec3(0.0, corner.y * size.y, 0.0);
+    gl_Position = projMatrix * viewMatrix * vec4(worldPos, 1.0);
+
+    texCoord = vec2((float(view) + corner.x * 0.5 + 0.5) / float(numViews), corner.y);
+}
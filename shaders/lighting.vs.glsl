@@ -1,7 +1,36 @@
 #version 410 core
 
+// Permutations, defined by the engine when it compiles a variant:
+//   NUM_POINT_LIGHTS  point lights evaluated, a constant so the loop unrolls
+//   SPOT_LIGHT        adds the spot light term
+//   UNLIT_FLAT        outputs material.diffuse as is, no lighting at all
+//   VEHICLE_MESH      draws instances of the baked vehicle: the material comes from a
+//                     per-vertex index, the placement and wheel spin from per-instance
+//                     attributes, and mvpMatrix only holds projection * view
+//   PACKED_MESH       positions and octahedral normals arrive as plain shorts, see PackedVertex.h
+//   BAKED_LIGHT       the directional light and the lamps come from bakedLight instead,
+//                     an ambient cube blended by the normal, see LightBaker.h
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 10
+#endif
+
+#ifdef PACKED_MESH
+layout(location = 0) in vec3 vPackedPos;     // quantized inside the mesh's bounds
+layout(location = 1) in vec2 vPackedNormal;  // octahedral
+uniform vec3 packedPositionScale;
+uniform vec3 packedPositionOffset;
+
+vec3 octahedralDecode(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    // the lower half of the sphere was folded over the diagonals
+    float fold = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
+#else
 layout(location = 0) in vec3 vPos;        // Vertex position
 layout(location = 1) in vec3 vNormal;     // Vertex normal
+#endif
 
 // Uniforms
 uniform mat4 mvpMatrix;
@@ -16,7 +45,17 @@ struct Material {
     vec3 specular;
     float shininess;
 };
+#ifdef VEHICLE_MESH
+// ***** baked vehicle *****
+#define VEHICLE_MATERIALS 3                    // VehicleMesh::NUM_MATERIALS
+layout(location = 2) in float vMaterialIndex;   // into vehicleMaterials
+layout(location = 3) in vec4 vWheelHub;         // a point on the axle, w = 1 for wheel vertices
+layout(location = 4) in vec4 vInstancePose;     // per instance: position, heading
+layout(location = 5) in float vInstanceWheelRotation;
+uniform Material vehicleMaterials[VEHICLE_MATERIALS];
+#else
 uniform Material material;
+#endif
 
 // Directional Light properties
 struct DirectionalLight {
@@ -25,34 +64,89 @@ struct DirectionalLight {
 };
 uniform DirectionalLight dirLight;
 
+#ifdef BAKED_LIGHT
+// +x, -x, +y, -y, +z, -z, the material already applied
+uniform vec3 bakedLight[6];
+#endif
+
 // Point Light properties
-#define MAX_POINT_LIGHTS 10
-uniform int numPointLights;
-uniform vec3 pointLightPositions[MAX_POINT_LIGHTS];
-uniform vec3 pointLightColors[MAX_POINT_LIGHTS];
-uniform float pointLightConstants[MAX_POINT_LIGHTS];
-uniform float pointLightLinears[MAX_POINT_LIGHTS];
-uniform float pointLightQuadratics[MAX_POINT_LIGHTS];
+#if NUM_POINT_LIGHTS > 0
+uniform vec3 pointLightPositions[NUM_POINT_LIGHTS];
+uniform vec3 pointLightColors[NUM_POINT_LIGHTS];
+uniform float pointLightConstants[NUM_POINT_LIGHTS];
+uniform float pointLightLinears[NUM_POINT_LIGHTS];
+uniform float pointLightQuadratics[NUM_POINT_LIGHTS];
+#endif
 
 // Spot Light properties
+#ifdef SPOT_LIGHT
 uniform vec3 spotLightPosition;
 uniform vec3 spotLightDirection;
 uniform vec3 spotLightColor;
 uniform float spotLightWidth;
+#endif
 
 // Outputs to Fragment Shader
 out vec3 vertexColor;
 
 void main() {
+#ifdef PACKED_MESH
+    vec3 vPos = packedPositionOffset + vPackedPos * packedPositionScale;
+    vec3 vNormal = octahedralDecode(vPackedNormal / 32767.0);
+#endif
+#ifdef VEHICLE_MESH
+    Material material = vehicleMaterials[int(vMaterialIndex)];
+
+    // the axles all run along the vehicle's x axis
+    vec3 localPos = vPos;
+    vec3 localNormal = vNormal;
+    if (vWheelHub.w > 0.0) {
+        float c = cos(vInstanceWheelRotation);
+        float s = sin(vInstanceWheelRotation);
+        mat3 spin = mat3(1.0, 0.0, 0.0,
+                         0.0, c, s,
+                         0.0, -s, c);
+        localPos = vWheelHub.xyz + spin * (vPos - vWheelHub.xyz);
+        localNormal = spin * vNormal;
+    }
+
+    // heading around y, then the position; rigid, so normals take the same rotation
+    float c = cos(vInstancePose.w);
+    float s = sin(vInstancePose.w);
+    mat3 heading = mat3(c, 0.0, -s,
+                        0.0, 1.0, 0.0,
+                        s, 0.0, c);
+    vec3 worldPos = vInstancePose.xyz + heading * localPos;
+    gl_Position = mvpMatrix * vec4(worldPos, 1.0);
+#else
     // Transformations
     gl_Position = mvpMatrix * vec4(vPos, 1.0);
+#endif
+    //marbles
+    gl_PointSize = 60.0; // Set point size
+
+#ifdef UNLIT_FLAT
+    vertexColor = material.diffuse;
+#else
+#ifdef VEHICLE_MESH
+    vec3 normal = normalize(heading * localNormal);
+#else
     vec3 normal = normalize(normalMatrix * vNormal);
     vec3 worldPos = vec3(modelMatrix * vec4(vPos, 1.0));
+#endif
     vec3 viewDir = normalize(viewPos - worldPos);
 
     // Initialize color
     vertexColor = vec3(0.0);
 
+#ifdef BAKED_LIGHT
+    {
+        vec3 weights = normal * normal;
+        vertexColor += weights.x * bakedLight[normal.x >= 0.0 ? 0 : 1]
+                     + weights.y * bakedLight[normal.y >= 0.0 ? 2 : 3]
+                     + weights.z * bakedLight[normal.z >= 0.0 ? 4 : 5];
+    }
+#else
     // Directional Light
     {
         vec3 lightDir = normalize(-dirLight.direction);
@@ -66,9 +160,11 @@ void main() {
 
         vertexColor += ambient + diffuse + specular;
     }
+#endif
 
     // Point Lights
-    for(int i = 0; i < numPointLights; i++) {
+#if NUM_POINT_LIGHTS > 0
+    for(int i = 0; i < NUM_POINT_LIGHTS; i++) {
         vec3 lightPos = pointLightPositions[i];
         vec3 lightColor = pointLightColors[i];
 
@@ -90,8 +186,10 @@ void main() {
 
         vertexColor += ambient + diffuse + specular;
     }
+#endif
 
     // Spot Light
+#ifdef SPOT_LIGHT
     {
         float linear = 0.09f;
         float quadratic = 0.032f;
@@ -112,6 +210,6 @@ void main() {
             vertexColor += 2.0*(ambient + diffuse + specular);
         }
     }
-    //marbles
-    gl_PointSize = 60.0; // Set point size
+#endif
+#endif
 }
@@ -0,0 +1,25 @@
+/*
+ *  File: particleRender.fs.glsl
+ *
+ *  Description:
+ *      Fragment Shader that tints the sparkle texture by the emitter color
+ *      and fades it out over the particle's lifetime
+ */
+
+// we are using OpenGL 4.1 Core profile
+#version 410 core
+
+// ***** FRAGMENT SHADER UNIFORMS *****
+uniform sampler2D image;
+
+// ***** FRAGMENT SHADER INPUT *****
+in vec2 texCoord;
+in vec4 tint;
+
+// ***** FRAGMENT SHADER OUTPUT *****
+out vec4 fragColorOut;
+
+// ***** FRAGMENT SHADER MAIN FUNCTION *****
+void main() {
+    fragColorOut = texture(image, texCoord) * tint;
+}
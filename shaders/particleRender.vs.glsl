@@ -0,0 +1,52 @@
+/*
+ *  File: particleRender.vs.glsl
+ *
+ *  Description:
+ *      Vertex Shader that expands one instanced quad per particle in eye
+ *      space so it always faces the camera. Dead particles collapse to a
+ *      zero sized quad and produce no fragments.
+ */
+
+// we are using OpenGL 4.1 Core profile
+#version 410 core
+
+// ***** VERTEX SHADER UNIFORMS *****
+#define NUM_EMITTERS 3
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform float particleSize;
+uniform ivec2 emitterRanges[NUM_EMITTERS];
+uniform vec3 emitterColors[NUM_EMITTERS];
+
+// ***** VERTEX SHADER INPUT *****
+layout(location = 0) in vec2 corner;        // per vertex quad corner in [-1, 1]
+layout(location = 1) in vec4 posAge;        // per instance particle state
+layout(location = 2) in vec4 velLife;
+
+// ***** VERTEX SHADER OUTPUT *****
+out vec2 texCoord;
+out vec4 tint;
+
+// ***** VERTEX SHADER MAIN FUNCTION *****
+void main() {
+    vec3 color = emitterColors[0];
+    for(int i = 0; i < NUM_EMITTERS; i++) {
+        if(gl_InstanceID >= emitterRanges[i].x && gl_InstanceID < emitterRanges[i].x + emitterRanges[i].y) {
+            color = emitterColors[i];
+        }
+    }
+
+    float age = posAge.w;
+    float life = velLife.w;
+    bool alive = age >= 0.0 && age < life;
+    float t = alive ? age / life : 1.0;
+    float size = alive ? particleSize * (1.0 - 0.5 * t) : 0.0;
+
+    vec4 eyePos = viewMatrix * vec4(posAge.xyz, 1.0);
+    eyePos.xy += corner * size;
+    gl_Position = projMatrix * eyePos;
+
+    texCoord = corner * 0.5 + 0.5;
+    tint = vec4(color, 1.0 - t);
+}
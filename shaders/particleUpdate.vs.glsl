@@ -0,0 +1,111 @@
+/*
+ *  File: particleUpdate.vs.glsl
+ *
+ *  Description:
+ *      Vertex Shader that advances one particle per vertex. The results are
+ *      captured with transform feedback into the other ping-pong buffer, so
+ *      no fragment stage is needed (GL_RASTERIZER_DISCARD is enabled).
+ */
+
+// we are using OpenGL 4.1 Core profile
+#version 410 core
+
+// ***** VERTEX SHADER UNIFORMS *****
+#define NUM_EMITTERS 3
+#define COIN 0
+#define PICKUP 1
+#define LANDING 2
+
+uniform float dt;
+uniform float seed;
+uniform ivec2 emitterRanges[NUM_EMITTERS];  // first particle, particle count
+uniform vec4 emitterSources[NUM_EMITTERS];  // xyz origin, w spawn radius
+uniform int emitterModes[NUM_EMITTERS];     // 0 idle, 1 continuous, 2 burst this step
+uniform float activeFraction;               // share of each emitter's slice that may spawn
+
+// ***** VERTEX SHADER INPUT *****
+layout(location = 0) in vec4 inPosAge;      // xyz position, w age in seconds
+layout(location = 1) in vec4 inVelLife;     // xyz velocity, w lifetime in seconds
+
+// ***** VERTEX SHADER OUTPUT *****
+out vec4 outPosAge;
+out vec4 outVelLife;
+
+// ***** VERTEX SHADER HELPER FUNCTIONS *****
+float random(uint n) {
+    n = (n << 13u) ^ n;
+    n = n * (n * n * 15731u + 789221u) + 1376312589u;
+    return float(n & 0x7fffffffu) / float(0x7fffffff);
+}
+
+// ***** VERTEX SHADER MAIN FUNCTION *****
+void main() {
+    int emitter = COIN;
+    for(int i = 0; i < NUM_EMITTERS; i++) {
+        if(gl_VertexID >= emitterRanges[i].x && gl_VertexID < emitterRanges[i].x + emitterRanges[i].y) {
+            emitter = i;
+        }
+    }
+    vec3 origin = emitterSources[emitter].xyz;
+    float radius = emitterSources[emitter].w;
+    int mode = emitterModes[emitter];
+
+    // particles past the active share of the slice are left to die out
+    if(float(gl_VertexID - emitterRanges[emitter].x) >= float(emitterRanges[emitter].y) * activeFraction) {
+        mode = 0;
+    }
+
+    uint key = uint(gl_VertexID) * 4u + uint(seed) * 7919u;
+    float r0 = random(key);
+    float r1 = random(key + 1u);
+    float r2 = random(key + 2u);
+    float r3 = random(key + 3u);
+
+    vec3 pos = inPosAge.xyz;
+    float age = inPosAge.w + dt;
+    vec3 vel = inVelLife.xyz;
+    float life = inVelLife.w;
+
+    if(mode == 2) {
+        // burst: every particle of the emitter restarts at once
+        float theta = r0 * 6.2831853;
+        if(emitter == PICKUP) {
+            float phi = acos(2.0 * r1 - 1.0);
+            vec3 dir = vec3(sin(phi) * cos(theta), abs(cos(phi)), sin(phi) * sin(theta));
+            pos = origin + dir * radius * r2;
+            vel = dir * (3.0 + 4.0 * r3);
+            life = 0.6 + 0.6 * r2;
+        } else {
+            vec3 dir = vec3(cos(theta), 0.0, sin(theta));
+            pos = origin + dir * radius * r2 + vec3(0.0, 0.1, 0.0);
+            vel = dir * (2.0 + 3.0 * r3) + vec3(0.0, 1.5 * r1, 0.0);
+            life = 0.4 + 0.5 * r1;
+        }
+        age = 0.0;
+    } else if(age >= life && mode == 1) {
+        // continuous: dead particles respawn around the emitter after a short random delay
+        float theta = r0 * 6.2831853;
+        float ring = radius * (0.6 + 0.4 * r2);
+        pos = origin + vec3(cos(theta) * ring, (r1 - 0.5) * 2.0 * radius, sin(theta) * ring);
+        vel = vec3(0.0, 0.3 + 0.4 * r3, 0.0);
+        life = 0.6 + 1.2 * r2;
+        age = -r3 * life;
+    } else if(age >= 0.0 && age < life) {
+        if(emitter == COIN) {
+            // swirl around the vertical axis through the coin while rising
+            vec3 arm = pos - origin;
+            vec3 tangent = normalize(vec3(-arm.z, 0.0, arm.x) + vec3(1e-4));
+            pos += (tangent * 1.5 + vec3(0.0, vel.y, 0.0)) * dt;
+        } else {
+            vel.y -= 9.8 * dt;
+            vel *= 1.0 - 1.5 * dt;
+            pos += vel * dt;
+        }
+    }
+
+    // keep dead particles from counting up forever
+    age = min(age, life + 1.0);
+
+    outPosAge = vec4(pos, age);
+    outVelLife = vec4(vel, life);
+}
@@ -1,17 +1,9 @@
 /*
- *  CSCI 441, Computer Graphics, Fall 2024
- *
- *  Project: lab12
- *  File: billboardQuadShader.f.glsl
+ *  File: screenQuad.fs.glsl
  *
  *  Description:
- *      Fragment Shader that applies color as diffuse texture
- *
- *  Author:
- *      Dr. Jeffrey Paone, Colorado School of Mines
- *
- *  Notes:
- *
+ *      Fragment Shader that copies an offscreen image, alpha included, so
+ *      it can be blended over what is already in the framebuffer
  */
 
 // we are using OpenGL 4.1 Core profile
@@ -21,18 +13,12 @@
 uniform sampler2D image;
 
 // ***** FRAGMENT SHADER INPUT *****
-// TODO #J add varying input
 in vec2 texCoord;
 
 // ***** FRAGMENT SHADER OUTPUT *****
 out vec4 fragColorOut;
 
-
-// ***** FRAGMENT SHADER HELPER FUNCTIONS *****
-
-
 // ***** FRAGMENT SHADER MAIN FUNCTION *****
 void main() {
-    // TODO #K perform the texture lookup
     fragColorOut = texture(image, texCoord);
 }
@@ -0,0 +1,20 @@
+/*
+ *  File: screenQuad.vs.glsl
+ *
+ *  Description:
+ *      Vertex Shader that covers the current viewport with a quad built
+ *      from gl_VertexID, drawn as a 4 vertex triangle strip without any
+ *      vertex attributes
+ */
+
+// we are using OpenGL 4.1 Core profile
+#version 410 core
+
+// ***** VERTEX SHADER OUTPUT *****
+out vec2 texCoord;
+
+// ***** VERTEX SHADER MAIN FUNCTION *****
+void main() {
+    texCoord = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(texCoord * 2.0 - 1.0, 0.0, 1.0);
+}
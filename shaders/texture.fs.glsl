@@ -1,5 +1,9 @@
 #version 330 core
 
+// Permutations, defined by the engine when it compiles a variant:
+//   SPOT_LIGHT        adds the spot light term
+//   LIGHTMAP          lights the texture with the baked directional light and lamps
+
 in vec2 TexCoords;            // Interpolated texture coordinates
 in vec3 FragPos;              // World-space position of the fragment
 
@@ -7,22 +11,30 @@ out vec4 FragColor;
 
 uniform sampler2D textureMap; // Base texture
 
+#ifdef LIGHTMAP
+in vec2 LightmapCoords;
+uniform sampler2D lightmap;   // LightBaker's atlas, on texture unit 1
+#endif
+
 // Spotlight parameters
+#ifdef SPOT_LIGHT
 uniform vec3 spotLightPosition;
 uniform vec3 spotLightDirection;
 uniform float spotLightWidth;
 uniform vec3 spotLightColor;
+#endif
 
 void main() {
     // Fetch texture color
     vec4 texColor = texture(textureMap, TexCoords);
 
+    vec3 spotlightEffect = vec3(0.0); // Initialize with no contribution
+#ifdef SPOT_LIGHT
     // Spotlight calculations
     vec3 lightDir = normalize(spotLightPosition - FragPos); // Direction from fragment to light
     float theta = dot(lightDir, normalize(-spotLightDirection)); // Angle between light and spotlight direction
 
     // Spotlight effect
-    vec3 spotlightEffect = vec3(0.0); // Initialize with no contribution
     if (theta > spotLightWidth) {
         // Spotlight is active on this fragment
         float distance = length(spotLightPosition - FragPos);
@@ -31,8 +43,14 @@ void main() {
         // Calculate spotlight contribution
         spotlightEffect = spotLightColor * attenuation * (theta - spotLightWidth);
     }
+#endif
+
+    vec3 bakedLight = vec3(1.0);
+#ifdef LIGHTMAP
+    bakedLight = texture(lightmap, LightmapCoords).rgb;
+#endif
 
     // Combine texture and spotlight
-    vec3 finalColor = texColor.rgb + spotlightEffect;
+    vec3 finalColor = texColor.rgb * bakedLight + spotlightEffect;
     FragColor = vec4(finalColor, texColor.a); // Add spotlight to texture
 }
@@ -1,16 +1,30 @@
 #version 330 core
 
-layout(location = 0) in vec3 vPos;           // Vertex positions
+// Permutations, defined by the engine when it compiles a variant:
+//   LIGHTMAP          passes on where the fragment falls in the baked lightmap atlas
+
+layout(location = 0) in vec3 vPos;           // Packed vertex position, see PackedVertex.h
 layout(location = 1) in vec2 textureCoords;  // Texture coordinates
 
 out vec3 FragPos;                            // World-space position
 out vec2 TexCoords;                          // Pass texture coordinates to fragment shader
 
 uniform mat4 mvpMatrix;                      // Model-View-Projection matrix
-uniform mat4 modelMatrix;                    // Model matrix for world-space position
+uniform vec3 positionScale;                  // Undoes the quantization of vPos
+uniform vec3 positionOffset;
+
+#ifdef LIGHTMAP
+out vec2 LightmapCoords;
+uniform vec4 lightmapRect;                   // world xz * xy + zw is the platform's place in the atlas
+#endif
 
 void main() {
-    gl_Position = mvpMatrix * vec4(vPos, 1.0);
+    // the level geometry decodes straight to world space
+    vec3 position = positionOffset + vPos * positionScale;
+    gl_Position = mvpMatrix * vec4(position, 1.0);
     TexCoords = textureCoords;
-    FragPos = vec3(modelMatrix * vec4(vPos, 1.0)); // Transform position to world space
+    FragPos = position;
+#ifdef LIGHTMAP
+    LightmapCoords = position.xz * lightmapRect.xy + lightmapRect.zw;
+#endif
 }